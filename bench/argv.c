@@ -0,0 +1,195 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Command lines as long as xargs and "find -exec +" make them: ms per
+ * fork() and execve() of ARGS arguments, the best of ROUNDS, without the
+ * library and with it, for a binary and a script of a fake root.  Every
+ * program started checks that all of its arguments arrived; a run which
+ * lost some is reported as such.
+ *
+ *   argv LIBRARY
+ */
+
+#include "bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define ARGS   100000
+#define ROUNDS 20
+
+static const struct {
+	const char *name;
+	const char *program;		/* NULL: the copy by its host path */
+	int library;
+} modes[] = {
+	{ "none",   NULL,          0 },
+	{ "binary", "/bin/argv",   1 },
+	{ "script", "/bin/script", 1 },
+};
+
+/*
+ * The driver, with the library if asked for: runs program ROUNDS times
+ * with ARGS arguments.  argv[0] is the host path of the copy, which is
+ * what the runtime linker of a fake root is given to load.
+ */
+static int driver(const char *program, const char *copy)
+{
+	extern char **environ;
+	unsigned long long t0, t, best = ~0ULL;
+	char **argv;
+	int i, status;
+	pid_t pid;
+
+	if ((argv = malloc((ARGS + 2) * sizeof(char *))) == NULL)
+		return 1;
+	argv[0] = (char *)copy;
+	for (i = 1; i <= ARGS; i++)
+		argv[i] = "x";
+	argv[ARGS + 1] = NULL;
+
+	for (i = 0; i < ROUNDS; i++) {
+		t0 = bench_ns();
+		if ((pid = fork()) == 0) {
+			execve(program, argv, environ);
+			_exit(127);
+		}
+		waitpid(pid, &status, 0);
+		if ((t = bench_ns() - t0) < best)
+			best = t;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			printf(" %10s\n", WIFEXITED(status) && WEXITSTATUS(status) == 2 ?
+					"truncated" : "failed");
+			return 0;
+		}
+	}
+	printf(" %10.2f\n", (double)best / 1000000);
+
+	return 0;
+}
+
+static int copy(const char *from, const char *to)
+{
+	char buf[65536];
+	ssize_t n;
+	int in, out, ret = 0;
+
+	if ((in = open(from, O_RDONLY)) < 0)
+		return -1;
+	if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0755)) < 0) {
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n)
+			ret = -1;
+	close(in);
+	close(out);
+
+	return n < 0 ? -1 : ret;
+}
+
+/* root/bin/argv, a copy of this program, and a script checking its own */
+static int tree(const char *root)
+{
+	char buf[PATH_MAX];
+	FILE *f;
+
+	snprintf(buf, sizeof(buf), "%s/bin", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/bin/argv", root);
+	if (copy("/proc/self/exe", buf) < 0)
+		return -1;
+	snprintf(buf, sizeof(buf), "%s/bin/script", root);
+	if ((f = fopen(buf, "w")) == NULL)
+		return -1;
+	fprintf(f, "#!/bin/sh\ntest $# -eq %d || exit 2\n", ARGS);
+	fclose(f);
+	chmod(buf, 0755);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-argv.XXXXXX", buf[PATH_MAX];
+	const char *arg;
+	int status = 0;
+	size_t k;
+	pid_t pid;
+
+	if ((arg = getenv("BENCH_CHILD")) != NULL && (arg = strdup(arg)) != NULL) {
+		unsetenv("BENCH_CHILD");
+		return driver(arg, argv[1]);
+	}
+	/* started by the driver: all arguments must be there */
+	if (getenv("BENCH_TARGET") != NULL)
+		return argc == ARGS + 1 ? 0 : 2;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s LIBRARY\n", argv[0]);
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	printf("\n# argv: ms per fork() and execve() of %d arguments, best of %d\n",
+			ARGS, ROUNDS);
+	printf("%-8s %10s\n", "mode", "ms");
+
+	snprintf(buf, sizeof(buf), "%s/bin/argv", root);
+	if (tree(root) == 0)
+		for (k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+			printf("%-8s", modes[k].name);
+			fflush(stdout);
+			if ((pid = fork()) == 0) {
+				setenv("BENCH_CHILD", modes[k].program ? modes[k].program : buf, 1);
+				setenv("BENCH_TARGET", "run", 1);
+				if (modes[k].library) {
+					setenv("LD_PRELOAD", argv[1], 1);
+					setenv("FAKECHROOT_BASE", root, 1);
+				}
+				execl("/proc/self/exe", "argv", buf, (char *)NULL);
+				_exit(127);
+			}
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				fprintf(stderr, "%s: %s run failed\n", argv[0], modes[k].name);
+				break;
+			}
+		}
+	else
+		status = 1 << 8;
+
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/bin/script", root);
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/bin", root);
+	rmdir(buf);
+	rmdir(root);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,68 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Helpers shared by the benchmarks.
+ */
+
+#ifndef __FAKECHROOT_BENCH_H__
+#define __FAKECHROOT_BENCH_H__
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_X86 1
+#include <x86intrin.h>
+
+typedef unsigned long long bench_ticks_t;
+#define BENCH_TICK_UNIT "cycles"
+
+static inline bench_ticks_t bench_ticks(void)
+{
+	return __rdtsc();
+}
+#else
+typedef unsigned long long bench_ticks_t;
+#define BENCH_TICK_UNIT "ns"
+
+static inline bench_ticks_t bench_ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+/* wall clock in nanoseconds */
+static inline unsigned long long bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif /* __FAKECHROOT_BENCH_H__ */
@@ -1,8 +1,6 @@
 /* vi: set sw=4 ts=4: */
 /*
  * libfakechroot -- fake chroot environment
- * (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
- * (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
  *
  * This library is free software; you can redistribute it and/or
  * modify it under the terms of the GNU Lesser General Public
@@ -19,23 +17,20 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
 
+
 /*
- * pathconf() call wrapper
+ * Shim for the session benchmark: preloaded after the library, its
+ * constructor runs before the one of the library, and calls a wrapper
+ * on a name that is missing, as a library set up early may.
  */
 
-#include "common.h"
-#include "wrapper.h"
-#include "proto.h"
+#include <sys/stat.h>
+#include <unistd.h>
 
-/* #include <unistd.h> */
-long pathconf(const char *path, int name)
+__attribute__((constructor)) static void bench_early(void)
 {
-	 
-
-	expand_chroot_path(path);
+	struct stat st;
 
-	return NEXTCALL(pathconf)(path, name);
+	stat("/nonexistent/bench-early", &st);
+	access("/nonexistent/bench-early", F_OK);
 }
-
-DECLARE_WRAPPER(pathconf);
-
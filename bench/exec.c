@@ -0,0 +1,208 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * What the execve() wrapper costs before the kernel takes over, for a
+ * binary and a script of a fake root, probed every time and taken from
+ * the exec plan cache (FAKECHROOT_OPTS=X), and run from the host in
+ * their stead (FAKECHROOT_HOSTTOOLS): us, calls passed on to libc
+ * (open(), read(), the stat family, close() and the like) and bytes read
+ * per call.  The calls are given an argument the kernel can not read, so
+ * that they fail with EFAULT once the wrapper is done and nothing is run.
+ *
+ *   exec LIBRARY SHIM
+ *
+ * runs itself under LIBRARY with SHIM (syscount.so) preloaded behind it,
+ * which counts the calls.
+ */
+
+#include "bench.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define ROUNDS 50
+#define RUNS   400
+
+static const char *const programs[] = { "/bin/true", "/bin/script" };
+static const char *const names[] = { "binary", "script" };
+
+static const struct {
+	const char *name;
+	const char *opts;
+	const char *tools;			/* FAKECHROOT_HOSTTOOLS, or NULL */
+} modes[] = {
+	{ "read", "",  NULL },
+	{ "plan", "X", NULL },
+	{ "host", "",  "true=/bin/true:script=/bin/true -x" },
+};
+
+/*
+ * The child, with the library: the time per call of each program, the
+ * best of ROUNDS rounds, as the failing system call alone takes longer
+ * than the wrapper and varies more.
+ */
+static int child(void)
+{
+	extern char **environ;
+	/* passed on by the wrapper, never looked at */
+	char *argv[3] = { NULL, (char *)1, NULL };
+	unsigned long *stats = dlsym(RTLD_DEFAULT, "bench_syscalls");
+	unsigned long *calls = dlsym(RTLD_DEFAULT, "bench_io_calls");
+	unsigned long *bytes = dlsym(RTLD_DEFAULT, "bench_io_bytes");
+	unsigned long long t0, t, best;
+	unsigned long c0, b0;
+	size_t k;
+	int i, r;
+
+	if (stats == NULL || calls == NULL || bytes == NULL)
+		return 1;
+
+	for (k = 0; k < 2; k++) {
+		argv[0] = (char *)programs[k];
+		/* the first call makes the entry */
+		if (execve(programs[k], argv, environ) == 0 || errno != EFAULT)
+			return 1;
+		c0 = *stats + *calls;
+		b0 = *bytes;
+		for (r = 0, best = ~0ULL; r < ROUNDS; r++) {
+			t0 = bench_ns();
+			for (i = 0; i < RUNS; i++)
+				execve(programs[k], argv, environ);
+			if ((t = bench_ns() - t0) < best)
+				best = t;
+		}
+		printf(" %8.2f %5.1f %6.0f", (double)best / RUNS / 1000,
+				(double)(*stats + *calls - c0) / ROUNDS / RUNS,
+				(double)(*bytes - b0) / ROUNDS / RUNS);
+	}
+	printf("\n");
+
+	return 0;
+}
+
+static int copy(const char *from, const char *to)
+{
+	char buf[65536];
+	ssize_t n;
+	int in, out, ret = 0;
+
+	if ((in = open(from, O_RDONLY)) < 0)
+		return -1;
+	if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0755)) < 0) {
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n)
+			ret = -1;
+	close(in);
+	close(out);
+
+	return n < 0 ? -1 : ret;
+}
+
+/* root/bin/true and a script run by it; made an hour ago, see lib-execplan.c */
+static int tree(const char *root)
+{
+	struct timespec ts[2] = { { 0, UTIME_OMIT }, { time(NULL) - 3600, 0 } };
+	char buf[PATH_MAX];
+	FILE *f;
+
+	snprintf(buf, sizeof(buf), "%s/bin", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/bin/true", root);
+	if (copy("/bin/true", buf) < 0)
+		return -1;
+	utimensat(AT_FDCWD, buf, ts, 0);
+	snprintf(buf, sizeof(buf), "%s/bin/script", root);
+	if ((f = fopen(buf, "w")) == NULL)
+		return -1;
+	fprintf(f, "#!/bin/true -x\nexit 1\n");
+	fclose(f);
+	chmod(buf, 0755);
+	utimensat(AT_FDCWD, buf, ts, 0);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-exec.XXXXXX", buf[PATH_MAX];
+	char preload[2 * PATH_MAX];
+	int status = 0;
+	size_t k;
+	pid_t pid;
+
+	if (getenv("BENCH_CHILD") != NULL)
+		return child();
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s LIBRARY SHIM\n", argv[0]);
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	printf("\n# exec: us per execve() call, best of %d rounds of %d\n", ROUNDS, RUNS);
+	printf("%-8s %-21s %-21s\n", "", names[0], names[1]);
+	printf("%-8s %8s %5s %6s %8s %5s %6s\n", "mode",
+			"us", "calls", "bytes", "us", "calls", "bytes");
+
+	if (tree(root) == 0)
+		for (k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+			printf("%-8s", modes[k].name);
+			fflush(stdout);
+			if ((pid = fork()) == 0) {
+				setenv("BENCH_CHILD", "run", 1);
+				snprintf(preload, sizeof(preload), "%s %s", argv[1], argv[2]);
+				setenv("LD_PRELOAD", preload, 1);
+				setenv("FAKECHROOT_BASE", root, 1);
+				setenv("FAKECHROOT_OPTS", modes[k].opts, 1);
+				if (modes[k].tools != NULL)
+					setenv("FAKECHROOT_HOSTTOOLS", modes[k].tools, 1);
+				execv("/proc/self/exe", argv);
+				_exit(127);
+			}
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				fprintf(stderr, "%s: %s run failed\n", argv[0], modes[k].name);
+				break;
+			}
+		}
+	else
+		status = 1 << 8;
+
+	snprintf(buf, sizeof(buf), "%s/bin/true", root);
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/bin/script", root);
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/bin", root);
+	rmdir(buf);
+	rmdir(root);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,265 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Exact cost of single calls through the library: user space instructions
+ * and system calls, counted by single-stepping a traced child, so neither
+ * timer noise nor missing performance counters get in the way.  Raw
+ * system calls such as openat2() are counted as well.  Every call is made
+ * twice first, so the numbers are those of a warm lookup.
+ *
+ *   inscount LIBRARY
+ *
+ * runs the calls under LIBRARY once per resolution backend (see resolve.c),
+ * ending in the next libc definitions or in raw system calls (R), in a
+ * fake root where /lib64 is an absolute symlink to /usr/lib.  Only x86-64
+ * is supported.
+ */
+
+#include "bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#if defined(__x86_64__)
+
+#include <sys/ptrace.h>
+#include <sys/user.h>
+
+enum { OP_NONE, OP_STAT, OP_LSTAT, OP_OPEN, OP_REALPATH };
+
+static const struct {
+	const char *name;
+	int op;
+	const char *path;
+} cases[] = {
+	{ "stat symlink",     OP_STAT,     "/lib64/libfoo.so.1" },
+	{ "stat plain",       OP_STAT,     "/usr/lib/libfoo.so.1" },
+	{ "lstat symlink",    OP_LSTAT,    "/lib64" },
+	{ "open symlink",     OP_OPEN,     "/lib64/libfoo.so.1" },
+	{ "realpath symlink", OP_REALPATH, "/lib64/libfoo.so.1" },
+};
+
+static void call(int op, const char *path)
+{
+	char res[PATH_MAX];
+	struct stat st;
+	int fd;
+
+	switch (op) {
+	case OP_STAT:
+		stat(path, &st);
+		break;
+	case OP_LSTAT:
+		lstat(path, &st);
+		break;
+	case OP_OPEN:
+		if ((fd = open(path, O_RDONLY)) >= 0)
+			close(fd);
+		break;
+	case OP_REALPATH:
+		realpath(path, res);
+		break;
+	}
+}
+
+/* every call is bracketed by two stops, the parent steps in between */
+static int child(void)
+{
+	size_t k;
+
+	call(OP_NONE, NULL);
+	raise(SIGSTOP);
+	raise(SIGSTOP);
+
+	for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		call(cases[k].op, cases[k].path);
+		call(cases[k].op, cases[k].path);
+		raise(SIGSTOP);
+		call(cases[k].op, cases[k].path);
+		raise(SIGSTOP);
+	}
+
+	return 0;
+}
+
+/* step from one stop to the next, counting instructions and syscalls */
+static int trace(pid_t pid, unsigned long *insns, unsigned long *syscalls)
+{
+	struct user_regs_struct regs;
+	unsigned long word;
+	int status;
+
+	*insns = *syscalls = 0;
+	for (;;) {
+		if (ptrace(PTRACE_GETREGS, pid, NULL, &regs) != 0)
+			return -1;
+		errno = 0;
+		word = ptrace(PTRACE_PEEKTEXT, pid, (void *)regs.rip, NULL);
+		if (errno == 0 && (word & 0xffff) == 0x050f)
+			(*syscalls)++;
+		if (ptrace(PTRACE_SINGLESTEP, pid, NULL, NULL) != 0 ||
+				waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status))
+			return -1;
+		if (WSTOPSIG(status) == SIGSTOP)
+			return 0;
+		(*insns)++;
+	}
+}
+
+static int run(const char *backend)
+{
+	unsigned long base_insns, base_syscalls, insns, syscalls;
+	int status;
+	size_t k;
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		execl("/proc/self/exe", "inscount", NULL);
+		_exit(127);
+	}
+
+	/* our stop, the exec, then the child's first bracket */
+	waitpid(pid, &status, 0);
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_EXITKILL);
+	ptrace(PTRACE_CONT, pid, NULL, NULL);
+	waitpid(pid, &status, 0);
+	ptrace(PTRACE_CONT, pid, NULL, NULL);
+	waitpid(pid, &status, 0);
+	if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGSTOP ||
+			trace(pid, &base_insns, &base_syscalls) != 0) {
+		fprintf(stderr, "inscount: tracing the child failed\n");
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		return 1;
+	}
+
+	printf("\n# %s backend: user space instructions and system calls per warm call\n",
+			backend);
+	printf("%-20s %12s %10s\n", "case", "insns", "syscalls");
+
+	for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		ptrace(PTRACE_CONT, pid, NULL, NULL);
+		waitpid(pid, &status, 0);
+		if (trace(pid, &insns, &syscalls) != 0)
+			break;
+		/* less what raise() itself takes */
+		printf("%-20s %12lu %10lu\n", cases[k].name,
+				insns - base_insns, syscalls - base_syscalls);
+	}
+
+	ptrace(PTRACE_CONT, pid, NULL, NULL);
+	waitpid(pid, &status, 0);
+
+	return k == sizeof(cases) / sizeof(cases[0]) ? 0 : 1;
+}
+
+static void make_root(const char *root)
+{
+	char buf[PATH_MAX];
+	int fd;
+
+	snprintf(buf, sizeof(buf), "%s/usr", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/usr/lib", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/usr/lib/libfoo.so.1", root);
+	if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) >= 0)
+		close(fd);
+	snprintf(buf, sizeof(buf), "%s/lib64", root);
+	if (symlink("/usr/lib", buf) != 0)
+		perror(buf);
+}
+
+static void remove_root(const char *root)
+{
+	char buf[PATH_MAX];
+
+	snprintf(buf, sizeof(buf), "%s/lib64", root);
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/usr/lib/libfoo.so.1", root);
+	unlink(buf);
+	snprintf(buf, sizeof(buf), "%s/usr/lib", root);
+	rmdir(buf);
+	snprintf(buf, sizeof(buf), "%s/usr", root);
+	rmdir(buf);
+	rmdir(root);
+}
+
+static const struct {
+	const char *name;
+	const char *opts;
+} backends[] = {
+	{ "string",      "U" },
+	{ "string+raw",  "UR" },
+	{ "default",     "" },
+	{ "default+raw", "R" },
+	{ "kernel",      "K" },
+};
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-inscount.XXXXXX";
+	int ret = 0;
+	size_t k;
+
+	if (getenv("FAKECHROOT_BASE") != NULL)
+		return child();
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s LIBRARY\n", argv[0]);
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	make_root(root);
+
+	setenv("LD_PRELOAD", argv[1], 1);
+	setenv("FAKECHROOT_BASE", root, 1);
+	for (k = 0; k < sizeof(backends) / sizeof(backends[0]); k++) {
+		fflush(stdout);
+		setenv("FAKECHROOT_OPTS", backends[k].opts, 1);
+		ret |= run(backends[k].name);
+	}
+	unsetenv("FAKECHROOT_BASE");
+	unsetenv("LD_PRELOAD");
+
+	remove_root(root);
+
+	return ret;
+}
+
+#else
+
+int main(void)
+{
+	fprintf(stderr, "inscount: only supported on x86-64\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,244 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Where the time between execve() and main() goes, us per process:
+ *
+ *   load      from execve() to the constructor of mark.so, preloaded after
+ *             the library: the kernel, then the runtime linker loading and
+ *             relocating every object;
+ *   init      from there to the constructor of this program, which runs
+ *             after every preloaded one: the constructor of the library;
+ *   bind      the first stat(), access(), open() and readlink() less the
+ *             same calls made again: binding them, in the program and in
+ *             the wrappers;
+ *   total     from execve() to the end of the first calls;
+ *   extra     total less the one of "none", which preloads mark.so alone:
+ *             what the library costs.
+ *
+ * The extra time is compared with the one in BASELINE, an earlier output
+ * of this program, if given; latency.txt holds the numbers last recorded.
+ *
+ *   latency LIBRARY MARK [BASELINE]
+ */
+
+#include "bench.h"
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define RUNS 1000
+
+enum { LOAD, INIT, BIND, TOTAL, PHASES };
+
+static const char *const phases[PHASES] = { "load", "init", "bind", "total" };
+
+static const struct {
+	const char *name;
+	const char *opts;			/* NULL: without the library */
+	int root;
+} modes[] = {
+	{ "none",        NULL, 0 },
+	{ "transparent", "",   0 },
+	{ "root",        "",   1 },
+	{ "eager",       "N",  1 },
+};
+
+#define MODES (sizeof(modes) / sizeof(modes[0]))
+
+static unsigned long long main_ns;
+
+__attribute__((constructor)) static void bench_main(void)
+{
+	main_ns = bench_ns();
+}
+
+static unsigned long long calls(void)
+{
+	char buf[PATH_MAX];
+	unsigned long long t0 = bench_ns();
+	struct stat st;
+	int fd;
+
+	stat("/etc/hello", &st);
+	access("/etc/hello", R_OK);
+	if ((fd = open("/etc/hello", O_RDONLY)) >= 0)
+		close(fd);
+	readlink("/etc/lnk", buf, sizeof(buf));
+
+	return bench_ns() - t0;
+}
+
+/* the child: the phases as seen from inside, written to the parent's pipe */
+static int child(const char *arg)
+{
+	unsigned long long *mark = dlsym(RTLD_DEFAULT, "bench_mark_ns");
+	unsigned long long t0, first, again, t[PHASES];
+	int fd;
+
+	if (sscanf(arg, "%d:%llu", &fd, &t0) != 2 || mark == NULL)
+		return 1;
+	first = calls();
+	again = calls();
+
+	t[LOAD] = *mark - t0;
+	t[INIT] = main_ns - *mark;
+	t[BIND] = first > again ? first - again : 0;
+	t[TOTAL] = bench_ns() - again - t0;
+
+	return write(fd, t, sizeof(t)) == sizeof(t) ? 0 : 1;
+}
+
+/* one process started as mode k; its phases are added to sum */
+static int run(char **argv, const char *root, int p[2], size_t k,
+		unsigned long long *sum)
+{
+	unsigned long long t[PHASES];
+	char arg[64], preload[2 * PATH_MAX];
+	int j, status = 0;
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		close(p[0]);
+		if (modes[k].opts != NULL) {
+			snprintf(preload, sizeof(preload), "%s %s", argv[1], argv[2]);
+			if (modes[k].root)
+				setenv("FAKECHROOT_BASE", root, 1);
+			setenv("FAKECHROOT_OPTS", modes[k].opts, 1);
+		} else
+			snprintf(preload, sizeof(preload), "%s", argv[2]);
+		setenv("LD_PRELOAD", preload, 1);
+		snprintf(arg, sizeof(arg), "%d:%llu", p[1], bench_ns());
+		setenv("BENCH_CHILD", arg, 1);
+		execv("/proc/self/exe", argv);
+		_exit(127);
+	}
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+			read(p[0], t, sizeof(t)) != sizeof(t))
+		return -1;
+	for (j = 0; j < PHASES; j++)
+		sum[j] += t[j];
+
+	return 0;
+}
+
+/* the extra times of an earlier output, by mode */
+static void baseline(const char *file, double *was)
+{
+	char line[256], name[32];
+	double us[PHASES], extra;
+	size_t k;
+	FILE *f;
+
+	if ((f = fopen(file, "r")) == NULL) {
+		perror(file);
+		return;
+	}
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "%31s %lf %lf %lf %lf %lf", name,
+					&us[LOAD], &us[INIT], &us[BIND], &us[TOTAL], &extra) == 6)
+			for (k = 0; k < MODES; k++)
+				if (strcmp(name, modes[k].name) == 0)
+					was[k] = extra;
+	fclose(f);
+}
+
+static void tree(const char *root)
+{
+	char buf[PATH_MAX];
+	int fd;
+
+	snprintf(buf, sizeof(buf), "%s/etc", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/etc/hello", root);
+	if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) >= 0)
+		close(fd);
+	snprintf(buf, sizeof(buf), "%s/etc/lnk", root);
+	symlink("hello", buf);
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-latency.XXXXXX";
+	unsigned long long sum[MODES][PHASES] = { { 0 } };
+	double was[MODES] = { 0 }, extra;
+	const char *arg;
+	int p[2], i, j;
+	size_t k;
+
+	if ((arg = getenv("BENCH_CHILD")) != NULL)
+		return child(arg);
+
+	if (argc != 3 && argc != 4) {
+		fprintf(stderr, "usage: %s LIBRARY MARK [BASELINE]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 4)
+		baseline(argv[3], was);
+	argv[3] = NULL;
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	tree(root);
+
+	/* the modes take turns, so that they share whatever the machine does */
+	if (pipe(p) < 0)
+		return 1;
+	for (i = 0; i < RUNS; i++)
+		for (k = 0; k < MODES; k++)
+			if (run(argv, root, p, k, sum[k]) < 0) {
+				fprintf(stderr, "%s: %s run failed\n", argv[0], modes[k].name);
+				goto out;
+			}
+
+	printf("\n# latency: us per process from execve(), %d runs\n", RUNS);
+	printf("%-12s", "mode");
+	for (j = 0; j < PHASES; j++)
+		printf(" %8s", phases[j]);
+	printf(argc == 4 ? " %8s %8s %7s\n" : " %8s\n", "extra", "was", "change");
+	for (k = 0; k < MODES; k++) {
+		extra = ((double)sum[k][TOTAL] - sum[0][TOTAL]) / RUNS / 1000;
+		printf("%-12s", modes[k].name);
+		for (j = 0; j < PHASES; j++)
+			printf(" %8.1f", (double)sum[k][j] / RUNS / 1000);
+		printf(" %8.1f", extra);
+		if (was[k] > 0)
+			printf(" %8.1f %+6.0f%%", was[k], (extra / was[k] - 1) * 100);
+		printf("\n");
+	}
+
+out:
+	close(p[0]);
+	close(p[1]);
+	nftw(root, rm, 16, FTW_DEPTH | FTW_PHYS);
+
+	return i < RUNS;
+}
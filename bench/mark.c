@@ -1,8 +1,6 @@
 /* vi: set sw=4 ts=4: */
 /*
  * libfakechroot -- fake chroot environment
- * (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
- * (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
  *
  * This library is free software; you can redistribute it and/or
  * modify it under the terms of the GNU Lesser General Public
@@ -19,25 +17,21 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
 
+
 /*
- * chown() call wrapper
+ * Time stamp shim for the latency benchmark: preloaded after the library,
+ * its constructor runs once every object is loaded and relocated, just
+ * before the one of the library, and leaves the time in bench_mark_ns.
  */
 
-#include "common.h"
-#include "wrapper.h"
-#include "proto.h"
+#include <time.h>
 
-/* #include <sys/types.h> */
-/* #include <unistd.h> */
-int chown(const char *path, uid_t owner, gid_t group)
-{
-	 
+unsigned long long bench_mark_ns;
 
-	track_chown(path, owner, group);
-	expand_chroot_path(path);
+__attribute__((constructor)) static void bench_mark(void)
+{
+	struct timespec ts;
 
-	return NEXTCALL(chown)(path, owner, group);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	bench_mark_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
-
-DECLARE_WRAPPER(chown);
-
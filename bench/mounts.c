@@ -0,0 +1,146 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Mount table lookup benchmark: cycles per fchr_mount_lookup() for
+ * tables of 1 to 4096 entries, against a linear scan of the same
+ * entries.  "hit" paths lie in the last entry added, "miss" paths in none.
+ *
+ *   mounts LIBRARY
+ */
+
+#include "bench.h"
+#include <dlfcn.h>
+
+#define ITERATIONS 200000
+#define HIT        "/opt/toolchain/bin/x86_64-linux-gnu-gcc"
+#define MISS       "/usr/include/x86_64-linux-gnu/sys/stat.h"
+
+struct fchr_mount {
+	const char *guest;
+	size_t guest_len;
+	const char *host;
+	size_t host_len;
+	int passthrough;
+};
+
+static const void *(*mounts_build)(const char *list, const char *file);
+static const struct fchr_mount *(*mount_lookup)(const void *m,
+		const char *path, size_t *len, struct fchr_mount *e);
+
+static char *guest[4096 + 1];
+
+static double run_trie(const void *m, const char *path)
+{
+	volatile size_t sink = 0;
+	struct fchr_mount e;
+	bench_ticks_t t0, t1;
+	size_t len;
+	int i;
+
+	t0 = bench_ticks();
+	for (i = 0; i < ITERATIONS; i++) {
+		if (mount_lookup(m, path, &len, &e))
+			sink += len;
+		__asm__ __volatile__("" ::: "memory");
+	}
+	t1 = bench_ticks();
+
+	return (double)(t1 - t0) / ITERATIONS;
+}
+
+/* longest matching entry, the obvious way */
+static double run_scan(int n, const char *path)
+{
+	volatile size_t sink = 0;
+	bench_ticks_t t0, t1;
+	size_t len, best;
+	int i, k;
+
+	t0 = bench_ticks();
+	for (i = 0; i < ITERATIONS; i++) {
+		best = 0;
+		for (k = 0; k < n; k++) {
+			len = strlen(guest[k]);
+			if (len > best && !strncmp(path, guest[k], len) &&
+					(path[len] == '/' || path[len] == '\0'))
+				best = len;
+		}
+		sink += best;
+		__asm__ __volatile__("" ::: "memory");
+	}
+	t1 = bench_ticks();
+
+	return (double)(t1 - t0) / ITERATIONS;
+}
+
+int main(int argc, char **argv)
+{
+	static char env[4096 * 48];
+	const void *m;
+	void *lib;
+	size_t off;
+	int n, k;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s LIBRARY\n", argv[0]);
+		return 2;
+	}
+	if (!(lib = dlopen(argv[1], RTLD_NOW))) {
+		fprintf(stderr, "%s: %s\n", argv[0], dlerror());
+		return 1;
+	}
+	/* a library built with --enable-hidden-visibility exports neither */
+	if (!(mounts_build = (const void *(*)(const char *, const char *))
+				dlsym(lib, "fchr_mounts_build")) ||
+			!(mount_lookup = (const struct fchr_mount *(*)(const void *,
+					const char *, size_t *, struct fchr_mount *))
+				dlsym(lib, "fchr_mount_lookup"))) {
+		printf("# mounts: lookup not exported, skipped\n");
+		return 0;
+	}
+
+	printf("# %s per lookup, %d iterations\n", BENCH_TICK_UNIT, ITERATIONS);
+	printf("%-6s %10s %10s %10s %10s\n", "size", "trie/hit", "trie/miss", "scan/hit", "scan/miss");
+
+	for (n = 1; n <= 4096; n *= 4) {
+		/* distinct prefixes sharing their first components, as real ones do */
+		for (k = 0, off = 0; k < n - 1; k++) {
+			free(guest[k]);
+			if (asprintf(&guest[k], "/opt/%s%d/share", k % 2 ? "tool" : "sdk", k) < 0)
+				return 1;
+			off += sprintf(env + off, "%s=/srv%s:", guest[k], guest[k]);
+		}
+		free(guest[k]);
+		guest[k] = strdup("/opt/toolchain");
+		sprintf(env + off, "%s=/srv%s", guest[k], guest[k]);
+
+		if (!(m = mounts_build(env, NULL))) {
+			fprintf(stderr, "%s: cannot build a table of %d entries\n", argv[0], n);
+			return 1;
+		}
+
+		printf("%-6d %10.1f %10.1f %10.1f %10.1f\n", n,
+				run_trie(m, HIT), run_trie(m, MISS),
+				run_scan(n, HIT), run_scan(n, MISS));
+	}
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+/*
+ * Root prefix matching microbenchmark: cycles per call of every
+ * fchr_prefix_match() implementation against the strstr() test it
+ * replaced, for root lengths from 16 to 4096 bytes.  "hit" paths lie
+ * inside the root, "miss" paths differ in the last byte of the root.
+ */
+
+#include "bench.h"
+
+int fchr_prefix_match(const char *path, const char *prefix, size_t len);
+int fchr_prefix_match_scalar(const char *path, const char *prefix, size_t len);
+#ifdef BENCH_X86
+int fchr_prefix_match_sse2(const char *path, const char *prefix, size_t len);
+int fchr_prefix_match_avx2(const char *path, const char *prefix, size_t len);
+#endif
+
+#define ITERATIONS 200000
+
+typedef int (*match_fn)(const char *path, const char *prefix, size_t len);
+
+static int match_strstr(const char *path, const char *prefix, size_t len)
+{
+	return strstr(path, prefix) == path;
+}
+
+static int match_strncmp(const char *path, const char *prefix, size_t len)
+{
+	return strncmp(path, prefix, len) == 0;
+}
+
+static const struct {
+	const char *name;
+	match_fn fn;
+	int x86;
+} impls[] = {
+	{ "strstr",  match_strstr,             0 },
+	{ "strncmp", match_strncmp,            0 },
+	{ "scalar",  fchr_prefix_match_scalar, 0 },
+#ifdef BENCH_X86
+	{ "sse2",    fchr_prefix_match_sse2,   1 },
+	{ "avx2",    fchr_prefix_match_avx2,   2 },
+#endif
+	{ "ifunc",   fchr_prefix_match,        0 },
+};
+
+static double run(match_fn fn, const char *path, const char *root, size_t len)
+{
+	volatile int sink = 0;
+	bench_ticks_t t0, t1;
+	int i;
+
+	t0 = bench_ticks();
+	for (i = 0; i < ITERATIONS; i++) {
+		sink += fn(path, root, len);
+		__asm__ __volatile__("" ::: "memory");
+	}
+	t1 = bench_ticks();
+
+	return (double)(t1 - t0) / ITERATIONS;
+}
+
+int main(void)
+{
+	static char root[4096 + 1], hit[8192], miss[8192];
+	size_t len, i, k;
+
+	printf("# %s per call, %d iterations\n", BENCH_TICK_UNIT, ITERATIONS);
+	printf("%-6s", "len");
+	for (k = 0; k < sizeof(impls) / sizeof(impls[0]); k++)
+		printf(" %9s/hit %8s/miss", impls[k].name, impls[k].name);
+	printf("\n");
+
+	for (len = 16; len <= 4096; len *= 2) {
+		for (i = 0; i < len; i++)
+			root[i] = (i % 8 == 0) ? '/' : 'a' + i % 26;
+		root[len] = '\0';
+		snprintf(hit, sizeof(hit), "%s/usr/include/stdio.h", root);
+		strcpy(miss, hit);
+		miss[len - 1] ^= 1;
+
+		printf("%-6zu", len);
+		for (k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+#ifdef BENCH_X86
+			if (impls[k].x86 == 2 && !__builtin_cpu_supports("avx2")) {
+				printf(" %13s %13s", "-", "-");
+				continue;
+			}
+#endif
+			printf(" %13.1f %13.1f",
+					run(impls[k].fn, hit, root, len),
+					run(impls[k].fn, miss, root, len));
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,224 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Missing name benchmark, shaped like a compiler's header search: every
+ * header lives in the last of NDIRS include directories, so each lookup
+ * probes NDIRS - 1 names which do not exist first.  Reported is the time
+ * per probe for open(), stat() and access(), and for open() while a file
+ * is created every CREATE_EVERY lookups, which stales the negative cache.
+ *
+ *   probe LIBRARY [INDEXER]
+ *
+ * runs the probes under LIBRARY with and without the negative lookup
+ * cache (FAKECHROOT_OPTS=E), for the string and default backends, and
+ * with the stat cache (FAKECHROOT_OPTS=I) taking /usr as immutable.
+ * Given the fakechroot-index program INDEXER, they run once more with a
+ * manifest of the tree (FAKECHROOT_INDEX).
+ */
+
+#include "bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define NDIRS        8
+#define NHDRS        64
+#define ITERATIONS   20000
+#define CREATE_EVERY 64
+
+enum { OP_OPEN, OP_STAT, OP_ACCESS, OP_OPEN_CREATE };
+
+static const struct {
+	const char *name;
+	int op;
+} cases[] = {
+	{ "open",          OP_OPEN },
+	{ "stat",          OP_STAT },
+	{ "access",        OP_ACCESS },
+	{ "open + create", OP_OPEN_CREATE },
+};
+
+/* search the include path for header n, returns whether it was found */
+static int search(int op, int n)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	int d, fd;
+
+	for (d = 0; d < NDIRS; d++) {
+		snprintf(path, sizeof(path), "/usr/include/inc%d/hdr%d.h", d, n);
+		switch (op) {
+		case OP_STAT:
+			if (stat(path, &st) == 0)
+				return d == NDIRS - 1;
+			break;
+		case OP_ACCESS:
+			if (access(path, R_OK) == 0)
+				return d == NDIRS - 1;
+			break;
+		default:
+			if ((fd = open(path, O_RDONLY)) >= 0) {
+				close(fd);
+				return d == NDIRS - 1;
+			}
+			break;
+		}
+		if (errno != ENOENT)
+			return 0;
+	}
+
+	return 0;
+}
+
+static int child(void)
+{
+	char path[PATH_MAX];
+	unsigned long long t0, t1;
+	size_t k;
+	int i, ok, fd;
+
+	printf("\n# %s: ns per probe, %d include directories, %d lookups\n",
+			getenv("BENCH_BACKEND"), NDIRS, ITERATIONS);
+	printf("%-16s %10s %s\n", "case", "ns", "result");
+
+	for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		ok = 1;
+		t0 = bench_ns();
+		for (i = 0; i < ITERATIONS; i++) {
+			ok &= search(cases[k].op, i % NHDRS);
+			if (cases[k].op == OP_OPEN_CREATE && i % CREATE_EVERY == 0) {
+				snprintf(path, sizeof(path), "/tmp/obj%d.o", i / CREATE_EVERY % 8);
+				if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0)
+					close(fd);
+			}
+		}
+		t1 = bench_ns();
+
+		printf("%-16s %10.1f %s\n", cases[k].name,
+				(double)(t1 - t0) / ITERATIONS / NDIRS, ok ? "ok" : "WRONG");
+	}
+
+	return 0;
+}
+
+static void tree(const char *root)
+{
+	char buf[PATH_MAX];
+	int d, n, fd;
+
+	snprintf(buf, sizeof(buf), "%s/usr", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/usr/include", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/tmp", root);
+	mkdir(buf, 0755);
+	for (d = 0; d < NDIRS; d++) {
+		snprintf(buf, sizeof(buf), "%s/usr/include/inc%d", root, d);
+		mkdir(buf, 0755);
+	}
+	for (n = 0; n < NHDRS; n++) {
+		snprintf(buf, sizeof(buf), "%s/usr/include/inc%d/hdr%d.h", root, NDIRS - 1, n);
+		if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) < 0) {
+			perror(buf);
+			exit(1);
+		}
+		close(fd);
+	}
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static const struct {
+	const char *name;
+	const char *opts;
+	int index;
+} backends[] = {
+	{ "string",            "U",  0 },
+	{ "string+negcache",   "UE", 0 },
+	{ "default",           "",   0 },
+	{ "default+negcache",  "E",  0 },
+	{ "default+statcache", "I",  0 },
+	{ "default+index",     "",   1 },
+};
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-probe.XXXXXX";
+	char usr[sizeof(root) + 4], manifest[sizeof(root) + 6];
+	char cmd[2 * PATH_MAX];
+	int status = 0;
+	size_t k;
+	pid_t pid;
+
+	if (getenv("FAKECHROOT_BASE") != NULL)
+		return child();
+
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "usage: %s LIBRARY [INDEXER]\n", argv[0]);
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	tree(root);
+	snprintf(usr, sizeof(usr), "%s/usr", root);
+	snprintf(manifest, sizeof(manifest), "%s.index", root);
+	if (argc == 3) {
+		snprintf(cmd, sizeof(cmd), "%s %s %s", argv[2], root, manifest);
+		if (system(cmd) != 0) {
+			fprintf(stderr, "%s failed\n", argv[2]);
+			return 1;
+		}
+	}
+
+	for (k = 0; k < sizeof(backends) / sizeof(backends[0]); k++) {
+		if (backends[k].index && argc != 3)
+			continue;
+		fflush(stdout);
+		if ((pid = fork()) == 0) {
+			setenv("LD_PRELOAD", argv[1], 1);
+			setenv("FAKECHROOT_BASE", root, 1);
+			setenv("FAKECHROOT_OPTS", backends[k].opts, 1);
+			setenv("FAKECHROOT_IMMUTABLE", usr, 1);
+			if (backends[k].index)
+				setenv("FAKECHROOT_INDEX", manifest, 1);
+			setenv("BENCH_BACKEND", backends[k].name, 1);
+			execv("/proc/self/exe", argv);
+			_exit(127);
+		}
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			break;
+	}
+
+	nftw(root, rm, 16, FTW_DEPTH | FTW_PHYS);
+	unlink(manifest);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,271 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Path resolution benchmark on a symlink farm shaped like a merged /usr
+ * multiarch sysroot: /lib -> usr/lib, /lib64 -> /usr/lib, relative
+ * libN.so -> libN.so.1 -> libN.so.1.0.0 chains and absolute libabsN.so
+ * links into /lib.  For every case it reports the stat-like, readlink()
+ * and getcwd() calls the library passes on per lookup, cold (first
+ * lookup of each name) and warm, and the warm time per lookup.
+ *
+ *   resolve LIBRARY SHIM
+ *
+ * builds the farm, then runs itself under LIBRARY with SHIM (syscount.so)
+ * preloaded behind it, once per resolution backend:
+ *
+ *   string   FAKECHROOT_OPTS=UC: string translation and the dentry cache
+ *   default  FAKECHROOT_OPTS=C: openat2(RESOLVE_IN_ROOT) for opens,
+ *            the dentry cache for the rest
+ *   kernel   FAKECHROOT_OPTS=KC: openat2() for the stat family as well
+ *
+ * openat2() is a raw system call which the shim can not see; compare the
+ * times.
+ */
+
+#include "bench.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define NLIBS      32
+#define ITERATIONS 100000
+#define MULTIARCH  "/usr/lib/x86_64-linux-gnu"
+#define DEEP       "/a/b/c/d/e/f/g/h/i/j/k/l"
+
+enum { OP_STAT, OP_LSTAT, OP_OPEN, OP_REALPATH };
+
+static const struct bench_case {
+	const char *name;
+	int op;
+	const char *fmt;		/* path of library n */
+	int links;				/* symlinks followed */
+} cases[] = {
+	{ "stat plain",         OP_STAT,     MULTIARCH "/lib%d.so.1.0.0",           0 },
+	{ "stat deep",          OP_STAT,     DEEP "/file%d",                        0 },
+	{ "stat rel chain",     OP_STAT,     MULTIARCH "/lib%d.so",                 2 },
+	{ "stat via /lib",      OP_STAT,     "/lib/x86_64-linux-gnu/lib%d.so",      3 },
+	{ "stat abs chain",     OP_STAT,     "/lib64/x86_64-linux-gnu/libabs%d.so", 5 },
+	{ "lstat via /lib",     OP_LSTAT,    "/lib/x86_64-linux-gnu/lib%d.so",      1 },
+	{ "open abs chain",     OP_OPEN,     "/lib64/x86_64-linux-gnu/libabs%d.so", 5 },
+	{ "realpath abs chain", OP_REALPATH, "/lib64/x86_64-linux-gnu/libabs%d.so", 5 },
+};
+
+static unsigned long *syscalls;
+
+static int lookup(const struct bench_case *bc, int n)
+{
+	char path[PATH_MAX], want[PATH_MAX], res[PATH_MAX];
+	struct stat st;
+	int fd;
+
+	snprintf(path, sizeof(path), bc->fmt, n);
+	switch (bc->op) {
+	case OP_STAT:
+		return stat(path, &st) == 0 && st.st_size == n + 1;
+	case OP_LSTAT:
+		return lstat(path, &st) == 0 && S_ISLNK(st.st_mode);
+	case OP_OPEN:
+		if ((fd = open(path, O_RDONLY)) < 0)
+			return 0;
+		close(fd);
+		return 1;
+	default:
+		snprintf(want, sizeof(want), MULTIARCH "/lib%d.so.1.0.0", n);
+		return realpath(path, res) != NULL && strcmp(res, want) == 0;
+	}
+}
+
+static int child(void)
+{
+	unsigned long calls;
+	unsigned long long t0, t1;
+	size_t k;
+	int i, ok;
+
+	syscalls = dlsym(RTLD_DEFAULT, "bench_syscalls");
+	if (syscalls == NULL) {
+		fprintf(stderr, "resolve: call counting shim not preloaded\n");
+		return 1;
+	}
+
+	printf("\n# %s backend: libc calls passed on per lookup; %d names, %d warm lookups\n",
+			getenv("BENCH_BACKEND"), NLIBS, ITERATIONS);
+	printf("%-20s %5s %10s %10s %10s %s\n",
+			"case", "links", "cold", "warm", "warm ns", "result");
+
+	for (k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		const struct bench_case *bc = &cases[k];
+		double cold, warm;
+
+		ok = 1;
+		calls = *syscalls;
+		for (i = 0; i < NLIBS; i++)
+			ok &= lookup(bc, i);
+		cold = (double)(*syscalls - calls) / NLIBS;
+
+		calls = *syscalls;
+		t0 = bench_ns();
+		for (i = 0; i < ITERATIONS; i++)
+			ok &= lookup(bc, i % NLIBS);
+		t1 = bench_ns();
+		warm = (double)(*syscalls - calls) / ITERATIONS;
+
+		printf("%-20s %5d %10.2f %10.2f %10.1f %s\n", bc->name, bc->links,
+				cold, warm, (double)(t1 - t0) / ITERATIONS, ok ? "ok" : "WRONG");
+	}
+
+	return 0;
+}
+
+static void put(const char *root, const char *path, const char *data)
+{
+	char buf[PATH_MAX];
+	FILE *f;
+
+	snprintf(buf, sizeof(buf), "%s%s", root, path);
+	if ((f = fopen(buf, "w")) == NULL || fputs(data, f) < 0 || fclose(f)) {
+		perror(buf);
+		exit(1);
+	}
+}
+
+static void link_to(const char *root, const char *target, const char *path)
+{
+	char buf[PATH_MAX];
+
+	snprintf(buf, sizeof(buf), "%s%s", root, path);
+	if (symlink(target, buf) != 0) {
+		perror(buf);
+		exit(1);
+	}
+}
+
+static void mkdirs(const char *root, const char *path)
+{
+	char buf[PATH_MAX], *p;
+
+	snprintf(buf, sizeof(buf), "%s%s", root, path);
+	for (p = buf + strlen(root) + 1; ; p++) {
+		if (*p == '/' || *p == '\0') {
+			char c = *p;
+
+			*p = '\0';
+			if (mkdir(buf, 0755) != 0 && errno != EEXIST) {
+				perror(buf);
+				exit(1);
+			}
+			if ((*p = c) == '\0')
+				break;
+		}
+	}
+}
+
+static void farm(const char *root)
+{
+	char path[PATH_MAX], target[PATH_MAX], data[NLIBS + 2];
+	int i;
+
+	mkdirs(root, MULTIARCH);
+	mkdirs(root, DEEP);
+	link_to(root, "usr/lib", "/lib");
+	link_to(root, "/usr/lib", "/lib64");
+
+	for (i = 0; i < NLIBS; i++) {
+		memset(data, 'x', i + 1);
+		data[i + 1] = '\0';
+
+		snprintf(path, sizeof(path), MULTIARCH "/lib%d.so.1.0.0", i);
+		put(root, path, data);
+		snprintf(path, sizeof(path), DEEP "/file%d", i);
+		put(root, path, data);
+
+		snprintf(target, sizeof(target), "lib%d.so.1.0.0", i);
+		snprintf(path, sizeof(path), MULTIARCH "/lib%d.so.1", i);
+		link_to(root, target, path);
+		snprintf(target, sizeof(target), "lib%d.so.1", i);
+		snprintf(path, sizeof(path), MULTIARCH "/lib%d.so", i);
+		link_to(root, target, path);
+		snprintf(target, sizeof(target), "/lib/x86_64-linux-gnu/lib%d.so", i);
+		snprintf(path, sizeof(path), MULTIARCH "/libabs%d.so", i);
+		link_to(root, target, path);
+	}
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static const struct {
+	const char *name;
+	const char *opts;
+} backends[] = {
+	{ "string",  "UC" },
+	{ "default", "C" },
+	{ "kernel",  "KC" },
+};
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-resolve.XXXXXX";
+	char preload[2 * PATH_MAX];
+	int status = 0;
+	size_t k;
+	pid_t pid;
+
+	if (getenv("FAKECHROOT_BASE") != NULL)
+		return child();
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s LIBRARY SHIM\n", argv[0]);
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	farm(root);
+
+	for (k = 0; k < sizeof(backends) / sizeof(backends[0]); k++) {
+		fflush(stdout);
+		if ((pid = fork()) == 0) {
+			snprintf(preload, sizeof(preload), "%s %s", argv[1], argv[2]);
+			setenv("LD_PRELOAD", preload, 1);
+			setenv("FAKECHROOT_BASE", root, 1);
+			setenv("FAKECHROOT_OPTS", backends[k].opts, 1);
+			setenv("BENCH_BACKEND", backends[k].name, 1);
+			execv("/proc/self/exe", argv);
+			_exit(127);
+		}
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			break;
+	}
+
+	nftw(root, rm, 16, FTW_DEPTH | FTW_PHYS);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
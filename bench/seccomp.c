@@ -0,0 +1,209 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Cost of the seccomp supervisor (FAKECHROOT_OPTS=F) next to the preloaded
+ * library: ns per call of stat(), open() and close(), access(), and of
+ * getppid(), a call the filter lets through, in
+ *
+ *   native      the static build of this program on the host paths;
+ *   preload     this program with the library, on the guest paths;
+ *   seccomp     the static build, started by the library under a
+ *               supervisor, on the guest paths.
+ *
+ * The static build is expected next to this program, with "-static"
+ * appended to its name.
+ *
+ *   seccomp LIBRARY
+ */
+
+#include "bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define CALLS 20000
+
+static int child(const char *prefix)
+{
+	char path[PATH_MAX];
+	unsigned long long t[5];
+	struct stat st;
+	int i, fd;
+
+	snprintf(path, sizeof(path), "%s/etc/hello", prefix);
+
+	t[0] = bench_ns();
+	for (i = 0; i < CALLS; i++)
+		if (stat(path, &st) < 0)
+			return 1;
+	t[1] = bench_ns();
+	for (i = 0; i < CALLS; i++) {
+		if ((fd = open(path, O_RDONLY)) < 0)
+			return 1;
+		close(fd);
+	}
+	t[2] = bench_ns();
+	for (i = 0; i < CALLS; i++)
+		if (access(path, R_OK) < 0)
+			return 1;
+	t[3] = bench_ns();
+	for (i = 0; i < CALLS; i++)
+		getppid();
+	t[4] = bench_ns();
+
+	printf("%-10s %10.0f %10.0f %10.0f %10.0f\n", getenv("BENCH_MODE"),
+			(double)(t[1] - t[0]) / CALLS, (double)(t[2] - t[1]) / CALLS,
+			(double)(t[3] - t[2]) / CALLS, (double)(t[4] - t[3]) / CALLS);
+
+	return 0;
+}
+
+static int copy(const char *from, const char *to)
+{
+	char buf[65536];
+	ssize_t n;
+	int in, out;
+
+	if ((in = open(from, O_RDONLY)) < 0)
+		return -1;
+	if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0755)) < 0) {
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	close(in);
+	close(out);
+
+	return n < 0 ? -1 : 0;
+}
+
+static int tree(const char *root, const char *exe)
+{
+	char buf[PATH_MAX];
+	int fd;
+
+	snprintf(buf, sizeof(buf), "%s/etc", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/bin", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/etc/hello", root);
+	if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) < 0)
+		return -1;
+	close(fd);
+	snprintf(buf, sizeof(buf), "%s/bin/static", root);
+
+	return copy(exe, buf);
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-seccomp.XXXXXX";
+	char exe[PATH_MAX];
+	const char *mode;
+	int status = 0, k;
+	ssize_t n;
+	pid_t pid;
+
+	if ((mode = getenv("BENCH_CHILD")) != NULL) {
+		/* started with the library, which starts the static build */
+		if (strcmp(mode, "launch") == 0) {
+			setenv("BENCH_CHILD", "", 1);
+			execl("/bin/static", "static", (char *)NULL);
+			return 127;
+		}
+		return child(mode);
+	}
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s LIBRARY\n", argv[0]);
+		return 1;
+	}
+	if ((n = readlink("/proc/self/exe", exe, sizeof(exe) - 8)) < 0)
+		return 1;
+	strcpy(exe + n, "-static");
+	if (access(exe, X_OK) < 0) {
+		fprintf(stderr, "%s: %s: %s\n", argv[0], exe, strerror(errno));
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	if (tree(root, exe) < 0) {
+		fprintf(stderr, "%s: cannot set up %s\n", argv[0], root);
+		return 1;
+	}
+
+	printf("\n# seccomp: ns per call, %d calls\n", CALLS);
+	printf("%-10s %10s %10s %10s %10s\n", "mode", "stat", "open+close",
+			"access", "getppid");
+	fflush(stdout);
+
+	for (k = 0; k < 3; k++) {
+		if ((pid = fork()) == 0) {
+			switch (k) {
+			case 0:
+				setenv("BENCH_MODE", "native", 1);
+				setenv("BENCH_CHILD", root, 1);
+				execl(exe, exe, (char *)NULL);
+				break;
+			case 1:
+				setenv("BENCH_MODE", "preload", 1);
+				setenv("BENCH_CHILD", "", 1);
+				setenv("LD_PRELOAD", argv[1], 1);
+				setenv("FAKECHROOT_BASE", root, 1);
+				execv("/proc/self/exe", argv);
+				break;
+			default:
+				setenv("BENCH_MODE", "seccomp", 1);
+				setenv("BENCH_CHILD", "launch", 1);
+				setenv("LD_PRELOAD", argv[1], 1);
+				setenv("FAKECHROOT_BASE", root, 1);
+				setenv("FAKECHROOT_OPTS", "F", 1);
+				execv("/proc/self/exe", argv);
+				break;
+			}
+			_exit(127);
+		}
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "%s: run %d failed\n", argv[0], k);
+			break;
+		}
+	}
+
+	nftw(root, rm, 16, FTW_DEPTH | FTW_PHYS);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,155 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Startup with a mount table of growing size: us per process started by a
+ * parent running with the library, when the child reads its environment,
+ * FAKECHROOT_MOUNTS_FILE among it, and when it takes the session execve()
+ * hands it (see lib-session.c).  The children do nothing but start.  For
+ * the first the parent makes the system call itself, past the wrapper
+ * and the session; both go through the runtime linker, as the wrapper
+ * does.  The last takes the session as well, with the caches on and
+ * early.so preloaded after the library: its constructor calls wrappers
+ * before the one of the library has set the caches up.
+ *
+ *   session LIBRARY EARLY
+ */
+
+#include "bench.h"
+#include <gnu/lib-names.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define RUNS 300
+#define LINKER "/lib/" LD_SO
+
+static const int sizes[] = { 1, 100, 1000, 10000 };
+
+/* the parent, with the library: RUNS children started one way or the other */
+static int launch(const char *mode)
+{
+	char exe[PATH_MAX];
+	unsigned long long t0, t1;
+	int i, status = 0;
+	ssize_t n;
+	pid_t pid;
+
+	if ((n = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) < 0)
+		return 1;
+	exe[n] = '\0';
+	setenv("BENCH_CHILD", "run", 1);
+
+	t0 = bench_ns();
+	for (i = 0; i < RUNS; i++) {
+		if ((pid = fork()) == 0) {
+			char *argv[] = { "ld.so", "--argv0", exe, exe, NULL };
+			extern char **environ;
+
+			if (strcmp(mode, "environment") != 0)
+				execl(exe, exe, (char *)NULL);
+			else
+				syscall(SYS_execve, LINKER, argv, environ);
+			_exit(127);
+		}
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			return 1;
+	}
+	t1 = bench_ns();
+
+	printf(" %10.1f", (double)(t1 - t0) / RUNS / 1000);
+
+	return 0;
+}
+
+static int table(const char *file, int size)
+{
+	FILE *f;
+	int i;
+
+	if ((f = fopen(file, "w")) == NULL)
+		return -1;
+	fprintf(f, "# %d entries\n/proc\n", size);
+	for (i = 1; i < size; i++)
+		fprintf(f, "/mnt/%d/data=/srv/volume%d\n", i, i);
+
+	return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *const modes[] = { "environment", "session", "caches" };
+	char file[] = "/tmp/fakechroot-session.XXXXXX", preload[2 * PATH_MAX];
+	const char *mode;
+	int status = 0, fd;
+	size_t i, k;
+	pid_t pid;
+
+	if ((mode = getenv("BENCH_CHILD")) != NULL)
+		return strcmp(mode, "run") == 0 ? 0 : launch(mode);
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s LIBRARY EARLY\n", argv[0]);
+		return 1;
+	}
+	snprintf(preload, sizeof(preload), "%s %s", argv[1], argv[2]);
+	if ((fd = mkstemp(file)) < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	printf("\n# session: us per process, %d runs\n", RUNS);
+	printf("%-8s %11s %10s %10s\n", "mounts", "environment", "session", "caches");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (table(file, sizes[i]) != 0)
+			break;
+		printf("%-8d", sizes[i]);
+		for (k = 0; k < 3; k++) {
+			fflush(stdout);
+			if ((pid = fork()) == 0) {
+				/* "/" as the root leaves the paths of the host as they are */
+				setenv("BENCH_CHILD", modes[k], 1);
+				setenv("LD_PRELOAD", k < 2 ? argv[1] : preload, 1);
+				setenv("FAKECHROOT_BASE", "/", 1);
+				setenv("FAKECHROOT_MOUNTS_FILE", file, 1);
+				if (k == 2)
+					setenv("FAKECHROOT_OPTS", "EIX", 1);
+				execv("/proc/self/exe", argv);
+				_exit(127);
+			}
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				break;
+		}
+		printf("\n");
+		if (k < 3) {
+			fprintf(stderr, "%s: run with %d mounts failed\n", argv[0], sizes[i]);
+			break;
+		}
+	}
+
+	unlink(file);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
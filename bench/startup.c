@@ -0,0 +1,142 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Startup benchmark for short-lived processes, the bulk of a build: each
+ * run is a fork() and exec() of a child which makes the handful of calls
+ * a small tool makes (stat, lstat, access, open, readlink, getcwd) and
+ * exits.  Reported is the wall time per process without the library,
+ * with lazy binding of the wrappers (the default), with all of them
+ * bound at startup (FAKECHROOT_OPTS=N), and preloaded without a fake root,
+ * where the wrappers get out of the way.
+ *
+ *   startup LIBRARY
+ */
+
+#include "bench.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define RUNS 500
+
+static const struct {
+	const char *name;
+	const char *opts;			/* NULL: without the library */
+	int root;
+} modes[] = {
+	{ "none",        NULL, 0 },
+	{ "lazy",        "",   1 },
+	{ "eager",       "N",  1 },
+	{ "transparent", "",   0 },
+};
+
+static int child(void)
+{
+	char buf[PATH_MAX];
+	struct stat st;
+	int fd;
+
+	stat("/etc/hello", &st);
+	lstat("/etc/lnk", &st);
+	access("/usr/bin/tool", X_OK);
+	if ((fd = open("/etc/hello", O_RDONLY)) >= 0)
+		close(fd);
+	readlink("/etc/lnk", buf, sizeof(buf));
+	getcwd(buf, sizeof(buf));
+
+	return 0;
+}
+
+static void tree(const char *root)
+{
+	char buf[PATH_MAX];
+	int fd;
+
+	snprintf(buf, sizeof(buf), "%s/etc", root);
+	mkdir(buf, 0755);
+	snprintf(buf, sizeof(buf), "%s/etc/hello", root);
+	if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) >= 0)
+		close(fd);
+	snprintf(buf, sizeof(buf), "%s/etc/lnk", root);
+	symlink("hello", buf);
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/fakechroot-startup.XXXXXX";
+	unsigned long long t0, t1;
+	int i, status = 0;
+	size_t k;
+	pid_t pid;
+
+	if (getenv("BENCH_CHILD") != NULL)
+		return child();
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s LIBRARY\n", argv[0]);
+		return 1;
+	}
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	tree(root);
+
+	printf("\n# startup: us per process, %d runs\n", RUNS);
+	printf("%-12s %10s\n", "mode", "us");
+
+	for (k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+		t0 = bench_ns();
+		for (i = 0; i < RUNS; i++) {
+			if ((pid = fork()) == 0) {
+				setenv("BENCH_CHILD", "1", 1);
+				if (modes[k].opts != NULL) {
+					setenv("LD_PRELOAD", argv[1], 1);
+					if (modes[k].root)
+						setenv("FAKECHROOT_BASE", root, 1);
+					setenv("FAKECHROOT_OPTS", modes[k].opts, 1);
+				}
+				execv("/proc/self/exe", argv);
+				_exit(127);
+			}
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				break;
+		}
+		t1 = bench_ns();
+		if (i < RUNS)
+			break;
+
+		printf("%-12s %10.1f\n", modes[k].name, (double)(t1 - t0) / RUNS / 1000);
+	}
+
+	nftw(root, rm, 16, FTW_DEPTH | FTW_PHYS);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
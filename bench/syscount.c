@@ -0,0 +1,84 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Call counting shim for the benchmarks: preloaded right after the
+ * library, it sees every stat-like, readlink() and getcwd() call the
+ * wrappers pass on and counts them in bench_syscalls.  File I/O, open(),
+ * read() and the like, is counted apart in bench_io_calls, with the bytes
+ * read in bench_io_bytes.  Types are left opaque so that no libc header
+ * gets in the way.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+unsigned long bench_syscalls;
+unsigned long bench_io_calls, bench_io_bytes;
+
+#define COUNT(ret, name, proto, args) \
+	ret name proto \
+	{ \
+		static ret (*next) proto; \
+		if (next == NULL) \
+			next = (ret (*) proto)dlsym(RTLD_NEXT, #name); \
+		__atomic_add_fetch(&bench_syscalls, 1, __ATOMIC_RELAXED); \
+		return next args; \
+	}
+
+COUNT(int, stat, (const char *p, void *b), (p, b))
+COUNT(int, lstat, (const char *p, void *b), (p, b))
+COUNT(int, stat64, (const char *p, void *b), (p, b))
+COUNT(int, lstat64, (const char *p, void *b), (p, b))
+COUNT(int, fstatat, (int d, const char *p, void *b, int f), (d, p, b, f))
+COUNT(int, __xstat, (int v, const char *p, void *b), (v, p, b))
+COUNT(int, __lxstat, (int v, const char *p, void *b), (v, p, b))
+COUNT(int, __xstat64, (int v, const char *p, void *b), (v, p, b))
+COUNT(int, __lxstat64, (int v, const char *p, void *b), (v, p, b))
+COUNT(ssize_t, readlink, (const char *p, char *b, size_t n), (p, b, n))
+COUNT(char *, getcwd, (char *b, size_t n), (b, n))
+
+#define COUNT_IO(ret, name, proto, args, bytes) \
+	ret name proto \
+	{ \
+		static ret (*next) proto; \
+		ret ret_; \
+		if (next == NULL) \
+			next = (ret (*) proto)dlsym(RTLD_NEXT, #name); \
+		__atomic_add_fetch(&bench_io_calls, 1, __ATOMIC_RELAXED); \
+		ret_ = next args; \
+		if (bytes && ret_ > 0) \
+			__atomic_add_fetch(&bench_io_bytes, ret_, __ATOMIC_RELAXED); \
+		return ret_; \
+	}
+
+/* open() takes a mode only with O_CREAT, which the wrappers pass anyway */
+COUNT_IO(int, open, (const char *p, int f, int m), (p, f, m), 0)
+COUNT_IO(int, open64, (const char *p, int f, int m), (p, f, m), 0)
+COUNT_IO(ssize_t, read, (int d, void *b, size_t n), (d, b, n), 1)
+COUNT_IO(ssize_t, pread, (int d, void *b, size_t n, off_t o), (d, b, n, o), 1)
+COUNT_IO(ssize_t, pread64, (int d, void *b, size_t n, off_t o), (d, b, n, o), 1)
+COUNT_IO(int, fstat, (int d, void *b), (d, b), 0)
+COUNT_IO(int, fstat64, (int d, void *b), (d, b), 0)
+COUNT_IO(int, __fxstat, (int v, int d, void *b), (v, d, b), 0)
+COUNT_IO(int, __fxstat64, (int v, int d, void *b), (v, d, b), 0)
+COUNT_IO(int, close, (int d), (d), 0)
@@ -0,0 +1,307 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+
+/*
+ * Training workload for the profile guided build ("make pgo" in src): what
+ * a build does most, in a fake root under ROOT.
+ *
+ *   - a stat storm: an include path search with open(), stat(), lstat()
+ *     and access(), most of the names missing, and a file made now and
+ *     then;
+ *   - a tree walk: nftw(), opendir() and readdir(), chdir() and getcwd();
+ *   - an exec storm: fork() and execve() of programs inside the fake
+ *     root, directly, through $PATH and through a #! line, and of small
+ *     tools with the library preloaded.
+ *
+ * It runs with the default options, with the wrappers bound at startup
+ * and once without a fake root.  ROOT is not removed: gcov writes the
+ * profile below it when GCOV_PREFIX points there, as it does in the pgo
+ * rule, since paths inside the fake root are not translated.
+ *
+ *   train LIBRARY ROOT
+ */
+
+#include "bench.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define NDIRS   8
+#define NHDRS   64
+#define ROUNDS  2000
+#define FANOUT  8
+#define WALKS   20
+#define EXECS   100
+
+static const struct {
+	const char *name;
+	const char *opts;
+	int root;
+} modes[] = {
+	{ "default",     "",  1 },
+	{ "eager",       "N", 1 },
+	{ "transparent", "",  0 },
+};
+
+static int walked;
+
+static int walk(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	walked++;
+	return 0;
+}
+
+static void stat_storm(void)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	int i, d, fd;
+
+	for (i = 0; i < ROUNDS; i++) {
+		for (d = 0; d < NDIRS; d++) {
+			snprintf(path, sizeof(path), "/usr/include/inc%d/hdr%d.h", d, i % NHDRS);
+			switch (i % 4) {
+			case 0:
+				fd = open(path, O_RDONLY);
+				if (fd >= 0)
+					close(fd);
+				break;
+			case 1:
+				stat(path, &st);
+				break;
+			case 2:
+				lstat(path, &st);
+				break;
+			default:
+				access(path, R_OK);
+				break;
+			}
+		}
+		if (i % 64 == 0) {
+			snprintf(path, sizeof(path), "/tmp/obj%d.o", i / 64 % 8);
+			if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0)
+				close(fd);
+		}
+	}
+}
+
+static void tree_walk(void)
+{
+	char cwd[PATH_MAX];
+	struct dirent *de;
+	DIR *dir;
+	int i;
+
+	for (i = 0; i < WALKS; i++) {
+		nftw("/usr/share", walk, 16, FTW_PHYS);
+		if ((dir = opendir("/usr/include")) != NULL) {
+			while ((de = readdir(dir)) != NULL)
+				walked++;
+			closedir(dir);
+		}
+		if (chdir("/usr/share/d0") == 0 && getcwd(cwd, sizeof(cwd)) != NULL)
+			chdir("/");
+	}
+}
+
+/* whether the programs start does not matter, the wrappers ran */
+static void exec_storm(void)
+{
+	char *const argv[] = { "train", NULL };
+	int i, status;
+	pid_t pid;
+
+	setenv("TRAIN_CHILD", "tool", 1);
+	for (i = 0; i < EXECS; i++) {
+		if ((pid = fork()) == 0) {
+			switch (i % 3) {
+			case 0:
+				execv("/bin/train", argv);
+				break;
+			case 1:
+				execvp("train", argv);
+				break;
+			default:
+				execv("/bin/script", argv);
+				break;
+			}
+			_exit(127);
+		}
+		waitpid(pid, &status, 0);
+	}
+}
+
+/* a small tool started by the exec storm */
+static int tool(void)
+{
+	char buf[PATH_MAX];
+	struct stat st;
+
+	stat("/usr/include/inc7/hdr0.h", &st);
+	access("/usr/include/inc0/hdr0.h", R_OK);
+	getcwd(buf, sizeof(buf));
+
+	return 0;
+}
+
+static int child(void)
+{
+	stat_storm();
+	tree_walk();
+	if (getenv("FAKECHROOT_BASE") != NULL)
+		exec_storm();
+
+	return 0;
+}
+
+static int copy(const char *from, const char *to)
+{
+	char buf[65536];
+	ssize_t n;
+	int in, out;
+
+	if ((in = open(from, O_RDONLY)) < 0)
+		return -1;
+	if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0755)) < 0) {
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	close(in);
+	close(out);
+
+	return n < 0 ? -1 : 0;
+}
+
+static int tree(const char *root)
+{
+	static const char *dirs[] = {
+		"bin", "tmp", "usr", "usr/include", "usr/share",
+	};
+	char buf[PATH_MAX], exe[PATH_MAX];
+	size_t k;
+	int d, n, fd;
+	FILE *f;
+
+	for (k = 0; k < sizeof(dirs) / sizeof(dirs[0]); k++) {
+		snprintf(buf, sizeof(buf), "%s/%s", root, dirs[k]);
+		mkdir(buf, 0755);
+	}
+	for (d = 0; d < NDIRS; d++) {
+		snprintf(buf, sizeof(buf), "%s/usr/include/inc%d", root, d);
+		mkdir(buf, 0755);
+	}
+	for (n = 0; n < NHDRS; n++) {
+		snprintf(buf, sizeof(buf), "%s/usr/include/inc%d/hdr%d.h", root, NDIRS - 1, n);
+		if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) >= 0)
+			close(fd);
+	}
+	for (d = 0; d < FANOUT; d++) {
+		snprintf(buf, sizeof(buf), "%s/usr/share/d%d", root, d);
+		mkdir(buf, 0755);
+		for (n = 0; n < FANOUT; n++) {
+			snprintf(buf, sizeof(buf), "%s/usr/share/d%d/f%d", root, d, n);
+			if ((fd = open(buf, O_WRONLY | O_CREAT, 0644)) >= 0)
+				close(fd);
+		}
+	}
+
+	/* programs for the exec storm inside the fake root */
+	if ((n = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) < 0)
+		return -1;
+	exe[n] = '\0';
+	snprintf(buf, sizeof(buf), "%s/bin/train", root);
+	if (copy(exe, buf) < 0)
+		return -1;
+	snprintf(buf, sizeof(buf), "%s/bin/script", root);
+	if ((f = fopen(buf, "w")) == NULL)
+		return -1;
+	fprintf(f, "#!/bin/train\n");
+	fclose(f);
+
+	return chmod(buf, 0755);
+}
+
+/* run this program as TRAIN_CHILD what under mode k */
+static int run(size_t k, const char *what, char **argv)
+{
+	int status = 0;
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		setenv("TRAIN_CHILD", what, 1);
+		setenv("LD_PRELOAD", argv[1], 1);
+		setenv("FAKECHROOT_OPTS", modes[k].opts, 1);
+		if (modes[k].root) {
+			setenv("FAKECHROOT_BASE", argv[2], 1);
+			setenv("PATH", "/bin", 1);
+		}
+		execv("/proc/self/exe", argv);
+		_exit(127);
+	}
+	waitpid(pid, &status, 0);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, char **argv)
+{
+	size_t k;
+	int i;
+
+	if (getenv("TRAIN_CHILD") != NULL)
+		return strcmp(getenv("TRAIN_CHILD"), "tool") == 0 ? tool() : child();
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s LIBRARY ROOT\n", argv[0]);
+		return 1;
+	}
+	if (mkdir(argv[2], 0755) < 0 && errno != EEXIST) {
+		perror(argv[2]);
+		return 1;
+	}
+	if (tree(argv[2]) < 0) {
+		fprintf(stderr, "%s: cannot set up %s\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	for (k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+		printf("train: %s\n", modes[k].name);
+		fflush(stdout);
+		for (i = 0; i < EXECS; i++)
+			if (run(k, "tool", argv) != 0)
+				break;
+		if (i < EXECS || run(k, "storm", argv) != 0) {
+			fprintf(stderr, "%s: %s run failed\n", argv[0], modes[k].name);
+			return 1;
+		}
+	}
+
+	return 0;
+}
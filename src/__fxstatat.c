@@ -28,8 +28,20 @@
 #ifdef HAVE___FXSTATAT
 int __fxstatat(int ver, int dirfd, const char *pathname, struct stat *buf, int flags)
 {
-    expand_chroot_path(pathname);
-    return NEXTCALL(__fxstatat)(ver, dirfd, pathname, buf, flags);
+    const char *guest = pathname;
+
+    if (fchr_negcache_hit(pathname, flags & AT_SYMLINK_NOFOLLOW))
+        return -1;
+
+    lookup_in_root(pathname,
+            (flags & AT_SYMLINK_NOFOLLOW) ? FCHR_LOOKUP_NOFOLLOW : 0,
+            NEXTCALL(__fxstatat)(ver, fakechroot_fd, "", buf,
+                (flags & ~AT_SYMLINK_NOFOLLOW) | AT_EMPTY_PATH));
+    resolve_chroot_path_at(dirfd, pathname,
+            (flags & AT_SYMLINK_NOFOLLOW) ? FCHR_RESOLVE_NOFOLLOW : 0);
+    return fchr_negcache_note(guest, flags & AT_SYMLINK_NOFOLLOW,
+            RAWCALL(fchr_raw_fxstatat(ver, dirfd, pathname, buf, flags),
+                NEXTCALL(__fxstatat)(ver, dirfd, pathname, buf, flags)));
 }
 DECLARE_WRAPPER(__fxstatat);
 #endif
@@ -28,8 +28,19 @@
 #ifdef HAVE___FXSTATAT64
 int __fxstatat64(int ver, int dirfd, const char *pathname, struct stat64 *buf, int flags)
 {
-    expand_chroot_path(pathname);
-    return NEXTCALL(__fxstatat64)(ver, dirfd, pathname, buf, flags);
+    const char *guest = pathname;
+
+    if (fchr_negcache_hit(pathname, flags & AT_SYMLINK_NOFOLLOW))
+        return -1;
+
+    lookup_in_root(pathname,
+            (flags & AT_SYMLINK_NOFOLLOW) ? FCHR_LOOKUP_NOFOLLOW : 0,
+            NEXTCALL(__fxstatat64)(ver, fakechroot_fd, "", buf,
+                (flags & ~AT_SYMLINK_NOFOLLOW) | AT_EMPTY_PATH));
+    resolve_chroot_path_at(dirfd, pathname,
+            (flags & AT_SYMLINK_NOFOLLOW) ? FCHR_RESOLVE_NOFOLLOW : 0);
+    return fchr_negcache_note(guest, flags & AT_SYMLINK_NOFOLLOW,
+            NEXTCALL(__fxstatat64)(ver, dirfd, pathname, buf, flags));
 }
 DECLARE_WRAPPER(__fxstatat64)
 #endif
@@ -32,10 +32,22 @@
 /* #include <unistd.h> */
 int __lxstat(int ver, const char *filename, struct stat *buf)
 {
+	const char *guest = filename;
 
-	expand_chroot_path(filename);
+	if (fchr_negcache_hit(filename, 1))
+		return -1;
 
-	return NEXTCALL(__lxstat)(ver, filename, buf);
+#ifdef HAVE___FXSTATAT
+	lookup_in_root(filename, FCHR_LOOKUP_NOFOLLOW,
+			NEXTCALL(__fxstatat)(ver, fakechroot_fd, "", buf, AT_EMPTY_PATH));
+#endif
+	resolve_chroot_path(filename, FCHR_RESOLVE_NOFOLLOW);
+
+	return fchr_negcache_note(guest, 1,
+			fchr_statcache(FCHR_STATCACHE_LSTAT, filename, ver, buf,
+				RAWCALL(fchr_raw_fxstatat(ver, AT_FDCWD, filename, buf,
+						AT_SYMLINK_NOFOLLOW),
+					NEXTCALL(__lxstat)(ver, filename, buf))));
 }
 DECLARE_WRAPPER(__lxstat)
 
@@ -32,10 +32,20 @@
 /* #include <unistd.h> */
 int __lxstat64 (int ver, const char *filename, struct stat64 *buf)
 {
+	const char *guest = filename;
 
-	expand_chroot_path(filename);
+	if (fchr_negcache_hit(filename, 1))
+		return -1;
 
-	return NEXTCALL(__lxstat64)(ver, filename, buf);
+#ifdef HAVE___FXSTATAT64
+	lookup_in_root(filename, FCHR_LOOKUP_NOFOLLOW,
+			NEXTCALL(__fxstatat64)(ver, fakechroot_fd, "", buf, AT_EMPTY_PATH));
+#endif
+	resolve_chroot_path(filename, FCHR_RESOLVE_NOFOLLOW);
+
+	return fchr_negcache_note(guest, 1,
+			fchr_statcache(FCHR_STATCACHE_LSTAT64, filename, ver, buf,
+				NEXTCALL(__lxstat64)(ver, filename, buf)));
 }
 DECLARE_WRAPPER(__lxstat64)
 
@@ -31,9 +31,8 @@
 /* Internal libc function */
 int __open(const char *pathname, int flags, ...)
 {
-	int mode = 0;
-
-	expand_chroot_path(pathname);
+	const char *guest = pathname;
+	int fd, mode = 0;
 
 	if (flags & O_CREAT) {
 		va_list arg;
@@ -42,7 +41,15 @@ int __open(const char *pathname, int flags, ...)
 		va_end(arg);
 	}
 
-	return NEXTCALL(__open)(pathname, flags, mode);
+	if (!(flags & O_CREAT) && fchr_negcache_hit(pathname, flags & O_NOFOLLOW))
+		return -1;
+
+	if ((fd = fchr_kernel_open(pathname, flags, mode)) == FCHR_FALLBACK) {
+		upper_chroot_path(pathname, fchr_overlay_open_how(flags));
+		fd = NEXTCALL(__open)(pathname, flags, mode);
+	}
+
+	return fchr_negcache_opened(guest, flags, fd);
 }
 DECLARE_WRAPPER(__open)
 
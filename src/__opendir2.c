@@ -32,9 +32,12 @@
 /* #include <dirent.h> */
 DIR *__opendir2 (const char *name, int flags)
 {
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_opendir(name);
+
 	expand_chroot_path(name);
 
-	return NEXTCALL(__opendir2)(name, flags);
+	return fchr_direct(NEXTCALL(__opendir2)(name, flags));
 }
 DECLARE_WRAPPER(__opendir2)
 
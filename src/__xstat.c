@@ -32,12 +32,22 @@
 /* #include <unistd.h> */
 int __xstat(int ver, const char *filename, struct stat *buf)
 {
-	 
+	const char *guest = filename;
 
-	expand_chroot_path(filename);
+	if (fchr_negcache_hit(filename, 0))
+		return -1;
+
+#ifdef HAVE___FXSTATAT
+	lookup_in_root(filename, 0,
+			NEXTCALL(__fxstatat)(ver, fakechroot_fd, "", buf, AT_EMPTY_PATH));
+#endif
+	resolve_chroot_path(filename, 0);
 	dprintf("*** %s: %s\n", __FUNCTION__, filename);
 
-	return NEXTCALL(__xstat)(ver, filename, buf);
+	return fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_STAT, filename, ver, buf,
+				RAWCALL(fchr_raw_fxstatat(ver, AT_FDCWD, filename, buf, 0),
+					NEXTCALL(__xstat)(ver, filename, buf))));
 }
 DECLARE_WRAPPER(__xstat)
 
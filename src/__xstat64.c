@@ -32,44 +32,21 @@
 /* #include <unistd.h> */
 int __xstat64 (int ver, const char *filename, struct stat64 *buf)
 {
-	 
+	const char *guest = filename;
 	int ret;
-	char *linkpath;
-	struct stat statbuf;
 
-	expand_chroot_path(filename);
+	if (fchr_negcache_hit(filename, 0))
+		return -1;
 
+#ifdef HAVE___FXSTATAT64
+	lookup_in_root(filename, 0,
+			NEXTCALL(__fxstatat64)(ver, fakechroot_fd, "", buf, AT_EMPTY_PATH));
+#endif
+	resolve_chroot_path(filename, 0);
 
-	/* explicit symlink unwinding */
-	/* XXX: this is duplicate from execve() */
-	ret = lstat(filename, &statbuf);
-	if (ret < 0)
-		return ret;
-	dprintf("### filename=%s, mode: %06o\n", filename, statbuf.st_mode);
-	if (S_ISLNK(statbuf.st_mode)) {
-		 
-		int i;
-
-		dprintf("### symlink\n");
-		linkpath = malloc(FAKECHROOT_MAXPATH);
-		if (!linkpath) return -ENOMEM;
-
-		memset(linkpath, 0, FAKECHROOT_MAXPATH);
-		i = readlink(filename, linkpath, PATH_MAX);
-		if (i < 0)
-			return errno;
-
-		dprintf("### to: %s\n", linkpath);
-		if (linkpath[0] == '/') {
-			expand_chroot_path(linkpath);
-			dprintf("### %s is a symlink to abs path, expanded to %s\n", filename, linkpath);
-		
-			if (!linkpath) return -EINVAL;
-
-			return NEXTCALL(__xstat64)(ver, linkpath, buf); 
-		}
-	}
-	ret = NEXTCALL(__xstat64)(ver, filename, buf); 
+	ret = fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_STAT64, filename, ver, buf,
+				NEXTCALL(__xstat64)(ver, filename, buf)));
 	dprintf("*** %s: %s ret=%d errno=%d\n", __FUNCTION__, filename, ret, errno);
 	return ret;
 }
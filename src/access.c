@@ -30,11 +30,19 @@
 /* #include <unistd.h> */
 int access(const char *pathname, int mode)
 {
-	 
+	const char *guest = pathname;
 
+	if (fchr_negcache_hit(pathname, 0))
+		return -1;
+
+	lookup_in_root(pathname, FCHR_LOOKUP_ACCESS,
+			faccessat(fakechroot_fd, "", mode, AT_EMPTY_PATH));
 	expand_chroot_path(pathname);
 
-	return NEXTCALL(access)(pathname, mode);
+	return fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_ACCESS, pathname, mode, NULL,
+				RAWCALL(fchr_raw_faccessat(AT_FDCWD, pathname, mode),
+					NEXTCALL(access)(pathname, mode))));
 }
 
 DECLARE_WRAPPER(access);
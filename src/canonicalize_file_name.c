@@ -31,12 +31,10 @@
 /* #include <stdlib.h> */
 char *canonicalize_file_name(const char *name)
 {
-	 
-
-	expand_chroot_path(name);
-
-	return NEXTCALL(canonicalize_file_name)(name);
+	/* realpath() resolves inside the fake root */
+	return realpath(name, NULL);
 }
+
 DECLARE_WRAPPER(canonicalize_file_name)
 
 #endif
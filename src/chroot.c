@@ -35,6 +35,7 @@ int chroot(const char *path)
 	char dir[FAKECHROOT_MAXPATH];
     char cwd[FAKECHROOT_MAXPATH];
     char full_path[FAKECHROOT_MAXPATH];
+	char lower[FAKECHROOT_MAXPATH];
 	char *crossdir;
 #if !defined(HAVE_SETENV)
 	char *envbuf;
@@ -77,18 +78,19 @@ int chroot(const char *path)
         snprintf(full_path, FAKECHROOT_MAXPATH, "%s", path);
     }
 
+	/* the new root is made in the upper layer, both layers move down */
+	lower[0] = '\0';
+	if (fakechroot_path != NULL && fchr_overlay(fchr_conf()) &&
+			fchr_overlay_chroot(full_path, lower) != 0)
+		return -1;
+
 	if (fakechroot_path != NULL)
         snprintf(dir, FAKECHROOT_MAXPATH, "%s%s", fakechroot_path, full_path);
     else
         snprintf(dir, FAKECHROOT_MAXPATH, "%s", full_path);
 
-#if defined(HAVE___XSTAT) && defined(_STAT_VER)
-    if ((status = NEXTCALL(__xstat)(_STAT_VER, dir, &sb)) != 0)
-        return status;
-#else
     if ((status = next_stat(dir, &sb)) != 0)
         return status;
-#endif
 
     if ((sb.st_mode & S_IFMT) != S_IFDIR)
         return ENOTDIR;
@@ -101,9 +103,17 @@ int chroot(const char *path)
 		}
 	}
 
+	/* setenv()/putenv() wrappers refresh the configuration snapshot */
 #if defined(HAVE_SETENV)
+	if (lower[0] != '\0')
+		setenv("FAKECHROOT_LOWER", lower, 1);
 	setenv("FAKECHROOT_BASE", dir, 1);
 #else
+	if (lower[0] != '\0') {
+		envbuf = malloc(FAKECHROOT_MAXPATH+17);
+		snprintf(envbuf, FAKECHROOT_MAXPATH+17, "FAKECHROOT_LOWER=%s", lower);
+		putenv(envbuf);
+	}
 	envbuf = malloc(FAKECHROOT_MAXPATH+16);
 	snprintf(envbuf, FAKECHROOT_MAXPATH+16, "FAKECHROOT_BASE=%s", dir);
 	putenv(envbuf);
@@ -136,5 +146,5 @@ int chroot(const char *path)
 	return 0;
 }
 
-DECLARE_WRAPPER(chroot);
+DECLARE_WRAPPER_FLAGS(chroot, FCHR_WRAPPER_KEEP);
 
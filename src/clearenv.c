@@ -20,27 +20,24 @@
  */
 
 /*
- * getwd() call wrapper
+ * clearenv() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE_GETWD
-/* #include <unistd.h> */
-char *getwd(char *buf)
+#ifdef HAVE_CLEARENV
+/* #include <stdlib.h> */
+int clearenv(void)
 {
-	char *cwd;
-	 
+	int ret = NEXTCALL(clearenv)();
 
-	if ((cwd = NEXTCALL(getwd)(buf)) == NULL)
-		return NULL;
+	if (ret == 0)
+		fchr_config_refresh();
 
-	narrow_chroot_path(cwd);
-	return cwd;
+	return ret;
 }
 
-DECLARE_WRAPPER(getwd);
-
+DECLARE_WRAPPER_FLAGS(clearenv, FCHR_WRAPPER_KEEP);
 #endif
@@ -20,25 +20,22 @@
  */
 
 /*
- * lchmod() call wrapper
+ * closedir() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE_LCHMOD
-/* #include <sys/types.h> */
-/* #include <sys/stat.h> */
-int lchmod(const char *path, mode_t mode)
+#ifdef HAVE_CLOSEDIR
+/* #include <dirent.h> */
+int closedir(DIR *dir)
 {
-	 
+	if (__atomic_load_n(&fchr_overlay_dirs, __ATOMIC_RELAXED) == 0)
+		return NEXTCALL(closedir)(dir);
 
-	expand_chroot_path(path);
-
-	return NEXTCALL(lchmod)(path, mode);
+	return fchr_overlay_closedir(dir);
 }
-DECLARE_WRAPPER(lchmod)
+DECLARE_WRAPPER(closedir)
 
 #endif
-
@@ -42,6 +42,7 @@
 #include <glob.h>
 #include <utime.h>
 #include <elf.h>
+#include <pthread.h>
 #ifdef HAVE_FTS_H
 #include <fts.h>
 #endif
@@ -68,9 +69,22 @@
 extern unsigned int fchr_opts;
 #define OPT_DEBUG    0x00000001
 #define OPT_LOAD_NOW 0x00000002
-#define OPT_LIST_WRAPPERS 0x00000003
+#define OPT_LIST_WRAPPERS 0x00000004
+#define OPT_STATS    0x00000008
+#define OPT_KERNEL_RESOLVE 0x00000010
+#define OPT_NO_OPENAT2 0x00000020
+#define OPT_NEGCACHE 0x00000040
+#define OPT_STATCACHE 0x00000080
+#define OPT_INDEX    0x00000100	/* FAKECHROOT_INDEX mapped */
+#define OPT_RAW_SYSCALL 0x00000200
+#define OPT_SECCOMP  0x00000400
+#define OPT_EXECPLAN 0x00000800
+#define OPT_DCACHE   0x00001000
 #define OPT_TRANSP   0x80000000
 
+/* the caches with a table set up by fakechroot_init() */
+#define OPT_CACHES (OPT_NEGCACHE | OPT_STATCACHE | OPT_EXECPLAN)
+
 #define FCHR_OPT_ENV "FAKECHROOT_OPTS"
 
 #define dprintf(fmt, args...) \
@@ -85,12 +99,160 @@ extern unsigned int fchr_opts;
 struct magic_struct {
 	const char *arch;
 	unsigned short mach; /* see EM_* constants from elf.h */
+	unsigned char elf_class; /* ELFCLASS* */
+	unsigned char elf_data; /* ELFDATA* */
+};
+
+/* what a program turned out to be, see fchr_probe() */
+enum {
+	FCHR_EXEC_BINARY = 1,
+	FCHR_EXEC_STATIC,			/* ELF of our machine without PT_INTERP */
+	FCHR_EXEC_SCRIPT
 };
 
+#define FCHR_PROBE_SIZE 256		/* the kernel's BINPRM_BUF_SIZE */
+#define FCHR_PROBE_STAT 0x1		/* fill in st as well */
+
+/* the first bytes of a program or library, see lib-cross.c */
+struct fchr_probe {
+	int kind;					/* FCHR_EXEC_* */
+	unsigned char elf_class;	/* ELFCLASS*, ELFCLASSNONE if no ELF file */
+	unsigned char elf_data;		/* ELFDATA* */
+	unsigned short machine;		/* EM_*, in host byte order */
+	size_t len;					/* read into head */
+	size_t line_len;			/* the "#!" line of a script */
+	struct stat st;				/* fstat() after the read, if asked for */
+	char head[FCHR_PROBE_SIZE];
+};
+
+int fchr_probe(const char *path, int flags, struct fchr_probe *p);
+int fchr_probe_ours(const struct fchr_probe *p);
+int fchr_elf_arch(const struct fchr_probe *p);
+int fchr_elf_native(const struct fchr_probe *p);
+int fchr_arch_find(const char *arch);
+const char *fchr_arch_name(int arch);
 int is_our_elf(const char *file);
+int cross_find(const char *cross, const char *arch);
+
+/* mount table, see lib-mount.c */
+struct fchr_mount {
+	const char *guest;			/* not terminated */
+	size_t guest_len;
+	const char *host;			/* same as guest for passthrough entries */
+	size_t host_len;
+	int passthrough;
+};
+
+struct fchr_mounts;
+
+const struct fchr_mounts *fchr_mounts_build(const char *list, const char *file);
+const struct fchr_mounts *fchr_mounts_load(const void *image, size_t size);
+const void *fchr_mounts_image(const struct fchr_mounts *m, size_t *size);
+int fchr_mounts_current(const struct fchr_mounts *m, const char *file);
+void fchr_mounts_free(const struct fchr_mounts *m);
+const struct fchr_mount *fchr_mount_lookup(const struct fchr_mounts *m,
+		const char *path, size_t *len, struct fchr_mount *e);
+int fchr_mount_narrow(const struct fchr_mounts *m, char *path);
+
+/*
+ * Configuration snapshot: FAKECHROOT_BASE, FAKECHROOT_LOWER and the usable
+ * FAKECHROOT_CROSS with their lengths, and the mount table.  A published
+ * snapshot is never modified, so wrappers may use it without locking;
+ * chroot() and the
+ * environment wrappers publish a fresh one through fchr_config_refresh()
+ * whenever one of the variables changes.
+ */
+struct fchr_config {
+	unsigned int generation;	/* bumped for every new snapshot */
+	const char *root;
+	size_t root_len;
+	const char *cross;
+	size_t cross_len;
+	int cross_arch;				/* see cross_find(), -1 without cross */
+	int root_fd;				/* O_PATH descriptor of root, see fchr_root_fd() */
+	const struct fchr_mounts *mounts;	/* NULL when there are none */
+	const char *lower;			/* read-only overlay layer below root, or NULL */
+	size_t lower_len;
+};
+
+extern const struct fchr_config *fchr_config;
+
+/* the variables of fchr_config_vars[], in order */
+enum {
+	FCHR_VAR_BASE,
+	FCHR_VAR_LOWER,
+	FCHR_VAR_CROSS,
+	FCHR_VAR_CROSS_ARCH,
+	FCHR_VAR_MOUNTS,
+	FCHR_VAR_MOUNTS_FILE,
+	FCHR_VAR_IMMUTABLE,
+	FCHR_VAR_HOSTTOOLS,
+	FCHR_VAR_ARCH_RULES,
+	FCHR_VARS
+};
+
+extern const char *const fchr_config_vars[];
+
+const struct fchr_config *fchr_config_init(void);
+const struct fchr_config *fchr_config_refresh(void);
+void fchr_config_make(const char *const val[], struct fchr_config *c);
+const struct fchr_config *fchr_config_publish(const struct fchr_config *d);
+int fchr_config_var(const char *name);
+unsigned int fchr_opts_parse(const char *s);
+
+/* session blob inherited across exec, see lib-session.c */
+void fchr_session_update(const char *const val[], const struct fchr_config *c);
+int fchr_session_attach(void);
+unsigned int fchr_session_opts(void);
+char *const *fchr_session_env(char *const envp[]);
+
+static inline const struct fchr_config *fchr_conf(void)
+{
+	const struct fchr_config *c = __atomic_load_n(&fchr_config, __ATOMIC_ACQUIRE);
+
+	/* wrappers may run before our constructor */
+	return c ? c : fchr_config_init();
+}
+
+/* prefix matching, see lib-prefix.c */
+int fchr_prefix_match(const char *path, const char *prefix, size_t len);
+
+/* path is the fake root itself or lies below it */
+static inline int fchr_in_root(const char *path, const struct fchr_config *c)
+{
+	return c->root != NULL &&
+		fchr_prefix_match(path, c->root, c->root_len) &&
+		(path[c->root_len] == '/' || path[c->root_len] == '\0');
+}
+
+/* host path outside the root back to its guest path, see lib-path.c */
+int fchr_narrow_host(const struct fchr_config *c, char *path);
+
+#define fakechroot_path (fchr_conf()->root)
+#define fakechroot_cross (fchr_conf()->cross)
+
+/*
+ * Reentrancy guard.  While a wrapper lets libc work on host paths it has
+ * translated already, calls which come back into our wrappers from libc,
+ * NSS modules or other preloaded libraries leave their paths alone.
+ */
+extern __thread unsigned int fchr_nested __attribute__((tls_model("initial-exec")));
 
-extern const char *fakechroot_path;
-extern const char *fakechroot_cross;
+#define fchr_direct(call) \
+	({ \
+		__typeof__(call) fakechroot_ret; \
+		fchr_nested++; \
+		fakechroot_ret = (call); \
+		fchr_nested--; \
+		fakechroot_ret; \
+	})
+
+/* libc's glob() with the program's callbacks run un-nested, see lib-glob.c */
+int fchr_glob_next(const char *pattern, int flags,
+		int (*errfunc)(const char *, int), void *pglob, int large, int altdir);
+
+/* The calling thread's table of a cache, see lib-main.c */
+void *fchr_thread_table(void **slot, size_t size, void *initial);
 
 #define track_mknod(path, mode, dev) \
 	do { \
@@ -121,100 +283,392 @@ extern const char *fakechroot_cross;
 
 #define cross_subst(path, origpath) \
 	do { \
-		if (fakechroot_cross) { \
+		const struct fchr_config *fakechroot_conf = fchr_conf(); \
+		if (fakechroot_conf->cross) { \
 			snprintf(path, FAKECHROOT_MAXPATH, "%s/%s", \
-					fakechroot_cross, origpath); \
+					fakechroot_conf->cross, origpath); \
 		} else \
 			strncpy(path, origpath, FAKECHROOT_MAXPATH); \
 	} while (0)
 
-            /*fakechroot_path = getenv("FAKECHROOT_BASE"); \*/
 #define narrow_chroot_path(path) \
     { \
-		char *fakechroot_ptr; \
-        if ((path) != NULL && *((char *)(path)) != '\0') { \
-            fakechroot_path = getenv("FAKECHROOT_BASE"); \
-            if (fakechroot_path != NULL) { \
-                fakechroot_ptr = strstr((path), fakechroot_path); \
-                if (fakechroot_ptr == (path)) { \
-                    if (strlen((path)) == strlen(fakechroot_path)) { \
-                        ((char *)(path))[0] = '/'; \
-                        ((char *)(path))[1] = '\0'; \
-                    } else { \
-                        (path) = ((path) + strlen(fakechroot_path)); \
-                    } \
+		const struct fchr_config *fakechroot_conf = fchr_conf(); \
+        if ((path) != NULL && *((char *)(path)) != '\0' && !fchr_nested) { \
+            if (fchr_in_root((path), fakechroot_conf)) { \
+                if (((char *)(path))[fakechroot_conf->root_len] == '\0') { \
+                    ((char *)(path))[0] = '/'; \
+                    ((char *)(path))[1] = '\0'; \
+                } else { \
+                    (path) = ((path) + fakechroot_conf->root_len); \
                 } \
-            } \
+            } else \
+                fchr_narrow_host(fakechroot_conf, (char *)(path)); \
         } \
-		dprintf("### narrow(%s): path=%s fpath=%s\n", __FUNCTION__, path, fakechroot_path); \
+		dprintf("### narrow(%s): path=%s fpath=%s\n", __FUNCTION__, path, fakechroot_conf->root); \
     }
 
 #define narrow_chroot_path_modify(path) \
     { \
-		char *fakechroot_ptr; \
-        if ((path) != NULL && *((char *)(path)) != '\0') { \
-			int l1, l2; \
-            fakechroot_path = getenv("FAKECHROOT_BASE"); \
-			if (fakechroot_path != NULL) { \
-				l1 = strlen(fakechroot_path); \
-                fakechroot_ptr = strstr((path), fakechroot_path); \
-                if (fakechroot_ptr == (path)) { \
-                    if ((l2 = strlen((path))) == l1) { \
-                        ((char *)(path))[0] = '/'; \
-                        ((char *)(path))[1] = '\0'; \
-                    } else { \
-                        memmove((path), ((path) + l1), l2 - l1 + 1); \
-                    } \
+		const struct fchr_config *fakechroot_conf = fchr_conf(); \
+        if ((path) != NULL && *((char *)(path)) != '\0' && !fchr_nested) { \
+			size_t l1 = fakechroot_conf->root_len; \
+            if (fchr_in_root((path), fakechroot_conf)) { \
+                if (((char *)(path))[l1] == '\0') { \
+                    ((char *)(path))[0] = '/'; \
+                    ((char *)(path))[1] = '\0'; \
+                } else { \
+                    memmove((path), ((path) + l1), strlen((path) + l1) + 1); \
                 } \
-            } \
+            } else \
+                fchr_narrow_host(fakechroot_conf, (char *)(path)); \
         } \
-		dprintf("### mnarrow(%s): path=%s fpath=%s\n", __FUNCTION__, path, fakechroot_path); \
+		dprintf("### mnarrow(%s): path=%s fpath=%s\n", __FUNCTION__, path, fakechroot_conf->root); \
     }
 
-#if 0
-#define expand_chroot_path(path, fakechroot_buf) \
-    { \
-		char *fakechroot_ptr; \
-        if ((path) != NULL && *((char *)(path)) == '/') { \
-            fakechroot_path = getenv("FAKECHROOT_BASE"); \
-            if (fakechroot_path != NULL) { \
-                fakechroot_ptr = strstr((path), fakechroot_path); \
-                if (fakechroot_ptr != (path)) { \
-                    strcpy(fakechroot_buf, fakechroot_path); \
-                    strcat(fakechroot_buf, (path)); \
-                    (path) = fakechroot_buf; \
-                } \
-            } \
-        } \
-    }
-	//dprintf("### expanded(%s): path=%s fpath=%s\n", __FUNCTION__, path, fakechroot_path); \
+/* guest to host translation cache, see lib-pathcache.c */
+unsigned int fchr_pathcache_hash(const char *path, size_t *len);
+int fchr_pathcache_lookup(const char *path, size_t len, unsigned int hash,
+		unsigned int generation, char *buf);
+void fchr_pathcache_store(const char *path, size_t len, unsigned int hash,
+		unsigned int generation, const char *host);
+void fchr_pathcache_stats(void);
+
+/* tables shared by the process tree, see lib-negcache.c */
+#define FCHR_SHARED_MAGIC 8
+void *fchr_shared_table(const char *env, const char *name, size_t size,
+		const char *magic, int *made);
+
+/* negative lookup cache, see lib-negcache.c */
+int fchr_negcache_init(void);
+int fchr_negcache_lookup(const char *path, int nofollow);
+void fchr_negcache_store(const char *path, int nofollow);
+void fchr_negcache_invalidate(void);
+void fchr_negcache_stats(void);
+
+/* path is known to be missing: fail the lookup with ENOENT */
+static inline int fchr_negcache_hit(const char *path, int nofollow)
+{
+	return (fchr_opts & OPT_NEGCACHE) && fchr_negcache_lookup(path, !!nofollow);
+}
+
+/* pass the result of the lookup of path on, remembering a missing name */
+static inline int fchr_negcache_note(const char *path, int nofollow, int ret)
+{
+	if (ret == -1 && errno == ENOENT && (fchr_opts & OPT_NEGCACHE))
+		fchr_negcache_store(path, !!nofollow);
+	return ret;
+}
+
+/* pass the result of a call which makes a name on, which stales the cache */
+static inline int fchr_negcache_made(int ret)
+{
+	if (ret != -1 && (fchr_opts & OPT_NEGCACHE))
+		fchr_negcache_invalidate();
+	return ret;
+}
+
+/* the same for an open() of path with flags, which may do either */
+static inline int fchr_negcache_opened(const char *path, int flags, int fd)
+{
+	return (flags & O_CREAT) ? fchr_negcache_made(fd) :
+		fchr_negcache_note(path, flags & O_NOFOLLOW, fd);
+}
+
+/*
+ * Argument vectors the exec wrappers build: up to FCHR_ARGV_STACK entries
+ * in the caller's array, more in a single allocation of the size needed,
+ * which fchr_argv_free() releases should the exec fail.
+ */
+#define FCHR_ARGV_STACK 256
+
+static inline const char **fchr_argv_alloc(const char **stack, size_t n)
+{
+	return n <= FCHR_ARGV_STACK ? stack : malloc(n * sizeof(*stack));
+}
+
+static inline void fchr_argv_free(const char **argv, const char **stack)
+{
+	int saved_errno = errno;
+
+	if (argv != stack)
+		free(argv);
+	errno = saved_errno;
+}
+
+/* what execve() found programs to be, see lib-execplan.c */
+int fchr_execplan_init(void);
+int fchr_execplan_lookup(const char *path, struct fchr_probe *p);
+void fchr_execplan_store(const char *path, const struct fchr_probe *p);
+void fchr_execplan_stats(void);
+
+/* host programs run in place of guest ones, see lib-hosttool.c */
+struct fchr_hosttool {
+	const char *host;
+	char *const *args;			/* put in front of the caller's */
+	int nargs;
+};
+
+const struct fchr_hosttool *fchr_hosttool_find(const char *path);
+
+/* how execve() runs binaries of an architecture */
+enum {
+	FCHR_RUN_LOADER,			/* the way of the cross tree, the default */
+	FCHR_RUN_NATIVE,			/* handed to the kernel as they are */
+	FCHR_RUN_EMULATOR			/* by a user mode emulator */
+};
+
+int fchr_hosttool_rule(int arch, const struct fchr_hosttool **emulator);
+int fchr_hosttool_rules(void);
+
+/* stat result cache for immutable trees, see lib-statcache.c */
+enum {
+	FCHR_STATCACHE_STAT = 1,
+	FCHR_STATCACHE_LSTAT,
+	FCHR_STATCACHE_STAT64,
+	FCHR_STATCACHE_LSTAT64,
+	FCHR_STATCACHE_ACCESS,
+	FCHR_STATCACHE_EACCESS
+};
+
+int fchr_statcache_init(void);
+int fchr_statcache_get(int kind, const char *path, int arg, void *buf);
+void fchr_statcache_put(int kind, const char *path, int arg, const void *buf,
+		int ret);
+void fchr_statcache_stats(void);
+
+/* sysroot manifest, see lib-index.c */
+int fchr_index_init(void);
+int fchr_index_lstat(const char *path, struct stat *st);
+ssize_t fchr_index_readlink(const char *path, char *buf, size_t size);
+int fchr_index_stat(int kind, const char *path, int arg);
+int fchr_index_elf(const char *path, struct fchr_probe *p);
+int fchr_index_scandir(const char *dir, void ***namelist,
+		int (*filter)(const void *),
+		int (*compar)(const void *, const void *), int large);
+int fchr_index_glob(const char *pattern, int flags,
+		int (*errfunc)(const char *, int), void *pglob, int large);
+void fchr_index_stats(void);
+
+/*
+ * Result of call, the stat or access call kind with arg on the host path
+ * path filling in buf, taken from the sysroot manifest or from the stat
+ * cache when path lies inside an immutable tree.
+ */
+#define fchr_statcache(kind, path, arg, buf, call) \
+	({ \
+		int fakechroot_ret = (fchr_opts & (OPT_STATCACHE | OPT_INDEX)) ? \
+			fchr_statcache_get((kind), (path), (arg), (buf)) : FCHR_FALLBACK; \
+		if (fakechroot_ret == FCHR_FALLBACK) { \
+			fakechroot_ret = (call); \
+			if (fchr_opts & OPT_STATCACHE) \
+				fchr_statcache_put((kind), (path), (arg), (buf), \
+						fakechroot_ret); \
+		} \
+		fakechroot_ret; \
+	})
+
+/*
+ * Path expansion writes into a FAKECHROOT_PATHBUF sized buffer which
+ * expand_chroot_path() declares on the wrapper's own stack, so the
+ * translated path lives exactly as long as the wrapper call and no
+ * heap allocation is made.  Each path argument gets a buffer of its own,
+ * named after the argument.
+ */
+#define FAKECHROOT_PATHBUF (FAKECHROOT_MAXPATH + 1)
+
+char *fakechroot_expand(const char *path, char *buf);
+char *fchr_translate(const char *path, size_t plen, char *buf,
+		const struct fchr_config *c);
 
-#else
 #define expand_chroot_path(path) \
-	expand_chroot_path_malloc(path)
-#endif
+	char fakechroot_buf_ ## path[FAKECHROOT_PATHBUF]; \
+	(path) = fakechroot_expand((path), fakechroot_buf_ ## path)
 
+/* same, for paths which must outlive the wrapper; caller frees if changed */
 #define expand_chroot_path_malloc(path) \
-    { \
-		char *fakechroot_buf, *fakechroot_ptr; \
-        if ((path) != NULL && *((char *)(path)) == '/') { \
-            fakechroot_path = getenv("FAKECHROOT_BASE"); \
-            if (fakechroot_path != NULL) { \
-                fakechroot_ptr = strstr((path), fakechroot_path); \
-                if (fakechroot_ptr != (path)) { \
-                    if ((fakechroot_buf = malloc(strlen(fakechroot_path)+strlen(path)+1)) == NULL) { \
-                        errno = ENOMEM; \
-                        return NULL; \
-                    } \
-                    strcpy(fakechroot_buf, fakechroot_path); \
-                    strcat(fakechroot_buf, (path)); \
-                    (path) = fakechroot_buf; \
-                } \
-            } \
-        } \
-    }
+	{ \
+		char fakechroot_buf[FAKECHROOT_PATHBUF]; \
+		if (fakechroot_expand((path), fakechroot_buf) == fakechroot_buf) \
+			(path) = strdup(fakechroot_buf); \
+	}
+
+/*
+ * Symlink aware expansion, see lib-resolve.c: links are followed inside
+ * the fake root, so neither absolute targets nor ".." lead out of it.
+ */
+#define FCHR_RESOLVE_NOFOLLOW 0x1	/* leave a trailing symlink alone */
+#define FCHR_RESOLVE_EXISTING 0x2	/* every component must exist */
+
+char *fchr_resolve(const char *path, char *buf, int flags);
+char *fakechroot_resolve(const char *path, char *buf, int flags);
+
+/* wrappers which remove or rename names drop the cached dentries */
+void fchr_dcache_invalidate(void);
+void fchr_dcache_stats(void);
+
+#define resolve_chroot_path(path, flags) \
+	char fakechroot_buf_ ## path[FAKECHROOT_PATHBUF]; \
+	(path) = fakechroot_resolve((path), fakechroot_buf_ ## path, (flags))
+
+/*
+ * A blocking system call made by hand, as the cancellation point the libc
+ * function it replaces is: with asynchronous cancellation enabled around
+ * it, which is what libc itself did before it grew its own cancellation
+ * syscalls.  Not while the process has a single thread, which nobody
+ * could cancel.
+ */
+#if defined(__has_include)
+#if __has_include(<sys/single_threaded.h>)
+#include <sys/single_threaded.h>
+#define fchr_single_threaded() __libc_single_threaded
+#endif
+#endif
+#ifndef fchr_single_threaded
+#define fchr_single_threaded() 0
+#endif
+
+#define fchr_cancellable(call) \
+	({ \
+		__typeof__(call) fakechroot_ret; \
+		int fakechroot_type; \
+		if (fchr_single_threaded()) \
+			fakechroot_ret = (call); \
+		else { \
+			pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &fakechroot_type); \
+			fakechroot_ret = (call); \
+			pthread_setcanceltype(fakechroot_type, &fakechroot_type); \
+		} \
+		fakechroot_ret; \
+	})
+
+/* openat2(RESOLVE_IN_ROOT) backend, see lib-openat2.c */
+#define FCHR_FALLBACK (-2)			/* translate the path as usual */
+#define FCHR_LOOKUP_NOFOLLOW 0x1
+#define FCHR_LOOKUP_ACCESS   0x2
+
+#define FCHR_ROOT_FD_UNSET (-2)		/* root_fd not opened yet */
+int fchr_root_fd_init(const char *root, size_t root_len,
+		const struct fchr_config *old);
+int fchr_root_fd(const struct fchr_config *c);
+int fchr_kernel_open(const char *path, int flags, mode_t mode);
+int fchr_kernel_lookup(const char *path, int flags);
+
+/*
+ * With the kernel backend in use for path, run call, an *at() call on the
+ * O_PATH descriptor fakechroot_fd of path, and return its result from the
+ * wrapper; otherwise do nothing.
+ */
+#define lookup_in_root(path, flags, call) \
+	do { \
+		int fakechroot_fd = fchr_kernel_lookup((path), (flags)); \
+		if (fakechroot_fd != FCHR_FALLBACK) { \
+			int fakechroot_ret = -1, fakechroot_errno; \
+			if (fakechroot_fd >= 0) { \
+				fakechroot_ret = (call); \
+				fakechroot_errno = errno; \
+				close(fakechroot_fd); \
+				errno = fakechroot_errno; \
+			} \
+			return fchr_negcache_note((path), \
+					(flags) & FCHR_LOOKUP_NOFOLLOW, fakechroot_ret); \
+		} \
+	} while (0)
+
+/* raw system calls instead of the next definitions, see lib-syscall.c */
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define FAKECHROOT_RAW_SYSCALL 1
+
+int fchr_raw_faccessat(int dirfd, const char *path, int mode);
+int fchr_raw_mkdirat(int dirfd, const char *path, mode_t mode);
+int fchr_raw_fchmodat(int dirfd, const char *path, mode_t mode);
+int fchr_raw_fchownat(int dirfd, const char *path, uid_t owner, gid_t group,
+		int flags);
+int fchr_raw_unlinkat(int dirfd, const char *path, int flags);
+int fchr_raw_fstatat(int dirfd, const char *path, struct stat *buf, int flags);
+int fchr_raw_fxstatat(int ver, int dirfd, const char *path, struct stat *buf,
+		int flags);
+int fchr_raw_openat(int dirfd, const char *path, int flags, mode_t mode);
+#endif
+
+/* supervisor for static programs, see lib-seccomp.c */
+#if defined(FAKECHROOT_RAW_SYSCALL) && defined(HAVE_LINUX_SECCOMP_H)
+#include <linux/seccomp.h>
+#ifdef SECCOMP_IOCTL_NOTIF_ADDFD
+#define FAKECHROOT_SECCOMP 1
+
+int fchr_seccomp_execve(const char *filename, char *const argv[],
+		char *const envp[]);
+#endif
+#endif
+
+/*
+ * *at() variants: a relative path is taken relative to dirfd, which the
+ * overlay can not see into, so it is only translated for AT_FDCWD.
+ */
+static inline int fchr_at_cwd(int dirfd, const char *path)
+{
+	return dirfd == AT_FDCWD || path == NULL || *path == '/';
+}
+
+#define expand_chroot_path_at(dirfd, path) \
+	char fakechroot_buf_ ## path[FAKECHROOT_PATHBUF]; \
+	(path) = fchr_at_cwd((dirfd), (path)) ? \
+		fakechroot_expand((path), fakechroot_buf_ ## path) : (char *)(path)
+
+#define resolve_chroot_path_at(dirfd, path, flags) \
+	char fakechroot_buf_ ## path[FAKECHROOT_PATHBUF]; \
+	(path) = fchr_at_cwd((dirfd), (path)) ? \
+		fakechroot_resolve((path), fakechroot_buf_ ## path, (flags)) : (char *)(path)
+
+/* copy-on-write overlay, see lib-overlay.c */
+#define fchr_overlay(c) ((c)->lower != NULL)
+
+#define FCHR_UPPER_NEW   0x1		/* the call may create the name */
+#define FCHR_UPPER_EXCL  0x2		/* ... and fails if it exists */
+#define FCHR_UPPER_COPY  0x4		/* the call changes an existing name */
+#define FCHR_UPPER_TRUNC 0x8		/* ... and discards its contents */
+#define FCHR_UPPER_NOFOLLOW 0x10	/* the call does not follow a trailing symlink */
+
+/* FCHR_UPPER_NOFOLLOW from the flags of a *at() call */
+#define fchr_at_nofollow(flags) \
+	((flags) & AT_SYMLINK_NOFOLLOW ? FCHR_UPPER_NOFOLLOW : 0)
+
+char *fchr_overlay_lookup(const char *path, size_t plen, char *buf,
+		const struct fchr_config *c);
+char *fchr_overlay_abs(const char *path, char *buf);
+char *fakechroot_upper(const char *path, char *buf, int how);
+int fchr_overlay_open_how(int flags);
+int fchr_overlay_fopen_how(const char *mode);
+int fchr_overlay_remove(const char *path, int flags);
+int fchr_overlay_rename(const char *oldpath, const char *newpath);
+int fchr_overlay_chroot(const char *path, char *lower);
+
+DIR *fchr_overlay_opendir(const char *name);
+struct dirent *fchr_overlay_readdir(DIR *dir);
+#ifdef HAVE_READDIR64
+struct dirent64 *fchr_overlay_readdir64(DIR *dir);
+#endif
+int fchr_overlay_closedir(DIR *dir);
+void fchr_overlay_rewinddir(DIR *dir);
+int fchr_overlay_scandir(const char *dir, void ***namelist,
+		int (*filter)(const void *),
+		int (*compar)(const void *, const void *), int large);
+int fchr_overlay_glob(const char *pattern, int flags,
+		int (*errfunc)(const char *, int), void *pglob, int large);
+
+/* merged directory streams open, so readdir() can skip the lookup */
+extern unsigned int fchr_overlay_dirs;
+
+/* prepare path for a call which changes it: the upper layer's host path */
+#define upper_chroot_path(path, how) \
+	char fakechroot_buf_ ## path[FAKECHROOT_PATHBUF]; \
+	(path) = fakechroot_upper((path), fakechroot_buf_ ## path, (how))
 
-	//dprintf("### mexpanded(%s): path=%s fpath=%s\n", __FUNCTION__, path, fakechroot_path); \
+#define upper_chroot_path_at(dirfd, path, how) \
+	char fakechroot_buf_ ## path[FAKECHROOT_PATHBUF]; \
+	(path) = fchr_at_cwd((dirfd), (path)) ? \
+		fakechroot_upper((path), fakechroot_buf_ ## path, (how)) : (char *)(path)
 
 #endif
 
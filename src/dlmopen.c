@@ -33,8 +33,8 @@ void *dlmopen(Lmid_t nsid, const char *filename, int flag)
 {
 	 
 
-	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(filename));
 	expand_chroot_path(filename);
+	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(filename));
 
 	return NEXTCALL(dlmopen)(nsid, filename, flag);
 }
@@ -32,10 +32,10 @@ void *dlopen(const char *filename, int flag)
 {
 	 
 
-	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(filename));
 	expand_chroot_path(filename);
+	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(filename));
 
-	if (getenv("FAKECHROOT_BASE")) {
+	if (fakechroot_path) {
 		char newpath[FAKECHROOT_MAXPATH];
 
 		narrow_chroot_path(filename);
@@ -25,43 +25,38 @@
 
 #include "common.h"
 #include "wrapper.h"
+#include "proto.h"
 
 #ifdef HAVE_EXECL
 
 /* #include <unistd.h> */
 int execl(const char *path, const char *arg, ...)
 {
-	size_t argv_max = 1024;
-	const char **argv = alloca(argv_max * sizeof(const char *));
-	unsigned int i;
+	const char *stack[FCHR_ARGV_STACK], **argv, *a;
+	size_t i, n;
 	va_list args;
+	int ret;
 
-	argv[0] = arg;
-
-	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(path));
+	/* counted first, for a vector of the right size with its NULL */
 	va_start(args, arg);
-	i = 0;
-	while (argv[i++] != NULL) {
-		if (i == argv_max) {
-			const char **nptr;
-			
-			nptr = alloca((argv_max *= 2) * sizeof(const char *));
-			if ((char *) argv + i == (char *) nptr)
-				/* Stack grows up.  */
-				argv_max += i;
-			else
-				/* We have a hole in the stack.  */
-				argv = (const char **) memcpy(nptr, argv,
-						i * sizeof(const char *));
-		}
+	for (n = 1, a = arg; a != NULL; n++)
+		a = va_arg(args, const char *);
+	va_end(args);
+	if ((argv = fchr_argv_alloc(stack, n)) == NULL)
+		return -1;
 
+	va_start(args, arg);
+	argv[0] = arg;
+	for (i = 1; i < n; i++)
 		argv[i] = va_arg(args, const char *);
-	}
 	va_end(args);
 
-	return execve(path, (char *const *) argv, environ);
+	ret = execve(path, (char *const *) argv, environ);
+	fchr_argv_free(argv, stack);
+
+	return ret;
 }
 
-DECLARE_WRAPPER(execl);
+DECLARE_WRAPPER_FLAGS(execl, FCHR_WRAPPER_KEEP);
 
 #endif /* HAVE_EXECL */
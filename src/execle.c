@@ -25,45 +25,40 @@
 
 #include "common.h"
 #include "wrapper.h"
+#include "proto.h"
 
 #ifdef HAVE_EXECLE
 
 /* #include <unistd.h> */
 int execle(const char *path, const char *arg, ...)
 {
-	size_t argv_max = 1024;
-	const char **argv = alloca(argv_max * sizeof(const char *));
+	const char *stack[FCHR_ARGV_STACK], **argv, *a;
 	const char *const *envp;
-	unsigned int i;
+	size_t i, n;
 	va_list args;
-	argv[0] = arg;
+	int ret;
 
-	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(path));
+	/* counted first, for a vector of the right size with its NULL */
 	va_start(args, arg);
-	i = 0;
-	while (argv[i++] != NULL) {
-		if (i == argv_max) {
-			const char **nptr;
-			
-			nptr = alloca((argv_max *= 2) * sizeof(const char *));
-			if ((char *) argv + i == (char *) nptr)
-				/* Stack grows up.  */
-				argv_max += i;
-			else
-				/* We have a hole in the stack.  */
-				argv = (const char **) memcpy(nptr, argv,
-						i * sizeof(const char *));
-		}
+	for (n = 1, a = arg; a != NULL; n++)
+		a = va_arg(args, const char *);
+	va_end(args);
+	if ((argv = fchr_argv_alloc(stack, n)) == NULL)
+		return -1;
 
+	va_start(args, arg);
+	argv[0] = arg;
+	for (i = 1; i < n; i++)
 		argv[i] = va_arg(args, const char *);
-	}
-
 	envp = va_arg(args, const char *const *);
 	va_end(args);
 
-	return execve(path, (char *const *) argv, (char *const *) envp);
+	ret = execve(path, (char *const *) argv, (char *const *) envp);
+	fchr_argv_free(argv, stack);
+
+	return ret;
 }
 
-DECLARE_WRAPPER(execle);
+DECLARE_WRAPPER_FLAGS(execle, FCHR_WRAPPER_KEEP);
 
 #endif /* HAVE_EXECLE */
@@ -32,44 +32,37 @@
 /* #include <unistd.h> */
 int execlp(const char *file, const char *arg, ...)
 {
-	size_t argv_max = 1024;
-	const char **argv = alloca(argv_max * sizeof(const char *));
-	unsigned int i;
+	const char *stack[FCHR_ARGV_STACK], **argv, *a;
+	size_t i, n;
 	va_list args;
-	 
+	int ret;
 
 	dprintf("### %s\n", __FUNCTION__);
 
-	argv[0] = arg;
-
+	/* counted first, for a vector of the right size with its NULL */
 	va_start(args, arg);
-	i = 0;
-	while (argv[i++] != NULL) {
-		if (i == argv_max) {
-			const char **nptr;
-			
-			nptr = alloca((argv_max *= 2) * sizeof(const char *));
-			if ((char *) argv + i == (char *) nptr)
-				/* Stack grows up.  */
-				argv_max += i;
-			else
-				/* We have a hole in the stack.  */
-				argv = (const char **) memcpy(nptr, argv,
-						i * sizeof(const char *));
-		}
+	for (n = 1, a = arg; a != NULL; n++)
+		a = va_arg(args, const char *);
+	va_end(args);
+	if ((argv = fchr_argv_alloc(stack, n)) == NULL)
+		return -1;
 
+	va_start(args, arg);
+	argv[0] = arg;
+	for (i = 1; i < n; i++)
 		argv[i] = va_arg(args, const char *);
-	}
 	va_end(args);
 
 //	expand_chroot_path(file);
-	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(file));
 
 //	return NEXTCALL(execvp)(file, (char *const *) argv);
-	return execvp(file, (char *const *) argv);
+	ret = execvp(file, (char *const *) argv);
+	fchr_argv_free(argv, stack);
+
+	return ret;
 }
 
-DECLARE_WRAPPER(execlp);
+DECLARE_WRAPPER_FLAGS(execlp, FCHR_WRAPPER_KEEP);
 
 #endif /* HAVE_EXECLP */
 
@@ -25,17 +25,17 @@
 
 #include "common.h"
 #include "wrapper.h"
+#include "proto.h"
 
 #ifdef HAVE_EXECV
 
 /* #include <unistd.h> */
 int execv(const char *path, char *const argv [])
 {
-	dprintf("%s: is_our_elf=%d\n", __FUNCTION__, is_our_elf(path));
 	return execve(path, argv, environ);
 }
 
-DECLARE_WRAPPER(execv);
+DECLARE_WRAPPER_FLAGS(execv, FCHR_WRAPPER_KEEP);
 
 #endif /* HAVE_EXECV */
 
@@ -36,31 +36,37 @@
 #error "Unable to detect runtime linker path"
 #endif
 
-static int execve_call(const char *filename, char *const argv [], char *const envp[])
+/*
+ * Hand filename on to the kernel, through the runtime linker inside a fake
+ * root unless direct is set.
+ */
+static int execve_call(const char *filename, char *const argv [], char *const envp[],
+		int direct)
 {
-	int i;
+	const char *stack[FCHR_ARGV_STACK], **argv_new = NULL;
+	char linker[FAKECHROOT_MAXPATH];
+	char *const *env;
+	size_t n;
+	int i, ret, saved;
 
 	dprintf("execve_call_before: %s", filename);
 	for (i = 0; argv[i]; i++)
 		dprintf(" %s", argv[i]);
 	dprintf("\n");
 	
-	if (!strstr(filename, LINKER) && getenv("FAKECHROOT_BASE") != NULL) {
-		char ** argv_new;
-
-		for (i = 0; argv[i] != NULL; i++);
-		i++;
-		argv_new = calloc(i + 4, sizeof(char *));
-		for (; i >= 0; i--)
-			argv_new[i+3] = argv[i];
-	
-		argv_new[2] = filename;
-		argv_new[1] = "--argv0";
+	if (!direct && !strstr(filename, LINKER) && fakechroot_path != NULL) {
+		/* ld.so --argv0 filename, then argv with its NULL */
+		for (n = 0; argv[n] != NULL; n++);
+		if ((argv_new = fchr_argv_alloc(stack, n + 4)) == NULL)
+			return -1;
 		argv_new[0] = "ld.so";
+		argv_new[1] = "--argv0";
+		argv_new[2] = filename;
+		memcpy(argv_new + 3, argv, (n + 1) * sizeof(*argv));
 
-		argv = argv_new;
-		filename = calloc(FAKECHROOT_MAXPATH+1, 1);
-		cross_subst(filename, LINKER);
+		argv = (char *const *)argv_new;
+		cross_subst(linker, LINKER);
+		filename = linker;
 	}
 
 	dprintf("execve_call: %s", filename);
@@ -68,82 +74,162 @@ static int execve_call(const char *filename, char *const argv [], char *const en
 		dprintf(" %s", argv[i]);
 	dprintf("\n");
 
-	return NEXTCALL(execve)(filename, argv, envp);
+	/* the configuration ready made for the child, see lib-session.c */
+	env = fchr_session_env(envp);
+	ret = NEXTCALL(execve)(filename, argv, env);
+	saved = errno;
+	if (env != envp)
+		free((void *)env);
+	if (argv_new != NULL)
+		fchr_argv_free(argv_new, stack);
+	errno = saved;
+
+	return ret;
+}
+
+/*
+ * Run a host program in place of a guest one, see lib-hosttool.c: with
+ * argv[0] as the caller gave it, the arguments of tool, the nextra words
+ * of extra, then the rest of argv.
+ */
+static int execve_hosttool(const struct fchr_hosttool *tool,
+		const char *const extra[], int nextra,
+		char *const argv[], char *const envp[])
+{
+	const char *stack[FCHR_ARGV_STACK], **newargv;
+	int i, n, k, ret;
+
+	for (n = 0; argv[n] != NULL; n++);
+	if ((newargv = fchr_argv_alloc(stack, n + tool->nargs + nextra + 2)) == NULL)
+		return -1;
+
+	k = 0;
+	newargv[k++] = n ? argv[0] : tool->host;
+	for (i = 0; i < tool->nargs; i++)
+		newargv[k++] = tool->args[i];
+	for (i = 0; i < nextra; i++)
+		newargv[k++] = extra[i];
+	for (i = 1; i < n; i++)
+		newargv[k++] = argv[i];
+	newargv[k] = NULL;
+
+	dprintf("### executing host tool %s\n", tool->host);
+	ret = execve_call(tool->host, (char *const *)newargv, envp, 1);
+	fchr_argv_free(newargv, stack);
+
+	return ret;
+}
+
+/*
+ * What host path filename is, remembered from an earlier exec or probed;
+ * -1 if it can not be read.
+ */
+static int execve_probe(const char *filename, struct fchr_probe *probe)
+{
+	if ((fchr_opts & OPT_EXECPLAN) &&
+			fchr_execplan_lookup(filename, probe) != FCHR_FALLBACK)
+		return 0;
+	if (fchr_probe(filename, (fchr_opts & OPT_EXECPLAN) ?
+				FCHR_PROBE_STAT : 0, probe) != 0)
+		return -1;
+	if (fchr_opts & OPT_EXECPLAN)
+		fchr_execplan_store(filename, probe);
+
+	return 0;
+}
+
+/*
+ * Run the binary at host path filename, a buffer of FAKECHROOT_MAXPATH
+ * bytes, which probe describes: under the seccomp supervisor if static,
+ * natively or emulated as the rule of its architecture says, else through
+ * the runtime linker of the fake root.
+ */
+static int execve_binary(char *filename, const struct fchr_probe *probe,
+		char *const argv[], char *const envp[])
+{
+	const struct fchr_hosttool *emulator;
+	const char *extra[5];
+	char linker[FAKECHROOT_MAXPATH];
+	int how;
+
+	if (!fakechroot_path)
+		return execve_call(filename, argv, envp, 0);
+
+#ifdef FAKECHROOT_SECCOMP
+	/* nothing of ours will run in it, see lib-seccomp.c */
+	if ((fchr_opts & OPT_SECCOMP) && probe->kind == FCHR_EXEC_STATIC)
+		return fchr_seccomp_execve(filename, argv, envp);
+#endif
+	/* the rule for its architecture, see lib-hosttool.c */
+	how = fchr_hosttool_rule(fchr_elf_arch(probe), &emulator);
+	if (how == FCHR_RUN_EMULATOR && fchr_elf_native(probe))
+		how = FCHR_RUN_NATIVE;
+	if (how == FCHR_RUN_NATIVE) {
+		dprintf("### executing natively %s\n", filename);
+		return execve_call(filename, argv, envp, 1);
+	}
+	if (how == FCHR_RUN_EMULATOR) {
+		extra[0] = "-L";
+		extra[1] = fakechroot_path;
+		extra[2] = "-0";
+		extra[3] = argv[0] ? argv[0] : filename;
+		extra[4] = filename;
+		dprintf("### emulating %s by %s\n", filename, emulator->host);
+		return execve_hosttool(emulator, extra, 5, argv, envp);
+	}
+	narrow_chroot_path_modify(filename);
+	cross_subst(linker, filename);
+	dprintf("### executing host %s\n", linker);
+	return execve_call(linker, argv, envp, 0);
 }
 
 /* #include <unistd.h> */
 int execve(const char *filename, char *const argv [], char *const envp[])
 {
-	int file;
+	const struct fchr_hosttool *tool;
+	struct fchr_probe probe;
 	char hashbang[FAKECHROOT_MAXPATH];
-	size_t argv_max = 1024;
-	const char **newargv = alloca(argv_max * sizeof(const char *));
+	const char *stack[FCHR_ARGV_STACK], **newargv;
 	char tmp[FAKECHROOT_MAXPATH], newfilename[FAKECHROOT_MAXPATH];
 	char argv0[FAKECHROOT_MAXPATH];
 	char *ptr;
 	unsigned int i, j, n;
+	size_t argc, k;
+	int kind, ret;
 	char c;
-	int ret;
 	 
 	char cross_fn[FAKECHROOT_MAXPATH];
-	char *linkpath;
-	struct stat statbuf;
 
 	WRAPPER_PROLOGUE();
 	dprintf("### %s %s\n", __FUNCTION__, filename);
-	expand_chroot_path(filename);
-
-	/* explicit symlink unwinding */
-	ret = lstat(filename, &statbuf);
-	dprintf("### filename=%s, mode: %06o\n", filename, statbuf.st_mode);
-	if (ret == 0 && S_ISLNK(statbuf.st_mode)) {
-
-		dprintf("### symlink\n");
-		linkpath = malloc(FAKECHROOT_MAXPATH);
-		if (!linkpath) return -ENOMEM;
-
-		memset(linkpath, 0, FAKECHROOT_MAXPATH);
-		i = readlink(filename, linkpath, PATH_MAX);
-		if (i < 0)
-			return errno;
-
-		dprintf("### to: %s\n", linkpath);
-		if (linkpath[0] == '/') {
-			expand_chroot_path(linkpath);
-			dprintf("### %s is a symlink to abs path, expanded to %s\n", filename, linkpath);
-		
-			if (!linkpath) return -EINVAL;
-
-			return execve(linkpath, argv, envp);
-		}
-	}
+	/* programs the host runs itself, by the name they are called by */
+	if ((tool = fchr_hosttool_find(filename)) != NULL)
+		return execve_hosttool(tool, NULL, 0, argv, envp);
+	/* symlinks are followed inside the fake root */
+	resolve_chroot_path(filename, 0);
 
 	strcpy(tmp, filename);
 	filename = tmp;
 
-	dprintf("%s: path=%s is_our_elf=%d\n", __FUNCTION__, filename,
-			is_our_elf(filename));
-	if ((file = open(filename, O_RDONLY)) == -1) {
+	if (execve_probe(filename, &probe) != 0) {
 		errno = ENOENT;
 		return -1;
 	}
+	dprintf("%s: path=%s arch=%s is_our_elf=%d\n", __FUNCTION__, filename,
+			fchr_arch_name(fchr_elf_arch(&probe)), fchr_probe_ours(&probe));
+	kind = probe.kind;
+	i = probe.line_len;
+	memcpy(hashbang, probe.head, i);
 
-	i = read(file, hashbang, FAKECHROOT_MAXPATH-2);
-	close(file);
-	if (i == -1) {
-		errno = ENOENT;
-		return -1;
-	}
+	if (kind != FCHR_EXEC_SCRIPT)
+		return execve_binary(tmp, &probe, argv, envp);
 
-	if (hashbang[0] != '#' || hashbang[1] != '!') {
-		if (getenv("FAKECHROOT_BASE")) {
-			narrow_chroot_path(filename);
-			cross_subst(hashbang, filename);
-			dprintf("### executing host %s\n", hashbang);
-			return execve_call(hashbang, argv, envp);
-		}
-		return execve_call(filename, argv, envp);
-	}
+	/* the words of the "#!" line, at most half of it, the script, the rest */
+	tool = NULL;
+	newfilename[0] = '\0';
+	for (argc = 0; argv[argc] != NULL; argc++);
+	if ((newargv = fchr_argv_alloc(stack, i / 2 + argc + 2)) == NULL)
+		return -1;
 
 	hashbang[i] = hashbang[i+1] = 0;
 	for (i = j = 2; (hashbang[i] == ' ' || hashbang[i] == '\t') &&
@@ -161,7 +247,8 @@ int execve(const char *filename, char *const argv [], char *const envp[])
 			if (i > j) {
 				if (n == 0) {
 					ptr = &hashbang[j];
-					expand_chroot_path(ptr);
+					tool = fchr_hosttool_find(ptr);
+					resolve_chroot_path(ptr, 0);
 					strcpy(newfilename, ptr);
 					strcpy(argv0, &hashbang[j]);
 					newargv[n++] = argv0;
@@ -174,24 +261,34 @@ int execve(const char *filename, char *const argv [], char *const envp[])
 			break;
 	}
 
-	expand_chroot_path(filename);
+	/* filename was expanded on entry */
 	newargv[n++] = filename;
 
-	for (i = 1; argv[i] != NULL && i<argv_max; )
-		newargv[n++] = argv[i++];
+	for (k = 1; k < argc; k++)
+		newargv[n++] = argv[k];
 
 	newargv[n] = 0;
 
-	if (getenv("FAKECHROOT_BASE")) {
+	/* the interpreter is run from the host, or as its architecture says */
+	if (tool != NULL)
+		ret = execve_hosttool(tool, NULL, 0, (char *const *)newargv, envp);
+	else if (fakechroot_path && newfilename[0] != '\0' &&
+			((fchr_opts & OPT_SECCOMP) || fchr_hosttool_rules()) &&
+			execve_probe(newfilename, &probe) == 0 &&
+			probe.kind != FCHR_EXEC_SCRIPT)
+		ret = execve_binary(newfilename, &probe, (char *const *)newargv, envp);
+	else if (fakechroot_path) {
 		narrow_chroot_path_modify(newfilename);
 		cross_subst(cross_fn, newfilename);
 		dprintf("### executing host %s\n", cross_fn);
-		return execve_call(cross_fn, (char *const *)newargv, envp);
-	}
+		ret = execve_call(cross_fn, (char *const *)newargv, envp, 0);
+	} else
+		ret = execve_call(newfilename, (char *const *)newargv, envp, 0);
+	fchr_argv_free(newargv, stack);
 
-	return execve_call(newfilename, (char *const *)newargv, envp);
+	return ret;
 }
 
-DECLARE_WRAPPER(execve);
+DECLARE_WRAPPER_FLAGS(execve, FCHR_WRAPPER_KEEP);
 
 #endif /* HAVE_EXECVE */
@@ -25,6 +25,7 @@
 
 #include "common.h"
 #include "wrapper.h"
+#include "proto.h"
 
 #ifdef HAVE_EXECVP
 
@@ -138,7 +139,7 @@ int execvp(const char *file, char *const argv[])
 	return -1;
 }
 
-DECLARE_WRAPPER(execvp);
+DECLARE_WRAPPER_FLAGS(execvp, FCHR_WRAPPER_KEEP);
 
 #endif /* HAVE_EXECVP */
 
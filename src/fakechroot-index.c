@@ -0,0 +1,329 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * fakechroot-index ROOT MANIFEST
+ *
+ * Walk the host tree ROOT once and write the manifest of it which the
+ * library answers lookups and directory listings from when started with
+ * FAKECHROOT_INDEX=MANIFEST: names, types, modes, sizes, symlink targets
+ * and, for executables and shared objects, the ELF machine.  See index.h
+ * for the format.  MANIFEST must lie outside ROOT, as writing it would
+ * change the tree it describes; run the tool again whenever ROOT changes.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "index.h"
+
+struct node {
+	char *path;
+	size_t path_len, dir_len;
+	char *target;
+	struct stat st;
+	uint16_t machine;
+	uint8_t elf_class, elf_data;
+	uint32_t children, nchildren;
+};
+
+static const char *progname;
+static char root[PATH_MAX];
+static size_t root_len;
+
+static struct node *nodes;
+static size_t count, size;
+
+static void die(const char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", progname, what, strerror(errno));
+	exit(1);
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+	if ((p = realloc(p, n)) == NULL)
+		die("realloc");
+	return p;
+}
+
+/* host path of the tree's relative path rel */
+static const char *host(char *buf, const char *rel)
+{
+	if (snprintf(buf, PATH_MAX, "%s%s%s", root, *rel || !*root ? "/" : "", rel) >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		die(rel);
+	}
+	return buf;
+}
+
+/* executables and shared objects: their ELF class, byte order and machine */
+static void elf_header(struct node *n, const char *name)
+{
+	char buf[PATH_MAX];
+	unsigned char e[EI_NIDENT + 4];
+	int fd;
+
+	if (!S_ISREG(n->st.st_mode) || n->st.st_size < (off_t)sizeof(Elf32_Ehdr) ||
+			(!(n->st.st_mode & 0111) && !strstr(name, ".so")))
+		return;
+	if ((fd = open(host(buf, n->path), O_RDONLY | O_CLOEXEC | O_NOFOLLOW)) < 0)
+		return;
+	if (read(fd, e, sizeof(e)) == (ssize_t)sizeof(e) && !memcmp(e, ELFMAG, SELFMAG)) {
+		n->elf_class = e[EI_CLASS];
+		n->elf_data = e[EI_DATA];
+		/* e_machine follows e_ident and e_type */
+		n->machine = e[EI_DATA] == ELFDATA2MSB ?
+			e[EI_NIDENT + 2] << 8 | e[EI_NIDENT + 3] :
+			e[EI_NIDENT + 3] << 8 | e[EI_NIDENT + 2];
+	}
+	close(fd);
+}
+
+static struct node *add(const char *rel, size_t dir_len, const char *name)
+{
+	char buf[PATH_MAX];
+	struct node *n;
+	ssize_t len;
+
+	if (count == size) {
+		size = size ? 2 * size : 1024;
+		nodes = xrealloc(nodes, size * sizeof(*nodes));
+	}
+	n = &nodes[count];
+	memset(n, 0, sizeof(*n));
+	if ((n->path = strdup(rel)) == NULL)
+		die("strdup");
+	n->path_len = strlen(rel);
+	n->dir_len = dir_len;
+
+	if (lstat(host(buf, rel), &n->st) != 0)
+		return NULL;
+	if (S_ISLNK(n->st.st_mode)) {
+		n->target = xrealloc(NULL, PATH_MAX);
+		if ((len = readlink(buf, n->target, PATH_MAX - 1)) < 0)
+			die(buf);
+		n->target[len] = '\0';
+	}
+	elf_header(n, name);
+	count++;
+
+	return n;
+}
+
+static void walk(const char *rel)
+{
+	char buf[PATH_MAX], sub[PATH_MAX];
+	struct dirent *e;
+	struct node *n;
+	size_t len = strlen(rel);
+	DIR *dir;
+
+	if ((dir = opendir(host(buf, rel))) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", progname, buf, strerror(errno));
+		return;
+	}
+	while ((e = readdir(dir)) != NULL) {
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+			continue;
+		if (snprintf(sub, sizeof(sub), "%s%s%s", rel, len ? "/" : "",
+					e->d_name) >= (int)sizeof(sub))
+			continue;
+		if ((n = add(sub, len, e->d_name)) != NULL && S_ISDIR(n->st.st_mode))
+			walk(sub);
+	}
+	closedir(dir);
+}
+
+static const char *name_of(const struct node *n)
+{
+	return n->dir_len ? n->path + n->dir_len + 1 : n->path;
+}
+
+static int node_cmp(const void *a, const void *b)
+{
+	const struct node *x = a, *y = b;
+	size_t xl = x->path_len - (x->dir_len ? x->dir_len + 1 : 0);
+	size_t yl = y->path_len - (y->dir_len ? y->dir_len + 1 : 0);
+	int r;
+
+	if ((r = memcmp(x->path, y->path, x->dir_len < y->dir_len ? x->dir_len : y->dir_len)) != 0)
+		return r;
+	if (x->dir_len != y->dir_len)
+		return x->dir_len < y->dir_len ? -1 : 1;
+	if ((r = memcmp(name_of(x), name_of(y), xl < yl ? xl : yl)) != 0)
+		return r;
+	return xl == yl ? 0 : xl < yl ? -1 : 1;
+}
+
+/* the directory with relative path dir of len bytes */
+static struct node *find(const char *dir, size_t len)
+{
+	struct node key;
+	const char *slash = memrchr(dir, '/', len);
+
+	memset(&key, 0, sizeof(key));
+	key.path = (char *)dir;
+	key.path_len = len;
+	key.dir_len = slash ? (size_t)(slash - dir) : 0;
+
+	return bsearch(&key, nodes, count, sizeof(*nodes), node_cmp);
+}
+
+int main(int argc, char **argv)
+{
+	struct fchr_index_header h;
+	struct fchr_index_entry *entries;
+	struct stat st;
+	char buf[PATH_MAX], dir[PATH_MAX], *strings, *tmp, *slash;
+	size_t i, j, strings_size = 0, off, total;
+	struct node *d;
+	FILE *f;
+	int fd;
+
+	progname = argv[0];
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s ROOT MANIFEST\n", progname);
+		return 1;
+	}
+
+	if (realpath(argv[1], root) == NULL)
+		die(argv[1]);
+	root_len = strlen(root);
+	if (root_len == 1)
+		root_len = 0, root[0] = '\0';
+
+	/* the manifest's directory must not be inside the tree */
+	snprintf(buf, sizeof(buf), "%s", argv[2]);
+	if ((slash = strrchr(buf, '/')) != NULL)
+		*(slash == buf ? slash + 1 : slash) = '\0';
+	else
+		strcpy(buf, ".");
+	if (realpath(buf, dir) == NULL)
+		die(argv[2]);
+	if (!strncmp(dir, root, root_len) && (dir[root_len] == '/' || dir[root_len] == '\0')) {
+		fprintf(stderr, "%s: %s lies inside %s\n", progname, argv[2], argv[1]);
+		return 1;
+	}
+
+	if (add("", 0, "") == NULL || !S_ISDIR(nodes[0].st.st_mode)) {
+		errno = ENOTDIR;
+		die(argv[1]);
+	}
+	walk("");
+	qsort(nodes, count, sizeof(*nodes), node_cmp);
+
+	/* children of a directory are adjacent */
+	for (i = 1; i < count; i = j) {
+		for (j = i + 1; j < count && nodes[j].dir_len == nodes[i].dir_len &&
+				!memcmp(nodes[j].path, nodes[i].path, nodes[i].dir_len); j++)
+			;
+		if ((d = find(nodes[i].path, nodes[i].dir_len)) != NULL) {
+			d->children = i;
+			d->nchildren = j - i;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		strings_size += nodes[i].path_len + 1 +
+			(nodes[i].target ? strlen(nodes[i].target) + 1 : 0);
+	strings_size += root_len + 1;
+	total = sizeof(h) + count * sizeof(*entries) + strings_size;
+	total = (total + 7) & ~(size_t)7;
+	if (total > UINT32_MAX) {
+		errno = EFBIG;
+		die(argv[2]);
+	}
+
+	entries = calloc(1, total - sizeof(h));
+	if (entries == NULL)
+		die("calloc");
+	strings = (char *)&entries[count];
+
+	for (i = off = 0; i < count; i++) {
+		struct fchr_index_entry *e = &entries[i];
+		struct node *n = &nodes[i];
+
+		e->path = off;
+		e->path_len = n->path_len;
+		e->dir_len = n->dir_len;
+		memcpy(strings + off, n->path, n->path_len + 1);
+		off += n->path_len + 1;
+		if (n->target) {
+			e->target = off;
+			e->target_len = strlen(n->target);
+			memcpy(strings + off, n->target, e->target_len + 1);
+			off += e->target_len + 1;
+		}
+		e->children = n->children;
+		e->nchildren = n->nchildren;
+		e->mode = n->st.st_mode;
+		e->ino = n->st.st_ino;
+		e->size = n->st.st_size;
+		e->mtime = n->st.st_mtim.tv_sec;
+		e->mtime_nsec = n->st.st_mtim.tv_nsec;
+		e->machine = n->machine;
+		e->elf_class = n->elf_class;
+		e->elf_data = n->elf_data;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, FCHR_INDEX_MAGIC, sizeof(h.magic));
+	h.version = FCHR_INDEX_VERSION;
+	h.byte_order = FCHR_INDEX_BYTE_ORDER;
+	h.size = total;
+	h.entries = sizeof(h);
+	h.strings = sizeof(h) + count * sizeof(*entries);
+	h.count = count;
+	h.root = off;
+	h.root_len = root_len;
+	memcpy(strings + off, root, root_len + 1);
+	h.parent_ino = stat(host(buf, ".."), &st) == 0 ? st.st_ino : nodes[0].st.st_ino;
+	h.checksum = fchr_index_sum(entries, total - sizeof(h));
+
+	/* replace the manifest in one go, a reader never sees half of it */
+	if (asprintf(&tmp, "%s.XXXXXX", argv[2]) < 0)
+		die("asprintf");
+	if ((fd = mkstemp(tmp)) < 0 || (f = fdopen(fd, "w")) == NULL)
+		die(tmp);
+	if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+			fwrite(entries, total - sizeof(h), 1, f) != 1 ||
+			fchmod(fileno(f), 0644) != 0 || fclose(f) != 0) {
+		unlink(tmp);
+		die(tmp);
+	}
+	if (rename(tmp, argv[2]) != 0) {
+		unlink(tmp);
+		die(argv[2]);
+	}
+
+	return 0;
+}
@@ -31,11 +31,16 @@
 /* #include <stdio.h> */
 FILE *fopen64 (const char *path, const char *mode)
 {
-	 
+	FILE *fp;
 
-	expand_chroot_path(path);
+	upper_chroot_path(path, fchr_overlay_fopen_how(mode));
 
-	return NEXTCALL(fopen64)(path, mode);
+	fp = fchr_direct(NEXTCALL(fopen64)(path, mode));
+	/* "w" and "a" may have made the name */
+	if (fp != NULL && *mode != 'r' && (fchr_opts & OPT_NEGCACHE))
+		fchr_negcache_invalidate();
+
+	return fp;
 }
 
 DECLARE_WRAPPER(fopen64);
@@ -30,11 +30,16 @@
 /* #include <stdio.h> */
 FILE *freopen(const char *path, const char *mode, FILE *stream)
 {
-	 
+	FILE *fp;
 
-	expand_chroot_path(path);
+	upper_chroot_path(path, fchr_overlay_fopen_how(mode));
 
-	return NEXTCALL(freopen)(path, mode, stream);
+	fp = fchr_direct(NEXTCALL(freopen)(path, mode, stream));
+	/* "w" and "a" may have made the name */
+	if (fp != NULL && *mode != 'r' && (fchr_opts & OPT_NEGCACHE))
+		fchr_negcache_invalidate();
+
+	return fp;
 }
 
 DECLARE_WRAPPER(freopen);
@@ -0,0 +1,56 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ * (c) 2003-2005 Piotr Roszatycki <dexter.org>, LGPL
+ * (c) 2006, 2007 Alexander Shishkin <virtuoso.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+/*
+ * fstatat() call wrapper
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#if defined(HAVE_FSTATAT) && defined(FAKECHROOT_PLAIN_STAT)
+/* #include <fcntl.h> */
+/* #include <sys/stat.h> */
+int fstatat(int dirfd, const char *pathname, struct stat *buf, int flags)
+{
+	const char *guest = pathname;
+
+	if (fchr_negcache_hit(pathname, flags & AT_SYMLINK_NOFOLLOW))
+		return -1;
+
+	lookup_in_root(pathname,
+			(flags & AT_SYMLINK_NOFOLLOW) ? FCHR_LOOKUP_NOFOLLOW : 0,
+			NEXTCALL(fstatat)(fakechroot_fd, "", buf,
+				(flags & ~AT_SYMLINK_NOFOLLOW) | AT_EMPTY_PATH));
+	resolve_chroot_path_at(dirfd, pathname,
+			(flags & AT_SYMLINK_NOFOLLOW) ? FCHR_RESOLVE_NOFOLLOW : 0);
+
+	return fchr_negcache_note(guest, flags & AT_SYMLINK_NOFOLLOW,
+			fchr_statcache((flags & AT_SYMLINK_NOFOLLOW) ?
+					FCHR_STATCACHE_LSTAT : FCHR_STATCACHE_STAT,
+				pathname, flags & ~AT_SYMLINK_NOFOLLOW, buf,
+				RAWCALL(fchr_raw_fstatat(dirfd, pathname, buf, flags),
+					NEXTCALL(fstatat)(dirfd, pathname, buf, flags))));
+}
+DECLARE_WRAPPER(fstatat)
+
+#endif
@@ -38,18 +38,30 @@ FTS *fts_open(char * const *path_argv, int options,
 	char **new_path_argv;
 	char **np;
 	int n;
+	FTS *fts;
 
 	for (n=0, p=path_argv; *p; n++, p++);
-	if ((new_path_argv = malloc(n*(sizeof(char *)))) == NULL)
+	if ((new_path_argv = malloc((n+1)*(sizeof(char *)))) == NULL)
 		return NULL;
 
 	for (n=0, p=path_argv, np=new_path_argv; *p; n++, p++, np++) {
 		path = *p;
 		expand_chroot_path_malloc(path);
+		if (path == NULL)
+			break;
 		*np = path;
 	}
+	*np = NULL;
 
-	return NEXTCALL(fts_open)(new_path_argv, options, compar);
+	/* fts copies the names into its own entries */
+	fts = *p ? NULL : fchr_direct(NEXTCALL(fts_open)(new_path_argv, options, compar));
+
+	for (p=path_argv, np=new_path_argv; *np; p++, np++)
+		if (*np != *p)
+			free(*np);
+	free(new_path_argv);
+
+	return fts;
 }
 DECLARE_WRAPPER(fts_open)
 
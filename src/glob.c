@@ -32,29 +32,22 @@ int glob(const char *pattern, int flags, int(*errfunc) (const char *, int),
 		glob_t *pglob)
 {
 	int rc, i;
-	char tmp[FAKECHROOT_MAXPATH], *tmpptr;
-	char *fakechroot_ptr;
+
+	if (fchr_overlay(fchr_conf()) &&
+			(rc = fchr_overlay_glob(pattern, flags, errfunc, pglob, 0)) != FCHR_FALLBACK)
+		return rc;
 
 	expand_chroot_path(pattern);
 
-	rc = NEXTCALL(glob)(pattern, flags, errfunc, pglob);
+	if (!(fchr_opts & OPT_INDEX) ||
+			(rc = fchr_index_glob(pattern, flags, errfunc, pglob, 0)) == FCHR_FALLBACK)
+		rc = fchr_glob_next(pattern, flags, errfunc, pglob, 0, 1);
 	if (rc < 0)
 		return rc;
 
-	for (i = 0; i < pglob->gl_pathc; i++) {
-		strcpy(tmp,pglob->gl_pathv[i]);
-
-		if (fakechroot_path != NULL) {
-			fakechroot_ptr = strstr(tmp, fakechroot_path);
-
-			if (fakechroot_ptr != tmp)
-				tmpptr = tmp;
-			else
-				tmpptr = tmp + strlen(fakechroot_path);
+	for (i = 0; i < pglob->gl_pathc; i++)
+		narrow_chroot_path_modify(pglob->gl_pathv[i]);
 
-			strcpy(pglob->gl_pathv[i], tmpptr);
-		}
-	}
 	return rc;
 }
 
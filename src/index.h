@@ -0,0 +1,117 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Sysroot manifest, as fakechroot-index writes it and lib-index.c maps it.
+ *
+ * The header is followed by the entry table and the string table, and
+ * the file is padded to a multiple of eight bytes.  Every entry names a
+ * file of the tree by its path relative to the root, without leading
+ * slash; the root itself is the empty path.  Entries are sorted by parent
+ * directory, then by name, comparing bytes, so the children of a
+ * directory are adjacent and any path is found by binary search.  Numbers
+ * are in host byte order, which byte_order tells.
+ */
+
+#ifndef __FAKECHROOT_INDEX_H__
+#define __FAKECHROOT_INDEX_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define FCHR_INDEX_MAGIC      "fchridx1"
+#define FCHR_INDEX_VERSION    1
+#define FCHR_INDEX_BYTE_ORDER 0x01020304
+
+struct fchr_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t size;				/* of the whole file */
+	uint64_t checksum;			/* fchr_index_sum() of all after the header */
+	uint64_t entries;			/* offset of the entry table */
+	uint64_t strings;			/* offset of the string table */
+	uint32_t count;				/* entries, the root first */
+	uint32_t root;				/* string offset of the absolute host root */
+	uint32_t root_len;
+	uint32_t pad;
+	uint64_t parent_ino;		/* inode of the root's ".." */
+};
+
+struct fchr_index_entry {
+	uint32_t path;				/* string offset, NUL terminated */
+	uint32_t path_len;
+	uint32_t dir_len;			/* of the parent's path, the name following */
+	uint32_t target;			/* string offset of a symlink's target */
+	uint32_t target_len;
+	uint32_t children;			/* index of a directory's first child */
+	uint32_t nchildren;
+	uint32_t mode;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime;				/* directories: the staleness guard */
+	uint32_t mtime_nsec;
+	uint16_t machine;			/* ELF e_machine, 0 for other files */
+	uint8_t elf_class;			/* ELF EI_CLASS and EI_DATA */
+	uint8_t elf_data;
+};
+
+/* parent directory and name of entry e */
+static inline const char *fchr_index_name(const char *strings,
+		const struct fchr_index_entry *e)
+{
+	const char *path = strings + e->path;
+
+	return e->dir_len ? path + e->dir_len + 1 : path;
+}
+
+/* order of the parent directory dir and name against entry e's */
+static inline int fchr_index_cmp(const char *dir, size_t dir_len,
+		const char *name, size_t name_len, const char *strings,
+		const struct fchr_index_entry *e)
+{
+	const char *path = strings + e->path;
+	size_t elen = e->path_len - (e->dir_len ? e->dir_len + 1 : 0);
+	int r;
+
+	if ((r = memcmp(dir, path, dir_len < e->dir_len ? dir_len : e->dir_len)) != 0)
+		return r;
+	if (dir_len != e->dir_len)
+		return dir_len < e->dir_len ? -1 : 1;
+	if ((r = memcmp(name, fchr_index_name(strings, e),
+					name_len < elen ? name_len : elen)) != 0)
+		return r;
+	return name_len == elen ? 0 : name_len < elen ? -1 : 1;
+}
+
+/* FNV-1a over 64 bit words; len is a multiple of eight */
+static inline uint64_t fchr_index_sum(const void *data, size_t len)
+{
+	const uint64_t *p = data;
+	uint64_t h = 14695981039346656037ULL;
+
+	for (len /= 8; len; len--)
+		h = (h ^ *p++) * 1099511628211ULL;
+
+	return h;
+}
+
+#endif
@@ -21,92 +21,316 @@
 
 #include "common.h"
 #include "wrapper.h"
+#include "proto.h"
 
-/* Path to fake cross-chroot environment: read-only, thus thread-safe */
-const char *fakechroot_cross = NULL;
-static const char *cross_arch = NULL;
-static int cross_arch_idx = -1;
+#ifndef EM_AARCH64
+#define EM_AARCH64   183
+#endif
+#ifndef EM_RISCV
+#define EM_RISCV     243
+#endif
+#ifndef EM_LOONGARCH
+#define EM_LOONGARCH 258
+#endif
 
 /* 
  * correlation between architecture names and elf
- * 'machine' header values
+ * 'machine', class and byte order header values;
+ * the first name of each triple is the one rules
+ * and messages use, see fchr_elf_arch()
  */
 static struct magic_struct MAGIC[] = {
-	{ .arch = "arm",            .mach = EM_ARM  },
-	{ .arch = "uclibc-arm",     .mach = EM_ARM  },
-	{ .arch = "armel",          .mach = EM_ARM  },
-	{ .arch = "uclibc-armel",   .mach = EM_ARM  },
-	{ .arch = "powerpc",        .mach = EM_PPC  },
-	{ .arch = "uclibc-powerpc", .mach = EM_PPC  },
-	{ .arch = "mips",           .mach = EM_MIPS },
-	{ .arch = "uclibc-mips",    .mach = EM_MIPS },
-	{ .arch = "mipsel",         .mach = EM_MIPS },
-	{ .arch = "uclibc-mipsel",  .mach = EM_MIPS },
-	{ .arch = "sh4",            .mach = EM_SH },
-	{ .arch = "uclibc-sh4",     .mach = EM_SH },
-	{ .arch = "sh4a",           .mach = EM_SH },
-	{ .arch = "uclibc-sh4a",    .mach = EM_SH },
-	{ .arch = "ppc64",          .mach = EM_PPC64 },
-	{ .arch = "i386",           .mach = EM_386 },
-	{ .arch = "uclibc-i386",    .mach = EM_386 },
+	/*  arch            mach          class       data */
+	{ "arm",            EM_ARM,       ELFCLASS32, ELFDATA2LSB },
+	{ "uclibc-arm",     EM_ARM,       ELFCLASS32, ELFDATA2LSB },
+	{ "armel",          EM_ARM,       ELFCLASS32, ELFDATA2LSB },
+	{ "uclibc-armel",   EM_ARM,       ELFCLASS32, ELFDATA2LSB },
+	{ "armhf",          EM_ARM,       ELFCLASS32, ELFDATA2LSB },
+	{ "armeb",          EM_ARM,       ELFCLASS32, ELFDATA2MSB },
+	{ "aarch64",        EM_AARCH64,   ELFCLASS64, ELFDATA2LSB },
+	{ "arm64",          EM_AARCH64,   ELFCLASS64, ELFDATA2LSB },
+	{ "powerpc",        EM_PPC,       ELFCLASS32, ELFDATA2MSB },
+	{ "uclibc-powerpc", EM_PPC,       ELFCLASS32, ELFDATA2MSB },
+	{ "ppc64",          EM_PPC64,     ELFCLASS64, ELFDATA2MSB },
+	{ "ppc64el",        EM_PPC64,     ELFCLASS64, ELFDATA2LSB },
+	{ "ppc64le",        EM_PPC64,     ELFCLASS64, ELFDATA2LSB },
+	{ "mips",           EM_MIPS,      ELFCLASS32, ELFDATA2MSB },
+	{ "uclibc-mips",    EM_MIPS,      ELFCLASS32, ELFDATA2MSB },
+	{ "mipsel",         EM_MIPS,      ELFCLASS32, ELFDATA2LSB },
+	{ "uclibc-mipsel",  EM_MIPS,      ELFCLASS32, ELFDATA2LSB },
+	{ "mips64",         EM_MIPS,      ELFCLASS64, ELFDATA2MSB },
+	{ "mips64el",       EM_MIPS,      ELFCLASS64, ELFDATA2LSB },
+	{ "sh4",            EM_SH,        ELFCLASS32, ELFDATA2LSB },
+	{ "uclibc-sh4",     EM_SH,        ELFCLASS32, ELFDATA2LSB },
+	{ "sh4a",           EM_SH,        ELFCLASS32, ELFDATA2LSB },
+	{ "uclibc-sh4a",    EM_SH,        ELFCLASS32, ELFDATA2LSB },
+	{ "i386",           EM_386,       ELFCLASS32, ELFDATA2LSB },
+	{ "uclibc-i386",    EM_386,       ELFCLASS32, ELFDATA2LSB },
+	{ "x86_64",         EM_X86_64,    ELFCLASS64, ELFDATA2LSB },
+	{ "amd64",          EM_X86_64,    ELFCLASS64, ELFDATA2LSB },
+	{ "riscv64",        EM_RISCV,     ELFCLASS64, ELFDATA2LSB },
+	{ "riscv32",        EM_RISCV,     ELFCLASS32, ELFDATA2LSB },
+	{ "s390x",          EM_S390,      ELFCLASS64, ELFDATA2MSB },
+	{ "sparc64",        EM_SPARCV9,   ELFCLASS64, ELFDATA2MSB },
+	{ "m68k",           EM_68K,       ELFCLASS32, ELFDATA2MSB },
+	{ "loongarch64",    EM_LOONGARCH, ELFCLASS64, ELFDATA2LSB },
 };
 
-#define swapb(x) ( (((x) & 0xff) << 8) | (((x) & 0xff00)) >> 8 )
-int is_our_elf(const char *file)
+#define MAGICS (sizeof(MAGIC) / sizeof(MAGIC[0]))
+
+/* what the kernel we run on executes without help */
+#if defined(__x86_64__) && defined(__LP64__)
+#define HOST_MACHINE EM_X86_64
+#elif defined(__i386__)
+#define HOST_MACHINE EM_386
+#elif defined(__aarch64__)
+#define HOST_MACHINE EM_AARCH64
+#elif defined(__arm__)
+#define HOST_MACHINE EM_ARM
+#elif defined(__powerpc64__)
+#define HOST_MACHINE EM_PPC64
+#elif defined(__powerpc__)
+#define HOST_MACHINE EM_PPC
+#elif defined(__riscv)
+#define HOST_MACHINE EM_RISCV
+#elif defined(__s390x__)
+#define HOST_MACHINE EM_S390
+#elif defined(__mips__)
+#define HOST_MACHINE EM_MIPS
+#elif defined(__sh__)
+#define HOST_MACHINE EM_SH
+#elif defined(__loongarch__)
+#define HOST_MACHINE EM_LOONGARCH
+#else
+#define HOST_MACHINE EM_NONE
+#endif
+
+#define HOST_CLASS (sizeof(long) == 8 ? ELFCLASS64 : ELFCLASS32)
+#define HOST_DATA  (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ ? ELFDATA2MSB : ELFDATA2LSB)
+
+/*
+ * Whether the ELF file probed in p, open as fd, is a statically linked
+ * executable of our own machine: one without PT_INTERP, which neither
+ * the runtime linker nor the library will ever see.  PT_INTERP has to
+ * precede every loadable segment, so the program headers up to the first
+ * PT_LOAD tell; those past the probed bytes are read one by one, which
+ * the usual layouts never need.
+ */
+static int elf_static(const struct fchr_probe *p, int fd)
 {
-	int fd, l;
-	Elf32_Ehdr elfh;
+#if defined(__x86_64__) || defined(__aarch64__)
+	Elf64_Ehdr eh;
+	Elf64_Phdr ph;
+	size_t off;
+	unsigned int i;
 
-	if (cross_arch_idx == -1) return -1;
+	if (p->len < sizeof(eh) || p->elf_class != ELFCLASS64 ||
+			p->elf_data != ELFDATA2LSB)
+		return 0;
+	memcpy(&eh, p->head, sizeof(eh));
+	if (eh.e_type != ET_EXEC && eh.e_type != ET_DYN)
+		return 0;
+#if defined(__x86_64__)
+	if (eh.e_machine != EM_X86_64)
+#else
+	if (eh.e_machine != EM_AARCH64)
+#endif
+		return 0;
+	if (eh.e_phentsize != sizeof(ph))
+		return 0;
 
-	fd = open(file, O_RDONLY);
-	dprintf("### file=%s\n", file);
-	if (fd < 0)
-		return -ENOENT;
+	for (i = 0; i < eh.e_phnum; i++) {
+		off = eh.e_phoff + (size_t)i * sizeof(ph);
+		/* a program header table past the end of the address space */
+		if (off < eh.e_phoff || (off_t)off < 0)
+			return 0;
+		if (off < p->len && p->len - off >= sizeof(ph))
+			memcpy(&ph, p->head + off, sizeof(ph));
+		else if (pread(fd, &ph, sizeof(ph), off) != sizeof(ph))
+			return 0;
+		if (ph.p_type == PT_INTERP)
+			return 0;
+		if (ph.p_type == PT_LOAD)
+			break;
+	}
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Probe the program or library at host path with an open() and a single
+ * pread() of its first FCHR_PROBE_SIZE bytes, as much as the kernel
+ * itself looks at.  With FCHR_PROBE_STAT in flags the same descriptor is
+ * given an fstat(), made after the read so that a file written since
+ * looks younger than what was read.  Fills in p, or returns -1 with errno
+ * set.
+ */
+int fchr_probe(const char *path, int flags, struct fchr_probe *p)
+{
+	const unsigned char *u = (const unsigned char *)p->head;
+	const char *nl;
+	ssize_t n;
+	int fd, saved_errno;
+
+	if ((fd = next_open(path, O_RDONLY | O_CLOEXEC, 0)) < 0)
+		return -1;
+	if ((n = pread(fd, p->head, sizeof(p->head), 0)) < 0 ||
+			((flags & FCHR_PROBE_STAT) && fstat(fd, &p->st) != 0)) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+	p->len = n;
+	p->line_len = 0;
+	p->elf_class = ELFCLASSNONE;
+	p->elf_data = ELFDATANONE;
+	p->machine = EM_NONE;
+
+	if (p->len >= 2 && p->head[0] == '#' && p->head[1] == '!') {
+		nl = memchr(p->head, '\n', p->len);
+		p->line_len = nl != NULL ? nl - p->head : p->len;
+		p->kind = FCHR_EXEC_SCRIPT;
+	} else if (p->len >= sizeof(Elf32_Ehdr) && !memcmp(p->head, ELFMAG, SELFMAG)) {
+		/* e_machine is at the same offset in both classes */
+		p->elf_class = u[EI_CLASS];
+		p->elf_data = u[EI_DATA];
+		p->machine = p->elf_data == ELFDATA2MSB ?
+			u[18] << 8 | u[19] : u[19] << 8 | u[18];
+		p->kind = elf_static(p, fd) ? FCHR_EXEC_STATIC : FCHR_EXEC_BINARY;
+	} else
+		p->kind = FCHR_EXEC_BINARY;
 
-	l = read(fd, &elfh, sizeof(Elf32_Ehdr));
 	close(fd);
 
-	if (l < sizeof(Elf32_Ehdr)) return -1;
-	if (elfh.e_machine != MAGIC[cross_arch_idx].mach &&
-	    elfh.e_machine != swapb(MAGIC[cross_arch_idx].mach))
+	return 0;
+}
+
+/* the first entry of MAGIC with the machine, class and byte order of i */
+static int magic_first(int i)
+{
+	int j;
+
+	for (j = 0; j < i; j++)
+		if (MAGIC[j].mach == MAGIC[i].mach &&
+				MAGIC[j].elf_class == MAGIC[i].elf_class &&
+				MAGIC[j].elf_data == MAGIC[i].elf_data)
+			return j;
+
+	return i;
+}
+
+/*
+ * Architecture of the ELF file probed in p, on EI_CLASS, EI_DATA and
+ * e_machine: the index in MAGIC of its first name, -1 for other files
+ * and unknown architectures.
+ */
+int fchr_elf_arch(const struct fchr_probe *p)
+{
+	int i;
+
+	if (p->elf_class == ELFCLASSNONE)
 		return -1;
 
+	for (i = 0; i < MAGICS; i++)
+		if (p->machine == MAGIC[i].mach && p->elf_class == MAGIC[i].elf_class &&
+				p->elf_data == MAGIC[i].elf_data)
+			return i;
+
+	return -1;
+}
+
+/* The same for the architecture named arch, -1 if it is unknown */
+int fchr_arch_find(const char *arch)
+{
+	int i;
+
+	for (i = 0; arch != NULL && i < MAGICS; i++)
+		if (!strcmp(arch, MAGIC[i].arch))
+			return magic_first(i);
+
+	return -1;
+}
+
+/* Name of the architecture fchr_elf_arch() returned, "none" for -1 */
+const char *fchr_arch_name(int arch)
+{
+	return arch >= 0 && arch < MAGICS ? MAGIC[arch].arch : "none";
+}
+
+/* Whether the ELF file probed in p runs on the host's kernel as it is */
+int fchr_elf_native(const struct fchr_probe *p)
+{
+	if (p->elf_class == ELFCLASSNONE)
+		return 0;
+	if (p->machine == HOST_MACHINE && p->elf_class == HOST_CLASS &&
+			p->elf_data == HOST_DATA)
+		return 1;
+#if defined(__x86_64__)
+	/* the compat layer */
+	if (p->machine == EM_386 && p->elf_class == ELFCLASS32)
+		return 1;
+#endif
+
 	return 0;
 }
 
-void cross_init()
+/* 0 if p probed an ELF file of the cross architecture, else -1 */
+int fchr_probe_ours(const struct fchr_probe *p)
+{
+	int cross_arch_idx = fchr_conf()->cross_arch;
+
+	if (cross_arch_idx == -1)
+		return -1;
+
+	return fchr_elf_arch(p) == cross_arch_idx ? 0 : -1;
+}
+
+int is_our_elf(const char *file)
+{
+	int cross_arch_idx = fchr_conf()->cross_arch;
+	struct fchr_probe p;
+	int l;
+
+	if (cross_arch_idx == -1) return -1;
+
+	/* the sysroot manifest knows the ELF header of indexed files */
+	if ((fchr_opts & OPT_INDEX) && (l = fchr_index_elf(file, &p)) != FCHR_FALLBACK)
+		return l < 0 ? -ENOENT : fchr_probe_ours(&p);
+
+	dprintf("### file=%s\n", file);
+	if (fchr_probe(file, 0, &p) != 0)
+		return -ENOENT;
+
+	return fchr_probe_ours(&p);
+}
+
+/*
+ * Validate the cross environment, FAKECHROOT_CROSS and CROSS_SHELL_ARCH;
+ * returns the index of the architecture, or -1 if either is unset or the
+ * architecture is unknown.
+ */
+int cross_find(const char *cross, const char *arch)
 {
 	int i;
 
-	/* read in cross chroot path */
-	fakechroot_cross = getenv("FAKECHROOT_CROSS");
-	if (!fakechroot_cross) return;
+	if (!cross) return -1;
 
-	/* read in cross architecture; void fakechroot_cross if unset */
-	cross_arch = getenv("CROSS_SHELL_ARCH");
-	if (!cross_arch) {
+	/* void cross chroot if the architecture is unset */
+	if (!arch) {
 		dprintf("### no arch name defined\n");
-		goto failure;
+		return -1;
 	}
 
 	/* find corresponding elf 'machine' header value */
-	for (i = 0; i < sizeof(MAGIC)/sizeof(struct magic_struct); i++) {
+	if ((i = fchr_arch_find(arch)) != -1) {
 		dprintf("### -> %s\n", MAGIC[i].arch);
-		if (!strcmp(cross_arch, MAGIC[i].arch)) {
-			cross_arch_idx = i;
-			break;
-		}
+		return i;
 	}
 
-	if (cross_arch_idx == -1) {
-		dprintf("### no magic found for arch %s\n", cross_arch);
-		goto failure;
-	}
-
-	return;
-
-failure:
-	fakechroot_cross = cross_arch = NULL;
+	dprintf("### no magic found for arch %s\n", arch);
+	return -1;
 }
-
@@ -0,0 +1,244 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Exec plan cache (FAKECHROOT_OPTS=X).
+ *
+ * execve() opens and reads every program it is asked to run, to tell
+ * scripts from binaries and statically linked ones from the others,
+ * while a parallel build runs the same few hundred programs over and
+ * over.  What it found is therefore remembered in a table shared by the
+ * whole process tree, the way the negative lookup cache shares its own:
+ * by host path, the kind of the file, the ELF class, byte order and
+ * machine of a binary and, for a script, its "#!" line.
+ * An entry stands while the file keeps the device, inode, size and
+ * modification time it had, which a single stat() checks instead of the
+ * probe of a miss (see fchr_probe()); inside immutable trees the stat
+ * cache answers even that.
+ *
+ * Only what the file itself decides is kept.  The interpreter of a
+ * script is translated anew every time, by the path and dentry caches,
+ * as the names leading to it may change while the script does not.
+ *
+ * A file changed twice within the granularity of its timestamps may keep
+ * them, so files modified during the last EXECPLAN_SETTLE seconds are not
+ * remembered at all.  Slots are guarded by sequence counters: readers take
+ * no locks and writers which would have to wait simply do not store.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#include <time.h>
+
+#define EXECPLAN_SLOTS  1024	/* power of two; pages are only used once touched */
+#define EXECPLAN_PROBES 4
+#define EXECPLAN_DATA   448		/* path, NUL, "#!" line, NUL */
+#define EXECPLAN_SETTLE 2
+
+#define EXECPLAN_ENV    "FAKECHROOT_EXECPLAN"
+#define EXECPLAN_MAGIC  "fchrexe2"
+
+struct execplan_entry {
+	unsigned int seq;			/* odd while being written, 0 for an empty slot */
+	unsigned int hash;
+	unsigned short len;
+	unsigned short line_len;
+	unsigned short machine;		/* see struct fchr_probe */
+	unsigned char kind;			/* FCHR_EXEC_* */
+	unsigned char elf_class;
+	unsigned char elf_data;
+	unsigned char pad[7];
+	unsigned long long dev;
+	unsigned long long ino;
+	long long size;
+	long long mtime;
+	long mtime_nsec;
+	char data[EXECPLAN_DATA];
+};
+
+struct execplan_shared {
+	char magic[FCHR_SHARED_MAGIC];
+	struct execplan_entry entries[EXECPLAN_SLOTS];
+};
+
+static struct execplan_shared *execplan_shared;
+
+/* process wide counters, only maintained with OPT_STATS */
+static unsigned long execplan_hits, execplan_misses;
+
+/*
+ * Join the process tree's table, or start one.  Returns 0 when the cache
+ * can not be used, in which case the caller turns it off.
+ */
+int fchr_execplan_init(void)
+{
+	int made;
+
+	execplan_shared = fchr_shared_table(EXECPLAN_ENV, "fakechroot-execplan",
+			sizeof(*execplan_shared), EXECPLAN_MAGIC, &made);
+
+	dprintf("### exec plan cache %s\n", execplan_shared ? "on" : "unavailable");
+
+	return execplan_shared != NULL;
+}
+
+static inline struct execplan_entry *execplan_slot(unsigned int hash, int i)
+{
+	return &execplan_shared->entries[(hash + i) & (EXECPLAN_SLOTS - 1)];
+}
+
+static inline int execplan_same(const struct execplan_entry *e,
+		const struct stat *st)
+{
+	return e->dev == st->st_dev && e->ino == st->st_ino &&
+		e->size == st->st_size && e->mtime == st->st_mtim.tv_sec &&
+		e->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+static void execplan_miss(void)
+{
+	if (fchr_opts & OPT_STATS)
+		__atomic_add_fetch(&execplan_misses, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * What the file at absolute host path was found to be, if it did not
+ * change since: the kind, ELF header fields and "#!" line of p are filled
+ * in as fchr_probe() would, and 0 returned.  FCHR_FALLBACK otherwise.
+ */
+int fchr_execplan_lookup(const char *path, struct fchr_probe *p)
+{
+	struct execplan_entry *e, copy;
+	unsigned int hash, seq;
+	struct stat st;
+	size_t path_len;
+	int i, saved_errno;
+
+	if (execplan_shared == NULL || path == NULL || *path != '/')
+		return FCHR_FALLBACK;
+	hash = fchr_pathcache_hash(path, &path_len);
+
+	for (i = 0; i < EXECPLAN_PROBES; i++) {
+		e = execplan_slot(hash, i);
+		seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq == 0 || (seq & 1) || e->hash != hash ||
+				e->len != path_len || memcmp(e->data, path, path_len))
+			continue;
+		copy = *e;
+		/* what was copied must not have changed meanwhile */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	if (i == EXECPLAN_PROBES || copy.line_len > sizeof(p->head)) {
+		execplan_miss();
+		return FCHR_FALLBACK;
+	}
+
+	/* the program must still be the file the entry was made from */
+	saved_errno = errno;
+	if (fchr_statcache(FCHR_STATCACHE_STAT, path, 0, &st,
+				next_stat(path, &st)) != 0 || !execplan_same(&copy, &st)) {
+		errno = saved_errno;
+		execplan_miss();
+		return FCHR_FALLBACK;
+	}
+
+	if (fchr_opts & OPT_STATS)
+		__atomic_add_fetch(&execplan_hits, 1, __ATOMIC_RELAXED);
+	p->kind = copy.kind;
+	p->elf_class = copy.elf_class;
+	p->elf_data = copy.elf_data;
+	p->machine = copy.machine;
+	p->len = p->line_len = copy.line_len;
+	memcpy(p->head, copy.data + path_len + 1, copy.line_len);
+
+	return 0;
+}
+
+/* The program at absolute host path was probed as p, with FCHR_PROBE_STAT */
+void fchr_execplan_store(const char *path, const struct fchr_probe *p)
+{
+	struct execplan_entry *e, *victim;
+	unsigned int hash, seq;
+	struct timespec now;
+	size_t path_len, len = p->line_len;
+	int i;
+
+	if (execplan_shared == NULL || path == NULL || *path != '/')
+		return;
+	hash = fchr_pathcache_hash(path, &path_len);
+	if (path_len + len + 2 > EXECPLAN_DATA)
+		return;
+
+	/* p->st was taken after the read: a file written since is too young */
+	if (!S_ISREG(p->st.st_mode) || clock_gettime(CLOCK_REALTIME, &now) != 0 ||
+			p->st.st_mtim.tv_sec + EXECPLAN_SETTLE > now.tv_sec)
+		return;
+
+	/* the slot of path if it has one, else the first free one, else home */
+	victim = NULL;
+	for (i = 0; i < EXECPLAN_PROBES; i++) {
+		e = execplan_slot(hash, i);
+		if (e->hash == hash && e->len == path_len &&
+				!memcmp(e->data, path, path_len)) {
+			victim = e;
+			break;
+		}
+		if (victim == NULL && __atomic_load_n(&e->seq, __ATOMIC_RELAXED) == 0)
+			victim = e;
+	}
+	if (victim == NULL)
+		victim = execplan_slot(hash, 0);
+
+	seq = __atomic_load_n(&victim->seq, __ATOMIC_RELAXED);
+	if ((seq & 1) || !__atomic_compare_exchange_n(&victim->seq, &seq, seq + 1,
+				0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	victim->hash = hash;
+	victim->len = path_len;
+	victim->line_len = len;
+	victim->kind = p->kind;
+	victim->elf_class = p->elf_class;
+	victim->elf_data = p->elf_data;
+	victim->machine = p->machine;
+	victim->dev = p->st.st_dev;
+	victim->ino = p->st.st_ino;
+	victim->size = p->st.st_size;
+	victim->mtime = p->st.st_mtim.tv_sec;
+	victim->mtime_nsec = p->st.st_mtim.tv_nsec;
+	memcpy(victim->data, path, path_len + 1);
+	memcpy(victim->data + path_len + 1, p->head, len);
+	victim->data[path_len + 1 + len] = '\0';
+
+	__atomic_store_n(&victim->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void fchr_execplan_stats(void)
+{
+	unsigned long hits = execplan_hits, misses = execplan_misses;
+
+	fprintf(stderr, "fakechroot: exec plan cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+			hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
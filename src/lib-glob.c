@@ -0,0 +1,203 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * glob() and glob64() of libc on a host pattern, for the wrappers, the
+ * sysroot index and the overlay.
+ *
+ * libc runs under fchr_direct(), so that the paths it works on are left
+ * alone, but it calls back into the program as well: errfunc, and the
+ * directory functions of a caller passing GLOB_ALTDIRFUNC.  Those run
+ * with the guard down and are given guest paths, as in a real chroot.
+ * Their targets are kept per thread for the duration of the call; a
+ * glob() made from within one of them stacks its own.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+struct glob_user {
+	int (*errfunc)(const char *, int);
+	void (*closedir)(void *);
+	void *(*readdir)(void *);
+	void *(*opendir)(const char *);
+	int (*lstat)(const char *, void *);
+	int (*stat)(const char *, void *);
+};
+
+static __thread struct glob_user *glob_user;
+
+/* the guest path of host path, in buf; called with the guard down */
+static const char *glob_guest(const char *path, char *buf)
+{
+	size_t len = strlen(path);
+
+	if (len >= FAKECHROOT_PATHBUF)
+		return path;
+	memcpy(buf, path, len + 1);
+	narrow_chroot_path_modify(buf);
+
+	return buf;
+}
+
+static int glob_errfunc(const char *path, int err)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	unsigned int nested = fchr_nested;
+	int ret;
+
+	fchr_nested = 0;
+	ret = glob_user->errfunc(glob_guest(path, buf), err);
+	fchr_nested = nested;
+
+	return ret;
+}
+
+static void glob_closedir(void *dir)
+{
+	unsigned int nested = fchr_nested;
+
+	fchr_nested = 0;
+	glob_user->closedir(dir);
+	fchr_nested = nested;
+}
+
+static void *glob_readdir(void *dir)
+{
+	unsigned int nested = fchr_nested;
+	void *ret;
+
+	fchr_nested = 0;
+	ret = glob_user->readdir(dir);
+	fchr_nested = nested;
+
+	return ret;
+}
+
+static void *glob_opendir(const char *path)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	unsigned int nested = fchr_nested;
+	void *ret;
+
+	fchr_nested = 0;
+	ret = glob_user->opendir(glob_guest(path, buf));
+	fchr_nested = nested;
+
+	return ret;
+}
+
+static int glob_lstat(const char *path, void *st)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	unsigned int nested = fchr_nested;
+	int ret;
+
+	fchr_nested = 0;
+	ret = glob_user->lstat(glob_guest(path, buf), st);
+	fchr_nested = nested;
+
+	return ret;
+}
+
+static int glob_stat(const char *path, void *st)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	unsigned int nested = fchr_nested;
+	int ret;
+
+	fchr_nested = 0;
+	ret = glob_user->stat(glob_guest(path, buf), st);
+	fchr_nested = nested;
+
+	return ret;
+}
+
+/* the caller's directory functions of g moved to u, ours put in place */
+#define glob_swap(g, u) \
+	do { \
+		(u)->closedir = (void *)(g)->gl_closedir; \
+		(u)->readdir = (void *)(g)->gl_readdir; \
+		(u)->opendir = (void *)(g)->gl_opendir; \
+		(u)->lstat = (void *)(g)->gl_lstat; \
+		(u)->stat = (void *)(g)->gl_stat; \
+		(g)->gl_closedir = (void *)glob_closedir; \
+		(g)->gl_readdir = (void *)glob_readdir; \
+		(g)->gl_opendir = (void *)glob_opendir; \
+		(g)->gl_lstat = (void *)glob_lstat; \
+		(g)->gl_stat = (void *)glob_stat; \
+	} while (0)
+
+#define glob_unswap(g, u) \
+	do { \
+		(g)->gl_closedir = (void *)(u)->closedir; \
+		(g)->gl_readdir = (void *)(u)->readdir; \
+		(g)->gl_opendir = (void *)(u)->opendir; \
+		(g)->gl_lstat = (void *)(u)->lstat; \
+		(g)->gl_stat = (void *)(u)->stat; \
+	} while (0)
+
+/*
+ * The next glob(), or glob64() if large, of the host pattern.  altdir
+ * tells that the directory functions of pglob are the caller's, rather
+ * than those of the library.
+ */
+int fchr_glob_next(const char *pattern, int flags,
+		int (*errfunc)(const char *, int), void *pglob, int large, int altdir)
+{
+	struct glob_user user, *outer = glob_user;
+	int ret;
+
+	altdir = altdir && (flags & GLOB_ALTDIRFUNC);
+	if (errfunc == NULL && !altdir) {
+#ifdef HAVE_GLOB64
+		if (large)
+			return fchr_direct(NEXTCALL(glob64)(pattern, flags, NULL, pglob));
+#endif
+		return fchr_direct(NEXTCALL(glob)(pattern, flags, NULL, pglob));
+	}
+
+	user.errfunc = errfunc;
+	glob_user = &user;
+#ifdef HAVE_GLOB64
+	if (large) {
+		if (altdir)
+			glob_swap((glob64_t *)pglob, &user);
+		ret = fchr_direct(NEXTCALL(glob64)(pattern, flags,
+					errfunc ? glob_errfunc : NULL, pglob));
+		if (altdir)
+			glob_unswap((glob64_t *)pglob, &user);
+		glob_user = outer;
+
+		return ret;
+	}
+#endif
+	if (altdir)
+		glob_swap((glob_t *)pglob, &user);
+	ret = fchr_direct(NEXTCALL(glob)(pattern, flags,
+				errfunc ? glob_errfunc : NULL, pglob));
+	if (altdir)
+		glob_unswap((glob_t *)pglob, &user);
+	glob_user = outer;
+
+	return ret;
+}
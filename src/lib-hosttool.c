@@ -0,0 +1,302 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Host tool substitution map (FAKECHROOT_HOSTTOOLS) and per architecture
+ * exec rules (FAKECHROOT_ARCH_RULES).
+ *
+ * A cross root holds gzip, sed, perl or sh built for the target, which
+ * only run emulated, although the host's own copies would do the same
+ * work at full speed.  FAKECHROOT_HOSTTOOLS lists, colon separated, the
+ * programs execve() runs from the host instead:
+ *
+ *   FAKECHROOT_HOSTTOOLS=/bin/sh=/bin/dash:gzip=/bin/gzip:perl=/usr/bin/perl -W
+ *
+ * The name left of the first '=' is either the absolute guest path a
+ * program is executed by, or a basename matching it in any directory;
+ * the full path is tried first.  Right of it is the host program, then
+ * arguments, separated by blanks, put in front of those of the caller.
+ * argv[0] is passed on unchanged.  The interpreter a "#!" script names is
+ * looked up the same way, by its path in the script.
+ *
+ * Binaries not listed are probed, and FAKECHROOT_ARCH_RULES says how
+ * those of each architecture run, by the names of lib-cross.c:
+ *
+ *   FAKECHROOT_ARCH_RULES=aarch64=/usr/bin/qemu-aarch64 -U LD_PRELOAD:i386=native
+ *
+ * "native" hands the binary to the kernel as it is, "loader" runs it the
+ * way of the cross tree (see execve.c), the default, and a host program
+ * is a user mode emulator in the manner of qemu: it is given its
+ * arguments, then "-L" with the fake root, "-0" with argv[0], the binary
+ * and the arguments of the caller.  Binaries the host runs itself are
+ * never emulated.  The rule of an interpreter which is a binary decides
+ * how it runs a script; static ones go to the seccomp supervisor as well.
+ *
+ * Both are built into tables for each generation of the configuration,
+ * on first use, the names of programs hashed so that a miss costs a hash
+ * of the path and of its basename; superseded tables are never freed, as
+ * with configuration snapshots.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#define HOSTTOOL_ENV "FAKECHROOT_HOSTTOOLS"
+#define RULES_ENV    "FAKECHROOT_ARCH_RULES"
+
+struct hosttool_entry {
+	const char *name;
+	size_t len;
+	unsigned int hash;
+	struct fchr_hosttool tool;
+};
+
+struct hosttool_rule {
+	int arch;					/* see fchr_elf_arch() */
+	int how;					/* FCHR_RUN_* */
+	struct fchr_hosttool emulator;
+};
+
+struct hosttool_table {
+	unsigned int generation;
+	size_t count;
+	size_t nrules;
+	struct hosttool_rule *rules;
+	size_t mask;				/* slots, a power of two, less one */
+	struct hosttool_entry *slot[];
+};
+
+static const struct hosttool_table *hosttool_table;
+
+/* the words of s, blank separated, stored at argv; their number */
+static int hosttool_split(char *s, char **argv)
+{
+	int n = 0;
+
+	for (;;) {
+		while (*s == ' ' || *s == '\t')
+			*s++ = '\0';
+		if (*s == '\0')
+			return n;
+		argv[n++] = s;
+		s += strcspn(s, " \t");
+	}
+}
+
+/*
+ * The next "name=value" item of the colon separated list at *s, split in
+ * place, with its value left in *value; NULL at the end of the list.
+ * Items without a name are skipped.
+ */
+static char *hosttool_item(char **s, char **value)
+{
+	char *item, *next;
+
+	while ((item = *s) != NULL) {
+		if ((next = strchr(item, ':')) != NULL)
+			*next++ = '\0';
+		*s = next;
+		if ((*value = strchr(item, '=')) != NULL && *value != item) {
+			*(*value)++ = '\0';
+			return item;
+		}
+	}
+
+	return NULL;
+}
+
+/* the items of list, at most */
+static size_t hosttool_items(const char *list)
+{
+	size_t n = 1;
+
+	for (; list != NULL && *list; list++)
+		n += *list == ':';
+
+	return n;
+}
+
+/* the entry of name in t; NULL if there is none */
+static const struct fchr_hosttool *hosttool_get(const struct hosttool_table *t,
+		const char *name)
+{
+	const struct hosttool_entry *e;
+	unsigned int hash;
+	size_t len, i;
+
+	hash = fchr_pathcache_hash(name, &len);
+	for (i = hash & t->mask; (e = t->slot[i]) != NULL; i = (i + 1) & t->mask)
+		if (e->hash == hash && e->len == len && !memcmp(e->name, name, len))
+			return &e->tool;
+
+	return NULL;
+}
+
+/*
+ * The tables of the current configuration, of FAKECHROOT_HOSTTOOLS and
+ * FAKECHROOT_ARCH_RULES; NULL if they can not be built.  Entries are
+ * taken in order, so the first of the same name wins.
+ */
+static const struct hosttool_table *hosttool_current(void)
+{
+	const struct fchr_config *c = fchr_conf();
+	const struct hosttool_table *cur;
+	struct hosttool_table *t;
+	struct hosttool_entry *e;
+	struct hosttool_rule *r;
+	const char *tools, *rules;
+	size_t count, nrules, slots, tools_len, rules_len, i;
+	char *strings, *s, *name, *value, **args;
+	int nargs, arch;
+
+	cur = __atomic_load_n(&hosttool_table, __ATOMIC_ACQUIRE);
+	if (cur != NULL && cur->generation == c->generation)
+		return cur;
+
+	tools = getenv(HOSTTOOL_ENV);
+	rules = getenv(RULES_ENV);
+	count = hosttool_items(tools);
+	nrules = hosttool_items(rules);
+	for (slots = 4; slots < 2 * count; slots <<= 1)
+		;
+	tools_len = tools ? strlen(tools) + 1 : 0;
+	rules_len = rules ? strlen(rules) + 1 : 0;
+
+	/* the slots, the entries, the rules, argument vectors, then the lists */
+	t = malloc(sizeof(*t) + slots * sizeof(t->slot[0]) + count * sizeof(*e) +
+			nrules * sizeof(*r) + (tools_len + rules_len) * (sizeof(char *) + 1));
+	if (t == NULL)
+		return NULL;
+	memset(t, 0, sizeof(*t) + slots * sizeof(t->slot[0]));
+	e = (struct hosttool_entry *)&t->slot[slots];
+	t->rules = r = (struct hosttool_rule *)&e[count];
+	args = (char **)&r[nrules];
+	strings = (char *)&args[tools_len + rules_len];
+	t->generation = c->generation;
+	t->mask = slots - 1;
+
+	s = tools ? memcpy(strings, tools, tools_len) : NULL;
+	while ((name = hosttool_item(&s, &value)) != NULL) {
+		/* names are absolute guest paths or basenames */
+		if (*name != '/' && strchr(name, '/') != NULL)
+			continue;
+		/* the host program must be absolute too: no PATH is searched */
+		if ((nargs = hosttool_split(value, args)) == 0 || *args[0] != '/' ||
+				hosttool_get(t, name) != NULL)
+			continue;
+
+		e->name = name;
+		e->hash = fchr_pathcache_hash(name, &e->len);
+		e->tool.host = args[0];
+		e->tool.args = args + 1;
+		e->tool.nargs = nargs - 1;
+		args += nargs;
+		for (i = e->hash & t->mask; t->slot[i] != NULL; i = (i + 1) & t->mask)
+			;
+		t->slot[i] = e++;
+		t->count++;
+		dprintf("### host tool %s: %s, %d args\n", name, e[-1].tool.host, nargs - 1);
+	}
+
+	s = rules ? memcpy(strings + tools_len, rules, rules_len) : NULL;
+	while ((name = hosttool_item(&s, &value)) != NULL) {
+		if ((arch = fchr_arch_find(name)) == -1)
+			continue;
+		for (i = 0; i < t->nrules && t->rules[i].arch != arch; i++)
+			;
+		if (i < t->nrules)
+			continue;
+
+		memset(r, 0, sizeof(*r));
+		r->arch = arch;
+		if ((nargs = hosttool_split(value, args)) == 1 && !strcmp(args[0], "native"))
+			r->how = FCHR_RUN_NATIVE;
+		else if (nargs == 1 && !strcmp(args[0], "loader"))
+			r->how = FCHR_RUN_LOADER;
+		else if (nargs > 0 && *args[0] == '/') {
+			r->how = FCHR_RUN_EMULATOR;
+			r->emulator.host = args[0];
+			r->emulator.args = args + 1;
+			r->emulator.nargs = nargs - 1;
+			args += nargs;
+		} else
+			continue;
+		r++;
+		t->nrules++;
+		dprintf("### %s binaries: %s\n", fchr_arch_name(arch), value);
+	}
+
+	__atomic_store_n(&hosttool_table, t, __ATOMIC_RELEASE);
+
+	return t;
+}
+
+/*
+ * The host program configured for the guest path a program is executed
+ * by, before it is translated; NULL if there is none.
+ */
+const struct fchr_hosttool *fchr_hosttool_find(const char *path)
+{
+	const struct hosttool_table *t;
+	const struct fchr_hosttool *tool;
+	const char *base;
+
+	if (path == NULL || *path == '\0' || (t = hosttool_current()) == NULL ||
+			t->count == 0)
+		return NULL;
+
+	if (*path == '/' && (tool = hosttool_get(t, path)) != NULL)
+		return tool;
+	base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+
+	return *base ? hosttool_get(t, base) : NULL;
+}
+
+/* whether FAKECHROOT_ARCH_RULES has any rule */
+int fchr_hosttool_rules(void)
+{
+	const struct hosttool_table *t = hosttool_current();
+
+	return t != NULL && t->nrules > 0;
+}
+
+/*
+ * How binaries of architecture arch, from fchr_elf_arch(), are to be run:
+ * FCHR_RUN_*, with the emulator left in *emulator for FCHR_RUN_EMULATOR.
+ */
+int fchr_hosttool_rule(int arch, const struct fchr_hosttool **emulator)
+{
+	const struct hosttool_table *t;
+	size_t i;
+
+	if (arch == -1 || (t = hosttool_current()) == NULL)
+		return FCHR_RUN_LOADER;
+
+	for (i = 0; i < t->nrules; i++)
+		if (t->rules[i].arch == arch) {
+			*emulator = &t->rules[i].emulator;
+			return t->rules[i].how;
+		}
+
+	return FCHR_RUN_LOADER;
+}
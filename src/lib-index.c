@@ -0,0 +1,650 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Sysroot manifest (FAKECHROOT_INDEX).
+ *
+ * fakechroot-index walks a tree which does not change, a sysroot say,
+ * and writes down what is in it.  A process started with FAKECHROOT_INDEX
+ * naming that manifest maps it and answers from it, for host paths inside
+ * the tree, what would otherwise take system calls:
+ *
+ *  - names which do not exist, for the stat family and access(), and for
+ *    the lookups of the path resolver, which also gets types and symlink
+ *    targets from it;
+ *  - access(F_OK) of names which do;
+ *  - the listings scandir() and glob() make, the latter through
+ *    GLOB_ALTDIRFUNC;
+ *  - the ELF class, byte order and machine is_our_elf() checks.
+ *
+ * opendir() still needs a descriptor to give out and fts keeps to libc's
+ * own calls, so those read the real directories.
+ *
+ * The manifest is used only if its header is consistent with the file,
+ * which fakechroot-index replaces by a rename(), and the root directory
+ * still has the modification time recorded.  The checksum of the whole
+ * file is only verified with FAKECHROOT_OPTS=D or S: every process would
+ * otherwise fault in all of the manifest before main().  Each listing
+ * first compares the time of the directory listed, and so does every
+ * name reported missing, with the nearest directory the manifest has on
+ * its way; a directory which changed means the manifest is stale, and the
+ * process goes back to the real filesystem for everything.  Changes which
+ * leave the directories alone, a file written in place, are not noticed:
+ * index the tree again after any change.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+#include "index.h"
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define INDEX_ENV "FAKECHROOT_INDEX"
+
+static const struct fchr_index_header *index_header;
+static const struct fchr_index_entry *index_entries;
+static const char *index_strings;
+static const char *index_root;
+static size_t index_root_len;
+
+/* process wide counters, only maintained with OPT_STATS */
+static unsigned long index_hits, index_misses;
+
+static inline void index_count(int answered)
+{
+	if (fchr_opts & OPT_STATS)
+		__atomic_add_fetch(answered ? &index_hits : &index_misses, 1,
+				__ATOMIC_RELAXED);
+}
+
+/* the tree changed under the manifest: stop using it */
+static void index_stale(const char *path)
+{
+	dprintf("### %s changed, sysroot index disabled\n", path);
+	__atomic_and_fetch(&fchr_opts, ~OPT_INDEX, __ATOMIC_RELAXED);
+}
+
+static int index_fresh(const char *path, const struct fchr_index_entry *e)
+{
+	struct stat st;
+
+	if (next_lstat(path, &st) != 0 || st.st_mtim.tv_sec != e->mtime ||
+			st.st_mtim.tv_nsec != e->mtime_nsec) {
+		index_stale(path);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Map the manifest FAKECHROOT_INDEX names.  Returns 0 when there is none,
+ * or it is damaged or stale.
+ */
+int fchr_index_init(void)
+{
+	const char *file = getenv(INDEX_ENV);
+	const struct fchr_index_header *h;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (file == NULL || *file == '\0')
+		return 0;
+
+	if ((fd = next_open(file, O_RDONLY | O_CLOEXEC, 0)) < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*h) ||
+			(map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+
+	h = map;
+	if (memcmp(h->magic, FCHR_INDEX_MAGIC, sizeof(h->magic)) ||
+			h->version != FCHR_INDEX_VERSION ||
+			h->byte_order != FCHR_INDEX_BYTE_ORDER ||
+			h->size != (uint64_t)st.st_size || h->size % 8 ||
+			h->count == 0 || h->entries != sizeof(*h) ||
+			h->strings != h->entries + (uint64_t)h->count * sizeof(*index_entries) ||
+			h->strings + h->root + h->root_len >= h->size ||
+			((fchr_opts & (OPT_DEBUG | OPT_STATS)) &&
+			 fchr_index_sum(h + 1, h->size - sizeof(*h)) != h->checksum)) {
+		dprintf("### %s: not a usable sysroot index\n", file);
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	index_header = h;
+	index_entries = (const void *)((const char *)map + h->entries);
+	index_strings = (const char *)map + h->strings;
+	index_root = index_strings + h->root;
+	index_root_len = h->root_len;
+
+	if (!index_fresh(index_root_len ? index_root : "/", &index_entries[0])) {
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Path of host path in the indexed tree, or NULL if it lies outside or is
+ * not in the canonical form the manifest has: no ".", ".." or empty names.
+ */
+static const char *index_rel(const char *path)
+{
+	const char *p, *name;
+
+	if (path == NULL || !(fchr_opts & OPT_INDEX) ||
+			strncmp(path, index_root, index_root_len))
+		return NULL;
+	path += index_root_len;
+	if (*path == '\0')
+		return path;
+	if (*path++ != '/')
+		return NULL;
+	if (*path == '\0')
+		return index_root_len ? NULL : path;
+
+	for (name = p = path; ; p++)
+		if (*p == '/' || *p == '\0') {
+			if (p == name || (name[0] == '.' &&
+						(p == name + 1 || (name[1] == '.' && p == name + 2))))
+				return NULL;
+			if (*p == '\0')
+				return path;
+			name = p + 1;
+		}
+}
+
+/* entry of relative path rel of len bytes */
+static const struct fchr_index_entry *index_find(const char *rel, size_t len)
+{
+	const char *slash = memrchr(rel, '/', len);
+	size_t dir_len = slash ? slash - rel : 0;
+	const char *name = slash ? slash + 1 : rel;
+	size_t name_len = len - (slash ? dir_len + 1 : 0);
+	size_t lo = 0, hi = index_header->count, mid;
+	int r;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		r = fchr_index_cmp(rel, dir_len, name, name_len, index_strings,
+				&index_entries[mid]);
+		if (r == 0)
+			return &index_entries[mid];
+		if (r < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+/*
+ * Whether the directory of host path, the first len bytes of its path rel
+ * in the tree, still is as indexed; the manifest is dropped if it is not.
+ */
+static int index_dir_fresh(const char *path, const char *rel, size_t len)
+{
+	const struct fchr_index_entry *d = index_find(rel, len);
+	char dir[FAKECHROOT_PATHBUF];
+	size_t dir_len = (rel - path) + len;
+
+	if (d == NULL || dir_len >= sizeof(dir))
+		return 0;
+	memcpy(dir, path, dir_len);
+	dir[dir_len] = '\0';
+
+	return index_fresh(dir, d);
+}
+
+/*
+ * Entry of host path: 0 with *ep set, -1 with errno set if the manifest
+ * knows it does not exist, FCHR_FALLBACK if it can not tell.  Only the
+ * latter two are counted; callers count what they make of an entry.  A
+ * name is only reported missing once the directory it would be in, or
+ * which holds the file standing in for one, still has the time indexed.
+ */
+static int index_lookup(const char *path, const struct fchr_index_entry **ep)
+{
+	const struct fchr_index_entry *e;
+	const char *rel = index_rel(path), *slash;
+	size_t len;
+
+	if (rel == NULL)
+		return FCHR_FALLBACK;
+
+	len = strlen(rel);
+	if ((*ep = index_find(rel, len)) != NULL)
+		return 0;
+
+	/* the nearest ancestor there is tells why */
+	while (len > 0) {
+		slash = memrchr(rel, '/', len);
+		len = slash ? (size_t)(slash - rel) : 0;
+		if ((e = index_find(rel, len)) != NULL) {
+			if (S_ISLNK(e->mode) || !index_dir_fresh(path, rel,
+						S_ISDIR(e->mode) ? len : e->dir_len)) {
+				index_count(0);
+				return FCHR_FALLBACK;
+			}
+			index_count(1);
+			errno = S_ISDIR(e->mode) ? ENOENT : ENOTDIR;
+			return -1;
+		}
+	}
+
+	index_count(0);
+	return FCHR_FALLBACK;
+}
+
+#define index_fill(st, e) \
+	do { \
+		memset((st), 0, sizeof(*(st))); \
+		(st)->st_mode = (e)->mode; \
+		(st)->st_ino = (e)->ino; \
+		(st)->st_nlink = 1; \
+		(st)->st_size = (e)->size; \
+		(st)->st_mtim.tv_sec = (e)->mtime; \
+		(st)->st_mtim.tv_nsec = (e)->mtime_nsec; \
+	} while (0)
+
+/*
+ * lstat() of host path from the manifest: only the type and mode, inode,
+ * size and modification time are filled in.  FCHR_FALLBACK if the path is
+ * not indexed.
+ */
+int fchr_index_lstat(const char *path, struct stat *st)
+{
+	const struct fchr_index_entry *e;
+	int ret = index_lookup(path, &e);
+
+	if (ret == 0) {
+		index_fill(st, e);
+		index_count(1);
+	}
+
+	return ret;
+}
+
+/* readlink() of host path, FCHR_FALLBACK if it is not indexed */
+ssize_t fchr_index_readlink(const char *path, char *buf, size_t size)
+{
+	const struct fchr_index_entry *e;
+	int ret = index_lookup(path, &e);
+	size_t len;
+
+	if (ret != 0)
+		return ret;
+	index_count(1);
+	if (!S_ISLNK(e->mode)) {
+		errno = EINVAL;
+		return -1;
+	}
+	len = e->target_len < size ? e->target_len : size;
+	memcpy(buf, index_strings + e->target, len);
+
+	return len;
+}
+
+/*
+ * What the stat cache call kind (FCHR_STATCACHE_*) with arg on host path
+ * returns, if the manifest can tell: a failure for a name which is not
+ * there, success for access(F_OK) of one which is.
+ */
+int fchr_index_stat(int kind, const char *path, int arg)
+{
+	const struct fchr_index_entry *e;
+	int ret = index_lookup(path, &e);
+
+	if (ret == 0) {
+		if ((kind != FCHR_STATCACHE_ACCESS && kind != FCHR_STATCACHE_EACCESS) ||
+				arg != F_OK || S_ISLNK(e->mode))
+			ret = FCHR_FALLBACK;
+		index_count(ret == 0);
+	}
+
+	return ret;
+}
+
+/*
+ * ELF class, byte order and machine of host path, into those of p, which
+ * are ELFCLASSNONE and EM_NONE for other files; -1 if it does not exist.
+ */
+int fchr_index_elf(const char *path, struct fchr_probe *p)
+{
+	const struct fchr_index_entry *e;
+	int ret = index_lookup(path, &e);
+
+	if (ret == 0) {
+		if (S_ISLNK(e->mode))
+			ret = FCHR_FALLBACK;
+		index_count(ret == 0);
+	}
+	if (ret == 0) {
+		p->elf_class = e->machine ? e->elf_class : ELFCLASSNONE;
+		p->elf_data = e->elf_data;
+		p->machine = e->machine;
+	}
+
+	return ret;
+}
+
+/*
+ * Directory entry of host path dir whose listing the manifest has, or
+ * NULL: with errno set and *ret -1 if there is no such directory, with
+ * *ret FCHR_FALLBACK if it can not tell.
+ */
+static const struct fchr_index_entry *index_dir(const char *dir, int *ret)
+{
+	const struct fchr_index_entry *e;
+
+	if ((*ret = index_lookup(dir, &e)) != 0)
+		return NULL;
+	if (S_ISLNK(e->mode) || !index_fresh(dir, e)) {
+		index_count(0);
+		*ret = FCHR_FALLBACK;
+		return NULL;
+	}
+	index_count(1);
+	if (!S_ISDIR(e->mode)) {
+		errno = ENOTDIR;
+		*ret = -1;
+		return NULL;
+	}
+
+	return e;
+}
+
+/* inode of the parent of directory e */
+static uint64_t index_parent_ino(const struct fchr_index_entry *e)
+{
+	const struct fchr_index_entry *p;
+
+	if (e == index_entries)
+		return index_header->parent_ino;
+	p = index_find(index_strings + e->path, e->dir_len);
+
+	return p ? p->ino : e->ino;
+}
+
+/*
+ * Entry k of the listing of directory e into the dirent or dirent64 d:
+ * "." and ".." come first, then the children.  Returns the size of the
+ * entry, 0 past the end.
+ */
+#define index_dirent(d, e, k) \
+	({ \
+		size_t fakechroot_size = 0; \
+		const char *fakechroot_name = NULL; \
+		if ((k) == 0) { \
+			(d)->d_ino = (e)->ino; \
+			(d)->d_type = DT_DIR; \
+			fakechroot_name = "."; \
+		} else if ((k) == 1) { \
+			(d)->d_ino = index_parent_ino(e); \
+			(d)->d_type = DT_DIR; \
+			fakechroot_name = ".."; \
+		} else if ((k) - 2 < (e)->nchildren) { \
+			const struct fchr_index_entry *fakechroot_c = \
+				&index_entries[(e)->children + (k) - 2]; \
+			(d)->d_ino = fakechroot_c->ino; \
+			(d)->d_type = IFTODT(fakechroot_c->mode); \
+			fakechroot_name = fchr_index_name(index_strings, fakechroot_c); \
+		} \
+		if (fakechroot_name != NULL) { \
+			fakechroot_size = offsetof(__typeof__(*(d)), d_name) + \
+				strlen(fakechroot_name) + 1; \
+			(d)->d_off = (k) + 1; \
+			(d)->d_reclen = (fakechroot_size + 7) & ~(size_t)7; \
+			strcpy((d)->d_name, fakechroot_name); \
+		} \
+		fakechroot_size; \
+	})
+
+/*
+ * scandir() and scandir64() of host path dir from the manifest;
+ * FCHR_FALLBACK if it is not indexed.
+ */
+int fchr_index_scandir(const char *dir, void ***namelist,
+		int (*filter)(const void *),
+		int (*compar)(const void *, const void *), int large)
+{
+	const struct fchr_index_entry *e;
+	union {
+		struct dirent d;
+#ifdef HAVE_READDIR64
+		struct dirent64 d64;
+#endif
+	} ent;
+	void **list = NULL, **grown, *copy;
+	size_t n = 0, size = 0, k, esize;
+	int ret;
+
+	if ((e = index_dir(dir, &ret)) == NULL)
+		return ret;
+
+	for (k = 0; ; k++) {
+#ifdef HAVE_READDIR64
+		if (large)
+			esize = index_dirent(&ent.d64, e, k);
+		else
+#endif
+			esize = index_dirent(&ent.d, e, k);
+		if (esize == 0)
+			break;
+
+		if (filter != NULL && !filter(&ent))
+			continue;
+		if (n == size) {
+			size = size ? 2 * size : 32;
+			if ((grown = realloc(list, size * sizeof(*list))) == NULL)
+				goto nomem;
+			list = grown;
+		}
+		if ((copy = malloc(esize)) == NULL)
+			goto nomem;
+		list[n++] = memcpy(copy, &ent, esize);
+	}
+
+	if (compar != NULL && n > 1)
+		qsort(list, n, sizeof(*list), compar);
+	*namelist = list;
+
+	return n;
+
+nomem:
+	for (k = 0; k < n; k++)
+		free(list[k]);
+	free(list);
+	errno = ENOMEM;
+
+	return -1;
+}
+
+/*
+ * Directory streams glob() reads through GLOB_ALTDIRFUNC: a listing from
+ * the manifest, or the real directory where it has none.
+ */
+struct index_dir {
+	const struct fchr_index_entry *e;
+	DIR *real;
+	size_t next;
+	union {
+		struct dirent d;
+#ifdef HAVE_READDIR64
+		struct dirent64 d64;
+#endif
+	} ent;
+};
+
+static void *index_opendir(const char *name)
+{
+	struct index_dir *d;
+	int ret;
+
+	if ((d = calloc(1, sizeof(*d))) == NULL)
+		return NULL;
+	if ((d->e = index_dir(name, &ret)) == NULL &&
+			(ret != FCHR_FALLBACK || (d->real = NEXTCALL(opendir)(name)) == NULL)) {
+		free(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+static struct dirent *index_readdir(void *p)
+{
+	struct index_dir *d = p;
+
+	if (d->real)
+		return NEXTCALL(readdir)(d->real);
+
+	return index_dirent(&d->ent.d, d->e, d->next) ? d->next++, &d->ent.d : NULL;
+}
+
+static void index_closedir(void *p)
+{
+	struct index_dir *d = p;
+
+	if (d->real)
+		NEXTCALL(closedir)(d->real);
+	free(d);
+}
+
+static int index_gl_lstat(const char *path, struct stat *st)
+{
+	int ret = fchr_index_lstat(path, st);
+
+	return ret == FCHR_FALLBACK ? next_lstat(path, st) : ret;
+}
+
+static int index_gl_stat(const char *path, struct stat *st)
+{
+	const struct fchr_index_entry *e;
+	int ret = index_lookup(path, &e);
+
+	if (ret == 0) {
+		if (S_ISLNK(e->mode))
+			ret = FCHR_FALLBACK;
+		else
+			index_fill(st, e);
+		index_count(ret == 0);
+	}
+
+	return ret == FCHR_FALLBACK ? next_stat(path, st) : ret;
+}
+
+#ifdef HAVE_GLOB64
+static struct dirent64 *index_readdir64(void *p)
+{
+	struct index_dir *d = p;
+
+	if (d->real)
+		return NEXTCALL(readdir64)(d->real);
+
+	return index_dirent(&d->ent.d64, d->e, d->next) ? d->next++, &d->ent.d64 : NULL;
+}
+
+/* glob() only looks at the type */
+static int index_gl_stat64_of(int ret, const struct stat *st, struct stat64 *st64)
+{
+	if (ret == 0) {
+		memset(st64, 0, sizeof(*st64));
+		st64->st_mode = st->st_mode;
+		st64->st_ino = st->st_ino;
+		st64->st_nlink = st->st_nlink;
+		st64->st_size = st->st_size;
+		st64->st_mtim = st->st_mtim;
+	}
+
+	return ret;
+}
+
+static int index_gl_lstat64(const char *path, struct stat64 *st64)
+{
+	struct stat st;
+
+	return index_gl_stat64_of(index_gl_lstat(path, &st), &st, st64);
+}
+
+static int index_gl_stat64(const char *path, struct stat64 *st64)
+{
+	struct stat st;
+
+	return index_gl_stat64_of(index_gl_stat(path, &st), &st, st64);
+}
+#endif
+
+/*
+ * glob() and glob64() of the host pattern, reading the indexed directories
+ * from the manifest.  FCHR_FALLBACK if the pattern does not start inside
+ * the tree or the caller brought its own directory functions.
+ */
+int fchr_index_glob(const char *pattern, int flags,
+		int (*errfunc)(const char *, int), void *pglob, int large)
+{
+	if ((flags & GLOB_ALTDIRFUNC) || index_rel(pattern) == NULL)
+		return FCHR_FALLBACK;
+
+#ifdef HAVE_GLOB64
+	if (large) {
+		glob64_t *g = pglob;
+
+		g->gl_opendir = index_opendir;
+		g->gl_readdir = index_readdir64;
+		g->gl_closedir = index_closedir;
+		g->gl_lstat = index_gl_lstat64;
+		g->gl_stat = index_gl_stat64;
+
+		return fchr_glob_next(pattern, flags | GLOB_ALTDIRFUNC, errfunc, g, 1, 0);
+	}
+#endif
+	{
+		glob_t *g = pglob;
+
+		g->gl_opendir = index_opendir;
+		g->gl_readdir = (void *)index_readdir;
+		g->gl_closedir = index_closedir;
+		g->gl_lstat = (void *)index_gl_lstat;
+		g->gl_stat = (void *)index_gl_stat;
+
+		return fchr_glob_next(pattern, flags | GLOB_ALTDIRFUNC, errfunc, g, 0, 0);
+	}
+}
+
+void fchr_index_stats(void)
+{
+	unsigned long hits = index_hits, misses = index_misses;
+
+	if (index_header == NULL)
+		return;
+	fprintf(stderr, "fakechroot: sysroot index: %lu hits, %lu misses (%.1f%% hit rate)\n",
+			hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
@@ -21,56 +21,443 @@
 
 #include "common.h"
 #include "wrapper.h"
+#include <sys/mman.h>
 
 void fakechroot_init(void) __attribute__((constructor));
+void fakechroot_fini(void) __attribute__((destructor));
 unsigned int fchr_opts = 0;
 
-/* Path to fake chroot environment: read-only, thus thread-safe */
-const char *fakechroot_path = NULL;
+/* Current configuration snapshot, see fchr_config_refresh() */
+const struct fchr_config *fchr_config = NULL;
 
-void fchr_parse_opts()
+/* Depth of fchr_direct() calls in this thread */
+__thread unsigned int fchr_nested = 0;
+
+/* not before glibc 2.34 in libc itself; a single thread then */
+#pragma weak pthread_once
+#pragma weak pthread_key_create
+#pragma weak pthread_setspecific
+
+/* A table of fchr_thread_table(), listed by thread */
+struct fchr_thread_table {
+	void **slot;
+	size_t size;
+	struct fchr_thread_table *next;
+};
+
+static __thread struct fchr_thread_table *fchr_thread_tables;
+static __thread int fchr_thread_initial;
+static pthread_once_t fchr_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t fchr_thread_key;
+
+/* Whether unbound wrappers may be pointed at the next definitions */
+static int fchr_passthrough = 0;
+
+static void fchr_dispatch_update(const struct fchr_config *c);
+
+/* Variables the snapshot is built from, see FCHR_VAR_* */
+const char *const fchr_config_vars[] = {
+	"FAKECHROOT_BASE",
+	"FAKECHROOT_LOWER",
+	"FAKECHROOT_CROSS",
+	"CROSS_SHELL_ARCH",
+	"FAKECHROOT_MOUNTS",
+	"FAKECHROOT_MOUNTS_FILE",
+	"FAKECHROOT_IMMUTABLE",
+	"FAKECHROOT_HOSTTOOLS",
+	"FAKECHROOT_ARCH_RULES",
+	NULL
+};
+
+/*
+ * Check whether an environment variable feeds the configuration snapshot.
+ * Accepts both "NAME" and "NAME=value" forms.
+ */
+int fchr_config_var(const char *name)
 {
-	char *optvar = getenv(FCHR_OPT_ENV);
+	const char *const *v;
+	size_t len;
+
+	if (!name)
+		return 0;
+
+	len = strcspn(name, "=");
+	for (v = fchr_config_vars; *v; v++)
+		if (strlen(*v) == len && !strncmp(*v, name, len))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Work out the configuration the variables val, indexed by FCHR_VAR_*,
+ * stand for, without publishing it: the strings of c point into val, and
+ * only the mount table is allocated.  Neither generation nor root_fd are
+ * set.
+ */
+void fchr_config_make(const char *const val[], struct fchr_config *c)
+{
+	const char *root = val[FCHR_VAR_BASE], *lower = val[FCHR_VAR_LOWER];
+	size_t root_len, lower_len;
+
+	memset(c, 0, sizeof(*c));
+	c->root_fd = -1;
+
+	root_len = root ? strlen(root) : 0;
+	/* trailing slashes would break the component boundary check; "/" becomes "" */
+	while (root_len > 0 && root[root_len - 1] == '/')
+		root_len--;
+	lower_len = lower ? strlen(lower) : 0;
+	while (lower_len > 0 && lower[lower_len - 1] == '/')
+		lower_len--;
+	/* an overlay needs both layers, and the host's / makes no lower one */
+	if (root && lower_len > 0) {
+		c->lower = lower;
+		c->lower_len = lower_len;
+	}
+	c->root = root;
+	c->root_len = root_len;
+
+	c->cross_arch = cross_find(val[FCHR_VAR_CROSS], val[FCHR_VAR_CROSS_ARCH]);
+	if (c->cross_arch != -1) {
+		c->cross = val[FCHR_VAR_CROSS];
+		c->cross_len = strlen(c->cross);
+	}
+
+	c->mounts = fchr_mounts_build(val[FCHR_VAR_MOUNTS],
+			val[FCHR_VAR_MOUNTS_FILE]);
+}
+
+/*
+ * Publish the configuration d, from fchr_config_make(), as a new snapshot.
+ *
+ * Strings are copied into the snapshot, as setenv() is free to release the
+ * ones environ points to; the mount table is taken over.  Superseded
+ * snapshots are never freed: another thread may still be translating a
+ * path with one of them, and they only change on chroot() or an explicit
+ * environment update.
+ */
+const struct fchr_config *fchr_config_publish(const struct fchr_config *d)
+{
+	static unsigned int generation;
+	const struct fchr_config *old;
+	struct fchr_config *c;
 	char *p;
 
-	if (!optvar)
-		return;
+	c = malloc(sizeof(struct fchr_config) + d->root_len + d->lower_len +
+			d->cross_len + 3);
+	old = __atomic_load_n(&fchr_config, __ATOMIC_ACQUIRE);
+	if (!c) {
+		static const struct fchr_config empty = {
+			.cross_arch = -1, .root_fd = -1
+		};
+
+		return old ? old : &empty;
+	}
+
+	*c = *d;
+	c->generation = __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+	p = (char *)(c + 1);
+	c->root = d->root ? memcpy(p, d->root, d->root_len) : NULL;
+	p[d->root_len] = '\0';
+	p += d->root_len + 1;
+	c->lower = d->lower ? memcpy(p, d->lower, d->lower_len) : NULL;
+	p[d->lower_len] = '\0';
+	p += d->lower_len + 1;
+	c->cross = d->cross ? memcpy(p, d->cross, d->cross_len) : NULL;
+	p[d->cross_len] = '\0';
+	/* shared with the old snapshot if the root is the same; never closed either */
+	c->root_fd = fchr_root_fd_init(c->root, c->root_len, old);
 
-	for (p = optvar; *p; p++) {
+	__atomic_store_n(&fchr_config, c, __ATOMIC_RELEASE);
+	fchr_dispatch_update(c);
+
+	return c;
+}
+
+/*
+ * The first snapshot, for a wrapper called before our constructor: the
+ * one of the session handed on by the parent, else from the environment.
+ */
+const struct fchr_config *fchr_config_init(void)
+{
+	if (fchr_session_attach())
+		return __atomic_load_n(&fchr_config, __ATOMIC_ACQUIRE);
+
+	return fchr_config_refresh();
+}
+
+/* Build and publish a new configuration snapshot from the environment */
+const struct fchr_config *fchr_config_refresh(void)
+{
+	const struct fchr_config *c;
+	const char *val[FCHR_VARS];
+	struct fchr_config d;
+	int i;
+
+	for (i = 0; i < FCHR_VARS; i++)
+		val[i] = getenv(fchr_config_vars[i]);
+	fchr_config_make(val, &d);
+	c = fchr_config_publish(&d);
+	fchr_session_update(val, c);
+
+	return c;
+}
+
+/* The OPT_* bits of a FAKECHROOT_OPTS value */
+unsigned int fchr_opts_parse(const char *s)
+{
+	unsigned int opts = 0;
+	const char *p;
+
+	for (p = s; *p; p++) {
 		switch (*p) {
 			/* debugging */
 			case 'D':
-				fchr_opts |= OPT_DEBUG;
+				opts |= OPT_DEBUG;
 				break;
 
+			/* bind every wrapper at startup, not on first use */
 			case 'N':
-				fchr_opts |= OPT_LOAD_NOW;
+				opts |= OPT_LOAD_NOW;
+				break;
+
+			/* list the wrappers at startup */
+			case 'W':
+				opts |= OPT_LIST_WRAPPERS;
 				break;
 
 			case 'T':
-				fchr_opts |= OPT_TRANSP;
+				opts |= OPT_TRANSP;
+				break;
+
+			/* stat family and access() through openat2() too */
+			case 'K':
+				opts |= OPT_KERNEL_RESOLVE;
+				break;
+
+			/* string translation only, no openat2() */
+			case 'U':
+				opts |= OPT_NO_OPENAT2;
+				break;
+
+			/* negative lookup cache */
+			case 'E':
+				opts |= OPT_NEGCACHE;
+				break;
+
+			/* stat cache for the sysroot and FAKECHROOT_IMMUTABLE */
+			case 'I':
+				opts |= OPT_STATCACHE;
+				break;
+
+			/* dentry cache, see lib-resolve.c */
+			case 'C':
+				opts |= OPT_DCACHE;
+				break;
+
+			/* exec plan cache, see lib-execplan.c */
+			case 'X':
+				opts |= OPT_EXECPLAN;
+				break;
+
+			/* raw system calls after translation, see lib-syscall.c */
+			case 'R':
+#ifdef FAKECHROOT_RAW_SYSCALL
+				opts |= OPT_RAW_SYSCALL;
+#endif
+				break;
+
+			/* static programs under a seccomp supervisor, see lib-seccomp.c */
+			case 'F':
+#ifdef FAKECHROOT_SECCOMP
+				opts |= OPT_SECCOMP;
+#endif
+				break;
+
+			/* statistics at exit */
+			case 'S':
+				opts |= OPT_STATS;
 				break;
 
 			default:
 				dprintf("Unknown option '%c'.\n", *p);
 		}
 	}
+
+	return opts;
 }
 
-void cross_init();
+void fchr_parse_opts()
+{
+	const char *optvar = getenv(FCHR_OPT_ENV);
+
+	if (optvar)
+		fchr_opts |= fchr_opts_parse(optvar);
+}
+
+/* At thread exit: unmap the thread's tables and forget them */
+static void fchr_thread_release(void *tables)
+{
+	struct fchr_thread_table *t, *next;
+
+	fchr_thread_tables = NULL;
+	for (t = tables; t != NULL; t = next) {
+		next = t->next;
+		*t->slot = NULL;
+		munmap(t, t->size);
+	}
+}
+
+static void fchr_thread_key_init(void)
+{
+	pthread_key_create(&fchr_thread_key, fchr_thread_release);
+}
+
+/*
+ * A zeroed table of size bytes for the calling thread, also stored into
+ * *slot, a __thread pointer of the caller's.  The caches make theirs on
+ * first use: in static TLS they would be cleared for every thread, the
+ * first one at startup included, whether or not it ever translates a
+ * path.  The thread which ran our constructor gets initial, a static
+ * table of the caller's; the others get one from mmap(), which is safe in
+ * a signal handler, and *slot is reset when they exit.  Either way pages
+ * no entry was stored in are never touched.
+ */
+void *fchr_thread_table(void **slot, size_t size, void *initial)
+{
+	struct fchr_thread_table *t;
+
+	if (fchr_thread_initial)
+		return *slot = initial;
+
+	size += sizeof(*t);
+	t = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (t == MAP_FAILED)
+		return NULL;
+	t->slot = slot;
+	t->size = size;
+	t->next = fchr_thread_tables;
+	fchr_thread_tables = t;
+
+	/* without the key the tables of exiting threads stay behind */
+	if (pthread_once != NULL &&
+			pthread_once(&fchr_thread_once, fchr_thread_key_init) == 0)
+		pthread_setspecific(fchr_thread_key, t);
+
+	return *slot = t + 1;
+}
+
+/*
+ * Slow path of fchr_nextfunc().  Racing threads all get the same answer
+ * from dlsym(), so whichever store lands last does no harm.
+ */
+fchr_wrapperfn_t fchr_loadfunc(struct fchr_wrapper *w)
+{
+	fchr_wrapperfn_t f = (fchr_wrapperfn_t)dlsym(RTLD_NEXT, w->name);
+
+	if (!f) {
+		fprintf(stderr, "unresolved symbol %s\n", w->name);
+		exit(EXIT_FAILURE);
+	}
+	__atomic_store_n(&w->nextfunc, f, __ATOMIC_RELEASE);
+	dprintf("Lazily loaded %s function\n", w->name);
+
+	/*
+	 * Without a fake root the wrapper is bypassed from now on.  Should a
+	 * chroot() have ended that meanwhile, fchr_dispatch_update() may have
+	 * reset the pointer before our store, which is undone here.
+	 */
+	if (!(w->flags & FCHR_WRAPPER_KEEP) &&
+			__atomic_load_n(&fchr_passthrough, __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&w->dispatch, f, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&fchr_passthrough, __ATOMIC_SEQ_CST))
+			__atomic_store_n(&w->dispatch, w->func, __ATOMIC_SEQ_CST);
+	}
+
+	return f;
+}
+
+/*
+ * Point the exported symbols at the wrappers, or, in a process without a
+ * fake root, straight at the next definitions of the functions which then
+ * have nothing to do: transparent processes pay one indirect jump per call
+ * and no more.  Wrappers not bound yet are bypassed once their first call
+ * binds them.  Kept are chroot(), the environment wrappers, which start
+ * translating as soon as a root appears, and the exec family, which runs
+ * cross executables whether or not there is a root.  The caches work on
+ * host paths too, so with any of them on nothing is bypassed.
+ */
+static void fchr_dispatch_update(const struct fchr_config *c)
+{
+	struct fchr_wrapper *w;
+	fchr_wrapperfn_t f;
+	int on = c->root == NULL &&
+		!(fchr_opts & (OPT_NEGCACHE | OPT_STATCACHE | OPT_INDEX)), was;
+
+	if (c->root == NULL)
+		__atomic_or_fetch(&fchr_opts, OPT_TRANSP, __ATOMIC_RELAXED);
+	else
+		__atomic_and_fetch(&fchr_opts, ~OPT_TRANSP, __ATOMIC_RELAXED);
+	was = __atomic_exchange_n(&fchr_passthrough, on, __ATOMIC_SEQ_CST);
+	/* never bypassed so far, every wrapper is still in place */
+	if (!on && !was)
+		return;
+
+	for (w = &__start_fchr_wrappers; w < &__stop_fchr_wrappers; w++) {
+		f = on && !(w->flags & FCHR_WRAPPER_KEEP) ?
+			__atomic_load_n(&w->nextfunc, __ATOMIC_ACQUIRE) : NULL;
+		__atomic_store_n(&w->dispatch, f ? f : w->func, __ATOMIC_SEQ_CST);
+	}
+}
+
+/*
+ * Resolve the next definition of every wrapped function in one pass over
+ * the fchr_wrappers section, and list them if asked to.  Functions which
+ * no later object defines are left to fchr_loadfunc(), which only fails when
+ * one of them really gets called.
+ */
+static void fchr_bind_wrappers(void)
+{
+	struct fchr_wrapper *w;
+	fchr_wrapperfn_t f;
+
+	for (w = &__start_fchr_wrappers; w < &__stop_fchr_wrappers; w++) {
+		if ((fchr_opts & OPT_LOAD_NOW) &&
+				__atomic_load_n(&w->nextfunc, __ATOMIC_ACQUIRE) == NULL &&
+				(f = (fchr_wrapperfn_t)dlsym(RTLD_NEXT, w->name)) != NULL)
+			__atomic_store_n(&w->nextfunc, f, __ATOMIC_RELEASE);
+
+		if (fchr_opts & OPT_LIST_WRAPPERS)
+			fprintf(stderr, "fakechroot: %s [%p], next: %p\n", w->name,
+					(void *)w->func, (void *)w->nextfunc);
+	}
+}
 
 /*
  * Library constructor
  */
 void fakechroot_init(void)
 {
-	struct fchr_wrapper *w;
+	fchr_thread_initial = 1;
+
+	/* a session handed on by the parent saves reading the environment */
+	if (!fchr_session_attach()) {
+		fchr_parse_opts();
+		fchr_config_refresh();
+	} else {
+		fchr_opts |= fchr_session_opts() & OPT_CACHES;
+	}
 
-	fakechroot_path = getenv("FAKECHROOT_BASE");
-	if (!fakechroot_path)
-		fchr_opts |= OPT_TRANSP;
+	if ((fchr_opts & OPT_NEGCACHE) && !fchr_negcache_init())
+		fchr_opts &= ~OPT_NEGCACHE;
+	if ((fchr_opts & OPT_STATCACHE) && !fchr_statcache_init())
+		fchr_opts &= ~OPT_STATCACHE;
+	if ((fchr_opts & OPT_EXECPLAN) && !fchr_execplan_init())
+		fchr_opts &= ~OPT_EXECPLAN;
+	if (fchr_index_init())
+		fchr_opts |= OPT_INDEX;
 
-	fchr_parse_opts();
 	dprintf("Fakechroot library initialization\n");
 
 	if (fchr_opts & OPT_TRANSP) {
@@ -78,16 +465,28 @@ void fakechroot_init(void)
 		/*return;*/
 	}
 
-	dprintf("Wrappers linked in:\n");
-
-	/* for (w = &__start_fchr_wrappers; w < &__stop_fchr_wrappers; w++) { */
-	/* 	if (fchr_opts & OPT_LOAD_NOW) */
-	/* 		w->nextfunc = dlsym(RTLD_NEXT, w->name); */
+	if (fchr_opts & (OPT_LOAD_NOW | OPT_LIST_WRAPPERS))
+		fchr_bind_wrappers();
 
-	/* 	if (fchr_opts & OPT_LIST_WRAPPERS) */
-	/* 		dprintf("\t* %s [%p], next: %p\n", w->name, w->func, w->nextfunc); */
-	/* } */
-
-	cross_init();
+	/* now that the caches are settled */
+	fchr_dispatch_update(fchr_conf());
 }
 
+/*
+ * Library destructor
+ */
+void fakechroot_fini(void)
+{
+	if (fchr_opts & OPT_STATS) {
+		fchr_pathcache_stats();
+		if (fchr_opts & OPT_DCACHE)
+			fchr_dcache_stats();
+		if (fchr_opts & OPT_NEGCACHE)
+			fchr_negcache_stats();
+		if (fchr_opts & OPT_STATCACHE)
+			fchr_statcache_stats();
+		if (fchr_opts & OPT_EXECPLAN)
+			fchr_execplan_stats();
+		fchr_index_stats();
+	}
+}
@@ -0,0 +1,647 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Mount table: guest prefixes which are not redirected into the fake root.
+ *
+ * Entries come from FAKECHROOT_MOUNTS, a colon separated list, and from
+ * the file named by FAKECHROOT_MOUNTS_FILE, one entry per line with '#'
+ * comments.  An entry is either
+ *
+ *   GUEST        passthrough: GUEST and everything below it are used as
+ *                they are on the host (/proc, /dev, /sys, ...)
+ *   GUEST=HOST   bind: GUEST maps to HOST instead of the root
+ *
+ * Later entries for the same GUEST replace earlier ones.  Everything not
+ * covered by an entry lives in FAKECHROOT_BASE as before.
+ *
+ * Prefixes are looked up in compressed (radix) tries, one from guest to
+ * host and one back for bind entries, so a lookup costs one pass over the
+ * path whatever the size of the table.  The tables belong to a
+ * configuration snapshot and are never changed or freed once built.
+ *
+ * The tries are built with pointers and then laid out in one block which
+ * has none, the image, so that a session (see lib-session.c) can hand the
+ * table to child processes as it is; they only point the entries at it.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+struct fchr_trie_node {
+	const char *label;			/* edge from the parent, not terminated */
+	size_t label_len;
+	int entry;					/* mount ending here, or -1 */
+	unsigned int nchild;
+	struct fchr_trie_node **child;	/* sorted by label[0] */
+};
+
+static struct fchr_trie_node *trie_node(const char *label, size_t len)
+{
+	struct fchr_trie_node *n = calloc(1, sizeof(*n));
+
+	if (n) {
+		n->label = label;
+		n->label_len = len;
+		n->entry = -1;
+	}
+
+	return n;
+}
+
+static struct fchr_trie_node *trie_child(const struct fchr_trie_node *n,
+		unsigned char c, unsigned int *pos)
+{
+	unsigned int lo = 0, hi = n->nchild;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		unsigned char m = n->child[mid]->label[0];
+
+		if (m == c) {
+			*pos = mid;
+			return n->child[mid];
+		}
+		if (m < c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*pos = lo;
+
+	return NULL;
+}
+
+static int trie_add_child(struct fchr_trie_node *n, unsigned int pos,
+		struct fchr_trie_node *child)
+{
+	struct fchr_trie_node **v;
+
+	v = realloc(n->child, (n->nchild + 1) * sizeof(*v));
+	if (!v)
+		return -1;
+	memmove(v + pos + 1, v + pos, (n->nchild - pos) * sizeof(*v));
+	v[pos] = child;
+	n->child = v;
+	n->nchild++;
+
+	return 0;
+}
+
+/* key must stay valid as long as the trie; *old receives the entry replaced */
+static int trie_insert(struct fchr_trie_node *root, const char *key,
+		size_t len, int entry, int *old)
+{
+	struct fchr_trie_node *n = root, *child, *split;
+	unsigned int pos;
+	size_t i, common;
+
+	for (i = 0; i < len; ) {
+		child = trie_child(n, key[i], &pos);
+		if (!child) {
+			if (!(child = trie_node(key + i, len - i)) ||
+					trie_add_child(n, pos, child))
+				return -1;
+			n = child;
+			break;
+		}
+
+		for (common = 0; common < child->label_len && i + common < len &&
+				child->label[common] == key[i + common]; common++)
+			;
+		if (common < child->label_len) {
+			/* the edge diverges, or ends, inside child's label */
+			if (!(split = trie_node(child->label, common)) ||
+					trie_add_child(split, 0, child))
+				return -1;
+			child->label += common;
+			child->label_len -= common;
+			n->child[pos] = split;
+			child = split;
+		}
+		i += common;
+		n = child;
+	}
+
+	*old = n->entry;
+	n->entry = entry;
+
+	return 0;
+}
+
+#define MOUNTS_MAGIC "fchrmnt1"
+
+/*
+ * The table itself is the image: this header, the entries, the nodes of
+ * both tries and the strings, in one block.  Offsets are from its start;
+ * the children of a node are adjacent and sorted by the first byte of
+ * their labels.
+ */
+struct fchr_mounts {
+	char magic[8];
+	uint32_t size;				/* of the whole image */
+	uint32_t count;				/* entries */
+	uint32_t entry;				/* offset of the entries */
+	uint32_t node;				/* offset of the nodes, the guest trie's root first */
+	uint32_t nnodes;
+	uint32_t host;				/* index of the host trie's root */
+	uint32_t strings;			/* offset of the strings */
+	uint32_t pad;
+	uint64_t file_dev;			/* FAKECHROOT_MOUNTS_FILE as it was read, */
+	uint64_t file_ino;			/* all 0 without one */
+	uint64_t file_size;
+	uint64_t file_mtime;		/* ns */
+};
+
+struct mount_entry {
+	uint32_t guest;				/* string offsets */
+	uint32_t guest_len;			/* 0 for an entry replaced by a later one */
+	uint32_t host;
+	uint32_t host_len;
+	uint32_t passthrough;
+};
+
+struct mount_node {
+	uint32_t label;				/* string offset of the edge from the parent */
+	uint32_t label_len;
+	int32_t entry;				/* mount ending here, or -1 */
+	uint32_t nchild;
+	uint32_t child;				/* index of the first child */
+};
+
+/* the table as parsed, before it is laid out */
+struct mount_list {
+	unsigned int count;
+	unsigned int size;
+	struct fchr_mount *entry;
+	struct stat file;
+};
+
+/* canonical form of an entry path: absolute, no blanks or trailing slash */
+static int mount_path(const char *s, size_t n, const char **path, size_t *len)
+{
+	while (n > 0 && (*s == ' ' || *s == '\t'))
+		s++, n--;
+	while (n > 0 && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\r'))
+		n--;
+	while (n > 1 && s[n - 1] == '/')
+		n--;
+	if (n < 2 || s[0] != '/')
+		return -1;
+	*path = s;
+	*len = n;
+
+	return 0;
+}
+
+static int mount_add(struct mount_list *m, const char *s, size_t n)
+{
+	struct fchr_mount *e;
+	const char *eq;
+
+	if (strspn(s, " \t\r") >= n)
+		return 0;
+	eq = memchr(s, '=', n);
+
+	if (m->count == m->size) {
+		if (!(e = realloc(m->entry, (m->size ? 2 * m->size : 16) * sizeof(*e))))
+			return -1;
+		m->entry = e;
+		m->size = m->size ? 2 * m->size : 16;
+	}
+	e = &m->entry[m->count];
+
+	if (mount_path(s, eq ? (size_t)(eq - s) : n, &e->guest, &e->guest_len) ||
+			(eq && mount_path(eq + 1, n - (eq + 1 - s), &e->host, &e->host_len))) {
+		dprintf("### ignoring mount entry %.*s\n", (int)n, s);
+		return 0;
+	}
+	if (!eq) {
+		e->host = e->guest;
+		e->host_len = e->guest_len;
+	}
+	e->passthrough = !eq;
+	m->count++;
+
+	return 0;
+}
+
+/* entries separated by any of sep; the strings are kept by the list */
+static int mount_parse(struct mount_list *m, const char *s, const char *sep)
+{
+	size_t n;
+
+	while (*s) {
+		n = strcspn(s, sep);
+		if (*s == '#')
+			n += strcspn(s + n, "\n");
+		else if (n > 0 && mount_add(m, s, n))
+			return -1;
+		s += n;
+		if (*s)
+			s++;
+	}
+
+	return 0;
+}
+
+static char *mount_file(const char *name, struct stat *st)
+{
+	char *data = NULL, *p;
+	size_t size = 0, len = 0;
+	ssize_t n;
+	int fd;
+
+	if ((fd = next_open(name, O_RDONLY | O_CLOEXEC, 0)) < 0) {
+		dprintf("### cannot open mount table %s\n", name);
+		return NULL;
+	}
+	if (fstat(fd, st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	do {
+		if (len + 1 >= size) {
+			size = size ? 2 * size : 4096;
+			if (!(p = realloc(data, size))) {
+				free(data);
+				close(fd);
+				return NULL;
+			}
+			data = p;
+		}
+		n = read(fd, data + len, size - len - 1);
+		if (n > 0)
+			len += n;
+	} while (n > 0 || (n < 0 && errno == EINTR));
+	close(fd);
+	data[len] = '\0';
+
+	return data;
+}
+
+static void trie_free(struct fchr_trie_node *n)
+{
+	unsigned int i;
+
+	if (n == NULL)
+		return;
+	for (i = 0; i < n->nchild; i++)
+		trie_free(n->child[i]);
+	free(n->child);
+	free(n);
+}
+
+/* nodes of trie n, and the bytes of their labels */
+static void trie_size(const struct fchr_trie_node *n, size_t *nodes,
+		size_t *labels)
+{
+	unsigned int i;
+
+	++*nodes;
+	*labels += n->label_len;
+	for (i = 0; i < n->nchild; i++)
+		trie_size(n->child[i], nodes, labels);
+}
+
+/*
+ * Lay out trie root breadth first from node index first on: the children
+ * of a node are queued together, so they end up adjacent.  Labels are
+ * copied to *str.  Returns the index following the trie.
+ */
+static uint32_t trie_flatten(char *image, struct mount_node *node,
+		uint32_t first, const struct fchr_trie_node *root,
+		const struct fchr_trie_node **queue, char **str)
+{
+	uint32_t head = 0, tail = 0, next = first + 1, i;
+
+	queue[tail++] = root;
+	while (head < tail) {
+		const struct fchr_trie_node *n = queue[head];
+		struct mount_node *out = &node[first + head];
+
+		head++;
+		out->label = *str - image;
+		out->label_len = n->label_len;
+		memcpy(*str, n->label, n->label_len);
+		*str += n->label_len;
+		out->entry = n->entry;
+		out->nchild = n->nchild;
+		out->child = next;
+		for (i = 0; i < n->nchild; i++)
+			queue[tail++] = n->child[i];
+		next += n->nchild;
+	}
+
+	return next;
+}
+
+/* the image of list m, with its tries guest and host; NULL on failure */
+static struct fchr_mounts *mount_flatten(const struct mount_list *m,
+		const struct fchr_trie_node *guest, const struct fchr_trie_node *host)
+{
+	const struct fchr_trie_node **queue;
+	struct fchr_mounts *h;
+	struct mount_entry *entry;
+	struct mount_node *node;
+	size_t nodes = 0, hnodes = 0, labels = 0, size, strings;
+	unsigned int i;
+	char *image, *str;
+
+	trie_size(guest, &nodes, &labels);
+	trie_size(host, &hnodes, &labels);
+	strings = labels;
+	for (i = 0; i < m->count; i++)
+		strings += m->entry[i].guest_len + m->entry[i].host_len;
+
+	size = sizeof(*h) + m->count * sizeof(*entry) +
+		(nodes + hnodes) * sizeof(*node) + strings;
+	size = (size + 7) & ~(size_t)7;
+	if (size > UINT32_MAX)
+		return NULL;
+	if (!(image = calloc(1, size)) ||
+			!(queue = malloc((nodes > hnodes ? nodes : hnodes) * sizeof(*queue)))) {
+		free(image);
+		return NULL;
+	}
+
+	h = (struct fchr_mounts *)image;
+	memcpy(h->magic, MOUNTS_MAGIC, sizeof(h->magic));
+	h->size = size;
+	h->count = m->count;
+	h->entry = sizeof(*h);
+	h->node = h->entry + m->count * sizeof(*entry);
+	h->nnodes = nodes + hnodes;
+	h->host = nodes;
+	h->strings = h->node + h->nnodes * sizeof(*node);
+	if (m->file.st_ino != 0) {
+		h->file_dev = m->file.st_dev;
+		h->file_ino = m->file.st_ino;
+		h->file_size = m->file.st_size;
+		h->file_mtime = m->file.st_mtim.tv_sec * 1000000000ULL +
+			m->file.st_mtim.tv_nsec;
+	}
+
+	entry = (struct mount_entry *)(image + h->entry);
+	node = (struct mount_node *)(image + h->node);
+	str = image + h->strings;
+	for (i = 0; i < m->count; i++) {
+		const struct fchr_mount *e = &m->entry[i];
+
+		entry[i].guest = str - image;
+		entry[i].guest_len = e->guest_len;
+		memcpy(str, e->guest, e->guest_len);
+		str += e->guest_len;
+		entry[i].host = str - image;
+		entry[i].host_len = e->host_len;
+		memcpy(str, e->host, e->host_len);
+		str += e->host_len;
+		entry[i].passthrough = e->passthrough;
+	}
+	trie_flatten(image, node, 0, guest, queue, &str);
+	trie_flatten(image, node, h->host, host, queue, &str);
+	free(queue);
+
+	return h;
+}
+
+/*
+ * Build the mount table from list, FAKECHROOT_MOUNTS, and file, the name of
+ * FAKECHROOT_MOUNTS_FILE; NULL if it is empty or can not be built.
+ */
+const struct fchr_mounts *fchr_mounts_build(const char *list, const char *file)
+{
+	struct fchr_trie_node *guest = NULL, *host = NULL;
+	struct fchr_mounts *m = NULL;
+	struct mount_list l;
+	char *fs = NULL, *ls = NULL;
+	unsigned int i;
+	int old;
+
+	if ((!list || !*list) && (!file || !*file))
+		return NULL;
+	memset(&l, 0, sizeof(l));
+
+	/* the entries point into these copies */
+	if (file && *file && (fs = mount_file(file, &l.file)) &&
+			mount_parse(&l, fs, "\n"))
+		goto out;
+	if (list && *list && (!(ls = strdup(list)) || mount_parse(&l, ls, ":")))
+		goto out;
+	if (l.count == 0)
+		goto out;
+
+	if (!(guest = trie_node("", 0)) || !(host = trie_node("", 0)))
+		goto out;
+	for (i = 0; i < l.count; i++) {
+		if (trie_insert(guest, l.entry[i].guest, l.entry[i].guest_len, i, &old))
+			goto out;
+		/* a repeated guest prefix replaces the older entry */
+		if (old >= 0)
+			l.entry[old].guest_len = 0;
+	}
+	for (i = 0; i < l.count; i++) {
+		const struct fchr_mount *e = &l.entry[i];
+
+		if (e->guest_len == 0)
+			continue;
+		if (!e->passthrough && trie_insert(host, e->host, e->host_len, i, &old))
+			goto out;
+		dprintf("### mount %.*s -> %.*s\n", (int)e->guest_len, e->guest,
+				(int)e->host_len, e->host);
+	}
+
+	m = mount_flatten(&l, guest, host);
+
+out:
+	trie_free(guest);
+	trie_free(host);
+	free(l.entry);
+	free(fs);
+	free(ls);
+
+	return m;
+}
+
+/*
+ * The mount table image, of size bytes, is; NULL if it is none.  Only
+ * its layout is checked: images come from fchr_mounts_image() of a
+ * process which could have run anything in ours anyway.
+ */
+const struct fchr_mounts *fchr_mounts_load(const void *image, size_t size)
+{
+	const struct fchr_mounts *h = image;
+
+	if (size < sizeof(*h) || memcmp(h->magic, MOUNTS_MAGIC, sizeof(h->magic)) ||
+			h->size != size || h->entry != sizeof(*h) ||
+			h->count > (size - h->entry) / sizeof(struct mount_entry) ||
+			h->node != h->entry + h->count * sizeof(struct mount_entry) ||
+			h->nnodes > (size - h->node) / sizeof(struct mount_node) ||
+			h->host == 0 || h->host >= h->nnodes ||
+			h->strings != h->node + h->nnodes * sizeof(struct mount_node))
+		return NULL;
+
+	return h;
+}
+
+/* the image of m, to be handed on as it is */
+const void *fchr_mounts_image(const struct fchr_mounts *m, size_t *size)
+{
+	*size = m->size;
+
+	return m;
+}
+
+/*
+ * Whether file, the FAKECHROOT_MOUNTS_FILE m was built with, is unchanged
+ * since.  A table of a session may be older than the file.
+ */
+int fchr_mounts_current(const struct fchr_mounts *m, const char *file)
+{
+	struct stat st;
+	int fd, ret;
+
+	if (!file || !*file)
+		return m->file_ino == 0;
+	if ((fd = next_open(file, O_RDONLY | O_CLOEXEC, 0)) < 0)
+		return 0;
+	ret = fstat(fd, &st);
+	close(fd);
+
+	return ret == 0 && m->file_dev == st.st_dev && m->file_ino == st.st_ino &&
+		m->file_size == (uint64_t)st.st_size &&
+		m->file_mtime == st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+}
+
+/* free a table built, not loaded from somebody else's image */
+void fchr_mounts_free(const struct fchr_mounts *m)
+{
+	free((void *)m);
+}
+
+static inline const struct mount_node *mount_node(const struct fchr_mounts *m,
+		uint32_t i)
+{
+	return (const struct mount_node *)((const char *)m + m->node) + i;
+}
+
+static const struct mount_node *node_child(const struct fchr_mounts *m,
+		const struct mount_node *n, unsigned char c)
+{
+	const struct mount_node *child = mount_node(m, n->child);
+	unsigned int lo = 0, hi = n->nchild;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		unsigned char l = ((const char *)m)[child[mid].label];
+
+		if (l == c)
+			return &child[mid];
+		if (l < c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+/*
+ * Longest entry whose key is a prefix of path ending at a component
+ * boundary, in the trie of root n; *len receives the key's length.  -1 if
+ * there is none.
+ */
+static int node_lookup(const struct fchr_mounts *m, const struct mount_node *n,
+		const char *path, size_t *len)
+{
+	const struct mount_node *child;
+	size_t i = 0;
+	int best = -1;
+
+	for (;;) {
+		if (n->entry >= 0 && (path[i] == '/' || path[i] == '\0')) {
+			best = n->entry;
+			*len = i;
+		}
+		if (path[i] == '\0' || !(child = node_child(m, n, path[i])) ||
+				strncmp(path + i, (const char *)m + child->label, child->label_len))
+			break;
+		i += child->label_len;
+		n = child;
+	}
+
+	return best;
+}
+
+/* entry i of m into e */
+static const struct fchr_mount *mount_entry(const struct fchr_mounts *m,
+		int i, struct fchr_mount *e)
+{
+	const struct mount_entry *me =
+		(const struct mount_entry *)((const char *)m + m->entry) + i;
+
+	e->guest = (const char *)m + me->guest;
+	e->guest_len = me->guest_len;
+	e->host = (const char *)m + me->host;
+	e->host_len = me->host_len;
+	e->passthrough = me->passthrough;
+
+	return e;
+}
+
+/*
+ * Mount entry guest path lies in, with the length of its guest prefix,
+ * filled into e.
+ */
+const struct fchr_mount *fchr_mount_lookup(const struct fchr_mounts *m,
+		const char *path, size_t *len, struct fchr_mount *e)
+{
+	int i;
+
+	if (m == NULL || (i = node_lookup(m, mount_node(m, 0), path, len)) < 0)
+		return NULL;
+
+	return mount_entry(m, i, e);
+}
+
+/*
+ * Map host path, a buffer of its own, back to the guest path of the bind
+ * entry it lies in, in place.  Only done where the guest prefix is not
+ * longer than the host one, so the path never grows.
+ */
+int fchr_mount_narrow(const struct fchr_mounts *m, char *path)
+{
+	struct fchr_mount e;
+	size_t len;
+	int i;
+
+	if (m == NULL || (i = node_lookup(m, mount_node(m, m->host), path, &len)) < 0)
+		return 0;
+	mount_entry(m, i, &e);
+	if (e.guest_len > len)
+		return 0;
+
+	memmove(path + e.guest_len, path + len, strlen(path + len) + 1);
+	memcpy(path, e.guest, e.guest_len);
+
+	return 1;
+}
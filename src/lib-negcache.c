@@ -0,0 +1,392 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Negative lookup cache (FAKECHROOT_OPTS=E).
+ *
+ * Compilers searching their include paths and configure scripts probe
+ * thousands of names which do not exist, each one a translation and a
+ * failing system call, and mostly in short lived processes.  Absolute
+ * paths which access(), the stat family or open() found missing are
+ * therefore remembered in a table shared by the whole process tree: a
+ * memfd inherited across fork() and exec(), whose descriptor, device and
+ * inode FAKECHROOT_NEGCACHE names.  A process which closed the descriptor
+ * reopens it through /proc; one which can not reach the table at all
+ * runs without the cache.
+ *
+ * Entries are keyed by the guest path and a fingerprint of the variables
+ * which decide its translation, so processes of the tree with another
+ * root or mount table never share them.  Slots are guarded by sequence
+ * counters: readers take no locks and writers which would have to wait
+ * simply do not store.
+ *
+ * A name missing now exists once anything creates it.  Our own wrappers
+ * which make names (open(O_CREAT), mkdir, mknod, link, symlink, rename,
+ * the mkstemp family) bump an epoch kept with the table, which stales
+ * every entry at once.  Names made by anything else, a program running
+ * outside fakechroot or system calls made directly, are not seen, which
+ * is why the cache must be asked for.
+ *
+ * fchr_shared_table() below makes and joins such tables for the exec plan
+ * cache too.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define NEGCACHE_SLOTS  8192	/* power of two; pages are only used once touched */
+#define NEGCACHE_PROBES 4
+#define NEGCACHE_DATA   236		/* path, NUL */
+
+#define NEGCACHE_ENV    "FAKECHROOT_NEGCACHE"
+#define NEGCACHE_MAGIC  "fchrneg1"
+
+/* shared descriptors are kept above the range programs usually use */
+#define SHARED_FD_MIN   512
+
+struct negcache_entry {
+	unsigned int seq;			/* odd while being written */
+	unsigned int ident;
+	unsigned int epoch;			/* 0 for an empty slot */
+	unsigned int hash;
+	unsigned short len;
+	unsigned char nofollow;
+	unsigned char pad;
+	char path[NEGCACHE_DATA];
+};
+
+struct negcache_shared {
+	char magic[FCHR_SHARED_MAGIC];
+	unsigned int epoch;
+	unsigned int dirty;			/* a miss was seen since the last bump */
+	struct negcache_entry entries[NEGCACHE_SLOTS];
+};
+
+/* the last miss of this thread, which a failing call may turn into an entry */
+static __thread struct {
+	unsigned int hash;
+	unsigned int epoch;
+	size_t len;
+	int nofollow;
+} negcache_pending;
+
+static struct negcache_shared *negcache_shared;
+
+/* configuration generation and fingerprint, updated together */
+static unsigned long long negcache_ident;
+
+/* process wide counters, only maintained with OPT_STATS */
+static unsigned long negcache_hits, negcache_misses;
+
+static void *shared_map(int fd, size_t size, const char *magic)
+{
+	char *s;
+
+	s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (s == MAP_FAILED)
+		return NULL;
+	if (memcmp(s, magic, FCHR_SHARED_MAGIC)) {
+		munmap(s, size);
+		return NULL;
+	}
+
+	return s;
+}
+
+/* the table of var="pid:fd:dev:ino", NULL if unreachable */
+static void *shared_attach(const char *var, size_t size, const char *magic)
+{
+	char proc[64];
+	unsigned long long dev, ino;
+	struct stat st;
+	void *s;
+	int pid, fd, own = 0;
+
+	if (sscanf(var, "%d:%d:%llu:%llu", &pid, &fd, &dev, &ino) != 4)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || st.st_dev != dev || st.st_ino != ino) {
+		/* closed or replaced by the program, the creator may still hold it */
+		snprintf(proc, sizeof(proc), "/proc/%d/fd/%d", pid, fd);
+		if ((fd = next_open(proc, O_RDWR | O_CLOEXEC, 0)) < 0)
+			return NULL;
+		own = 1;
+		if (fstat(fd, &st) != 0 || st.st_dev != dev || st.st_ino != ino) {
+			close(fd);
+			return NULL;
+		}
+	}
+
+	s = shared_map(fd, size, magic);
+	if (own)
+		close(fd);
+
+	return s;
+}
+
+/* a fresh table for a new process tree, exported to its children as env */
+static void *shared_create(const char *env, const char *name, size_t size,
+		const char *magic)
+{
+	char var[96];
+	struct stat st;
+	void *s;
+	int fd = -1, hi;
+
+#if defined(HAVE_MEMFD_CREATE)
+	fd = memfd_create(name, 0);
+#elif defined(SYS_memfd_create)
+	fd = syscall(SYS_memfd_create, name, 0);
+#endif
+	if (fd < 0)
+		return NULL;
+
+	if ((hi = fcntl(fd, F_DUPFD, SHARED_FD_MIN)) >= 0) {
+		close(fd);
+		fd = hi;
+	}
+
+	if (ftruncate(fd, size) != 0 || fstat(fd, &st) != 0 ||
+			(s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+				fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	memcpy(s, magic, FCHR_SHARED_MAGIC);
+
+	snprintf(var, sizeof(var), "%d:%d:%llu:%llu", (int)getpid(), fd,
+			(unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+	setenv(env, var, 1);
+
+	return s;
+}
+
+/*
+ * The table of size bytes shared by the process tree under the variable
+ * env, starting with the FCHR_SHARED_MAGIC bytes of magic: joined if env
+ * names one, else made, zeroed, under name and exported.  *made tells
+ * which.  NULL if it can not be had.
+ */
+void *fchr_shared_table(const char *env, const char *name, size_t size,
+		const char *magic, int *made)
+{
+	const char *var = getenv(env);
+
+	*made = var == NULL;
+
+	return var != NULL ? shared_attach(var, size, magic) :
+		shared_create(env, name, size, magic);
+}
+
+/*
+ * Join the process tree's shared page, or start one.  Returns 0 when the
+ * cache can not be used, in which case the caller turns it off.
+ */
+int fchr_negcache_init(void)
+{
+	int made;
+
+	negcache_shared = fchr_shared_table(NEGCACHE_ENV, "fakechroot-negcache",
+			sizeof(*negcache_shared), NEGCACHE_MAGIC, &made);
+	if (negcache_shared != NULL && made)
+		negcache_shared->epoch = 1;
+
+	dprintf("### negative lookup cache %s\n", negcache_shared ? "on" : "unavailable");
+
+	return negcache_shared != NULL;
+}
+
+/* fingerprint of what decides the translation of a guest path */
+static unsigned int negcache_fingerprint(void)
+{
+	static const char *vars[] = {
+		"FAKECHROOT_BASE", "FAKECHROOT_LOWER",
+		"FAKECHROOT_MOUNTS", "FAKECHROOT_MOUNTS_FILE", NULL
+	};
+	unsigned int h = 2166136261U;
+	const unsigned char *p;
+	const char **v;
+
+	for (v = vars; *v; v++) {
+		if ((p = (const unsigned char *)getenv(*v)) != NULL)
+			for (; *p; p++)
+				h = (h ^ *p) * 16777619U;
+		h = (h ^ '\n') * 16777619U;
+	}
+
+	return h;
+}
+
+static unsigned int negcache_config(void)
+{
+	unsigned int generation = fchr_conf()->generation, ident;
+	unsigned long long cur = __atomic_load_n(&negcache_ident, __ATOMIC_ACQUIRE);
+
+	if ((unsigned int)(cur >> 32) == generation)
+		return (unsigned int)cur;
+
+	ident = negcache_fingerprint();
+	__atomic_store_n(&negcache_ident,
+			(unsigned long long)generation << 32 | ident, __ATOMIC_RELEASE);
+
+	return ident;
+}
+
+static inline unsigned int negcache_hash(const char *path, size_t *len,
+		unsigned int ident, int nofollow)
+{
+	return (fchr_pathcache_hash(path, len) ^ ident) + (unsigned int)nofollow;
+}
+
+static inline struct negcache_entry *negcache_slot(unsigned int hash, int i)
+{
+	return &negcache_shared->entries[(hash + i) & (NEGCACHE_SLOTS - 1)];
+}
+
+/*
+ * Whether absolute path is known to be missing under the current
+ * configuration; if so errno is set to ENOENT.  A miss is remembered for
+ * fchr_negcache_store().
+ */
+int fchr_negcache_lookup(const char *path, int nofollow)
+{
+	unsigned int ident, epoch, hash, seq;
+	struct negcache_entry *e;
+	size_t len;
+	int i;
+
+	negcache_pending.len = 0;
+	if (negcache_shared == NULL || path == NULL || *path != '/' || fchr_nested)
+		return 0;
+
+	ident = negcache_config();
+	epoch = __atomic_load_n(&negcache_shared->epoch, __ATOMIC_SEQ_CST);
+	hash = negcache_hash(path, &len, ident, nofollow);
+
+	for (i = 0; i < NEGCACHE_PROBES; i++) {
+		e = negcache_slot(hash, i);
+		seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if ((seq & 1) || e->epoch != epoch || e->hash != hash ||
+				e->ident != ident || e->len != len ||
+				e->nofollow != nofollow || memcmp(e->path, path, len))
+			continue;
+		/* what was compared must not have changed meanwhile */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if (fchr_opts & OPT_STATS)
+			__atomic_add_fetch(&negcache_hits, 1, __ATOMIC_RELAXED);
+		errno = ENOENT;
+		return 1;
+	}
+
+	if (fchr_opts & OPT_STATS)
+		__atomic_add_fetch(&negcache_misses, 1, __ATOMIC_RELAXED);
+
+	/*
+	 * The epoch is read, and the next bump asked for, before the call is
+	 * made: should the name be made meanwhile, the entry is stale from
+	 * the start rather than wrong.
+	 */
+	if (len < NEGCACHE_DATA) {
+		if (!__atomic_load_n(&negcache_shared->dirty, __ATOMIC_SEQ_CST))
+			__atomic_store_n(&negcache_shared->dirty, 1, __ATOMIC_SEQ_CST);
+		negcache_pending.hash = hash;
+		negcache_pending.epoch = epoch;
+		negcache_pending.len = len;
+		negcache_pending.nofollow = nofollow;
+	}
+
+	return 0;
+}
+
+/* path, the subject of this thread's last miss, turned out to be missing */
+void fchr_negcache_store(const char *path, int nofollow)
+{
+	struct negcache_entry *e, *victim;
+	unsigned int ident, hash, seq, epoch = negcache_pending.epoch;
+	size_t len;
+	int i;
+
+	if (negcache_shared == NULL || negcache_pending.len == 0 || path == NULL ||
+			*path != '/')
+		return;
+	ident = negcache_config();
+	hash = negcache_hash(path, &len, ident, nofollow);
+	if (hash != negcache_pending.hash || len != negcache_pending.len ||
+			nofollow != negcache_pending.nofollow) {
+		negcache_pending.len = 0;
+		return;
+	}
+	negcache_pending.len = 0;
+
+	/* first stale slot in the probe sequence, else the home slot */
+	victim = negcache_slot(hash, 0);
+	for (i = 0; i < NEGCACHE_PROBES; i++) {
+		e = negcache_slot(hash, i);
+		if (e->epoch != epoch) {
+			victim = e;
+			break;
+		}
+	}
+
+	seq = __atomic_load_n(&victim->seq, __ATOMIC_RELAXED);
+	if ((seq & 1) || !__atomic_compare_exchange_n(&victim->seq, &seq, seq + 1,
+				0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	victim->ident = ident;
+	victim->epoch = epoch;
+	victim->hash = hash;
+	victim->nofollow = nofollow;
+	victim->len = len;
+	memcpy(victim->path, path, len + 1);
+
+	__atomic_store_n(&victim->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * A name was made: stale the entries of the whole process tree.  Bumps
+ * are skipped while nobody has missed since the last one, as no entry
+ * can have been added then.
+ */
+void fchr_negcache_invalidate(void)
+{
+	if (negcache_shared == NULL)
+		return;
+	if (__atomic_exchange_n(&negcache_shared->dirty, 0, __ATOMIC_SEQ_CST))
+		__atomic_add_fetch(&negcache_shared->epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+void fchr_negcache_stats(void)
+{
+	unsigned long hits = negcache_hits, misses = negcache_misses;
+
+	fprintf(stderr, "fakechroot: negative cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+			hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
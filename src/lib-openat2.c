@@ -0,0 +1,362 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Kernel side resolution inside the fake root.
+ *
+ * Since Linux 5.6 openat2(2) with RESOLVE_IN_ROOT resolves a path
+ * relative to a directory descriptor as if that directory were "/": ".."
+ * stops there and absolute symlinks restart there, which is exactly what
+ * fakechroot needs.  Every configuration snapshot carries an O_PATH
+ * descriptor of the fake root for this, opened on first use by
+ * fchr_root_fd().
+ *
+ * Absolute paths are then opened in a single system call with no string
+ * work at all.  The stat family and access() (FAKECHROOT_OPTS=K) use an
+ * O_PATH descriptor of the path and the *at(AT_EMPTY_PATH) call on it.
+ * Whenever the kernel backend can not be used, because it is missing, was
+ * disabled with FAKECHROOT_OPTS=U, or the program closed our descriptor,
+ * the callers fall back to string translation.  So do paths in the mount
+ * table.  As symlinks inside the root may point into a mount, which the
+ * kernel can not see, names it did not find are then resolved again by
+ * fchr_resolve().
+ *
+ * RESOLVE_IN_ROOT refuses to follow magic links, so /dev/fd/N, /dev/stdin
+ * and /proc/self/fd/N, which bash process substitution hands out, fail
+ * with ELOOP; those paths are translated as strings as well.
+ *
+ * A program may also dup2() another file over our descriptor.  The device
+ * and inode it had when we opened it are kept, and checked again whenever
+ * a lookup fails with ENOENT or ENOTDIR; a replaced descriptor turns the
+ * backend off like a closed one.  A lookup which succeeds in the wrong
+ * directory is not caught.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(SYS_openat2) && defined(O_PATH) && defined(O_TMPFILE)
+
+/* struct open_how from <linux/openat2.h>, which older systems lack */
+struct fchr_open_how {
+	uint64_t flags;
+	uint64_t mode;
+	uint64_t resolve;
+};
+
+#define FCHR_RESOLVE_IN_ROOT 0x10
+
+/* the root descriptor is kept above the range programs usually use */
+#define FCHR_ROOT_FD_MIN 512
+
+/* attempts before a rename race (EAGAIN) makes us fall back */
+#define FCHR_OPENAT2_RETRIES 4
+
+/* identities of the root descriptors opened, at most */
+#define FCHR_ROOT_IDS 8
+
+/* set once the program closed or replaced our root descriptor */
+static int kernel_broken;
+
+static struct {
+	int fd;						/* 0 until the slot is filled */
+	dev_t dev;
+	ino_t ino;
+} root_ids[FCHR_ROOT_IDS];
+static unsigned int root_ids_used;
+
+/* faccessat(AT_EMPTY_PATH) works, which takes Linux 5.8 */
+static int kernel_access;
+
+static inline int openat2_in_root(int dirfd, const char *path, int flags, mode_t mode)
+{
+	struct fchr_open_how how;
+
+	how.flags = (unsigned int)flags;
+	how.mode = (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE ?
+		(mode & 07777) : 0;
+	how.resolve = FCHR_RESOLVE_IN_ROOT;
+
+	return fchr_cancellable(syscall(SYS_openat2, dirfd, path, &how, sizeof(how)));
+}
+
+/*
+ * root_fd of a new configuration snapshot: the one of old when the root did
+ * not change, else FCHR_ROOT_FD_UNSET for fchr_root_fd() to open on first
+ * use; -1 means the kernel backend is not available.
+ */
+int fchr_root_fd_init(const char *root, size_t root_len,
+		const struct fchr_config *old)
+{
+	if (root == NULL || root_len == 0 || root_len > FAKECHROOT_MAXPATH)
+		return -1;
+	if (old != NULL && old->root != NULL && old->root_len == root_len &&
+			!memcmp(old->root, root, root_len))
+		return __atomic_load_n(&old->root_fd, __ATOMIC_ACQUIRE);
+
+	return FCHR_ROOT_FD_UNSET;
+}
+
+/* remember what the root descriptor fd refers to */
+static void root_id_note(int fd, const struct stat *st)
+{
+	unsigned int i = __atomic_fetch_add(&root_ids_used, 1, __ATOMIC_RELAXED);
+
+	if (i >= FCHR_ROOT_IDS)
+		return;
+	root_ids[i].dev = st->st_dev;
+	root_ids[i].ino = st->st_ino;
+	__atomic_store_n(&root_ids[i].fd, fd, __ATOMIC_RELEASE);
+}
+
+/* whether the root descriptor fd no longer refers to what we opened */
+static int root_id_changed(int fd)
+{
+	unsigned int i, n = __atomic_load_n(&root_ids_used, __ATOMIC_RELAXED);
+	struct stat st;
+
+	for (i = 0; i < n && i < FCHR_ROOT_IDS; i++)
+		if (__atomic_load_n(&root_ids[i].fd, __ATOMIC_ACQUIRE) == fd)
+			return fstat(fd, &st) != 0 || st.st_dev != root_ids[i].dev ||
+				st.st_ino != root_ids[i].ino;
+
+	return 0;
+}
+
+static int root_fd_open(const char *root, size_t root_len, struct stat *st)
+{
+	char path[FAKECHROOT_PATHBUF];
+	int fd, hi;
+
+	memcpy(path, root, root_len);
+	path[root_len] = '\0';
+	if ((fd = next_open(path, O_PATH | O_DIRECTORY | O_CLOEXEC, 0)) < 0)
+		return -1;
+
+	if ((hi = fcntl(fd, F_DUPFD_CLOEXEC, FCHR_ROOT_FD_MIN)) >= 0) {
+		close(fd);
+		fd = hi;
+	}
+	if (fstat(fd, st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	/* does the kernel know openat2() at all? */
+	if ((hi = openat2_in_root(fd, "/", O_PATH | O_CLOEXEC, 0)) < 0) {
+		dprintf("### openat2() unusable (errno=%d), using string translation\n", errno);
+		close(fd);
+		return -1;
+	}
+	close(hi);
+
+	__atomic_store_n(&kernel_access,
+			faccessat(fd, "", F_OK, AT_EMPTY_PATH) == 0, __ATOMIC_RELAXED);
+
+	return fd;
+}
+
+/*
+ * The O_PATH descriptor of the root of c, or -1.  It is opened on first
+ * use: the seven system calls that takes are wasted on the many processes
+ * which exec or exit before looking up a single path.  Of threads racing
+ * to open it the first one wins; a descriptor is never closed once in a
+ * snapshot, as it may be shared with the next one.
+ */
+int fchr_root_fd(const struct fchr_config *c)
+{
+	int unset = FCHR_ROOT_FD_UNSET, fd, saved_errno;
+	struct stat st;
+
+	if ((fd = __atomic_load_n(&c->root_fd, __ATOMIC_ACQUIRE)) != FCHR_ROOT_FD_UNSET)
+		return fd;
+
+	saved_errno = errno;
+	fd = root_fd_open(c->root, c->root_len, &st);
+	if (!__atomic_compare_exchange_n((int *)&c->root_fd, &unset, fd, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		if (fd >= 0)
+			close(fd);
+		fd = unset;
+	} else if (fd >= 0)
+		root_id_note(fd, &st);
+	errno = saved_errno;
+
+	return fd;
+}
+
+/*
+ * Root descriptor to resolve path against, or -1 when the kernel backend
+ * is not to be used for it, as for paths in the mount table.  *guest is
+ * set to path without the fake root when path is a host path already.
+ */
+static inline int kernel_root(const char *path, const char **guest)
+{
+	const struct fchr_config *c;
+	struct fchr_mount e;
+	size_t len;
+
+	if (path == NULL || *path != '/' || fchr_nested ||
+			(fchr_opts & OPT_NO_OPENAT2) ||
+			__atomic_load_n(&kernel_broken, __ATOMIC_RELAXED))
+		return -1;
+
+	c = fchr_conf();
+	/* the overlay's layers are not one tree the kernel could walk */
+	if (c->root_fd == -1 || fchr_overlay(c))
+		return -1;
+
+	*guest = fchr_in_root(path, c) ? path + c->root_len : path;
+	if (**guest == '\0')
+		*guest = "/";
+	else if (c->mounts != NULL && fchr_mount_lookup(c->mounts, *guest, &len, &e))
+		return -1;
+
+	return fchr_root_fd(c);
+}
+
+static int kernel_open(int rootfd, const char *path, int flags, mode_t mode)
+{
+	int fd, i, err, saved_errno = errno;
+
+	for (i = 0; i < FCHR_OPENAT2_RETRIES; i++) {
+		if ((fd = openat2_in_root(rootfd, path, flags, mode)) >= 0)
+			return fd;
+
+		switch (errno) {
+		case EAGAIN:
+			continue;
+		case ENOENT:
+		case ENOTDIR:
+			err = errno;
+			if (!root_id_changed(rootfd)) {
+				errno = err;
+				return -1;
+			}
+			/* fall through */
+		case EBADF:
+			/* the program closed or replaced our descriptor */
+			__atomic_store_n(&kernel_broken, 1, __ATOMIC_RELAXED);
+			/* fall through */
+		case ELOOP:		/* magic links, see above */
+		case EXDEV:
+		case EINVAL:	/* flags openat() would have ignored */
+		case ENOSYS:
+		case EPERM:		/* seccomp filters */
+			errno = saved_errno;
+			return FCHR_FALLBACK;
+		default:
+			return -1;
+		}
+	}
+
+	errno = saved_errno;
+	return FCHR_FALLBACK;
+}
+
+/*
+ * open() path inside the fake root.  Returns the descriptor, -1 with
+ * errno set, or FCHR_FALLBACK when the caller has to translate the path
+ * and open it itself.
+ */
+int fchr_kernel_open(const char *path, int flags, mode_t mode)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	const char *guest;
+	int rootfd = kernel_root(path, &guest), fd, saved_errno = errno;
+
+	if (rootfd < 0)
+		return FCHR_FALLBACK;
+
+	fd = kernel_open(rootfd, guest, flags, mode);
+
+	/* a symlink may lead into a mount, which the kernel can not see */
+	if (fd == -1 && errno == ENOENT && fchr_conf()->mounts != NULL) {
+		errno = saved_errno;
+		path = fakechroot_resolve(path, buf,
+				(flags & O_NOFOLLOW) || (flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL) ?
+				FCHR_RESOLVE_NOFOLLOW : 0);
+		fd = next_open(path, flags, mode);
+	}
+
+	return fd;
+}
+
+/*
+ * O_PATH descriptor of path inside the fake root for the stat family and
+ * access(), with the same return convention.  Only used with
+ * FAKECHROOT_OPTS=K; access additionally needs faccessat(AT_EMPTY_PATH).
+ */
+int fchr_kernel_lookup(const char *path, int flags)
+{
+	const char *guest;
+	int rootfd, fd, saved_errno = errno;
+
+	if (!(fchr_opts & OPT_KERNEL_RESOLVE))
+		return FCHR_FALLBACK;
+	/* kernel_access is only known once the root descriptor is open */
+	if ((rootfd = kernel_root(path, &guest)) < 0 ||
+			((flags & FCHR_LOOKUP_ACCESS) &&
+			 !__atomic_load_n(&kernel_access, __ATOMIC_RELAXED)))
+		return FCHR_FALLBACK;
+
+	fd = kernel_open(rootfd, guest, O_PATH | O_CLOEXEC |
+			((flags & FCHR_LOOKUP_NOFOLLOW) ? O_NOFOLLOW : 0), 0);
+
+	/* the caller resolves the path itself, see fchr_kernel_open() */
+	if (fd == -1 && errno == ENOENT && fchr_conf()->mounts != NULL) {
+		errno = saved_errno;
+		return FCHR_FALLBACK;
+	}
+
+	return fd;
+}
+
+#else /* no openat2() */
+
+int fchr_root_fd_init(const char *root, size_t root_len,
+		const struct fchr_config *old)
+{
+	return -1;
+}
+
+int fchr_root_fd(const struct fchr_config *c)
+{
+	return c->root_fd;
+}
+
+int fchr_kernel_open(const char *path, int flags, mode_t mode)
+{
+	return FCHR_FALLBACK;
+}
+
+int fchr_kernel_lookup(const char *path, int flags)
+{
+	return FCHR_FALLBACK;
+}
+
+#endif
@@ -0,0 +1,1191 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Copy-on-write overlay.
+ *
+ * With FAKECHROOT_LOWER set the fake root is made of two layers: the
+ * lower one, typically a sysroot shared by many builds, which is never
+ * written to, and the upper one, FAKECHROOT_BASE, which starts out empty.
+ * Names are looked up in the upper layer first, then in the lower one.
+ * A call which changes a lower file first copies it up, by reflink where
+ * the file system can, and the parent directories along with it.
+ *
+ * A removed lower name is recorded by a whiteout, an empty ".wh.NAME"
+ * file where NAME would be in the upper layer.  Next to an upper
+ * directory the same marker makes the directory opaque instead: nothing
+ * of the lower directory of that name shows through.  Directories made
+ * over hidden lower ones get such a marker, so the nearest upper ancestor
+ * of a name always tells whether the lower layer is visible there.
+ *
+ * Listings through opendir()/readdir(), scandir() and glob() merge both
+ * layers and hide the markers; ftw() and fts() read directories inside
+ * libc and see the upper layer only.  As with overlayfs, directories
+ * which exist in the lower layer can not be renamed (EXDEV).
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+#include <sched.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#define WHITEOUT     ".wh."
+#define WHITEOUT_LEN 4
+
+enum { LAYER_UPPER, LAYER_LOWER, LAYER_HIDDEN };
+
+/* prefix followed by path[0..len) into buf, cut like fchr_translate() */
+static char *layer_path(char *buf, const char *prefix, size_t plen,
+		const char *path, size_t len)
+{
+	if (plen + len > FAKECHROOT_MAXPATH)
+		len = FAKECHROOT_MAXPATH - plen;
+	memcpy(buf, prefix, plen);
+	memcpy(buf + plen, path, len);
+	buf[plen + len] = '\0';
+
+	return buf;
+}
+
+#define upper_path(buf, c, path, len) \
+	layer_path((buf), (c)->root, (c)->root_len, (path), (len))
+#define lower_path(buf, c, path, len) \
+	layer_path((buf), (c)->lower, (c)->lower_len, (path), (len))
+
+/* length of the parent of path[0..len), 0 for the root */
+static size_t parent_len(const char *path, size_t len)
+{
+	while (len > 0 && path[len - 1] != '/')
+		len--;
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+
+	return len;
+}
+
+/* the upper whiteout of path[0..len), which must not be the root */
+static char *whiteout_path(char *buf, const struct fchr_config *c,
+		const char *path, size_t len)
+{
+	size_t d = len;
+
+	while (d > 0 && path[d - 1] != '/')
+		d--;
+	if (c->root_len + len + WHITEOUT_LEN > FAKECHROOT_MAXPATH)
+		return NULL;
+
+	memcpy(buf, c->root, c->root_len);
+	memcpy(buf + c->root_len, path, d);
+	memcpy(buf + c->root_len + d, WHITEOUT, WHITEOUT_LEN);
+	memcpy(buf + c->root_len + d + WHITEOUT_LEN, path + d, len - d);
+	buf[c->root_len + len + WHITEOUT_LEN] = '\0';
+
+	return buf;
+}
+
+static int whiteout_exists(const struct fchr_config *c, const char *path,
+		size_t len)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	struct stat st;
+
+	return whiteout_path(buf, c, path, len) && next_lstat(buf, &st) == 0;
+}
+
+static int whiteout_make(const struct fchr_config *c, const char *path,
+		size_t len)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int fd;
+
+	if (!whiteout_path(buf, c, path, len)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if ((fd = next_open(buf, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) < 0)
+		return -1;
+	close(fd);
+
+	return 0;
+}
+
+static int lower_exists(const struct fchr_config *c, const char *path,
+		size_t len, struct stat *st)
+{
+	char buf[FAKECHROOT_PATHBUF];
+
+	return next_lstat(lower_path(buf, c, path, len), st) == 0;
+}
+
+/*
+ * Which layer the absolute guest path[0..len) is found in.  Anything the
+ * upper layer has, and any error other than a missing name there, belongs
+ * to it; otherwise the nearest existing upper ancestor decides between a
+ * lower name and a hidden one.  A name missing from both layers counts as
+ * lower: reading it fails just the same.
+ */
+static int overlay_layer(const char *path, size_t len,
+		const struct fchr_config *c)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	struct stat st;
+	size_t n, p;
+
+	while (len > 1 && path[len - 1] == '/')
+		len--;
+	if (len <= 1)
+		return LAYER_UPPER;
+
+	if (next_lstat(upper_path(buf, c, path, len), &st) == 0 || errno != ENOENT)
+		return LAYER_UPPER;
+
+	for (n = len; ; n = p) {
+		p = parent_len(path, n);
+		if (p > 0 && next_lstat(upper_path(buf, c, path, p), &st) != 0) {
+			if (errno != ENOENT)
+				return LAYER_UPPER;
+			continue;
+		}
+		if (p > 0 && !S_ISDIR(st.st_mode))
+			return LAYER_UPPER;
+		/* path[0..p) is an upper directory, path[0..n) is missing in it */
+		if (whiteout_exists(c, path, n) || (p > 0 && whiteout_exists(c, path, p)))
+			return LAYER_HIDDEN;
+		return LAYER_LOWER;
+	}
+}
+
+/* host path of guest path[0..plen), for fchr_translate() */
+char *fchr_overlay_lookup(const char *path, size_t plen, char *buf,
+		const struct fchr_config *c)
+{
+	if (overlay_layer(path, plen, c) == LAYER_LOWER)
+		return lower_path(buf, c, path, plen);
+
+	return upper_path(buf, c, path, plen);
+}
+
+/*
+ * Relative path as an absolute guest path in buf, from the working
+ * directory.  path itself is returned if that can not be done: it is
+ * empty or the working directory lies outside both layers and the mounts.
+ */
+char *fchr_overlay_abs(const char *path, char *buf)
+{
+	const struct fchr_config *c = fchr_conf();
+	size_t len, n = strlen(path);
+
+	if (n == 0 || next_getcwd(buf, FAKECHROOT_PATHBUF) == NULL)
+		return (char *)path;
+	if (fchr_in_root(buf, c))
+		memmove(buf, buf + c->root_len, strlen(buf + c->root_len) + 1);
+	else if (!fchr_narrow_host(c, buf))
+		return (char *)path;
+
+	len = strlen(buf);
+	if (len == 0 || buf[len - 1] != '/')
+		buf[len++] = '/';
+	if (len + n > FAKECHROOT_MAXPATH)
+		return (char *)path;
+	memcpy(buf + len, path, n + 1);
+
+	return buf;
+}
+
+/*
+ * Absolute guest form of path, a guest path, a relative one or a host
+ * path in either layer; NULL if there is none.  buf receives it when
+ * path has to be rewritten.
+ */
+static const char *overlay_guest(const char *path, char *buf,
+		const struct fchr_config *c)
+{
+	if (path == NULL || *path == '\0')
+		return NULL;
+	if (*path != '/')
+		return fchr_overlay_abs(path, buf) == buf ? buf : NULL;
+	if (fchr_in_root(path, c))
+		return path[c->root_len] ? path + c->root_len : "/";
+	if (fchr_prefix_match(path, c->lower, c->lower_len) &&
+			(path[c->lower_len] == '/' || path[c->lower_len] == '\0'))
+		return path[c->lower_len] ? path + c->lower_len : "/";
+
+	return path;
+}
+
+/* guest paths the overlay leaves to fchr_translate() */
+static int overlay_skip(const char *guest, const struct fchr_config *c)
+{
+	struct fchr_mount e;
+	size_t len;
+
+	return guest == NULL || fchr_mount_lookup(c->mounts, guest, &len, &e) != NULL;
+}
+
+/*
+ * Canonical guest form of path into buf, symlinks followed through both
+ * layers rather than by the kernel in one of them, the trailing one
+ * unless nofollow.  Should that fail, the plain guest path, so the call
+ * reports the error, and *failed, if given, is set.  NULL if path can not
+ * be placed in the overlay.
+ */
+static char *overlay_canon(const char *path, char *buf, int nofollow,
+		int *failed, const struct fchr_config *c)
+{
+	char abs[FAKECHROOT_PATHBUF];
+	const char *guest;
+	int saved_errno = errno;
+
+	if (fchr_nested || (guest = overlay_guest(path, abs, c)) == NULL)
+		return NULL;
+	if (fchr_resolve(guest, buf, nofollow ? FCHR_RESOLVE_NOFOLLOW : 0) == NULL) {
+		errno = saved_errno;
+		strcpy(buf, guest);
+		if (failed != NULL)
+			*failed = 1;
+	}
+
+	return buf;
+}
+
+static int copy_data(int in, int out)
+{
+	char buf[65536];
+	ssize_t n, w, off;
+
+#ifdef FICLONE
+	if (ioctl(out, FICLONE, in) == 0)
+		return 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	while ((n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0)
+		;
+	if (n == 0)
+		return 0;
+	/* not supported between these files: start over the plain way */
+	if (lseek(in, 0, SEEK_SET) != 0 || lseek(out, 0, SEEK_SET) != 0 ||
+			ftruncate(out, 0) != 0)
+		return -1;
+#endif
+	for (;;) {
+		if ((n = read(in, buf, sizeof(buf))) == 0)
+			return 0;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (off = 0; off < n; off += w)
+			if ((w = write(out, buf + off, n - off)) < 0) {
+				if (errno != EINTR)
+					return -1;
+				w = 0;
+			}
+	}
+}
+
+/*
+ * Copy lower file from, which st describes, up to to.  Regular files are
+ * written to a temporary next to to and renamed over it, so nobody ever
+ * sees a partial copy; with FCHR_UPPER_TRUNC only the metadata is copied.
+ */
+static int copy_up(const char *from, const char *to, const struct stat *st,
+		int how)
+{
+	char tmp[FAKECHROOT_PATHBUF];
+	struct timespec times[2];
+	size_t d;
+	ssize_t n;
+	int in = -1, out, saved_errno;
+
+	if (S_ISDIR(st->st_mode)) {
+		if (NEXTCALL(mkdir)(to, 0700) != 0)
+			return errno == EEXIST ? 0 : -1;
+		return NEXTCALL(chmod)(to, st->st_mode & 07777);
+	}
+	if (S_ISLNK(st->st_mode)) {
+		if ((n = next_readlink(from, tmp, FAKECHROOT_MAXPATH)) < 0)
+			return -1;
+		tmp[n] = '\0';
+		return NEXTCALL(symlink)(tmp, to) == 0 || errno == EEXIST ? 0 : -1;
+	}
+	if (S_ISFIFO(st->st_mode))
+		return NEXTCALL(mkfifo)(to, st->st_mode & 07777) == 0 ||
+			errno == EEXIST ? 0 : -1;
+	if (!S_ISREG(st->st_mode)) {
+		errno = EXDEV;
+		return -1;
+	}
+
+	for (d = strlen(to); d > 0 && to[d - 1] != '/'; d--)
+		;
+	if (d + sizeof(WHITEOUT ".cow.XXXXXX") > FAKECHROOT_PATHBUF) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memcpy(tmp, to, d);
+	strcpy(tmp + d, WHITEOUT ".cow.XXXXXX");
+	if ((out = NEXTCALL(mkstemp)(tmp)) < 0)
+		return -1;
+
+	if (!(how & FCHR_UPPER_TRUNC) &&
+			((in = next_open(from, O_RDONLY | O_CLOEXEC, 0)) < 0 ||
+			 copy_data(in, out) != 0))
+		goto fail;
+	times[0] = st->st_atim;
+	times[1] = st->st_mtim;
+	if ((geteuid() == 0 && fchown(out, st->st_uid, st->st_gid) != 0) ||
+			fchmod(out, st->st_mode & 07777) != 0 ||
+			futimens(out, times) != 0 ||
+			NEXTCALL(rename)(tmp, to) != 0)
+		goto fail;
+
+	if (in >= 0)
+		close(in);
+	close(out);
+
+	return 0;
+
+fail:
+	saved_errno = errno;
+	NEXTCALL(unlink)(tmp);
+	if (in >= 0)
+		close(in);
+	close(out);
+	errno = saved_errno;
+
+	return -1;
+}
+
+/*
+ * Make sure the parent of path[0..len) exists in the upper layer, copying
+ * up the lower directories leading to it.
+ */
+static int make_parents(const char *path, size_t len,
+		const struct fchr_config *c)
+{
+	char upper[FAKECHROOT_PATHBUF], lower[FAKECHROOT_PATHBUF];
+	struct stat st;
+	size_t p = parent_len(path, len);
+
+	if (p == 0)
+		return 0;
+	if (next_lstat(upper_path(upper, c, path, p), &st) == 0)
+		return 0;
+	if (errno != ENOENT)
+		return -1;
+
+	/* it must then be a visible lower directory */
+	if (overlay_layer(path, p, c) != LAYER_LOWER ||
+			next_lstat(lower_path(lower, c, path, p), &st) != 0) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		errno = ENOTDIR;
+		return -1;
+	}
+	if (make_parents(path, p, c) != 0)
+		return -1;
+
+	return copy_up(lower, upper, &st, 0);
+}
+
+/* how an open() with flags changes its path */
+int fchr_overlay_open_how(int flags)
+{
+	int how = 0;
+
+	if ((flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL))
+		return FCHR_UPPER_NEW | FCHR_UPPER_EXCL;
+	if (flags & O_NOFOLLOW)
+		how |= FCHR_UPPER_NOFOLLOW;
+	if (flags & O_CREAT)
+		how |= FCHR_UPPER_NEW | FCHR_UPPER_COPY;
+	if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC))
+		how |= FCHR_UPPER_COPY;
+	if (flags & O_TRUNC)
+		how |= FCHR_UPPER_TRUNC;
+
+	return how;
+}
+
+/* the same for an fopen() with mode */
+int fchr_overlay_fopen_how(const char *mode)
+{
+	int flags;
+
+	switch (*mode) {
+	case 'w':
+		flags = O_WRONLY | O_CREAT | O_TRUNC;
+		break;
+	case 'a':
+		flags = O_WRONLY | O_CREAT;
+		break;
+	default:
+		flags = O_RDONLY;
+		break;
+	}
+	if (strchr(mode, '+') != NULL)
+		flags = (flags & ~O_ACCMODE) | O_RDWR;
+	if ((flags & O_CREAT) && strchr(mode, 'x') != NULL)
+		flags |= O_EXCL;
+
+	return fchr_overlay_open_how(flags);
+}
+
+/*
+ * Translate path for a call which changes it as how (FCHR_UPPER_*) says,
+ * preparing the upper layer first: lower files to be changed are copied
+ * up, parents of new names made, and a new name over a hidden lower one
+ * gets a whiteout, so a directory made there is opaque.  Returns the
+ * upper host path in buf, or the lower one where the call is to fail on
+ * an existing lower name (FCHR_UPPER_EXCL).  The lower layer itself is
+ * never handed out for writing.  For how 0 only symlinks are followed
+ * through the layers; outside overlay mode this is fakechroot_expand().
+ */
+char *fakechroot_upper(const char *path, char *buf, int how)
+{
+	const struct fchr_config *c = fchr_conf();
+	char canon[FAKECHROOT_PATHBUF], lower[FAKECHROOT_PATHBUF];
+	const char *guest;
+	struct stat st;
+	size_t len;
+	int failed = 0;
+
+	if (!fchr_overlay(c) || (guest = overlay_canon(path, canon,
+			how & (FCHR_UPPER_NOFOLLOW | FCHR_UPPER_EXCL), &failed, c)) == NULL)
+		return fakechroot_expand(path, buf);
+
+	len = strlen(guest);
+	if (!(how & ~FCHR_UPPER_NOFOLLOW) || overlay_skip(guest, c))
+		return fchr_translate(guest, len, buf, c);
+	/* a dangling or looping path: nothing to copy, fail in the upper layer */
+	if (failed)
+		return upper_path(buf, c, guest, len);
+
+	switch (overlay_layer(guest, len, c)) {
+	case LAYER_UPPER:
+		break;
+	case LAYER_LOWER:
+		if (next_lstat(lower_path(lower, c, guest, len), &st) != 0) {
+			if (how & FCHR_UPPER_NEW)
+				make_parents(guest, len, c);
+			break;
+		}
+		if (how & FCHR_UPPER_EXCL)
+			return strcpy(buf, lower);
+		/* should the copy fail, the call fails on the missing upper name */
+		if (how & FCHR_UPPER_COPY) {
+			if (make_parents(guest, len, c) == 0)
+				copy_up(lower, upper_path(buf, c, guest, len), &st, how);
+		} else if (how & FCHR_UPPER_NEW)
+			make_parents(guest, len, c);
+		break;
+	case LAYER_HIDDEN:
+		if ((how & FCHR_UPPER_NEW) && make_parents(guest, len, c) == 0 &&
+				lower_exists(c, guest, len, &st) &&
+				!whiteout_exists(c, guest, len))
+			whiteout_make(c, guest, len);
+		break;
+	}
+
+	return upper_path(buf, c, guest, len);
+}
+
+/*
+ * Merged directory streams: the caller holds the upper directory's DIR,
+ * whose entries come first, whiteouts left out; then those of the lower
+ * directory which the upper one neither has nor hides.
+ */
+struct overlay_dir {
+	DIR *dir;
+	DIR *lower;					/* NULL if opaque or missing */
+	int lower_pass;
+	char **names;				/* hash set of upper and hidden names */
+	size_t count, size;
+	struct overlay_dir *next;
+};
+
+#define OVERLAY_DIR_SLOTS 64	/* power of two */
+
+static struct overlay_dir *overlay_dir_table[OVERLAY_DIR_SLOTS];
+static int overlay_dir_lock;
+
+unsigned int fchr_overlay_dirs;
+
+static inline unsigned int overlay_dir_slot(DIR *dir)
+{
+	return ((unsigned long)dir >> 4) & (OVERLAY_DIR_SLOTS - 1);
+}
+
+static void overlay_dir_lock_take(void)
+{
+	while (__atomic_exchange_n(&overlay_dir_lock, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+static void overlay_dir_lock_drop(void)
+{
+	__atomic_store_n(&overlay_dir_lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct overlay_dir *overlay_dir_find(DIR *dir, int unlink)
+{
+	struct overlay_dir **p, *od;
+
+	overlay_dir_lock_take();
+	for (p = &overlay_dir_table[overlay_dir_slot(dir)]; (od = *p) != NULL; p = &od->next)
+		if (od->dir == dir) {
+			if (unlink) {
+				*p = od->next;
+				__atomic_sub_fetch(&fchr_overlay_dirs, 1, __ATOMIC_RELAXED);
+			}
+			break;
+		}
+	overlay_dir_lock_drop();
+
+	return od;
+}
+
+static unsigned int name_hash(const char *name)
+{
+	unsigned int h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 16777619U;
+
+	return h;
+}
+
+static int names_has(const struct overlay_dir *od, const char *name)
+{
+	size_t i;
+
+	if (od->size == 0)
+		return 0;
+	for (i = name_hash(name) & (od->size - 1); od->names[i]; i = (i + 1) & (od->size - 1))
+		if (!strcmp(od->names[i], name))
+			return 1;
+
+	return 0;
+}
+
+/* on failure the lower entry may show up twice, which is all */
+static void names_add(struct overlay_dir *od, const char *name)
+{
+	char **names, *s;
+	size_t i, k, size;
+
+	if (names_has(od, name))
+		return;
+	if (2 * (od->count + 1) > od->size) {
+		size = od->size ? 2 * od->size : 64;
+		if ((names = calloc(size, sizeof(*names))) == NULL)
+			return;
+		for (k = 0; k < od->size; k++)
+			if (od->names[k]) {
+				for (i = name_hash(od->names[k]) & (size - 1); names[i]; i = (i + 1) & (size - 1))
+					;
+				names[i] = od->names[k];
+			}
+		free(od->names);
+		od->names = names;
+		od->size = size;
+	}
+	if ((s = strdup(name)) == NULL)
+		return;
+	for (i = name_hash(name) & (od->size - 1); od->names[i]; i = (i + 1) & (od->size - 1))
+		;
+	od->names[i] = s;
+	od->count++;
+}
+
+static void names_clear(struct overlay_dir *od)
+{
+	size_t k;
+
+	for (k = 0; k < od->size; k++)
+		free(od->names[k]);
+	free(od->names);
+	od->names = NULL;
+	od->count = od->size = 0;
+}
+
+/* whether the merged stream leaves out name, read in the current pass */
+static int overlay_dir_skip(struct overlay_dir *od, const char *name)
+{
+	if (!od->lower_pass) {
+		if (!strncmp(name, WHITEOUT, WHITEOUT_LEN)) {
+			if (od->lower)
+				names_add(od, name + WHITEOUT_LEN);
+			return 1;
+		}
+		if (od->lower)
+			names_add(od, name);
+		return 0;
+	}
+
+	return !strcmp(name, ".") || !strcmp(name, "..") || names_has(od, name);
+}
+
+DIR *fchr_overlay_opendir(const char *name)
+{
+	const struct fchr_config *c = fchr_conf();
+	char canon[FAKECHROOT_PATHBUF], host[FAKECHROOT_PATHBUF];
+	struct overlay_dir *od;
+	const char *guest;
+	unsigned int slot;
+	size_t len;
+	DIR *dir;
+
+	if ((guest = overlay_canon(name, canon, 0, NULL, c)) == NULL)
+		return fchr_direct(NEXTCALL(opendir)(fakechroot_expand(name, host)));
+	len = strlen(guest);
+	if (overlay_skip(guest, c))
+		return fchr_direct(NEXTCALL(opendir)(fchr_translate(guest, len, host, c)));
+
+	switch (overlay_layer(guest, len, c)) {
+	case LAYER_HIDDEN:
+		errno = ENOENT;
+		return NULL;
+	case LAYER_LOWER:
+		return fchr_direct(NEXTCALL(opendir)(lower_path(host, c, guest, len)));
+	}
+
+	if ((dir = fchr_direct(NEXTCALL(opendir)(upper_path(host, c, guest, len)))) == NULL)
+		return NULL;
+	/* unmerged but still usable */
+	if ((od = calloc(1, sizeof(*od))) == NULL)
+		return dir;
+	od->dir = dir;
+
+	while (len > 1 && guest[len - 1] == '/')
+		len--;
+	if (len <= 1 || !whiteout_exists(c, guest, len))
+		od->lower = fchr_direct(NEXTCALL(opendir)(lower_path(host, c, guest, len)));
+
+	slot = overlay_dir_slot(dir);
+	overlay_dir_lock_take();
+	od->next = overlay_dir_table[slot];
+	overlay_dir_table[slot] = od;
+	__atomic_add_fetch(&fchr_overlay_dirs, 1, __ATOMIC_RELAXED);
+	overlay_dir_lock_drop();
+
+	return dir;
+}
+
+struct dirent *fchr_overlay_readdir(DIR *dir)
+{
+	struct overlay_dir *od = overlay_dir_find(dir, 0);
+	struct dirent *e;
+
+	if (od == NULL)
+		return NEXTCALL(readdir)(dir);
+
+	while (!od->lower_pass) {
+		if ((e = NEXTCALL(readdir)(dir)) == NULL) {
+			if (od->lower == NULL)
+				return NULL;
+			od->lower_pass = 1;
+		} else if (!overlay_dir_skip(od, e->d_name))
+			return e;
+	}
+	while ((e = NEXTCALL(readdir)(od->lower)) != NULL)
+		if (!overlay_dir_skip(od, e->d_name))
+			return e;
+
+	return NULL;
+}
+
+#ifdef HAVE_READDIR64
+struct dirent64 *fchr_overlay_readdir64(DIR *dir)
+{
+	struct overlay_dir *od = overlay_dir_find(dir, 0);
+	struct dirent64 *e;
+
+	if (od == NULL)
+		return NEXTCALL(readdir64)(dir);
+
+	while (!od->lower_pass) {
+		if ((e = NEXTCALL(readdir64)(dir)) == NULL) {
+			if (od->lower == NULL)
+				return NULL;
+			od->lower_pass = 1;
+		} else if (!overlay_dir_skip(od, e->d_name))
+			return e;
+	}
+	while ((e = NEXTCALL(readdir64)(od->lower)) != NULL)
+		if (!overlay_dir_skip(od, e->d_name))
+			return e;
+
+	return NULL;
+}
+#endif
+
+int fchr_overlay_closedir(DIR *dir)
+{
+	struct overlay_dir *od = overlay_dir_find(dir, 1);
+
+	if (od != NULL) {
+		if (od->lower)
+			NEXTCALL(closedir)(od->lower);
+		names_clear(od);
+		free(od);
+	}
+
+	return NEXTCALL(closedir)(dir);
+}
+
+void fchr_overlay_rewinddir(DIR *dir)
+{
+	struct overlay_dir *od = overlay_dir_find(dir, 0);
+
+	if (od != NULL) {
+		if (od->lower)
+			NEXTCALL(rewinddir)(od->lower);
+		od->lower_pass = 0;
+		names_clear(od);
+	}
+
+	NEXTCALL(rewinddir)(dir);
+}
+
+/* merged directory guest path[0..len) has no entries but "." and ".." */
+static int overlay_dir_empty(const char *path, size_t len,
+		const struct fchr_config *c)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	struct dirent *e;
+	DIR *dir;
+	int empty = 1;
+
+	if ((dir = fchr_overlay_opendir(layer_path(buf, "", 0, path, len))) == NULL)
+		return 0;
+	while (empty && (e = fchr_overlay_readdir(dir)) != NULL)
+		empty = !strcmp(e->d_name, ".") || !strcmp(e->d_name, "..");
+	fchr_overlay_closedir(dir);
+
+	return empty;
+}
+
+/* remove the whiteouts left in upper directory host */
+static void whiteouts_clear(const char *host)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	struct dirent *e;
+	size_t len = strlen(host);
+	DIR *dir;
+
+	if ((dir = fchr_direct(NEXTCALL(opendir)(host))) == NULL)
+		return;
+	while ((e = NEXTCALL(readdir)(dir)) != NULL)
+		if (!strncmp(e->d_name, WHITEOUT, WHITEOUT_LEN) &&
+				len + 1 + strlen(e->d_name) <= FAKECHROOT_MAXPATH) {
+			memcpy(buf, host, len);
+			buf[len] = '/';
+			strcpy(buf + len + 1, e->d_name);
+			NEXTCALL(unlink)(buf);
+		}
+	NEXTCALL(closedir)(dir);
+}
+
+/*
+ * unlink(), rmdir() or remove() of path: dir is 0, 1 or -1 for either.
+ * The upper name goes, and a whiteout hides the lower one if any.
+ */
+int fchr_overlay_remove(const char *path, int dir)
+{
+	const struct fchr_config *c = fchr_conf();
+	char canon[FAKECHROOT_PATHBUF], upper[FAKECHROOT_PATHBUF];
+	const char *guest;
+	struct stat st, lst;
+	size_t len;
+	int layer, is_dir, has_lower;
+
+	guest = overlay_canon(path, canon, 1, NULL, c);
+	if (guest == NULL || overlay_skip(guest, c)) {
+		path = guest ? fchr_translate(guest, strlen(guest), upper, c) :
+			fakechroot_expand(path, upper);
+		return dir > 0 ? NEXTCALL(rmdir)(path) :
+			dir == 0 ? NEXTCALL(unlink)(path) : NEXTCALL(remove)(path);
+	}
+
+	len = strlen(guest);
+	while (len > 1 && guest[len - 1] == '/')
+		len--;
+	if (len <= 1) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	if ((layer = overlay_layer(guest, len, c)) == LAYER_HIDDEN) {
+		errno = ENOENT;
+		return -1;
+	}
+	has_lower = lower_exists(c, guest, len, &lst);
+	upper_path(upper, c, guest, len);
+	if (layer == LAYER_UPPER) {
+		if (next_lstat(upper, &st) != 0)
+			return -1;
+	} else if (has_lower)
+		st = lst;
+	else {
+		errno = ENOENT;
+		return -1;
+	}
+
+	is_dir = S_ISDIR(st.st_mode);
+	if (dir == 0 && is_dir) {
+		errno = EISDIR;
+		return -1;
+	}
+	if (dir > 0 && !is_dir) {
+		errno = ENOTDIR;
+		return -1;
+	}
+	if (is_dir && !overlay_dir_empty(guest, len, c)) {
+		errno = ENOTEMPTY;
+		return -1;
+	}
+
+	if (layer == LAYER_UPPER) {
+		if (is_dir) {
+			whiteouts_clear(upper);
+			if (NEXTCALL(rmdir)(upper) != 0)
+				return -1;
+		} else if (NEXTCALL(unlink)(upper) != 0)
+			return -1;
+	} else if (make_parents(guest, len, c) != 0)
+		return -1;
+
+	if (has_lower) {
+		if (whiteout_make(c, guest, len) != 0)
+			return -1;
+	} else if (whiteout_path(upper, c, guest, len))
+		NEXTCALL(unlink)(upper);	/* a stale opaque marker */
+	fchr_dcache_invalidate();
+
+	return 0;
+}
+
+/*
+ * rename() of oldpath to newpath.  Lower files are copied up and renamed
+ * in the upper layer, with a whiteout for the old name; lower directories
+ * give EXDEV, which makes mv(1) and friends copy them instead.
+ */
+int fchr_overlay_rename(const char *oldpath, const char *newpath)
+{
+	const struct fchr_config *c = fchr_conf();
+	char ocanon[FAKECHROOT_PATHBUF], ncanon[FAKECHROOT_PATHBUF];
+	char oupper[FAKECHROOT_PATHBUF], nupper[FAKECHROOT_PATHBUF];
+	const char *oguest, *nguest;
+	struct stat st, lst;
+	size_t olen, nlen;
+	int olayer, nlayer;
+
+	oguest = overlay_canon(oldpath, ocanon, 1, NULL, c);
+	nguest = overlay_canon(newpath, ncanon, 1, NULL, c);
+	if (oguest == NULL || nguest == NULL ||
+			overlay_skip(oguest, c) || overlay_skip(nguest, c))
+		return NEXTCALL(rename)(
+				oguest ? fchr_translate(oguest, strlen(oguest), oupper, c) :
+					fakechroot_expand(oldpath, oupper),
+				nguest ? fchr_translate(nguest, strlen(nguest), nupper, c) :
+					fakechroot_expand(newpath, nupper));
+
+	olen = strlen(oguest);
+	nlen = strlen(nguest);
+	if ((olayer = overlay_layer(oguest, olen, c)) == LAYER_HIDDEN) {
+		errno = ENOENT;
+		return -1;
+	}
+	upper_path(oupper, c, oguest, olen);
+	if (olayer == LAYER_UPPER) {
+		if (next_lstat(oupper, &st) != 0)
+			return -1;
+		/* merged with a lower directory unless opaque */
+		if (S_ISDIR(st.st_mode) && lower_exists(c, oguest, olen, &lst) &&
+				!whiteout_exists(c, oguest, olen)) {
+			errno = EXDEV;
+			return -1;
+		}
+	} else {
+		if (!lower_exists(c, oguest, olen, &st))
+			return -1;
+		if (S_ISDIR(st.st_mode)) {
+			errno = EXDEV;
+			return -1;
+		}
+		fakechroot_upper(oguest, oupper, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+		if (next_lstat(oupper, &st) != 0)
+			return -1;
+	}
+
+	/* a lower target must be replaceable as rename() would replace it */
+	nlayer = overlay_layer(nguest, nlen, c);
+	if (nlayer == LAYER_LOWER && lower_exists(c, nguest, nlen, &lst)) {
+		if (S_ISDIR(st.st_mode) != S_ISDIR(lst.st_mode)) {
+			errno = S_ISDIR(st.st_mode) ? ENOTDIR : EISDIR;
+			return -1;
+		}
+		if (S_ISDIR(lst.st_mode) && !overlay_dir_empty(nguest, nlen, c)) {
+			errno = ENOTEMPTY;
+			return -1;
+		}
+	}
+	fakechroot_upper(nguest, nupper, FCHR_UPPER_NEW | FCHR_UPPER_NOFOLLOW);
+
+	if (NEXTCALL(rename)(oupper, nupper) != 0)
+		return -1;
+
+	if (lower_exists(c, oguest, olen, &lst))
+		whiteout_make(c, oguest, olen);
+	/* the directory moved over a lower name must not merge with it */
+	if (S_ISDIR(st.st_mode) && lower_exists(c, nguest, nlen, &lst))
+		whiteout_make(c, nguest, nlen);
+	fchr_dcache_invalidate();
+
+	return 0;
+}
+
+/*
+ * chroot() into guest directory path: it is made in the upper layer and
+ * lower, FAKECHROOT_MAXPATH bytes, receives the new lower root.
+ */
+int fchr_overlay_chroot(const char *path, char *lower)
+{
+	const struct fchr_config *c = fchr_conf();
+	char buf[FAKECHROOT_PATHBUF];
+	size_t len = strlen(path);
+
+	if (overlay_layer(path, len, c) == LAYER_HIDDEN) {
+		errno = ENOENT;
+		return -1;
+	}
+	fakechroot_upper(path, buf, FCHR_UPPER_COPY);
+	snprintf(lower, FAKECHROOT_MAXPATH, "%s%s", c->lower, path);
+
+	return 0;
+}
+
+/*
+ * scandir() and scandir64() of a merged directory: the same as libc's,
+ * over our own merged stream.
+ */
+int fchr_overlay_scandir(const char *dir, void ***namelist,
+		int (*filter)(const void *),
+		int (*compar)(const void *, const void *), int large)
+{
+	void **list = NULL, **grown, *e, *copy;
+	size_t n = 0, size = 0, k, esize;
+	DIR *d;
+
+	if ((d = fchr_overlay_opendir(dir)) == NULL)
+		return -1;
+
+	for (;;) {
+#ifdef HAVE_READDIR64
+		if (large) {
+			struct dirent64 *e64 = fchr_overlay_readdir64(d);
+
+			if ((e = e64) == NULL)
+				break;
+			esize = offsetof(struct dirent64, d_name) + strlen(e64->d_name) + 1;
+		} else
+#endif
+		{
+			struct dirent *e32 = fchr_overlay_readdir(d);
+
+			if ((e = e32) == NULL)
+				break;
+			esize = offsetof(struct dirent, d_name) + strlen(e32->d_name) + 1;
+		}
+
+		if (filter != NULL && !filter(e))
+			continue;
+		if (n == size) {
+			size = size ? 2 * size : 32;
+			if ((grown = realloc(list, size * sizeof(*list))) == NULL)
+				goto nomem;
+			list = grown;
+		}
+		if ((copy = malloc(esize)) == NULL)
+			goto nomem;
+		list[n++] = memcpy(copy, e, esize);
+	}
+	fchr_overlay_closedir(d);
+
+	if (compar != NULL && n > 1)
+		qsort(list, n, sizeof(*list), compar);
+	*namelist = list;
+
+	return n;
+
+nomem:
+	for (k = 0; k < n; k++)
+		free(list[k]);
+	free(list);
+	fchr_overlay_closedir(d);
+	errno = ENOMEM;
+
+	return -1;
+}
+
+static void glob_free(int large, void *pglob)
+{
+#ifdef HAVE_GLOB64
+	if (large) {
+		globfree64(pglob);
+		return;
+	}
+#endif
+	globfree(pglob);
+}
+
+static int glob_compare(const void *a, const void *b)
+{
+	return strcoll(*(char *const *)a, *(char *const *)b);
+}
+
+static int glob_is_whiteout(const char *path)
+{
+	const char *base = strrchr(path, '/');
+
+	return !strncmp(base ? base + 1 : path, WHITEOUT, WHITEOUT_LEN);
+}
+
+/*
+ * glob() and glob64() of a merged tree: the pattern is matched in both
+ * layers and the lower matches the upper layer shadows or hides dropped.
+ * glob_t and glob64_t share the fields used here.  FCHR_FALLBACK if the
+ * pattern does not lie in the overlay or the caller brought its own
+ * directory functions.
+ */
+int fchr_overlay_glob(const char *pattern, int flags,
+		int (*errfunc)(const char *, int), void *pglob, int large)
+{
+	const struct fchr_config *c = fchr_conf();
+	char abs[FAKECHROOT_PATHBUF], host[FAKECHROOT_PATHBUF];
+	union {
+		glob_t g;
+#ifdef HAVE_GLOB64
+		glob64_t g64;
+#endif
+	} lower;
+	glob_t *g = pglob;
+	const char *guest;
+	char **v;
+	size_t from, i, n, len, strip = 0;
+	int rc;
+
+	if (fchr_nested || (flags & GLOB_ALTDIRFUNC) ||
+			overlay_skip(guest = overlay_guest(pattern, abs, c), c))
+		return FCHR_FALLBACK;
+	len = strlen(guest);
+	if (*pattern != '/')
+		strip = len - strlen(pattern);
+
+	from = (flags & GLOB_APPEND) ? g->gl_pathc : 0;
+	rc = fchr_glob_next(upper_path(host, c, guest, len),
+			flags & ~GLOB_NOCHECK, errfunc, pglob, large, 0);
+	if (rc != 0 && rc != GLOB_NOMATCH)
+		return rc;
+	if (rc == GLOB_NOMATCH && !(flags & GLOB_APPEND))
+		g->gl_pathc = 0;
+
+	/* the upper matches, less whiteouts */
+	for (i = n = from; i < g->gl_pathc; i++) {
+		char *p = g->gl_pathv[g->gl_offs + i];
+
+		narrow_chroot_path_modify(p);
+		if (glob_is_whiteout(p))
+			free(p);
+		else
+			g->gl_pathv[g->gl_offs + n++] = p;
+	}
+	g->gl_pathc = n;
+
+	memset(&lower, 0, sizeof(lower));
+	rc = fchr_glob_next(lower_path(host, c, guest, len),
+			flags & ~(GLOB_APPEND | GLOB_DOOFFS | GLOB_NOCHECK), errfunc, &lower,
+			large, 0);
+	if (rc == GLOB_NOSPACE)
+		return rc;
+	if (rc == 0 && lower.g.gl_pathc > 0) {
+		/* libc leaves gl_pathv NULL only when gl_offs is 0 */
+		v = realloc(g->gl_pathv,
+				(g->gl_offs + g->gl_pathc + lower.g.gl_pathc + 1) * sizeof(*v));
+		if (v == NULL) {
+			glob_free(large, &lower);
+			return GLOB_NOSPACE;
+		}
+		g->gl_pathv = v;
+
+		n = g->gl_pathc;
+		for (i = 0; i < lower.g.gl_pathc; i++) {
+			char *p = lower.g.gl_pathv[i];
+
+			narrow_chroot_path_modify(p);
+			if (glob_is_whiteout(p) ||
+					overlay_layer(p, strlen(p), c) != LAYER_LOWER)
+				continue;
+			g->gl_pathv[g->gl_offs + n++] = p;
+			lower.g.gl_pathv[i] = NULL;
+		}
+		g->gl_pathc = n;
+		g->gl_pathv[g->gl_offs + n] = NULL;
+
+		if (!(flags & GLOB_NOSORT))
+			qsort(g->gl_pathv + g->gl_offs + from, n - from, sizeof(*v),
+					glob_compare);
+	}
+	glob_free(large, &lower);
+
+	if (g->gl_pathc == from) {
+		if (!(flags & GLOB_NOCHECK))
+			return GLOB_NOMATCH;
+		v = realloc(g->gl_pathv, (g->gl_offs + from + 2) * sizeof(*v));
+		if (v == NULL)
+			return GLOB_NOSPACE;
+		g->gl_pathv = v;
+		if ((v[g->gl_offs + from] = strdup(pattern)) == NULL)
+			return GLOB_NOSPACE;
+		v[g->gl_offs + from + 1] = NULL;
+		g->gl_pathc = from + 1;
+		return 0;
+	}
+
+	/* relative matches for a relative pattern */
+	for (i = from; strip && i < g->gl_pathc; i++) {
+		char *p = g->gl_pathv[g->gl_offs + i];
+
+		if (strlen(p) >= strip)
+			memmove(p, p + strip, strlen(p + strip) + 1);
+	}
+
+	return 0;
+}
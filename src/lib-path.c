@@ -0,0 +1,123 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+#include "common.h"
+
+/*
+ * Translate guest path of plen bytes into host path, the uncached way:
+ * through the mount table entry it lies in, else into the fake root, or
+ * the overlay layer holding it.
+ */
+char *fchr_translate(const char *path, size_t plen, char *buf,
+		const struct fchr_config *c)
+{
+	const struct fchr_mount *m;
+	struct fchr_mount me;
+	const char *prefix = c->root;
+	size_t rlen = c->root_len, mlen;
+
+	if ((m = fchr_mount_lookup(c->mounts, path, &mlen, &me)) != NULL) {
+		prefix = m->host;
+		rlen = m->host_len;
+		path += mlen;
+		plen -= mlen;
+	} else if (fchr_overlay(c))
+		return fchr_overlay_lookup(path, plen, buf, c);
+
+	if (rlen > FAKECHROOT_MAXPATH)
+		rlen = FAKECHROOT_MAXPATH;
+	if (rlen + plen > FAKECHROOT_MAXPATH)
+		plen = FAKECHROOT_MAXPATH - rlen;
+
+	memcpy(buf, prefix, rlen);
+	memcpy(buf + rlen, path, plen);
+	buf[rlen + plen] = '\0';
+
+	return buf;
+}
+
+/*
+ * Map host path, a buffer of its own, back to its guest path in place if
+ * it lies in the overlay's lower layer or a bind mount; returns whether
+ * it did.  Paths inside the fake root are left to the callers.
+ */
+int fchr_narrow_host(const struct fchr_config *c, char *path)
+{
+	if (fchr_overlay(c) && fchr_prefix_match(path, c->lower, c->lower_len) &&
+			(path[c->lower_len] == '/' || path[c->lower_len] == '\0')) {
+		if (path[c->lower_len] == '\0')
+			strcpy(path, "/");
+		else
+			memmove(path, path + c->lower_len, strlen(path + c->lower_len) + 1);
+		return 1;
+	}
+
+	return fchr_mount_narrow(c->mounts, path);
+}
+
+/*
+ * Translate guest path into host path.
+ *
+ * Relative paths, paths already inside the fake root and all paths when no
+ * fake root is set or inside fchr_direct() are returned as is.  "Inside"
+ * means below the root directory, not merely sharing a string prefix with
+ * it.  In overlay mode relative paths are made absolute first, as the
+ * working directory lies in one layer only, and nothing is cached: which
+ * layer a name lives in changes under our feet.  Otherwise the host
+ * path, from the mount table or the fake root, is stored in buf, which
+ * holds FAKECHROOT_PATHBUF bytes; it comes from the per-thread translation
+ * cache when possible.
+ *
+ * A result which does not fit is cut to exactly FAKECHROOT_MAXPATH bytes:
+ * the kernel then fails the call with ENAMETOOLONG, just as it would for
+ * the untruncated path, instead of acting on a shortened one.
+ */
+char *fakechroot_expand(const char *path, char *buf)
+{
+	const struct fchr_config *c;
+	char abs[FAKECHROOT_PATHBUF];
+	unsigned int hash;
+	size_t plen;
+
+	if (path == NULL || fchr_nested)
+		return (char *)path;
+
+	c = fchr_conf();
+	if (*path != '/') {
+		if (!fchr_overlay(c) || c->root == NULL ||
+				(path = fchr_overlay_abs(path, abs)) != abs)
+			return (char *)path;
+		return fchr_translate(abs, strlen(abs), buf, c);
+	}
+	if (c->root == NULL || fchr_in_root(path, c))
+		return (char *)path;
+	if (fchr_overlay(c))
+		return fchr_translate(path, strlen(path), buf, c);
+
+	hash = fchr_pathcache_hash(path, &plen);
+	if (fchr_pathcache_lookup(path, plen, hash, c->generation, buf))
+		return buf;
+
+	fchr_translate(path, plen, buf, c);
+	fchr_pathcache_store(path, plen, hash, c->generation, buf);
+
+	return buf;
+}
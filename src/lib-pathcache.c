@@ -0,0 +1,130 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Guest to host path translation cache.
+ *
+ * Every thread has a small open addressing table of its own, made when it
+ * stores its first pair, so lookups take no locks.  Entries are tagged with the generation of the
+ * configuration snapshot they were computed under; when the snapshot is
+ * replaced (chroot(), environment changes) all older entries simply stop
+ * matching.  Pairs too long for a slot are not cached.
+ */
+
+#include "common.h"
+
+#define PATHCACHE_SLOTS  128	/* power of two */
+#define PATHCACHE_PROBES 4
+#define PATHCACHE_DATA   240	/* guest path, NUL, host path, NUL */
+
+struct pathcache_entry {
+	unsigned int generation;	/* 0 for an empty slot */
+	unsigned int hash;
+	unsigned short guest_len;
+	unsigned short host_len;
+	char data[PATHCACHE_DATA];
+};
+
+/* the thread's table once it stored a pair, see fchr_thread_table() */
+static __thread void *pathcache;
+static struct pathcache_entry pathcache_initial[PATHCACHE_SLOTS];
+
+/* process wide counters, only maintained with OPT_STATS */
+static unsigned long pathcache_hits, pathcache_misses;
+
+/* FNV-1a; also measures the path */
+unsigned int fchr_pathcache_hash(const char *path, size_t *len)
+{
+	const unsigned char *p = (const unsigned char *)path;
+	unsigned int h = 2166136261U;
+
+	for (; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	*len = p - (const unsigned char *)path;
+
+	return h;
+}
+
+/*
+ * Look path up; on a hit the host path is copied into buf, which holds
+ * FAKECHROOT_PATHBUF bytes, and 1 is returned.
+ */
+int fchr_pathcache_lookup(const char *path, size_t len, unsigned int hash,
+		unsigned int generation, char *buf)
+{
+	struct pathcache_entry *t = pathcache, *e;
+	int i;
+
+	for (i = 0; t != NULL && i < PATHCACHE_PROBES; i++) {
+		e = &t[(hash + i) & (PATHCACHE_SLOTS - 1)];
+		if (e->generation == generation && e->hash == hash &&
+				e->guest_len == len && !memcmp(e->data, path, len)) {
+			memcpy(buf, e->data + len + 1, e->host_len + 1);
+			if (fchr_opts & OPT_STATS)
+				__atomic_add_fetch(&pathcache_hits, 1, __ATOMIC_RELAXED);
+			return 1;
+		}
+	}
+
+	if (fchr_opts & OPT_STATS)
+		__atomic_add_fetch(&pathcache_misses, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+void fchr_pathcache_store(const char *path, size_t len, unsigned int hash,
+		unsigned int generation, const char *host)
+{
+	struct pathcache_entry *t = pathcache, *e, *victim;
+	size_t host_len = strlen(host);
+	int i;
+
+	if (len + host_len + 2 > PATHCACHE_DATA)
+		return;
+	if (t == NULL && (t = fchr_thread_table(&pathcache,
+					sizeof(pathcache_initial), pathcache_initial)) == NULL)
+		return;
+
+	/* first stale slot in the probe sequence, else the home slot */
+	victim = &t[hash & (PATHCACHE_SLOTS - 1)];
+	for (i = 0; i < PATHCACHE_PROBES; i++) {
+		e = &t[(hash + i) & (PATHCACHE_SLOTS - 1)];
+		if (e->generation != generation) {
+			victim = e;
+			break;
+		}
+	}
+
+	victim->generation = generation;
+	victim->hash = hash;
+	victim->guest_len = len;
+	victim->host_len = host_len;
+	memcpy(victim->data, path, len + 1);
+	memcpy(victim->data + len + 1, host, host_len + 1);
+}
+
+void fchr_pathcache_stats(void)
+{
+	unsigned long hits = pathcache_hits, misses = pathcache_misses;
+
+	fprintf(stderr, "fakechroot: path cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+			hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
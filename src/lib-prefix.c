@@ -0,0 +1,184 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Root prefix matching.
+ *
+ * fchr_prefix_match(path, prefix, len) tells whether the NUL terminated
+ * path starts with the len bytes of prefix, which contain no NUL.  Unlike
+ * strstr() it never looks past the first mismatch, and the vector versions
+ * compare 16 or 32 bytes per step.  The implementation is picked once, at
+ * load time, through a GNU indirect function.
+ *
+ * The vector loops may read path bytes past its terminating NUL (a NUL
+ * never matches the prefix, so the result is unaffected), but they never
+ * let such a read cross into the next page.
+ */
+
+#include "common.h"
+#include <stdint.h>
+
+#define PAGE_SIZE_MIN 4096
+
+/* a load of n bytes at p stays within p's page */
+#define same_page(p, n) \
+	((((uintptr_t)(p)) & (PAGE_SIZE_MIN - 1)) <= PAGE_SIZE_MIN - (n))
+
+/* bytes left in p's page */
+#define page_left(p) \
+	(PAGE_SIZE_MIN - (((uintptr_t)(p)) & (PAGE_SIZE_MIN - 1)))
+
+static inline int match_bytes(const char *path, const char *prefix, size_t len)
+{
+	for (; len; len--)
+		if (*path++ != *prefix++)
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Step over a page boundary which a wide load at path would cross: the
+ * bytes up to it are compared one by one.  Once they all match they held
+ * no NUL, so the next page belongs to the string and wide loads may go on.
+ */
+#define cross_page(path, prefix, len, width) \
+	if (!same_page(path, width)) { \
+		size_t n = page_left(path); \
+		if (!match_bytes(path, prefix, n)) \
+			return 0; \
+		path += n; \
+		prefix += n; \
+		len -= n; \
+		continue; \
+	}
+
+int fchr_prefix_match_scalar(const char *path, const char *prefix, size_t len)
+{
+	while (len >= sizeof(unsigned long)) {
+		unsigned long a, b;
+
+		cross_page(path, prefix, len, sizeof(unsigned long));
+		memcpy(&a, path, sizeof(a));
+		memcpy(&b, prefix, sizeof(b));
+		if (a != b)
+			return 0;
+		path += sizeof(unsigned long);
+		prefix += sizeof(unsigned long);
+		len -= sizeof(unsigned long);
+	}
+
+	return match_bytes(path, prefix, len);
+}
+
+#if defined(__GNUC__) && defined(__ELF__) && \
+	(defined(__x86_64__) || defined(__i386__))
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+int fchr_prefix_match_sse2(const char *path, const char *prefix, size_t len)
+{
+	while (len >= 16) {
+		__m128i a, b;
+
+		cross_page(path, prefix, len, 16);
+		a = _mm_loadu_si128((const __m128i *)path);
+		b = _mm_loadu_si128((const __m128i *)prefix);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xffff)
+			return 0;
+		path += 16;
+		prefix += 16;
+		len -= 16;
+	}
+
+	return fchr_prefix_match_scalar(path, prefix, len);
+}
+
+__attribute__((target("avx2")))
+int fchr_prefix_match_avx2(const char *path, const char *prefix, size_t len)
+{
+	while (len >= 64) {
+		__m256i a0, a1, b0, b1, eq;
+
+		cross_page(path, prefix, len, 64);
+		a0 = _mm256_loadu_si256((const __m256i *)path);
+		a1 = _mm256_loadu_si256((const __m256i *)(path + 32));
+		b0 = _mm256_loadu_si256((const __m256i *)prefix);
+		b1 = _mm256_loadu_si256((const __m256i *)(prefix + 32));
+		eq = _mm256_and_si256(_mm256_cmpeq_epi8(a0, b0),
+				_mm256_cmpeq_epi8(a1, b1));
+		if ((unsigned int)_mm256_movemask_epi8(eq) != 0xffffffffU)
+			return 0;
+		path += 64;
+		prefix += 64;
+		len -= 64;
+	}
+
+	return fchr_prefix_match_sse2(path, prefix, len);
+}
+
+typedef int (*fchr_prefix_match_fn_t)(const char *, const char *, size_t);
+
+/*
+ * Runs while the library is relocated, before its thread local storage is
+ * set up: it must not be instrumented by -fprofile-generate, whose value
+ * profiling uses it.
+ *
+ * __builtin_cpu_supports() would bring in libgcc's CPU model, whose
+ * constructor runs a dozen cpuid instructions at every startup; on a
+ * virtual machine each one traps to the hypervisor.  The three below are
+ * all it takes.
+ */
+__attribute__((no_profile_instrument_function))
+static fchr_prefix_match_fn_t fchr_prefix_match_resolve(void)
+{
+	unsigned int max, a, b, c, d, xcr0;
+	int sse2;
+
+	if ((max = __get_cpuid_max(0, NULL)) < 1)
+		return fchr_prefix_match_scalar;
+	__cpuid(1, a, b, c, d);
+	sse2 = (d & bit_SSE2) != 0;
+
+	/* AVX2 also needs the kernel to save the ymm registers */
+	if (max >= 7 && (c & bit_OSXSAVE) && (c & bit_AVX)) {
+		__asm__("xgetbv" : "=a" (xcr0), "=d" (d) : "c" (0));
+		__cpuid_count(7, 0, a, b, c, d);
+		if ((xcr0 & 6) == 6 && (b & bit_AVX2))
+			return fchr_prefix_match_avx2;
+	}
+
+	return sse2 ? fchr_prefix_match_sse2 : fchr_prefix_match_scalar;
+}
+
+int fchr_prefix_match(const char *path, const char *prefix, size_t len)
+	__attribute__((ifunc("fchr_prefix_match_resolve")));
+
+#else
+
+int fchr_prefix_match(const char *path, const char *prefix, size_t len)
+{
+	return fchr_prefix_match_scalar(path, prefix, len);
+}
+
+#endif
@@ -0,0 +1,372 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Path resolution inside the fake root.
+ *
+ * The kernel knows nothing about FAKECHROOT_BASE: an absolute symlink or
+ * a ".." at the top of a translated path takes it straight out of the
+ * root.  fchr_resolve() therefore walks the guest path one component at a
+ * time, the way namei does, and follows symlinks itself, restarting
+ * absolute ones at the fake root.
+ *
+ * With FAKECHROOT_OPTS=C what every component turned out to be is
+ * remembered in a per-thread dentry cache keyed by the guest path leading
+ * to it, that is by (parent, name): directories, other files and symlinks
+ * together with their target.  Warm lookups thus cost no system calls at
+ * all.  Entries belong to a configuration generation and to a cache
+ * epoch; the epoch is bumped whenever a wrapper of this process removes
+ * or renames something.  Names that do not exist are not cached, so files
+ * created meanwhile are always found.  Symlinks replaced or directories
+ * swapped by any other process, a child's "ln -sf" among them, are not
+ * seen, which is why the cache must be asked for, like the negative
+ * lookup cache.  Inside immutable trees the lstat() behind a miss goes
+ * through the stat cache, which does remember missing names, and inside
+ * an indexed sysroot the manifest answers instead.
+ *
+ * Symlinks of the host's /proc, reached through the mount table, are not
+ * followed: /proc/self, /proc/self/fd/N and the like point at pipes,
+ * sockets or another process, and only the kernel can walk them.  The
+ * rest of the path is left to it as it is.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#define FCHR_MAXSYMLINKS 40
+
+#define DCACHE_SLOTS  256		/* power of two */
+#define DCACHE_PROBES 4
+#define DCACHE_DATA   240		/* guest path, NUL, link target, NUL */
+
+enum { DENT_NONE, DENT_ERROR, DENT_DIR, DENT_LINK, DENT_MAGIC, DENT_OTHER };
+
+struct dcache_entry {
+	unsigned int generation;	/* 0 for an empty slot */
+	unsigned int epoch;
+	unsigned int hash;
+	unsigned char type;
+	unsigned char pad;
+	unsigned short key_len;
+	char data[DCACHE_DATA];
+};
+
+/* the thread's table once it stored an entry, see fchr_thread_table() */
+static __thread void *dcache;
+static struct dcache_entry dcache_initial[DCACHE_SLOTS];
+
+static unsigned int dcache_epoch;
+
+/* process wide counters, only maintained with OPT_STATS */
+static unsigned long dcache_hits, dcache_misses;
+
+void fchr_dcache_invalidate(void)
+{
+	__atomic_add_fetch(&dcache_epoch, 1, __ATOMIC_RELEASE);
+}
+
+void fchr_dcache_stats(void)
+{
+	unsigned long hits = dcache_hits, misses = dcache_misses;
+
+	fprintf(stderr, "fakechroot: dentry cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+			hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
+
+#define DCACHE_HASH_INIT 2166136261U
+
+/* FNV-1a, continued from h so a path's hash extends its parent's */
+static inline unsigned int dcache_hash(unsigned int h, const char *key, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)key;
+
+	for (; len; len--)
+		h = (h ^ *p++) * 16777619U;
+
+	return h;
+}
+
+/*
+ * Find out what the guest path key of key_len bytes, with the given hash,
+ * is on the host.  A symlink's target is stored into target, which holds
+ * FAKECHROOT_PATHBUF bytes.  DENT_NONE means the name does not exist,
+ * DENT_ERROR any other failure, errno telling which; DENT_MAGIC is a
+ * symlink of /proc.
+ */
+static int dentry_lookup(const char *key, size_t key_len, unsigned int hash,
+		char *target, const struct fchr_config *c)
+{
+	unsigned int epoch = __atomic_load_n(&dcache_epoch, __ATOMIC_ACQUIRE);
+	struct dcache_entry *t = dcache, *e, *victim;
+	char host[FAKECHROOT_PATHBUF];
+	struct stat st;
+	size_t tlen = 0;
+	ssize_t n;
+	int type, i;
+
+	if (!(fchr_opts & OPT_DCACHE))
+		t = NULL;
+	for (i = 0; t != NULL && i < DCACHE_PROBES; i++) {
+		e = &t[(hash + i) & (DCACHE_SLOTS - 1)];
+		if (e->generation == c->generation && e->epoch == epoch &&
+				e->hash == hash && e->key_len == key_len &&
+				!memcmp(e->data, key, key_len)) {
+			if (e->type == DENT_LINK)
+				strcpy(target, e->data + key_len + 1);
+			if (fchr_opts & OPT_STATS)
+				__atomic_add_fetch(&dcache_hits, 1, __ATOMIC_RELAXED);
+			return e->type;
+		}
+	}
+
+	if ((fchr_opts & (OPT_DCACHE | OPT_STATS)) == (OPT_DCACHE | OPT_STATS))
+		__atomic_add_fetch(&dcache_misses, 1, __ATOMIC_RELAXED);
+
+	fchr_translate(key, key_len, host, c);
+	if ((fchr_opts & OPT_INDEX) &&
+			(n = fchr_index_lstat(host, &st)) != FCHR_FALLBACK) {
+		if (n != 0)
+			return errno == ENOENT ? DENT_NONE : DENT_ERROR;
+	} else if (fchr_statcache(FCHR_STATCACHE_LSTAT, host, 0, &st,
+				next_lstat(host, &st)) != 0)
+		return errno == ENOENT ? DENT_NONE : DENT_ERROR;
+
+	if (S_ISDIR(st.st_mode))
+		type = DENT_DIR;
+	else if (S_ISLNK(st.st_mode) && !strncmp(host, "/proc/", 6))
+		type = DENT_MAGIC;
+	else if (S_ISLNK(st.st_mode)) {
+		if (!(fchr_opts & OPT_INDEX) || (n = fchr_index_readlink(host, target,
+						FAKECHROOT_MAXPATH)) == FCHR_FALLBACK)
+			n = next_readlink(host, target, FAKECHROOT_MAXPATH);
+		if (n < 0)
+			return DENT_ERROR;
+		if (n == 0 || n >= FAKECHROOT_MAXPATH) {
+			errno = n ? ENAMETOOLONG : ENOENT;
+			return DENT_ERROR;
+		}
+		target[n] = '\0';
+		tlen = n;
+		type = DENT_LINK;
+	} else
+		type = DENT_OTHER;
+
+	if (!(fchr_opts & OPT_DCACHE) || key_len + tlen + 2 > DCACHE_DATA)
+		return type;
+	if (t == NULL && (t = fchr_thread_table(&dcache,
+					sizeof(dcache_initial), dcache_initial)) == NULL)
+		return type;
+
+	victim = &t[hash & (DCACHE_SLOTS - 1)];
+	for (i = 0; i < DCACHE_PROBES; i++) {
+		e = &t[(hash + i) & (DCACHE_SLOTS - 1)];
+		if (e->generation != c->generation || e->epoch != epoch) {
+			victim = e;
+			break;
+		}
+	}
+
+	victim->generation = c->generation;
+	victim->epoch = epoch;
+	victim->hash = hash;
+	victim->type = type;
+	victim->key_len = key_len;
+	memcpy(victim->data, key, key_len);
+	victim->data[key_len] = '\0';
+	if (type == DENT_LINK)
+		memcpy(victim->data + key_len + 1, target, tlen + 1);
+
+	return type;
+}
+
+/*
+ * Resolve path, a guest path or a host path inside the fake root, to its
+ * canonical guest form: no ".", "..", symlinks or repeated slashes.  buf,
+ * which holds FAKECHROOT_PATHBUF bytes, receives it and is returned.
+ * Relative paths start from the working directory, which must then lie
+ * inside the fake root or a mount (EXDEV otherwise).  Names are looked up
+ * on the host through the mount table, see fchr_translate().
+ *
+ * A trailing symlink is left alone with FCHR_RESOLVE_NOFOLLOW, and a
+ * missing last component is fine unless FCHR_RESOLVE_EXISTING is given.
+ * On failure NULL is returned with errno set as realpath() would.
+ */
+char *fchr_resolve(const char *path, char *buf, int flags)
+{
+	const struct fchr_config *c = fchr_conf();
+	char rest[2][FAKECHROOT_PATHBUF], target[FAKECHROOT_PATHBUF];
+	size_t rlen = c->root ? c->root_len : 0, glen = 0, nlen, tlen;
+	const struct fchr_mount *m;
+	struct fchr_mount me;
+	const char *r, *name, *next;
+	char *guest = buf;
+	unsigned int hash = DCACHE_HASH_INIT;
+	int cur = 0, links = 0, last;
+
+	if (path == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (*path == '\0') {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	guest[0] = '\0';
+
+	if (*path != '/') {
+		if (next_getcwd(guest, FAKECHROOT_PATHBUF) == NULL)
+			return NULL;
+		if (fchr_in_root(guest, c))
+			memmove(guest, guest + rlen, strlen(guest + rlen) + 1);
+		else if (!fchr_narrow_host(c, guest) &&
+				(!(m = fchr_mount_lookup(c->mounts, guest, &tlen, &me)) ||
+				 !m->passthrough)) {
+			errno = EXDEV;
+			return NULL;
+		}
+		glen = strlen(guest);
+		hash = dcache_hash(DCACHE_HASH_INIT, guest, glen);
+	} else if (fchr_in_root(path, c))
+		path += rlen;
+
+	for (r = path; ; ) {
+		while (*r == '/')
+			r++;
+		if (*r == '\0')
+			break;
+
+		for (name = next = r; *next != '\0' && *next != '/'; next++)
+			;
+		nlen = next - name;
+		for (r = next; *r == '/'; r++)
+			;
+		last = *r == '\0';
+
+		if (nlen == 1 && name[0] == '.')
+			continue;
+		if (nlen == 2 && name[0] == '.' && name[1] == '.') {
+			while (glen > 0 && guest[--glen] != '/')
+				;
+			guest[glen] = '\0';
+			hash = dcache_hash(DCACHE_HASH_INIT, guest, glen);
+			continue;
+		}
+
+		if (glen + 1 + nlen > FAKECHROOT_MAXPATH) {
+			errno = ENAMETOOLONG;
+			return NULL;
+		}
+		guest[glen] = '/';
+		memcpy(guest + glen + 1, name, nlen);
+		hash = dcache_hash(hash, guest + glen, 1 + nlen);
+		glen += 1 + nlen;
+		guest[glen] = '\0';
+
+		/* a trailing slash asks for the directory behind a symlink */
+		if (last && r == next && (flags & FCHR_RESOLVE_NOFOLLOW))
+			break;
+
+		switch (dentry_lookup(guest, glen, hash, target, c)) {
+		case DENT_NONE:
+			if (last && !(flags & FCHR_RESOLVE_EXISTING))
+				goto out;
+			errno = ENOENT;
+			return NULL;
+		case DENT_ERROR:
+			return NULL;
+		case DENT_DIR:
+			break;
+		case DENT_OTHER:
+			if (!last || r != next) {
+				errno = ENOTDIR;
+				return NULL;
+			}
+			break;
+		case DENT_LINK:
+			if (++links > FCHR_MAXSYMLINKS) {
+				errno = ELOOP;
+				return NULL;
+			}
+			/* continue with the target followed by what is left */
+			tlen = strlen(target);
+			if (tlen + strlen(next) > FAKECHROOT_MAXPATH) {
+				errno = ENAMETOOLONG;
+				return NULL;
+			}
+			cur ^= 1;
+			memcpy(rest[cur], target, tlen);
+			strcpy(rest[cur] + tlen, next);
+			r = rest[cur];
+			if (target[0] == '/')
+				glen = 0;
+			else
+				while (glen > 0 && guest[--glen] != '/')
+					;
+			guest[glen] = '\0';
+			hash = dcache_hash(DCACHE_HASH_INIT, guest, glen);
+			break;
+		case DENT_MAGIC:
+			/* the kernel follows it, and walks what is left */
+			if (!last) {
+				if (glen + 1 + strlen(r) > FAKECHROOT_MAXPATH) {
+					errno = ENAMETOOLONG;
+					return NULL;
+				}
+				guest[glen] = '/';
+				strcpy(guest + glen + 1, r);
+			}
+			goto out;
+		}
+	}
+
+out:
+	if (glen == 0) {
+		guest[0] = '/';
+		guest[1] = '\0';
+	}
+
+	return guest;
+}
+
+/*
+ * Translate guest path into host path like fakechroot_expand(), following
+ * symlinks inside the fake root.  Only absolute paths are resolved, and
+ * relative ones in overlay mode; elsewhere the kernel may walk those
+ * itself as before.  When resolution fails the plain expansion is
+ * returned, so the wrapped call reports the error.
+ */
+char *fakechroot_resolve(const char *path, char *buf, int flags)
+{
+	char guest[FAKECHROOT_PATHBUF];
+	int saved_errno = errno;
+
+	if (path == NULL || fchr_nested || fakechroot_path == NULL ||
+			(*path != '/' && !fchr_overlay(fchr_conf())))
+		return (char *)path;
+
+	if (fchr_resolve(path, guest, flags) != NULL)
+		return fchr_translate(guest, strlen(guest), buf, fchr_conf());
+
+	errno = saved_errno;
+	return fakechroot_expand(path, buf);
+}
@@ -0,0 +1,1209 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Seccomp supervisor for static programs (FAKECHROOT_OPTS=F).
+ *
+ * A statically linked program, a Go binary say, never loads the library
+ * and so sees the host tree.  With this option execve() starts such a
+ * program under a seccomp filter which hands the system calls taking a
+ * path to a supervisor process (SECCOMP_RET_USER_NOTIF).  Every other
+ * system call, and the stat family on a descriptor, the filter lets
+ * through without asking anyone: the kernel remembers that their verdict
+ * does not depend on the arguments and they run at native speed.
+ *
+ * The supervisor is a fork of the process calling execve(), so it has
+ * the configuration, the caches and the wrappers of the library.  For
+ * each call it reads the path from the program's memory, makes it
+ * absolute against the program's working directory or dirfd, and makes
+ * the call again through the wrapper of the function, as if the program
+ * had called it; where libc has no wrapped function for it, on a path
+ * translated here.  The result goes back the same way: an open()'s
+ * descriptor is installed in the program with SECCOMP_IOCTL_NOTIF_ADDFD,
+ * buffers are written with process_vm_writev().
+ *
+ * The kernel can not be made to run a call with other arguments, so what
+ * a call does to the program itself has to be faked:
+ *   - chdir() and fchdir() keep a descriptor of the directory at
+ *     FCHR_SECCOMP_CWD, which relative paths are taken against and
+ *     getcwd() reports; the real working directory stays where it was;
+ *   - execve() is let through for paths the library would pass on as
+ *     they are, host paths inside the root among them, and fails with
+ *     EPERM for paths it would translate.
+ * The filter stays with the program and its children, and a program in
+ * such a tree which has the library gets no supervisor of its own.  It
+ * can not be taken back either, so an execve() failing once it is set
+ * leaves the caller under it, see fchr_seccomp_execve().
+ *
+ * A SIGSYS handler in the program was no choice: it does not survive an
+ * execve() of another static program.  Nor is this a sandbox: a program
+ * can race the supervisor for its own memory, and calls on descriptors
+ * are never looked at.  Extended attributes, inotify and socket paths
+ * are not covered, and a directory read through its descriptor shows one
+ * layer of an overlay only.  Needs Linux 5.9, with 5.14 an open() costs
+ * one round trip less.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#ifdef FAKECHROOT_SECCOMP
+
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <utime.h>
+
+#if defined(__x86_64__)
+#define FCHR_AUDIT_ARCH AUDIT_ARCH_X86_64
+#else
+#define FCHR_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#endif
+
+#ifndef SECCOMP_ADDFD_FLAG_SEND
+#define SECCOMP_ADDFD_FLAG_SEND (1UL << 1)
+#endif
+
+/* the program's working directory after a chdir(), see above */
+#define FCHR_SECCOMP_CWD 1000
+
+/* getcwd(NULL, FCHR_SECCOMP_MAGIC) returns it under a supervisor */
+#define FCHR_SECCOMP_MAGIC 0x66636872
+
+/* threads serving the program, a blocking open() holds one */
+#define FCHR_SECCOMP_THREADS 4
+
+/* results of a handler besides a value or -errno */
+#define NOTIF_SENT     (-4096L - 1)	/* answered already */
+#define NOTIF_CONTINUE (-4096L - 2)	/* the kernel makes the call */
+
+/* not before glibc 2.34 in libc itself; a single thread then */
+#pragma weak pthread_create
+
+/* a notification being answered */
+struct notif {
+	int fd;						/* the listener */
+	struct seccomp_notif *req;
+	pid_t pid;
+};
+
+/* the path taking calls, beside those the filter looks at the flags of */
+static const unsigned int trapped[] = {
+#ifdef SYS_open
+	SYS_open, SYS_creat, SYS_stat, SYS_lstat, SYS_access, SYS_readlink,
+	SYS_mkdir, SYS_mknod, SYS_rmdir, SYS_unlink, SYS_rename, SYS_link,
+	SYS_symlink, SYS_chmod, SYS_chown, SYS_lchown, SYS_utime, SYS_utimes,
+	SYS_futimesat,
+#endif
+#ifdef SYS_renameat
+	SYS_renameat,
+#endif
+#ifdef SYS_renameat2
+	SYS_renameat2,
+#endif
+#ifdef SYS_faccessat2
+	SYS_faccessat2,
+#endif
+#ifdef SYS_openat2
+	SYS_openat2,
+#endif
+#ifdef SYS_fchmodat2
+	SYS_fchmodat2,
+#endif
+	SYS_openat, SYS_faccessat, SYS_readlinkat, SYS_mkdirat, SYS_mknodat,
+	SYS_unlinkat, SYS_linkat, SYS_symlinkat, SYS_fchmodat, SYS_fchownat,
+	SYS_truncate, SYS_statfs, SYS_chdir, SYS_fchdir, SYS_getcwd,
+	SYS_execve, SYS_execveat,
+};
+
+#define NTRAPPED (sizeof(trapped) / sizeof(trapped[0]))
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define ARG_LO(i) (offsetof(struct seccomp_data, args[i]))
+#define ARG_HI(i) (offsetof(struct seccomp_data, args[i]) + 4)
+#else
+#define ARG_LO(i) (offsetof(struct seccomp_data, args[i]) + 4)
+#define ARG_HI(i) (offsetof(struct seccomp_data, args[i]))
+#endif
+
+#define STMT(code, k) ((struct sock_filter)BPF_STMT((code), (k)))
+#define JUMP(code, k, t, f) ((struct sock_filter)BPF_JUMP((code), (k), (t), (f)))
+#define LOAD(off) STMT(BPF_LD | BPF_W | BPF_ABS, (off))
+#define RET(action) STMT(BPF_RET | BPF_K, (action))
+#define JEQ(k, t, f) JUMP(BPF_JMP | BPF_JEQ | BPF_K, (k), (t), (f))
+#define JGE(k, t, f) JUMP(BPF_JMP | BPF_JGE | BPF_K, (k), (t), (f))
+#define JSET(k, t, f) JUMP(BPF_JMP | BPF_JSET | BPF_K, (k), (t), (f))
+
+/* the filter, into f which holds NTRAPPED + 32 instructions; its length */
+static unsigned short filter_build(struct sock_filter *f)
+{
+	unsigned short n = 0;
+	unsigned int i;
+
+	f[n++] = LOAD(offsetof(struct seccomp_data, arch));
+	f[n++] = JEQ(FCHR_AUDIT_ARCH, 1, 0);
+	f[n++] = RET(SECCOMP_RET_ERRNO | ENOSYS);
+	f[n++] = LOAD(offsetof(struct seccomp_data, nr));
+#if defined(__x86_64__)
+	/* x32 */
+	f[n++] = JGE(0x40000000, 0, 1);
+	f[n++] = RET(SECCOMP_RET_ERRNO | ENOSYS);
+#endif
+
+	/* fstat() and the like, by AT_EMPTY_PATH */
+	f[n++] = JEQ(SYS_newfstatat, 0, 4);
+	f[n++] = LOAD(ARG_LO(3));
+	f[n++] = JSET(AT_EMPTY_PATH, 0, 1);
+	f[n++] = RET(SECCOMP_RET_ALLOW);
+	f[n++] = RET(SECCOMP_RET_USER_NOTIF);
+#ifdef SYS_statx
+	f[n++] = JEQ(SYS_statx, 0, 4);
+	f[n++] = LOAD(ARG_LO(2));
+	f[n++] = JSET(AT_EMPTY_PATH, 0, 1);
+	f[n++] = RET(SECCOMP_RET_ALLOW);
+	f[n++] = RET(SECCOMP_RET_USER_NOTIF);
+#endif
+	/* futimens(), utimensat() without a path */
+	f[n++] = JEQ(SYS_utimensat, 0, 6);
+	f[n++] = LOAD(ARG_LO(1));
+	f[n++] = JEQ(0, 0, 3);
+	f[n++] = LOAD(ARG_HI(1));
+	f[n++] = JEQ(0, 0, 1);
+	f[n++] = RET(SECCOMP_RET_ALLOW);
+	f[n++] = RET(SECCOMP_RET_USER_NOTIF);
+
+	for (i = 0; i < NTRAPPED; i++)
+		f[n++] = JEQ(trapped[i], NTRAPPED - i, 0);
+	f[n++] = RET(SECCOMP_RET_ALLOW);
+	f[n++] = RET(SECCOMP_RET_USER_NOTIF);
+
+	return n;
+}
+
+/*
+ * Access to the program's memory.  Its pages may go away under us, so
+ * nothing is read before it is known to be there.
+ */
+static int peek(pid_t pid, unsigned long addr, void *buf, size_t len)
+{
+	struct iovec local = { buf, len }, remote = { (void *)addr, len };
+
+	return process_vm_readv(pid, &local, 1, &remote, 1, 0) == (ssize_t)len ?
+		0 : -EFAULT;
+}
+
+static int poke(pid_t pid, unsigned long addr, const void *buf, size_t len)
+{
+	struct iovec local = { (void *)buf, len }, remote = { (void *)addr, len };
+
+	return process_vm_writev(pid, &local, 1, &remote, 1, 0) == (ssize_t)len ?
+		0 : -EFAULT;
+}
+
+/* the string at addr, a page at a time, into buf of FAKECHROOT_PATHBUF */
+static int peek_path(pid_t pid, unsigned long addr, char *buf)
+{
+	size_t off = 0, len;
+
+	if (addr == 0)
+		return -EFAULT;
+	while (off < FAKECHROOT_PATHBUF) {
+		len = 4096 - ((addr + off) & 4095);
+		if (len > FAKECHROOT_PATHBUF - off)
+			len = FAKECHROOT_PATHBUF - off;
+		if (peek(pid, addr + off, buf + off, len) < 0)
+			return -EFAULT;
+		if (memchr(buf + off, '\0', len) != NULL)
+			return 0;
+		off += len;
+	}
+
+	return -ENAMETOOLONG;
+}
+
+/* a host path to the path the program knows it by, in place */
+static void notif_narrow(char *path)
+{
+	const struct fchr_config *c = fchr_conf();
+
+	if (!fchr_in_root(path, c))
+		fchr_narrow_host(c, path);
+	else if (path[c->root_len] == '\0')
+		strcpy(path, "/");
+	else
+		memmove(path, path + c->root_len, strlen(path + c->root_len) + 1);
+}
+
+/* the program's working directory, a host path; its length or -errno */
+static ssize_t notif_cwd(struct notif *n, char *buf)
+{
+	char link[64];
+	ssize_t len;
+
+	snprintf(link, sizeof(link), "/proc/%d/fd/%d", n->pid, FCHR_SECCOMP_CWD);
+	if ((len = NEXTCALL(readlink)(link, buf, FAKECHROOT_MAXPATH)) < 0) {
+		snprintf(link, sizeof(link), "/proc/%d/cwd", n->pid);
+		if ((len = NEXTCALL(readlink)(link, buf, FAKECHROOT_MAXPATH)) < 0)
+			return -ENOENT;
+	}
+	buf[len] = '\0';
+
+	return len;
+}
+
+/*
+ * The path argument at addr of a call on dirfd, as an absolute path in
+ * buf: a guest path, or with *host set a host path outside the root and
+ * its mounts, to be used as it is.  0 or -errno.  An absolute path below
+ * the host side of a mount is taken for a host path too, as op_execve()
+ * does: a dynamic program in the tree has the library, which translated
+ * it already.
+ */
+static int notif_path(struct notif *n, int dirfd, unsigned long addr,
+		char *buf, int *host)
+{
+	char path[FAKECHROOT_PATHBUF], link[64];
+	const struct fchr_config *c;
+	ssize_t len;
+	int ret;
+
+	*host = 0;
+	if ((ret = peek_path(n->pid, addr, path)) < 0)
+		return ret;
+	/* what was read is what the program meant, unless it is gone */
+	if (ioctl(n->fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &n->req->id) < 0)
+		return -ENOENT;
+	if (*path == '\0')
+		return -ENOENT;
+
+	if (*path == '/') {
+		/* the supervisor's own would be meant otherwise */
+		if (strncmp(path, "/proc/self", 10) == 0 &&
+				(path[10] == '/' || path[10] == '\0'))
+			len = snprintf(buf, FAKECHROOT_PATHBUF, "/proc/%d%s", n->pid, path + 10);
+		else if (strncmp(path, "/proc/thread-self", 17) == 0 &&
+				(path[17] == '/' || path[17] == '\0'))
+			len = snprintf(buf, FAKECHROOT_PATHBUF, "/proc/%d%s", n->pid, path + 17);
+		else
+			len = snprintf(buf, FAKECHROOT_PATHBUF, "%s", path);
+		if (len >= FAKECHROOT_PATHBUF)
+			return -ENAMETOOLONG;
+		strcpy(path, buf);
+		*host = fchr_narrow_host(fchr_conf(), path);
+		return 0;
+	}
+
+	if (dirfd == AT_FDCWD)
+		len = notif_cwd(n, buf);
+	else {
+		snprintf(link, sizeof(link), "/proc/%d/fd/%d", n->pid, dirfd);
+		if ((len = NEXTCALL(readlink)(link, buf, FAKECHROOT_MAXPATH)) < 0)
+			return -EBADF;
+		buf[len] = '\0';
+	}
+	if (len < 0)
+		return len;
+	if (*buf != '/')
+		return -ENOTDIR;			/* a pipe, a socket */
+
+	c = fchr_conf();
+	if (fchr_in_root(buf, c))
+		notif_narrow(buf);
+	else if (!fchr_narrow_host(c, buf))
+		*host = 1;
+
+	len = strlen(buf);
+	if (len + 1 + strlen(path) >= FAKECHROOT_PATHBUF)
+		return -ENAMETOOLONG;
+	if (len > 1)
+		buf[len++] = '/';
+	strcpy(buf + len, path);
+
+	return 0;
+}
+
+/* the program's umask, which the supervisor's (0) stands in for */
+static mode_t notif_umask(struct notif *n)
+{
+	char path[64], buf[1024], *p;
+	unsigned int mask = 022;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", n->pid);
+	if ((fd = next_open(path, O_RDONLY | O_CLOEXEC, 0)) < 0)
+		return mask;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len > 0) {
+		buf[len] = '\0';
+		if ((p = strstr(buf, "\nUmask:")) != NULL)
+			sscanf(p + 7, "%o", &mask);
+	}
+
+	return mask;
+}
+
+/* the call on a path of notif_path(), as the program or on the host path */
+#define replay(host, call) ((host) ? fchr_direct(call) : (call))
+
+/* libc's -1 and errno to the kernel's -errno */
+static inline long sysret(long ret)
+{
+	return ret < 0 ? -errno : ret;
+}
+
+/* fd as the program's descriptor newfd, or the lowest free one if -1 */
+static long notif_addfd(struct notif *n, int fd, int newfd, int cloexec)
+{
+	struct seccomp_notif_addfd addfd;
+	long ret;
+	int err;
+
+	memset(&addfd, 0, sizeof(addfd));
+	addfd.id = n->req->id;
+	addfd.srcfd = fd;
+	addfd.newfd_flags = cloexec ? O_CLOEXEC : 0;
+	if (newfd >= 0) {
+		addfd.newfd = newfd;
+		addfd.flags = SECCOMP_ADDFD_FLAG_SETFD;
+		ret = ioctl(n->fd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+	} else {
+		/* it answers the call as well, since Linux 5.14 */
+		addfd.flags = SECCOMP_ADDFD_FLAG_SEND;
+		if ((ret = ioctl(n->fd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd)) >= 0)
+			ret = NOTIF_SENT;
+		else if (errno == EINVAL) {
+			addfd.flags = 0;
+			ret = ioctl(n->fd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+		}
+	}
+	err = errno;
+	close(fd);
+
+	return ret < 0 && ret != NOTIF_SENT ? -err : ret;
+}
+
+static long op_open(struct notif *n, int dirfd, unsigned long path, int flags,
+		mode_t mode)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int host, fd, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+		mode &= ~notif_umask(n);
+	/* a terminal would become the supervisor's */
+	if ((fd = replay(host, open(buf, flags | O_NOCTTY, mode))) < 0)
+		return -errno;
+
+	return notif_addfd(n, fd, -1, flags & O_CLOEXEC);
+}
+
+static long op_stat(struct notif *n, int dirfd, unsigned long path,
+		unsigned long addr, int flags)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	struct stat st;
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if (flags & AT_SYMLINK_NOFOLLOW)
+		ret = replay(host, lstat(buf, &st));
+	else
+		ret = replay(host, stat(buf, &st));
+	if (ret < 0)
+		return -errno;
+
+	return poke(n->pid, addr, &st, sizeof(st));
+}
+
+#ifdef SYS_statx
+static long op_statx(struct notif *n, int dirfd, unsigned long path,
+		int flags, unsigned int mask, unsigned long addr)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF];
+	char stx[256];				/* struct statx, which libc may not know */
+	const char *p;
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	p = host ? buf : fakechroot_resolve(buf, tmp,
+			flags & AT_SYMLINK_NOFOLLOW ? FCHR_RESOLVE_NOFOLLOW : 0);
+	if (syscall(SYS_statx, AT_FDCWD, p, flags, mask, stx) < 0)
+		return -errno;
+
+	return poke(n->pid, addr, stx, sizeof(stx));
+}
+#endif
+
+static long op_access(struct notif *n, int dirfd, unsigned long path,
+		int mode, int flags)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF];
+	const char *p;
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if (flags == 0)
+		return sysret(replay(host, access(buf, mode)));
+
+	p = host ? buf : fakechroot_resolve(buf, tmp,
+			flags & AT_SYMLINK_NOFOLLOW ? FCHR_RESOLVE_NOFOLLOW : 0);
+	return sysret(faccessat(AT_FDCWD, p, mode, flags));
+}
+
+static long op_readlink(struct notif *n, int dirfd, unsigned long path,
+		unsigned long addr, size_t size)
+{
+	char buf[FAKECHROOT_PATHBUF], link[FAKECHROOT_PATHBUF];
+	ssize_t len;
+	int host, ret;
+
+	/* readlinkat(fd, "", ...) of an O_PATH descriptor */
+	if (dirfd != AT_FDCWD && peek(n->pid, path, buf, 1) == 0 && *buf == '\0')
+		return NOTIF_CONTINUE;
+	if ((int)size <= 0)
+		return -EINVAL;
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if ((len = replay(host, readlink(buf, link, FAKECHROOT_MAXPATH))) < 0)
+		return -errno;
+	if ((size_t)len > size)
+		len = size;
+
+	return poke(n->pid, addr, link, len) < 0 ? -EFAULT : len;
+}
+
+static long op_mkdir(struct notif *n, int dirfd, unsigned long path,
+		mode_t mode)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+
+	return sysret(replay(host, mkdir(buf, mode & ~notif_umask(n))));
+}
+
+static long op_mknod(struct notif *n, int dirfd, unsigned long path,
+		mode_t mode, dev_t dev)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF];
+	const char *p;
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	p = host ? buf : fakechroot_upper(buf, tmp, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return sysret(fchr_negcache_made(fchr_direct(mknod(p,
+			mode & ~notif_umask(n), dev))));
+}
+
+static long op_unlink(struct notif *n, int dirfd, unsigned long path,
+		int flags)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if (flags & ~AT_REMOVEDIR)
+		return -EINVAL;
+	if (flags & AT_REMOVEDIR)
+		return sysret(replay(host, rmdir(buf)));
+
+	return sysret(replay(host, unlink(buf)));
+}
+
+static long op_rename(struct notif *n, int olddirfd, unsigned long oldpath,
+		int newdirfd, unsigned long newpath, unsigned int flags)
+{
+	char oldbuf[FAKECHROOT_PATHBUF], newbuf[FAKECHROOT_PATHBUF];
+	char oldtmp[FAKECHROOT_PATHBUF], newtmp[FAKECHROOT_PATHBUF];
+	const char *o, *p;
+	int oldhost, newhost, ret;
+
+	if ((ret = notif_path(n, olddirfd, oldpath, oldbuf, &oldhost)) < 0 ||
+			(ret = notif_path(n, newdirfd, newpath, newbuf, &newhost)) < 0)
+		return ret;
+	if (flags == 0 && !oldhost && !newhost)
+		return sysret(rename(oldbuf, newbuf));
+
+	/* RENAME_EXCHANGE and friends, or host paths: no overlay */
+	o = oldhost ? oldbuf : fakechroot_expand(oldbuf, oldtmp);
+	p = newhost ? newbuf : fakechroot_expand(newbuf, newtmp);
+#ifdef SYS_renameat2
+	ret = syscall(SYS_renameat2, AT_FDCWD, o, AT_FDCWD, p, flags);
+#else
+	ret = flags ? (errno = EINVAL, -1) : fchr_direct(rename(o, p));
+#endif
+	if (ret == 0)
+		fchr_dcache_invalidate();
+
+	return sysret(fchr_negcache_made(ret));
+}
+
+static long op_link(struct notif *n, int olddirfd, unsigned long oldpath,
+		int newdirfd, unsigned long newpath, int flags)
+{
+	char oldbuf[FAKECHROOT_PATHBUF], newbuf[FAKECHROOT_PATHBUF];
+	char oldtmp[FAKECHROOT_PATHBUF], newtmp[FAKECHROOT_PATHBUF];
+	const char *o, *p;
+	int oldhost, newhost, ret;
+
+	/* linkat(fd, "", ..., AT_EMPTY_PATH) names an open file */
+	if ((flags & AT_EMPTY_PATH) && peek(n->pid, oldpath, oldbuf, 1) == 0 &&
+			*oldbuf == '\0') {
+		if ((ret = notif_path(n, newdirfd, newpath, newbuf, &newhost)) < 0)
+			return ret;
+		p = newhost ? newbuf : fakechroot_upper(newbuf, newtmp,
+				FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+		snprintf(oldtmp, sizeof(oldtmp), "/proc/%d/fd/%d", n->pid, olddirfd);
+		return sysret(fchr_negcache_made(linkat(AT_FDCWD, oldtmp,
+				AT_FDCWD, p, AT_SYMLINK_FOLLOW)));
+	}
+
+	if ((ret = notif_path(n, olddirfd, oldpath, oldbuf, &oldhost)) < 0 ||
+			(ret = notif_path(n, newdirfd, newpath, newbuf, &newhost)) < 0)
+		return ret;
+	if (flags == 0 && !oldhost && !newhost)
+		return sysret(link(oldbuf, newbuf));
+
+	o = oldhost ? oldbuf : fakechroot_upper(oldbuf, oldtmp, FCHR_UPPER_COPY |
+			(flags & AT_SYMLINK_FOLLOW ? 0 : FCHR_UPPER_NOFOLLOW));
+	p = newhost ? newbuf : fakechroot_upper(newbuf, newtmp,
+			FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return sysret(fchr_negcache_made(linkat(AT_FDCWD, o, AT_FDCWD, p, flags)));
+}
+
+static long op_symlink(struct notif *n, unsigned long target, int dirfd,
+		unsigned long path)
+{
+	char buf[FAKECHROOT_PATHBUF], to[FAKECHROOT_PATHBUF];
+	int host, ret;
+
+	/* the target is stored as it is, the wrapper translates it */
+	if ((ret = peek_path(n->pid, target, to)) < 0)
+		return ret;
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+
+	return sysret(replay(host, symlink(to, buf)));
+}
+
+static long op_chmod(struct notif *n, int dirfd, unsigned long path,
+		mode_t mode, int flags)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF];
+	const char *p;
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if (flags == 0)
+		return sysret(replay(host, chmod(buf, mode)));
+
+	p = host ? buf : fakechroot_upper(buf, tmp,
+			FCHR_UPPER_COPY | fchr_at_nofollow(flags));
+	return sysret(fchr_direct(fchmodat(AT_FDCWD, p, mode, flags)));
+}
+
+static long op_chown(struct notif *n, int dirfd, unsigned long path,
+		uid_t owner, gid_t group, int flags)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int host, ret;
+
+	/* fchownat(fd, "", ..., AT_EMPTY_PATH) is fchown() */
+	if ((flags & AT_EMPTY_PATH) && peek(n->pid, path, buf, 1) == 0 &&
+			*buf == '\0')
+		return NOTIF_CONTINUE;
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	if (flags & AT_SYMLINK_NOFOLLOW)
+		return sysret(replay(host, lchown(buf, owner, group)));
+
+	return sysret(replay(host, chown(buf, owner, group)));
+}
+
+/* times, if not NULL, are already in the supervisor's memory */
+static long op_utimens(struct notif *n, int dirfd, unsigned long path,
+		const struct timespec *times, int flags)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF];
+	const char *p;
+	int host, ret;
+
+	if ((ret = notif_path(n, dirfd, path, buf, &host)) < 0)
+		return ret;
+	p = host ? buf : fakechroot_upper(buf, tmp,
+			FCHR_UPPER_COPY | fchr_at_nofollow(flags));
+
+	return sysret(fchr_direct(utimensat(AT_FDCWD, p, times, flags)));
+}
+
+static long op_utimensat(struct notif *n, int dirfd, unsigned long path,
+		unsigned long addr, int flags)
+{
+	struct timespec ts[2];
+
+	if (addr != 0 && peek(n->pid, addr, ts, sizeof(ts)) < 0)
+		return -EFAULT;
+
+	return op_utimens(n, dirfd, path, addr ? ts : NULL, flags);
+}
+
+#ifdef SYS_utimes
+/* utimes(), futimesat(): microseconds */
+static long op_utimes(struct notif *n, int dirfd, unsigned long path,
+		unsigned long addr)
+{
+	struct timespec ts[2];
+	struct timeval tv[2];
+	int i;
+
+	if (addr == 0)
+		return op_utimens(n, dirfd, path, NULL, 0);
+	if (peek(n->pid, addr, tv, sizeof(tv)) < 0)
+		return -EFAULT;
+	for (i = 0; i < 2; i++) {
+		if (tv[i].tv_usec < 0 || tv[i].tv_usec >= 1000000)
+			return -EINVAL;
+		ts[i].tv_sec = tv[i].tv_sec;
+		ts[i].tv_nsec = tv[i].tv_usec * 1000;
+	}
+
+	return op_utimens(n, dirfd, path, ts, 0);
+}
+
+/* utime(): seconds */
+static long op_utime(struct notif *n, unsigned long path, unsigned long addr)
+{
+	struct timespec ts[2];
+	struct utimbuf ub;
+
+	if (addr == 0)
+		return op_utimens(n, AT_FDCWD, path, NULL, 0);
+	if (peek(n->pid, addr, &ub, sizeof(ub)) < 0)
+		return -EFAULT;
+	ts[0].tv_sec = ub.actime;
+	ts[1].tv_sec = ub.modtime;
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+
+	return op_utimens(n, AT_FDCWD, path, ts, 0);
+}
+#endif
+
+static long op_truncate(struct notif *n, unsigned long path, off_t length)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int host, ret;
+
+	if ((ret = notif_path(n, AT_FDCWD, path, buf, &host)) < 0)
+		return ret;
+
+	return sysret(replay(host, truncate(buf, length)));
+}
+
+static long op_statfs(struct notif *n, unsigned long path, unsigned long addr)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF];
+	struct statfs sfs;
+	const char *p;
+	int host, ret;
+
+	if ((ret = notif_path(n, AT_FDCWD, path, buf, &host)) < 0)
+		return ret;
+	p = host ? buf : fakechroot_resolve(buf, tmp, 0);
+	if (statfs(p, &sfs) < 0)
+		return -errno;
+
+	return poke(n->pid, addr, &sfs, sizeof(sfs));
+}
+
+static long op_getcwd(struct notif *n, unsigned long addr, size_t size)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	ssize_t len;
+
+	if (addr == 0 && size == FCHR_SECCOMP_MAGIC)
+		return FCHR_SECCOMP_MAGIC;
+	if ((len = notif_cwd(n, buf)) < 0)
+		return len;
+	notif_narrow(buf);
+	len = strlen(buf) + 1;
+	if ((size_t)len > size)
+		return -ERANGE;
+
+	return poke(n->pid, addr, buf, len) < 0 ? -EFAULT : len;
+}
+
+/*
+ * fd as the program's working directory.  It is opened for reading, the
+ * kernel does not pass O_PATH descriptors on.
+ */
+static long notif_chdir(struct notif *n, int fd)
+{
+	long ret;
+
+	if (faccessat(fd, "", X_OK, AT_EACCESS | AT_EMPTY_PATH) < 0 &&
+			errno == EACCES) {
+		close(fd);
+		return -EACCES;
+	}
+	ret = notif_addfd(n, fd, FCHR_SECCOMP_CWD, 1);
+
+	return ret < 0 ? ret : 0;
+}
+
+static long op_chdir(struct notif *n, unsigned long path)
+{
+	char buf[FAKECHROOT_PATHBUF];
+	int host, fd, ret;
+
+	if ((ret = notif_path(n, AT_FDCWD, path, buf, &host)) < 0)
+		return ret;
+	if ((fd = replay(host, open(buf, O_RDONLY | O_DIRECTORY | O_CLOEXEC))) < 0)
+		return -errno;
+
+	return notif_chdir(n, fd);
+}
+
+static long op_fchdir(struct notif *n, int dirfd)
+{
+	char link[64];
+	int fd;
+
+	snprintf(link, sizeof(link), "/proc/%d/fd/%d", n->pid, dirfd);
+	if ((fd = next_open(link, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0)) < 0)
+		return errno == ENOENT ? -EBADF : -errno;
+
+	return notif_chdir(n, fd);
+}
+
+/* execve() and execveat(), which go ahead or fail, see above */
+static long op_execve(struct notif *n, int dirfd, unsigned long path)
+{
+	char buf[FAKECHROOT_PATHBUF], tmp[FAKECHROOT_PATHBUF], link[64];
+	int ret;
+
+	if ((ret = peek_path(n->pid, path, buf)) < 0)
+		return ret;
+	if (*buf == '/') {
+		/* the library's, on a host path below the root or a mount */
+		strcpy(tmp, buf);
+		if (fchr_in_root(buf, fchr_conf()) || fchr_narrow_host(fchr_conf(), tmp))
+			return NOTIF_CONTINUE;
+		return strcmp(fakechroot_expand(buf, tmp), buf) == 0 ?
+			NOTIF_CONTINUE : -EPERM;
+	}
+	if (*buf == '\0' || dirfd != AT_FDCWD)
+		return NOTIF_CONTINUE;
+
+	/* relative to the real working directory, unless it was changed */
+	snprintf(link, sizeof(link), "/proc/%d/fd/%d", n->pid, FCHR_SECCOMP_CWD);
+	return access(link, F_OK) < 0 ? NOTIF_CONTINUE : -EPERM;
+}
+
+static long notif_call(struct notif *n)
+{
+	const __u64 *a = n->req->data.args;
+
+	switch (n->req->data.nr) {
+#ifdef SYS_open
+	case SYS_open:
+		return op_open(n, AT_FDCWD, a[0], a[1], a[2]);
+	case SYS_creat:
+		return op_open(n, AT_FDCWD, a[0], O_CREAT | O_WRONLY | O_TRUNC, a[1]);
+	case SYS_stat:
+		return op_stat(n, AT_FDCWD, a[0], a[1], 0);
+	case SYS_lstat:
+		return op_stat(n, AT_FDCWD, a[0], a[1], AT_SYMLINK_NOFOLLOW);
+	case SYS_access:
+		return op_access(n, AT_FDCWD, a[0], a[1], 0);
+	case SYS_readlink:
+		return op_readlink(n, AT_FDCWD, a[0], a[1], a[2]);
+	case SYS_mkdir:
+		return op_mkdir(n, AT_FDCWD, a[0], a[1]);
+	case SYS_mknod:
+		return op_mknod(n, AT_FDCWD, a[0], a[1], a[2]);
+	case SYS_rmdir:
+		return op_unlink(n, AT_FDCWD, a[0], AT_REMOVEDIR);
+	case SYS_unlink:
+		return op_unlink(n, AT_FDCWD, a[0], 0);
+	case SYS_rename:
+		return op_rename(n, AT_FDCWD, a[0], AT_FDCWD, a[1], 0);
+	case SYS_link:
+		return op_link(n, AT_FDCWD, a[0], AT_FDCWD, a[1], 0);
+	case SYS_symlink:
+		return op_symlink(n, a[0], AT_FDCWD, a[1]);
+	case SYS_chmod:
+		return op_chmod(n, AT_FDCWD, a[0], a[1], 0);
+	case SYS_chown:
+		return op_chown(n, AT_FDCWD, a[0], a[1], a[2], 0);
+	case SYS_lchown:
+		return op_chown(n, AT_FDCWD, a[0], a[1], a[2], AT_SYMLINK_NOFOLLOW);
+	case SYS_utime:
+		return op_utime(n, a[0], a[1]);
+	case SYS_utimes:
+		return op_utimes(n, AT_FDCWD, a[0], a[1]);
+	case SYS_futimesat:
+		return op_utimes(n, a[0], a[1], a[2]);
+#endif
+#ifdef SYS_renameat
+	case SYS_renameat:
+		return op_rename(n, a[0], a[1], a[2], a[3], 0);
+#endif
+#ifdef SYS_renameat2
+	case SYS_renameat2:
+		return op_rename(n, a[0], a[1], a[2], a[3], a[4]);
+#endif
+#ifdef SYS_faccessat2
+	case SYS_faccessat2:
+		return op_access(n, a[0], a[1], a[2], a[3]);
+#endif
+#ifdef SYS_openat2
+	case SYS_openat2:
+		/* the program falls back to openat() */
+		return -ENOSYS;
+#endif
+#ifdef SYS_fchmodat2
+	case SYS_fchmodat2:
+		return op_chmod(n, a[0], a[1], a[2], a[3]);
+#endif
+#ifdef SYS_statx
+	case SYS_statx:
+		return op_statx(n, a[0], a[1], a[2], a[3], a[4]);
+#endif
+	case SYS_openat:
+		return op_open(n, a[0], a[1], a[2], a[3]);
+	case SYS_newfstatat:
+		return op_stat(n, a[0], a[1], a[2], a[3]);
+	case SYS_faccessat:
+		return op_access(n, a[0], a[1], a[2], 0);
+	case SYS_readlinkat:
+		return op_readlink(n, a[0], a[1], a[2], a[3]);
+	case SYS_mkdirat:
+		return op_mkdir(n, a[0], a[1], a[2]);
+	case SYS_mknodat:
+		return op_mknod(n, a[0], a[1], a[2], a[3]);
+	case SYS_unlinkat:
+		return op_unlink(n, a[0], a[1], a[2]);
+	case SYS_linkat:
+		return op_link(n, a[0], a[1], a[2], a[3], a[4]);
+	case SYS_symlinkat:
+		return op_symlink(n, a[0], a[1], a[2]);
+	case SYS_fchmodat:
+		return op_chmod(n, a[0], a[1], a[2], 0);
+	case SYS_fchownat:
+		return op_chown(n, a[0], a[1], a[2], a[3], a[4]);
+	case SYS_utimensat:
+		return op_utimensat(n, a[0], a[1], a[2], a[3]);
+	case SYS_truncate:
+		return op_truncate(n, a[0], a[1]);
+	case SYS_statfs:
+		return op_statfs(n, a[0], a[1]);
+	case SYS_chdir:
+		return op_chdir(n, a[0]);
+	case SYS_fchdir:
+		return op_fchdir(n, a[0]);
+	case SYS_getcwd:
+		return op_getcwd(n, a[0], a[1]);
+	case SYS_execve:
+		return op_execve(n, AT_FDCWD, a[0]);
+	case SYS_execveat:
+		return op_execve(n, a[0], a[1]);
+	}
+
+	return NOTIF_CONTINUE;
+}
+
+static void notif_handle(int fd, struct seccomp_notif *req)
+{
+	struct notif n = { fd, req, req->pid };
+	struct seccomp_notif_resp resp;
+	long ret;
+
+	if ((ret = notif_call(&n)) == NOTIF_SENT)
+		return;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.id = req->id;
+	if (ret == NOTIF_CONTINUE)
+		resp.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+	else if (ret < 0)
+		resp.error = ret;
+	else
+		resp.val = ret;
+	/* fails if the program is gone meanwhile */
+	ioctl(fd, SECCOMP_IOCTL_NOTIF_SEND, &resp);
+}
+
+/* answer notifications on the listener fd, until it has no program */
+static void *notif_serve(void *arg)
+{
+	int fd = (int)(long)arg;
+	struct seccomp_notif req;
+
+	for (;;) {
+		memset(&req, 0, sizeof(req));
+		if (ioctl(fd, SECCOMP_IOCTL_NOTIF_RECV, &req) < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			break;
+		}
+		notif_handle(fd, &req);
+	}
+
+	return NULL;
+}
+
+/* the supervisor, on the other end of sock of the program to be */
+static void __attribute__((noreturn)) supervise(int sock)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	struct seccomp_notif req;
+	struct pollfd p;
+	pthread_t thread;
+	sigset_t mask;
+	pid_t pid = getpid();
+	int fd = -1, keep[2], low, threads, i;
+	char c;
+
+	/* the program's signals and terminal are not ours */
+	setsid();
+	sigfillset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+	for (i = 1; i < NSIG; i++)
+		signal(i, SIG_DFL);
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+	umask(0);
+
+	if (write(sock, &pid, sizeof(pid)) != sizeof(pid))
+		_exit(1);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) == 1 &&
+			(cmsg = CMSG_FIRSTHDR(&msg)) != NULL &&
+			cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	if (fd < 0)
+		_exit(0);
+
+	/*
+	 * Of the program's descriptors the root's is needed, see
+	 * lib-openat2.c; holding on to the others would keep pipes open.
+	 */
+	dprintf("### seccomp: supervisor %d\n", pid);
+	i = open("/dev/null", O_RDWR);
+	dup2(i, 0);
+	dup2(i, 1);
+	dup2(i, 2);
+	if (i > 2)
+		close(i);
+	keep[0] = fd;
+	keep[1] = fchr_root_fd(fchr_conf());
+	if (keep[1] < keep[0]) {
+		keep[0] = keep[1];
+		keep[1] = fd;
+	}
+	for (i = 0, low = 3; i < 2; i++) {
+		if (keep[i] < low)
+			continue;
+		if (keep[i] > low)
+			syscall(SYS_close_range, low, keep[i] - 1, 0);
+		low = keep[i] + 1;
+	}
+	syscall(SYS_close_range, low, ~0U, 0);
+
+	threads = 0;
+	if (pthread_create != NULL)
+		for (i = 1; i < FCHR_SECCOMP_THREADS; i++)
+			if (pthread_create(&thread, NULL, notif_serve, (void *)(long)fd) == 0)
+				threads++;
+
+	p.fd = fd;
+	if (threads == 0) {
+		/* on our own: wait for a notification or the end */
+		p.events = POLLIN;
+		while (poll(&p, 1, -1) >= 0 || errno == EINTR) {
+			if (p.revents & (POLLHUP | POLLERR | POLLNVAL))
+				break;
+			if (p.revents & POLLIN) {
+				memset(&req, 0, sizeof(req));
+				if (ioctl(fd, SECCOMP_IOCTL_NOTIF_RECV, &req) == 0)
+					notif_handle(fd, &req);
+			}
+		}
+	} else {
+		/* the threads serve, wait for the last program to go */
+		p.events = 0;
+		while (poll(&p, 1, -1) >= 0 || errno == EINTR)
+			if (p.revents & (POLLHUP | POLLERR | POLLNVAL))
+				break;
+	}
+
+	_exit(0);
+}
+
+/* under a supervisor already: ours answers */
+static int supervised(void)
+{
+	return syscall(SYS_getcwd, NULL, (size_t)FCHR_SECCOMP_MAGIC) ==
+		FCHR_SECCOMP_MAGIC;
+}
+
+/*
+ * Whether execve() of filename with argv and envp can be expected to
+ * succeed: the filter can not be taken back once installed, so the
+ * failures which can be foreseen are left to the kernel without one.
+ */
+static int exec_feasible(const char *filename, char *const argv[],
+		char *const envp[])
+{
+	long max = sysconf(_SC_ARG_MAX);
+	size_t size = 0;
+	int i;
+
+	if (faccessat(AT_FDCWD, filename, X_OK, AT_EACCESS) != 0)
+		return 0;
+	for (i = 0; argv != NULL && argv[i] != NULL; i++)
+		size += strlen(argv[i]) + 1 + sizeof(char *);
+	for (i = 0; envp != NULL && envp[i] != NULL; i++)
+		size += strlen(envp[i]) + 1 + sizeof(char *);
+
+	return max <= 0 || size <= (size_t)max;
+}
+
+/*
+ * execve() of filename, a host path to a static program, under a new
+ * supervisor.  Whatever goes wrong on the way, the program is started
+ * anyway, as it would be without FAKECHROOT_OPTS=F.
+ *
+ * NO_NEW_PRIVS and the filter are set before the execve() and stay if it
+ * fails after all: the caller then goes on with setuid programs running
+ * without their privileges, its path calls answered by the supervisor,
+ * which lives as long as it does.  Paths its library translated are taken
+ * as they are, see notif_path().  exec_feasible() keeps such failures to
+ * the ones nobody could foresee, a shortage of memory, a file replaced
+ * meanwhile; anything else would need a process standing in for the
+ * program, with another pid.
+ */
+int fchr_seccomp_execve(const char *filename, char *const argv[],
+		char *const envp[])
+{
+	__typeof__(NEXTCALL(execve)) next = NEXTCALL(execve);
+	struct sock_filter insns[NTRAPPED + 32];
+	struct sock_fprog prog;
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int sock[2], fd, status;
+	pid_t pid, sup;
+	char c = 0;
+
+	if (supervised() || !exec_feasible(filename, argv, envp))
+		return next(filename, argv, envp);
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sock) < 0)
+		return next(filename, argv, envp);
+
+	/* twice, so the program never sees a child it does not know of */
+	if ((pid = fork()) == 0) {
+		close(sock[0]);
+		if (fork() == 0)
+			supervise(sock[1]);
+		_exit(0);
+	}
+	close(sock[1]);
+	if (pid > 0)
+		waitpid(pid, &status, 0);
+	if (pid < 0 || read(sock[0], &sup, sizeof(sup)) != sizeof(sup)) {
+		close(sock[0]);
+		return next(filename, argv, envp);
+	}
+
+	/* the supervisor reads our memory, which Yama may otherwise deny */
+	prctl(PR_SET_PTRACER, sup, 0, 0, 0);
+
+	prog.len = filter_build(insns);
+	prog.filter = insns;
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0 ||
+			(fd = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+					SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog)) < 0) {
+		dprintf("### seccomp: no filter: %s\n", strerror(errno));
+		close(sock[0]);
+		return next(filename, argv, envp);
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	/* without a supervisor path calls fail with ENOSYS, still better
+	 * than on the host tree */
+	sendmsg(sock[0], &msg, 0);
+	close(fd);
+	close(sock[0]);
+
+	dprintf("### seccomp: executing %s under %d\n", filename, sup);
+	return next(filename, argv, envp);
+}
+
+#endif /* FAKECHROOT_SECCOMP */
@@ -0,0 +1,478 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Sessions: the configuration handed to child processes ready made.
+ *
+ * Every process works out its configuration from the environment in the
+ * constructor, and with a mount table that means reading and parsing
+ * FAKECHROOT_MOUNTS_FILE and building the tries, over again in each of the
+ * thousands of short lived processes of a build.  So execve() hands the
+ * child a session instead: a sealed memfd holding the values of the
+ * variables and what they stand for, the mount table as its image (see
+ * lib-mount.c), and FAKECHROOT_OPTS parsed.  FAKECHROOT_SESSION names its
+ * descriptor, device and inode.  The child maps it read only and, if its
+ * own variables are the ones the session was made from, takes the
+ * configuration as it is; otherwise, or if the session can not be reached
+ * or FAKECHROOT_MOUNTS_FILE changed since, it reads its environment as
+ * before.
+ *
+ * A process which read its environment makes the session of it as soon
+ * as the configuration is published, so that the children it forks have
+ * it too; execve() makes another only for an environment of a child's
+ * own.  Without a mount table there is nothing worth handing on: the few
+ * plain variables are quicker to read than a session is to map.  Nor is
+ * the session checked beyond its layout: the parent which made it could
+ * have run anything in the child anyway.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(F_ADD_SEALS) && (defined(HAVE_MEMFD_CREATE) || defined(SYS_memfd_create))
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#define SESSION_ENV    "FAKECHROOT_SESSION"
+#define SESSION_MAGIC  "fchrses3"
+#define SESSION_SEALS  (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+/* kept above the range programs usually use, like the negative cache */
+#define SESSION_FD_MIN 512
+
+/* the variables of fchr_config_vars[], then FAKECHROOT_OPTS */
+#define SESSION_OPTS   FCHR_VARS
+#define SESSION_VARS   (FCHR_VARS + 1)
+
+/* Offsets are from the start of the session, 0 standing for NULL */
+struct session_header {
+	char magic[8];
+	uint32_t size;				/* of the whole session */
+	uint32_t opts;				/* FAKECHROOT_OPTS, parsed */
+	uint32_t var[SESSION_VARS];	/* the values the session was made from */
+	uint32_t root;				/* the configuration they stand for */
+	uint32_t root_len;
+	uint32_t lower;
+	uint32_t lower_len;
+	uint32_t cross;
+	uint32_t cross_len;
+	int32_t cross_arch;
+	uint32_t mounts;			/* offset of the mount table's image */
+	uint32_t mounts_size;
+};
+
+/* the session handed on by this process */
+struct session {
+	const struct session_header *h;
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	char var[96];				/* SESSION_ENV=fd:dev:ino */
+};
+
+static struct session *session_current;
+
+/* the configuration was taken from a session already */
+static int session_attached;
+
+/* the options of that session */
+static unsigned int session_opts;
+
+/* string at off of h, NULL for 0 or if it does not lie in h */
+static const char *session_string(const struct session_header *h, uint32_t off)
+{
+	const char *s = (const char *)h + off;
+
+	if (off == 0 || off < sizeof(*h) || off >= h->size ||
+			!memchr(s, '\0', h->size - off))
+		return NULL;
+
+	return s;
+}
+
+/* whether h was made from the variables val */
+static int session_matches(const struct session_header *h, const char *const val[])
+{
+	const char *s;
+	int i;
+
+	for (i = 0; i < SESSION_VARS; i++) {
+		s = session_string(h, h->var[i]);
+		if ((s == NULL) != (val[i] == NULL) || (s && strcmp(s, val[i])))
+			return 0;
+	}
+
+	return 1;
+}
+
+static uint32_t session_put(char *base, char **p, const char *s, size_t len)
+{
+	uint32_t off;
+
+	if (s == NULL)
+		return 0;
+	off = *p - base;
+	memcpy(*p, s, len);
+	(*p)[len] = '\0';
+	*p += len + 1;
+
+	return off;
+}
+
+/* the session of configuration d, made from the variables val */
+static struct session_header *session_make(const char *const val[],
+		const struct fchr_config *d)
+{
+	struct session_header *h;
+	const void *image;
+	size_t image_size, size;
+	char *p;
+	int i;
+
+	image = fchr_mounts_image(d->mounts, &image_size);
+	size = ((sizeof(*h) + 7) & ~(size_t)7) + image_size +
+		d->root_len + d->lower_len + d->cross_len + 3;
+	for (i = 0; i < SESSION_VARS; i++)
+		if (val[i])
+			size += strlen(val[i]) + 1;
+	if (size > UINT32_MAX || !(h = calloc(1, size)))
+		return NULL;
+
+	memcpy(h->magic, SESSION_MAGIC, sizeof(h->magic));
+	h->size = size;
+	h->opts = val[SESSION_OPTS] ? fchr_opts_parse(val[SESSION_OPTS]) : 0;
+	h->mounts = (sizeof(*h) + 7) & ~(size_t)7;
+	h->mounts_size = image_size;
+	memcpy((char *)h + h->mounts, image, image_size);
+
+	p = (char *)h + h->mounts + image_size;
+	for (i = 0; i < SESSION_VARS; i++)
+		h->var[i] = session_put((char *)h, &p, val[i], val[i] ? strlen(val[i]) : 0);
+	h->root = session_put((char *)h, &p, d->root, d->root_len);
+	h->root_len = d->root_len;
+	h->lower = session_put((char *)h, &p, d->lower, d->lower_len);
+	h->lower_len = d->lower_len;
+	h->cross = session_put((char *)h, &p, d->cross, d->cross_len);
+	h->cross_len = d->cross_len;
+	h->cross_arch = d->cross_arch;
+
+	return h;
+}
+
+/* h in a sealed memfd of its own, which children inherit; NULL on failure */
+static struct session *session_export(const struct session_header *h)
+{
+	struct session *s;
+	struct stat st;
+	size_t done = 0;
+	ssize_t n;
+	int fd = -1, hi;
+
+#if defined(HAVE_MEMFD_CREATE)
+	fd = memfd_create("fakechroot-session", MFD_ALLOW_SEALING);
+#else
+	fd = syscall(SYS_memfd_create, "fakechroot-session", MFD_ALLOW_SEALING);
+#endif
+	if (fd < 0)
+		return NULL;
+
+	if ((hi = fcntl(fd, F_DUPFD, SESSION_FD_MIN)) >= 0) {
+		close(fd);
+		fd = hi;
+	}
+
+	while (done < h->size) {
+		n = write(fd, (const char *)h + done, h->size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			goto fail;
+		done += n;
+	}
+	if (fcntl(fd, F_ADD_SEALS, SESSION_SEALS) != 0 || fstat(fd, &st) != 0 ||
+			!(s = malloc(sizeof(*s))))
+		goto fail;
+
+	s->h = h;
+	s->fd = fd;
+	s->dev = st.st_dev;
+	s->ino = st.st_ino;
+	snprintf(s->var, sizeof(s->var), SESSION_ENV "=%d:%llu:%llu", fd,
+			(unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+
+	return s;
+
+fail:
+	close(fd);
+	return NULL;
+}
+
+/* whether descriptor fd still is the one of device dev and inode ino */
+static int session_fd_is(int fd, dev_t dev, ino_t ino)
+{
+	struct stat st;
+
+	return fstat(fd, &st) == 0 && st.st_dev == dev && st.st_ino == ino;
+}
+
+/*
+ * Make s the session handed on.  The one it supersedes is closed, which a
+ * child another thread is starting just now may miss; that child reads
+ * its environment then.  Its header is never freed, as a racing thread may
+ * still be comparing against it.
+ */
+static void session_publish(struct session *s)
+{
+	struct session *old = __atomic_exchange_n(&session_current, s, __ATOMIC_ACQ_REL);
+
+	if (old != NULL && old->fd != s->fd && session_fd_is(old->fd, old->dev, old->ino))
+		close(old->fd);
+}
+
+/*
+ * Make the session of configuration c, just published from the variables
+ * val, the one handed on.  Made right away rather than on execve(), which
+ * is mostly called in a child of ours just forked, whose session would be
+ * lost to us.
+ */
+void fchr_session_update(const char *const val[], const struct fchr_config *c)
+{
+	const char *all[SESSION_VARS];
+	struct session_header *h;
+	struct session *s;
+
+	if (c->mounts == NULL)
+		return;
+	memcpy(all, val, FCHR_VARS * sizeof(*all));
+	all[SESSION_OPTS] = getenv(FCHR_OPT_ENV);
+
+	if (!(h = session_make(all, c)))
+		return;
+	if (!(s = session_export(h))) {
+		free(h);
+		return;
+	}
+	session_publish(s);
+}
+
+/*
+ * Take the configuration from the session FAKECHROOT_SESSION names, if
+ * there is a usable one.  Returns 0 if the environment is to be read
+ * instead.  Called at startup, by the constructor or a wrapper called
+ * before it, before anything else.
+ */
+int fchr_session_attach(void)
+{
+	const char *var = getenv(SESSION_ENV), *val[SESSION_VARS];
+	const struct session_header *h;
+	const struct fchr_mounts *m;
+	unsigned long long dev, ino;
+	struct fchr_config d;
+	struct session *s;
+	struct stat st;
+	void *map;
+	int fd, i;
+
+	if (__atomic_load_n(&session_attached, __ATOMIC_ACQUIRE))
+		return 1;
+	if (var == NULL || sscanf(var, "%d:%llu:%llu", &fd, &dev, &ino) != 3)
+		return 0;
+	if (fstat(fd, &st) != 0 || st.st_dev != dev || st.st_ino != ino)
+		return 0;
+
+	if ((fcntl(fd, F_GET_SEALS) & SESSION_SEALS) != SESSION_SEALS ||
+			st.st_size < (off_t)sizeof(*h) || st.st_size > UINT32_MAX ||
+			(map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		goto fail;
+	h = map;
+
+	for (i = 0; i < FCHR_VARS; i++)
+		val[i] = getenv(fchr_config_vars[i]);
+	val[SESSION_OPTS] = getenv(FCHR_OPT_ENV);
+
+	if (memcmp(h->magic, SESSION_MAGIC, sizeof(h->magic)) ||
+			h->size != (uint64_t)st.st_size || !session_matches(h, val) ||
+			h->mounts < sizeof(*h) || h->mounts % 8 || h->mounts > h->size ||
+			h->mounts_size > h->size - h->mounts ||
+			(h->root && (!session_string(h, h->root) ||
+				strlen(session_string(h, h->root)) != h->root_len)) ||
+			(h->lower && (!session_string(h, h->lower) ||
+				strlen(session_string(h, h->lower)) != h->lower_len)) ||
+			(h->cross && (!session_string(h, h->cross) ||
+				strlen(session_string(h, h->cross)) != h->cross_len)) ||
+			!(m = fchr_mounts_load((const char *)h + h->mounts, h->mounts_size)) ||
+			!fchr_mounts_current(m, val[FCHR_VAR_MOUNTS_FILE]) ||
+			!(s = malloc(sizeof(*s)))) {
+		munmap(map, st.st_size);
+		goto fail;
+	}
+
+	memset(&d, 0, sizeof(d));
+	d.root = session_string(h, h->root);
+	d.root_len = h->root_len;
+	d.lower = session_string(h, h->lower);
+	d.lower_len = h->lower_len;
+	d.cross = session_string(h, h->cross);
+	d.cross_len = h->cross_len;
+	d.cross_arch = h->cross_arch;
+	d.mounts = m;
+
+	/* the caches wait for their tables, see fchr_session_opts() */
+	session_opts = h->opts;
+	fchr_opts |= h->opts & ~OPT_CACHES;
+	fchr_config_publish(&d);
+
+	/* handed on as it is to children with the same environment */
+	s->h = h;
+	s->fd = fd;
+	s->dev = st.st_dev;
+	s->ino = st.st_ino;
+	snprintf(s->var, sizeof(s->var), SESSION_ENV "=%s", var);
+	__atomic_store_n(&session_current, s, __ATOMIC_RELEASE);
+	__atomic_store_n(&session_attached, 1, __ATOMIC_RELEASE);
+
+	dprintf("### configuration from session %s\n", var);
+
+	return 1;
+
+fail:
+	/* a session of no use to us, nor to our children */
+	close(fd);
+	return 0;
+}
+
+/*
+ * The options of the session attached.  Those of OPT_CACHES are left to
+ * fakechroot_init(), as a wrapper called before it may have attached.
+ */
+unsigned int fchr_session_opts(void)
+{
+	return session_opts;
+}
+
+/* value of variable name in envp, NULL if unset */
+static const char *session_getenv(char *const envp[], const char *name)
+{
+	size_t len = strlen(name);
+	int i;
+
+	for (i = 0; envp[i] != NULL; i++)
+		if (!strncmp(envp[i], name, len) && envp[i][len] == '=')
+			return envp[i] + len + 1;
+
+	return NULL;
+}
+
+/*
+ * The environment to start a child with instead of envp: envp with the
+ * session of its variables in FAKECHROOT_SESSION, or envp itself if it is
+ * that already or there is no session to hand on.  A copy is malloc()ed,
+ * for the caller to free should execve() return.
+ */
+char *const *fchr_session_env(char *const envp[])
+{
+	const char *val[SESSION_VARS];
+	struct session_header *h;
+	struct fchr_config d;
+	struct session *s;
+	char **env;
+	int i, n, at = -1;
+
+	if (envp == NULL)
+		return envp;
+	for (i = 0; i < FCHR_VARS; i++)
+		val[i] = session_getenv(envp, fchr_config_vars[i]);
+	val[SESSION_OPTS] = session_getenv(envp, FCHR_OPT_ENV);
+	if ((!val[FCHR_VAR_MOUNTS] || !*val[FCHR_VAR_MOUNTS]) &&
+			(!val[FCHR_VAR_MOUNTS_FILE] || !*val[FCHR_VAR_MOUNTS_FILE]))
+		return envp;
+
+	s = __atomic_load_n(&session_current, __ATOMIC_ACQUIRE);
+	if (s == NULL || !session_matches(s->h, val)) {
+		/* an environment of its own for this child */
+		fchr_config_make(val, &d);
+		if (d.mounts == NULL)
+			return envp;
+		h = session_make(val, &d);
+		fchr_mounts_free(d.mounts);
+		if (h == NULL)
+			return envp;
+		if (!(s = session_export(h))) {
+			free(h);
+			return envp;
+		}
+		session_publish(s);
+	} else if (!session_fd_is(s->fd, s->dev, s->ino)) {
+		/* closed by the program, or made by a vfork() child */
+		if (!(s = session_export(s->h)))
+			return envp;
+		session_publish(s);
+	}
+
+	for (n = 0; envp[n] != NULL; n++)
+		if (!strncmp(envp[n], SESSION_ENV "=", sizeof(SESSION_ENV))) {
+			if (!strcmp(envp[n], s->var))
+				return envp;
+			at = n;
+		}
+
+	if (!(env = malloc((n + 2) * sizeof(*env))))
+		return envp;
+	memcpy(env, envp, (n + 1) * sizeof(*env));
+	if (at < 0)
+		at = n++;
+	env[at] = s->var;
+	env[n] = NULL;
+
+	return env;
+}
+
+#else
+
+void fchr_session_update(const char *const val[], const struct fchr_config *c)
+{
+}
+
+int fchr_session_attach(void)
+{
+	return 0;
+}
+
+unsigned int fchr_session_opts(void)
+{
+	return 0;
+}
+
+char *const *fchr_session_env(char *const envp[])
+{
+	return envp;
+}
+
+#endif
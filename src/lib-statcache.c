@@ -0,0 +1,326 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Stat result cache for immutable trees (FAKECHROOT_OPTS=I).
+ *
+ * The cross sysroot FAKECHROOT_CROSS points at does not change during a
+ * build, yet gcc and ld stat the same headers and libraries in it
+ * thousands of times.  With this mode the sysroot, and the host subtrees
+ * FAKECHROOT_IMMUTABLE lists (colon separated), are taken to be
+ * immutable: the results of the stat family and access() on host paths
+ * inside them, failures included, are kept in a process wide table and
+ * handed out again without a system call.  Nothing ever invalidates
+ * them, so anything reached through those trees must really stay put,
+ * whoever would write to it.
+ *
+ * The table is open addressed and guarded per slot by a sequence counter,
+ * so lookups take no locks; paths live in an append-only arena and are
+ * never freed.  Both are anonymous mappings made at startup, whose pages
+ * are only used once touched, and a forked child inherits what its parent
+ * had cached.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#include <sys/mman.h>
+
+#define STATCACHE_SLOTS  16384	/* power of two */
+#define STATCACHE_PROBES 8
+#define STATCACHE_ARENA  (8 << 20)
+
+#define STATCACHE_ENV    "FAKECHROOT_IMMUTABLE"
+
+struct statcache_entry {
+	unsigned int seq;			/* odd while being written, 0 for an empty slot */
+	unsigned int hash;
+	unsigned char kind;
+	unsigned char pad;
+	unsigned short len;
+	int arg;					/* __xstat() version or access() mode */
+	int err;					/* errno of a failed call, else 0 */
+	const char *path;			/* in the arena */
+	union {
+		struct stat st;
+#ifdef HAVE_STAT64
+		struct stat64 st64;
+#endif
+	} u;
+};
+
+/* the immutable trees of one configuration generation */
+struct statcache_trees {
+	unsigned int generation;
+	size_t count;
+	struct {
+		const char *path;
+		size_t len;
+	} tree[];
+};
+
+static struct statcache_entry *statcache;
+static char *statcache_arena;
+static size_t statcache_arena_used;
+
+static const struct statcache_trees *statcache_trees;
+
+/* process wide counters, only maintained with OPT_STATS */
+static unsigned long statcache_hits, statcache_misses;
+
+/*
+ * Map the table and the arena.  Returns 0 when that fails, in which case
+ * the caller turns the cache off.
+ */
+int fchr_statcache_init(void)
+{
+	statcache = mmap(NULL, STATCACHE_SLOTS * sizeof(*statcache),
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	statcache_arena = mmap(NULL, STATCACHE_ARENA,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (statcache == MAP_FAILED || statcache_arena == MAP_FAILED) {
+		if (statcache != MAP_FAILED)
+			munmap(statcache, STATCACHE_SLOTS * sizeof(*statcache));
+		if (statcache_arena != MAP_FAILED)
+			munmap(statcache_arena, STATCACHE_ARENA);
+		statcache = NULL;
+		dprintf("### stat cache unavailable\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * The immutable trees of the current configuration: the sysroot and the
+ * FAKECHROOT_IMMUTABLE entries.  Superseded lists are never freed, as
+ * with configuration snapshots.
+ */
+static const struct statcache_trees *statcache_current(void)
+{
+	const struct fchr_config *c = fchr_conf();
+	const struct statcache_trees *cur;
+	struct statcache_trees *t;
+	const char *list, *p, *end;
+	size_t count = 1, len;
+	char *s;
+
+	cur = __atomic_load_n(&statcache_trees, __ATOMIC_ACQUIRE);
+	if (cur != NULL && cur->generation == c->generation)
+		return cur;
+
+	list = getenv(STATCACHE_ENV);
+	for (p = list; p != NULL && *p; p++)
+		count += *p == ':';
+	len = list ? strlen(list) + 1 : 0;
+
+	t = malloc(sizeof(*t) + count * sizeof(t->tree[0]) + len);
+	if (t == NULL)
+		return cur;
+	s = (char *)&t->tree[count];
+	t->generation = c->generation;
+	t->count = 0;
+
+	if (c->cross != NULL && c->cross_len > 1) {
+		t->tree[t->count].path = c->cross;
+		t->tree[t->count++].len = c->cross_len;
+	}
+	for (p = list; p != NULL && *p; p = *end ? end + 1 : end) {
+		end = p + strcspn(p, ":");
+		len = end - p;
+		while (len > 1 && p[len - 1] == '/')
+			len--;
+		/* only absolute trees, and the host's / would be everything */
+		if (*p != '/' || len < 2)
+			continue;
+		memcpy(s, p, len);
+		s[len] = '\0';
+		t->tree[t->count].path = s;
+		t->tree[t->count++].len = len;
+		s += len + 1;
+	}
+
+	__atomic_store_n(&statcache_trees, t, __ATOMIC_RELEASE);
+
+	return t;
+}
+
+static int statcache_immutable(const char *path)
+{
+	const struct statcache_trees *t;
+	size_t i;
+
+	if (path == NULL || *path != '/' || fchr_nested ||
+			(t = statcache_current()) == NULL)
+		return 0;
+
+	for (i = 0; i < t->count; i++)
+		if (fchr_prefix_match(path, t->tree[i].path, t->tree[i].len) &&
+				(path[t->tree[i].len] == '/' || path[t->tree[i].len] == '\0'))
+			return 1;
+
+	return 0;
+}
+
+static inline size_t statcache_size(int kind)
+{
+	switch (kind) {
+	case FCHR_STATCACHE_STAT:
+	case FCHR_STATCACHE_LSTAT:
+		return sizeof(struct stat);
+#ifdef HAVE_STAT64
+	case FCHR_STATCACHE_STAT64:
+	case FCHR_STATCACHE_LSTAT64:
+		return sizeof(struct stat64);
+#endif
+	default:
+		return 0;
+	}
+}
+
+static inline unsigned int statcache_hash(const char *path, size_t *len,
+		int kind, int arg)
+{
+	return fchr_pathcache_hash(path, len) ^ ((unsigned int)kind << 24) ^
+		((unsigned int)arg * 0x9e3779b1U);
+}
+
+/*
+ * Cached result of the call kind (FCHR_STATCACHE_*) with arg on host path:
+ * its return value, the stat buffer filled in or errno set; FCHR_FALLBACK
+ * when the call has to be made.  The sysroot manifest is asked first.
+ */
+int fchr_statcache_get(int kind, const char *path, int arg, void *buf)
+{
+	struct statcache_entry *e;
+	unsigned int hash, seq;
+	size_t len, size = statcache_size(kind);
+	int i, err;
+
+	if ((fchr_opts & OPT_INDEX) &&
+			(i = fchr_index_stat(kind, path, arg)) != FCHR_FALLBACK)
+		return i;
+	if (!(fchr_opts & OPT_STATCACHE) || statcache == NULL ||
+			!statcache_immutable(path))
+		return FCHR_FALLBACK;
+
+	hash = statcache_hash(path, &len, kind, arg);
+	for (i = 0; i < STATCACHE_PROBES; i++) {
+		e = &statcache[(hash + i) & (STATCACHE_SLOTS - 1)];
+		seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq == 0)
+			break;
+		if ((seq & 1) || e->hash != hash || e->kind != kind ||
+				e->arg != arg || e->len != len || memcmp(e->path, path, len))
+			continue;
+		err = e->err;
+		if (!err && size)
+			memcpy(buf, &e->u, size);
+		/* what was copied must not have changed meanwhile */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if (fchr_opts & OPT_STATS)
+			__atomic_add_fetch(&statcache_hits, 1, __ATOMIC_RELAXED);
+		if (err) {
+			errno = err;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (fchr_opts & OPT_STATS)
+		__atomic_add_fetch(&statcache_misses, 1, __ATOMIC_RELAXED);
+
+	return FCHR_FALLBACK;
+}
+
+static void statcache_store(int kind, const char *path, int arg,
+		const void *buf, int err)
+{
+	struct statcache_entry *e, *victim;
+	unsigned int hash, seq;
+	size_t len, size = statcache_size(kind), off;
+	int i;
+	char *copy;
+
+	if (statcache == NULL || !statcache_immutable(path))
+		return;
+
+	hash = statcache_hash(path, &len, kind, arg);
+
+	off = __atomic_fetch_add(&statcache_arena_used, len + 1, __ATOMIC_RELAXED);
+	if (off + len + 1 > STATCACHE_ARENA)
+		return;
+	copy = memcpy(statcache_arena + off, path, len + 1);
+
+	/* first empty slot in the probe sequence, else the home slot */
+	victim = &statcache[hash & (STATCACHE_SLOTS - 1)];
+	for (i = 0; i < STATCACHE_PROBES; i++) {
+		e = &statcache[(hash + i) & (STATCACHE_SLOTS - 1)];
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == 0) {
+			victim = e;
+			break;
+		}
+	}
+
+	seq = __atomic_load_n(&victim->seq, __ATOMIC_RELAXED);
+	if ((seq & 1) || !__atomic_compare_exchange_n(&victim->seq, &seq, seq + 1,
+				0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	victim->hash = hash;
+	victim->kind = kind;
+	victim->arg = arg;
+	victim->len = len;
+	victim->path = copy;
+	victim->err = err;
+	if (!err && size)
+		memcpy(&victim->u, buf, size);
+
+	__atomic_store_n(&victim->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* remember the result ret of the call, with buf or errno as it left them */
+void fchr_statcache_put(int kind, const char *path, int arg, const void *buf,
+		int ret)
+{
+	int saved_errno = errno;
+
+	/* interrupted or out of memory is no answer about the tree */
+	if (ret == 0)
+		statcache_store(kind, path, arg, buf, 0);
+	else if (ret == -1 && errno != EINTR && errno != ENOMEM && errno != EFAULT)
+		statcache_store(kind, path, arg, buf, errno);
+
+	errno = saved_errno;
+}
+
+void fchr_statcache_stats(void)
+{
+	unsigned long hits = statcache_hits, misses = statcache_misses;
+
+	fprintf(stderr, "fakechroot: stat cache: %lu hits, %lu misses (%.1f%% hit rate), %lu system calls saved\n",
+			hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0, hits);
+}
@@ -0,0 +1,157 @@
+/* vi: set sw=4 ts=4: */
+/*
+    libfakechroot -- fake chroot environment
+    (c) 2003-2005 Piotr Roszatycki <dexter@debian.org>, LGPL
+    (c) 2006, 2007 Alexander Shishkin <virtuoso@slind.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+*/
+
+/*
+ * Raw system call backend (FAKECHROOT_OPTS=R).
+ *
+ * Once a wrapper has translated its path, the next definition of the
+ * function, libc's, usually does nothing but issue the matching *at()
+ * system call.  Getting there costs the indirect call through the wrapper
+ * table, libc's own argument shuffling and, for open(), its varargs.
+ * With this backend the simple wrappers (see RAWCALL() in wrapper.h) have
+ * the system call made right here, on the translated path.
+ *
+ * Errors come back from the kernel as -errno and are stored in errno as
+ * libc would.  Of the calls here only openat() is a cancellation point,
+ * see fchr_cancellable().
+ *
+ * Only for Linux on x86-64 and AArch64, where struct stat is the kernel's
+ * and the *at() calls take no hidden flags; elsewhere RAWCALL() always
+ * takes the next definition and FAKECHROOT_OPTS=R is ignored.
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#ifdef FAKECHROOT_RAW_SYSCALL
+
+#include <sys/syscall.h>
+
+#if defined(__x86_64__)
+
+static inline long raw_syscall(long n, long a, long b, long c, long d, long e)
+{
+	register long r10 __asm__("r10") = d;
+	register long r8 __asm__("r8") = e;
+	long ret;
+
+	__asm__ __volatile__("syscall"
+			: "=a"(ret)
+			: "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8)
+			: "rcx", "r11", "memory");
+	return ret;
+}
+
+#elif defined(__aarch64__)
+
+static inline long raw_syscall(long n, long a, long b, long c, long d, long e)
+{
+	register long x8 __asm__("x8") = n;
+	register long x0 __asm__("x0") = a;
+	register long x1 __asm__("x1") = b;
+	register long x2 __asm__("x2") = c;
+	register long x3 __asm__("x3") = d;
+	register long x4 __asm__("x4") = e;
+
+	__asm__ __volatile__("svc 0"
+			: "+r"(x0)
+			: "r"(x8), "r"(x1), "r"(x2), "r"(x3), "r"(x4)
+			: "memory", "cc");
+	return x0;
+}
+
+#endif
+
+/* the kernel's -errno to libc's -1 and errno */
+static inline int raw_result(long ret)
+{
+	if ((unsigned long)ret > -4096UL) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+#define raw_call(n, a, b, c, d, e) \
+	raw_result(raw_syscall((n), (long)(a), (long)(b), (long)(c), \
+				(long)(d), (long)(e)))
+
+int fchr_raw_faccessat(int dirfd, const char *path, int mode)
+{
+	return raw_call(SYS_faccessat, dirfd, path, mode, 0, 0);
+}
+
+int fchr_raw_mkdirat(int dirfd, const char *path, mode_t mode)
+{
+	return raw_call(SYS_mkdirat, dirfd, path, mode, 0, 0);
+}
+
+int fchr_raw_fchmodat(int dirfd, const char *path, mode_t mode)
+{
+	return raw_call(SYS_fchmodat, dirfd, path, mode, 0, 0);
+}
+
+int fchr_raw_fchownat(int dirfd, const char *path, uid_t owner, gid_t group,
+		int flags)
+{
+	return raw_call(SYS_fchownat, dirfd, path, owner, group, flags);
+}
+
+int fchr_raw_unlinkat(int dirfd, const char *path, int flags)
+{
+	return raw_call(SYS_unlinkat, dirfd, path, flags, 0, 0);
+}
+
+int fchr_raw_fstatat(int dirfd, const char *path, struct stat *buf, int flags)
+{
+	return raw_call(SYS_newfstatat, dirfd, path, buf, flags, 0);
+}
+
+/*
+ * The __xstat() family: the versions libc accepts there, _STAT_VER_KERNEL
+ * and on x86-64 _STAT_VER_LINUX, which newer headers no longer declare,
+ * all mean the kernel's struct stat.
+ */
+int fchr_raw_fxstatat(int ver, int dirfd, const char *path, struct stat *buf,
+		int flags)
+{
+#if defined(__x86_64__)
+	if (ver != 0 && ver != 1) {
+#else
+	if (ver != 0) {
+#endif
+		errno = EINVAL;
+		return -1;
+	}
+
+	return fchr_raw_fstatat(dirfd, path, buf, flags);
+}
+
+int fchr_raw_openat(int dirfd, const char *path, int flags, mode_t mode)
+{
+	if (!(flags & O_CREAT) && (flags & O_TMPFILE) != O_TMPFILE)
+		mode = 0;
+
+	return fchr_cancellable(raw_call(SYS_openat, dirfd, path, flags, mode, 0));
+}
+
+#endif /* FAKECHROOT_RAW_SYSCALL */
@@ -0,0 +1,51 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * libfakechroot -- fake chroot environment
+ * (c) 2003-2005 Piotr Roszatycki <dexter.org>, LGPL
+ * (c) 2006, 2007 Alexander Shishkin <virtuoso.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+/*
+ * lstat() call wrapper
+ */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+#if defined(HAVE_LSTAT) && defined(FAKECHROOT_PLAIN_STAT)
+/* #include <sys/stat.h> */
+int lstat(const char *file_name, struct stat *buf)
+{
+	const char *guest = file_name;
+
+	if (fchr_negcache_hit(file_name, 1))
+		return -1;
+
+	lookup_in_root(file_name, FCHR_LOOKUP_NOFOLLOW,
+			NEXTCALL(fstatat)(fakechroot_fd, "", buf, AT_EMPTY_PATH));
+	resolve_chroot_path(file_name, FCHR_RESOLVE_NOFOLLOW);
+
+	return fchr_negcache_note(guest, 1,
+			fchr_statcache(FCHR_STATCACHE_LSTAT, file_name, 0, buf,
+				RAWCALL(fchr_raw_fstatat(AT_FDCWD, file_name, buf,
+						AT_SYMLINK_NOFOLLOW),
+					NEXTCALL(lstat)(file_name, buf))));
+}
+DECLARE_WRAPPER(lstat)
+
+#endif
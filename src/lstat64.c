@@ -28,16 +28,23 @@
 #include "proto.h"
 
 #ifdef HAVE_LSTAT64
-#if !defined(HAVE___LXSTAT64)
+#if !defined(HAVE___LXSTAT64) || defined(FAKECHROOT_PLAIN_STAT)
 /* #include <sys/stat.h> */
 /* #include <unistd.h> */
 int lstat64 (const char *file_name, struct stat64 *buf)
 {
-	 
+	const char *guest = file_name;
 
-	expand_chroot_path(file_name);
+	if (fchr_negcache_hit(file_name, 1))
+		return -1;
 
-	return NEXTCALL(lstat64)(file_name, buf);
+	lookup_in_root(file_name, FCHR_LOOKUP_NOFOLLOW,
+			fstatat64(fakechroot_fd, "", buf, AT_EMPTY_PATH));
+	resolve_chroot_path(file_name, FCHR_RESOLVE_NOFOLLOW);
+
+	return fchr_negcache_note(guest, 1,
+			fchr_statcache(FCHR_STATCACHE_LSTAT64, file_name, 0, buf,
+				NEXTCALL(lstat64)(file_name, buf)));
 }
 DECLARE_WRAPPER(lstat64)
 
@@ -31,24 +31,17 @@
 /* #include <stdlib.h> */
 char *mkdtemp(char *template)
 {
-	char tmp[FAKECHROOT_MAXPATH], *oldtemplate, *ptr;
-	 
-
-	oldtemplate = template;
-
-	expand_chroot_path(template);
-
+	char *oldtemplate = template;
+	size_t len = strlen(template);
 
+	upper_chroot_path(template, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
 	if (NEXTCALL(mkdtemp)(template) == NULL)
 		return NULL;
-
-	ptr = tmp;
-	strcpy(ptr, template);
-	narrow_chroot_path(ptr);
-	if (ptr == NULL)
-		return NULL;
-
-	strcpy(oldtemplate, ptr);
+	if (fchr_opts & OPT_NEGCACHE)
+		fchr_negcache_invalidate();
+	/* only the trailing XXXXXX changed; the rest may have been made absolute */
+	if (template != oldtemplate && len >= 6)
+		memcpy(oldtemplate + len - 6, template + strlen(template) - 6, 6);
 	return oldtemplate;
 }
 DECLARE_WRAPPER(mkdtemp)
@@ -31,23 +31,16 @@
 /* #include <stdlib.h> */
 int mkstemp64 (char *template)
 {
-	char tmp[FAKECHROOT_MAXPATH], *oldtemplate, *ptr;
+	char *oldtemplate = template;
+	size_t len = strlen(template);
 	int fd;
-	 
 
-	oldtemplate = template;
-
-	expand_chroot_path(template);
-
-	if ((fd = NEXTCALL(mkstemp64)(template)) == -1)
+	upper_chroot_path(template, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+	if ((fd = fchr_negcache_made(NEXTCALL(mkstemp64)(template))) == -1)
 		return -1;
-
-	ptr = tmp;
-	strcpy(ptr, template);
-	narrow_chroot_path(ptr);
-	if (ptr != NULL)
-		strcpy(oldtemplate, ptr);
-
+	/* only the trailing XXXXXX changed; the rest may have been made absolute */
+	if (template != oldtemplate && len >= 6)
+		memcpy(oldtemplate + len - 6, template + strlen(template) - 6, 6);
 	return fd;
 }
 
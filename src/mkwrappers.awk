@@ -0,0 +1,184 @@
+# Generate the table driven wrappers from wrappers.tab:
+#
+#   awk -v what=h -f mkwrappers.awk wrappers.tab > wrappers.h
+#   awk -v what=c -f mkwrappers.awk wrappers.tab > wrappers.c
+#
+# wrappers.h holds their prototypes for proto.h, wrappers.c the wrappers
+# themselves, all in one translation unit.  Plain POSIX awk.
+
+function trim(s)
+{
+	sub(/^[ \t]+/, "", s)
+	sub(/[ \t]+$/, "", s)
+	return s
+}
+
+function fail(msg)
+{
+	printf("wrappers.tab:%d: %s\n", NR, msg) > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+# the argument list calling a function with parameters params
+function arguments(params,    n, i, p, list, out)
+{
+	if (params == "void")
+		return ""
+	n = split(params, list, ",")
+	out = ""
+	for (i = 1; i <= n; i++) {
+		p = trim(list[i])
+		sub(/[ \t]*\[[^]]*\]$/, "", p)
+		if (!match(p, /[A-Za-z_][A-Za-z_0-9]*$/))
+			fail("no parameter name in \"" p "\"")
+		out = out (i > 1 ? ", " : "") substr(p, RSTART, RLENGTH)
+	}
+	return out
+}
+
+# FCHR_UPPER_* bits and C expressions joined by "+"
+function upper_how(how,    n, i, list, out)
+{
+	n = split(how, list, "+")
+	out = ""
+	for (i = 1; i <= n; i++)
+		out = out (i > 1 ? " | " : "") \
+			(list[i] ~ /^[A-Z]+$/ ? "FCHR_UPPER_" list[i] : list[i])
+	return out
+}
+
+# the statement for one action of the paths field
+function action(a,    n, f, path, dirfd, at)
+{
+	n = split(a, f, ":")
+	path = f[2]
+	dirfd = ""
+	if ((at = index(path, "@")) > 0) {
+		dirfd = substr(path, at + 1)
+		path = substr(path, 1, at - 1)
+	}
+	if (first_path == "" && (f[1] == "expand" || f[1] == "upper"))
+		first_path = path
+
+	if (f[1] == "expand" && n == 2)
+		return dirfd == "" ? "expand_chroot_path(" path ");" : \
+			"expand_chroot_path_at(" dirfd ", " path ");"
+	if (f[1] == "upper" && n == 3)
+		return dirfd == "" ? \
+			"upper_chroot_path(" path ", " upper_how(f[3]) ");" : \
+			"upper_chroot_path_at(" dirfd ", " path ", " upper_how(f[3]) ");"
+	if (f[1] == "chown" && n == 4)
+		return "track_chown(" path ", " f[3] ", " f[4] ");"
+	if (f[1] == "mknod" && n == 4)
+		return "track_mknod(" path ", " f[3] ", " f[4] ");"
+	fail("unknown action \"" a "\"")
+}
+
+BEGIN {
+	FS = "|"
+	if (what != "c" && what != "h") {
+		print "mkwrappers.awk: what must be c or h" > "/dev/stderr"
+		failed = 1
+		exit 1
+	}
+
+	print "/* Generated from wrappers.tab by mkwrappers.awk, do not edit. */"
+	print ""
+	if (what == "h") {
+		print "#ifndef __FAKECHROOT_WRAPPERS_H__"
+		print "#define __FAKECHROOT_WRAPPERS_H__"
+		print ""
+	} else {
+		print "#include \"common.h\""
+		print "#include \"wrapper.h\""
+		print "#include \"proto.h\""
+	}
+}
+
+/^[ \t]*(#|$)/ {
+	next
+}
+
+{
+	if (NF != 7)
+		fail("7 fields expected, " NF " found")
+	name = trim($1)
+	guard = trim($2)
+	ret = trim($3)
+	params = trim($4)
+	paths = trim($5)
+	result = trim($6)
+	raw = trim($7)
+	if (params == "")
+		params = "void"
+	star = ret ~ /\*$/ ? "" : " "
+
+	if (what == "h") {
+		printf("WRAPPER_PROTO(%s, %s, (%s))\n", name, ret, params)
+		next
+	}
+
+	print ""
+	if (guard != "-")
+		print "#ifdef " guard
+	printf("%s%s%s(%s)\n{\n", ret, star, name, params)
+
+	first_path = ""
+	body = ""
+	if (paths != "-") {
+		n = split(paths, acts, /[ \t]+/)
+		for (i = 1; i <= n; i++)
+			body = body "\t" action(acts[i]) "\n"
+	}
+	call = "NEXTCALL(" name ")(" arguments(params) ")"
+	if (raw != "-")
+		call = "RAWCALL(fchr_raw_" raw ",\n\t\t\t" call ")"
+
+	if (result ~ /^probe:/) {
+		split(result, r, ":")
+		if (first_path == "")
+			fail("probe without a path")
+		print "\tconst char *guest = " first_path ";"
+		print ""
+		print "\tif (fchr_negcache_hit(" first_path ", 0))"
+		print "\t\treturn -1;"
+		printf("%s", body)
+		print ""
+		print "\treturn fchr_negcache_note(guest, 0,"
+		print "\t\t\tfchr_statcache(" r[2] ", " first_path ", " r[3] ", NULL,"
+		print "\t\t\t\t" call "));"
+	} else if (result == "narrow" || result == "narrow_modify") {
+		print "\t" ret star "ret;"
+		print ""
+		printf("%s", body)
+		print "\tif ((ret = " call ") == NULL)"
+		print "\t\treturn NULL;"
+		print "\tnarrow_chroot_path" (result == "narrow" ? "" : "_modify") "(ret);"
+		print ""
+		print "\treturn ret;"
+	} else if (result == "made") {
+		printf("%s", body)
+		print ""
+		print "\treturn fchr_negcache_made(" call ");"
+	} else if (result == "-") {
+		printf("%s", body)
+		print ""
+		print "\treturn " call ";"
+	} else
+		fail("unknown result \"" result "\"")
+
+	print "}"
+	print "DECLARE_WRAPPER(" name ");"
+	if (guard != "-")
+		print "#endif"
+}
+
+END {
+	if (failed)
+		exit 1
+	if (what == "h") {
+		print ""
+		print "#endif"
+	}
+}
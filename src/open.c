@@ -32,10 +32,8 @@
 /* #include <fcntl.h> */
 int open(const char *pathname, int flags, ...)
 {
-	int mode = 0;
-	 
-
-	expand_chroot_path(pathname);
+	const char *guest = pathname;
+	int fd, mode = 0;
 
 	if (flags & O_CREAT) {
 		va_list arg;
@@ -44,7 +42,16 @@ int open(const char *pathname, int flags, ...)
 		va_end(arg);
 	}
 
-	return NEXTCALL(open)(pathname, flags, mode);
+	if (!(flags & O_CREAT) && fchr_negcache_hit(pathname, flags & O_NOFOLLOW))
+		return -1;
+
+	if ((fd = fchr_kernel_open(pathname, flags, mode)) == FCHR_FALLBACK) {
+		upper_chroot_path(pathname, fchr_overlay_open_how(flags));
+		fd = RAWCALL(fchr_raw_openat(AT_FDCWD, pathname, flags, mode),
+				NEXTCALL(open)(pathname, flags, mode));
+	}
+
+	return fchr_negcache_opened(guest, flags, fd);
 }
 
 DECLARE_WRAPPER(open);
@@ -33,10 +33,8 @@
 /* #include <fcntl.h> */
 int open64 (const char *pathname, int flags, ...)
 {
-	int mode = 0;
-	 
-
-	expand_chroot_path(pathname);
+	const char *guest = pathname;
+	int fd, mode = 0;
 
 	if (flags & O_CREAT) {
 		va_list arg;
@@ -45,7 +43,16 @@ int open64 (const char *pathname, int flags, ...)
 		va_end(arg);
 	}
 
-	return NEXTCALL(open64)(pathname, flags, mode);
+	if (!(flags & O_CREAT) && fchr_negcache_hit(pathname, flags & O_NOFOLLOW))
+		return -1;
+
+	if ((fd = fchr_kernel_open(pathname, flags | O_LARGEFILE, mode)) == FCHR_FALLBACK) {
+		upper_chroot_path(pathname, fchr_overlay_open_how(flags));
+		fd = RAWCALL(fchr_raw_openat(AT_FDCWD, pathname, flags, mode),
+				NEXTCALL(open64)(pathname, flags, mode));
+	}
+
+	return fchr_negcache_opened(guest, flags, fd);
 }
 
 DECLARE_WRAPPER(open64);
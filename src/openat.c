@@ -28,8 +28,8 @@
 #ifdef HAVE_OPENAT
 int openat(int dirfd, const char *pathname, int flags, ...)
 {
-	int mode = 0;
-	expand_chroot_path(pathname);
+	const char *guest = pathname;
+	int fd, mode = 0;
 
 	if (flags & O_CREAT) {
 		va_list arg;
@@ -38,7 +38,16 @@ int openat(int dirfd, const char *pathname, int flags, ...)
 		va_end(arg);
 	}
 
-	return NEXTCALL(openat)(dirfd, pathname, flags, mode);
+	if (!(flags & O_CREAT) && fchr_negcache_hit(pathname, flags & O_NOFOLLOW))
+		return -1;
+
+	if ((fd = fchr_kernel_open(pathname, flags, mode)) == FCHR_FALLBACK) {
+		upper_chroot_path_at(dirfd, pathname, fchr_overlay_open_how(flags));
+		fd = RAWCALL(fchr_raw_openat(dirfd, pathname, flags, mode),
+				NEXTCALL(openat)(dirfd, pathname, flags, mode));
+	}
+
+	return fchr_negcache_opened(guest, flags, fd);
 }
 DECLARE_WRAPPER(openat);
 #endif
@@ -32,9 +32,12 @@
 /* #include <dirent.h> */
 DIR *opendir(const char *name)
 {
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_opendir(name);
+
 	expand_chroot_path(name);
 
-	return NEXTCALL(opendir)(name);
+	return fchr_direct(NEXTCALL(opendir)(name));
 }
 DECLARE_WRAPPER(opendir)
 
@@ -32,27 +32,19 @@ WRAPPER_PROTO(execv,  int, (const char *path, char *const argv []))
 WRAPPER_PROTO(execve, int, (const char *filename, char *const argv [], char *const envp[]))
 WRAPPER_PROTO(execvp, int, (const char *file, char *const argv[]))
 
+/* the wrappers generated from wrappers.tab */
+#include "wrappers.h"
+
 WRAPPER_PROTO(access, int, (const char *pathname, int mode))
-WRAPPER_PROTO(acct, int, (const char *filename))
-WRAPPER_PROTO(chdir, int, (const char *path))
-WRAPPER_PROTO(chmod, int, (const char *path, mode_t mode))
-WRAPPER_PROTO(chown, int, (const char *path, uid_t owner, gid_t group))
 WRAPPER_PROTO(chroot, int, (const char *path))
-WRAPPER_PROTO(creat, int, (const char *path, mode_t mode))
-WRAPPER_PROTO(creat64, int, (const char *path, mode_t mode))
+WRAPPER_PROTO(clearenv, int, (void))
+WRAPPER_PROTO(closedir, int, (DIR *dir))
 WRAPPER_PROTO(dlopen, void *, (const char *path, int flag))
 WRAPPER_PROTO(fopen, FILE *, (const char *path, const char *mode))
 WRAPPER_PROTO(fopen64, FILE *, (const char *path, const char *mode))
 WRAPPER_PROTO(freopen, FILE *, (const char *path, const char *mode, FILE *stream))
 WRAPPER_PROTO(freopen64, FILE *, (const char *path, const char *mode, FILE *stream))
-WRAPPER_PROTO(getcwd, char *, (char *buf, size_t size))
-WRAPPER_PROTO(getwd, char *, (char *buf))
 WRAPPER_PROTO(glob, int, (const char *pattern, int flags, int(*errfunc) (const char *, int), glob_t *pglob))
-WRAPPER_PROTO(lchown, int, (const char *path, uid_t owner, gid_t group))
-WRAPPER_PROTO(link, int, (const char *oldpath, const char *newpath))
-WRAPPER_PROTO(mkdir, int, (const char *path, mode_t mode))
-WRAPPER_PROTO(mkdirat, int, (int dirfd, const char *pathname, mode_t mode))
-WRAPPER_PROTO(mkfifo, int, (const char *path, mode_t mode))
 WRAPPER_PROTO(mkstemp, int, (char *template))
 WRAPPER_PROTO(mkstemp64, int, (char *template))
 WRAPPER_PROTO(mktemp, char *, (char *template))
@@ -61,21 +53,21 @@ WRAPPER_PROTO(open64, int, (const char *pathname, int flags, ...))
 WRAPPER_PROTO(openat, int, (int dirfd, const char *pathname, int flags, ...))
 WRAPPER_PROTO(openat64, int, (int dirfd, const char *pathname, int flags, ...))
 WRAPPER_PROTO(opendir, DIR *, (const char *name))
-WRAPPER_PROTO(pathconf, long, (const char *pathname, int name))
+WRAPPER_PROTO(putenv, int, (char *string))
+WRAPPER_PROTO(readdir, struct dirent *, (DIR *dir))
 WRAPPER_PROTO(readlink, ssize_t, (const char *path, char *buf, READLINK_TYPE_ARG3))
 WRAPPER_PROTO(realpath, char *, (const char *path, char *resolved))
 WRAPPER_PROTO(remove, int, (const char *path))
 WRAPPER_PROTO(rename, int, (const char *oldpath, const char *newpath))
 WRAPPER_PROTO(renameat, int, (int olddirfd, const char *oldpath, int newdirfd, const char *newpath))
+WRAPPER_PROTO(rewinddir, void, (DIR *dir))
 WRAPPER_PROTO(rmdir, int, (const char *path))
+WRAPPER_PROTO(setenv, int, (const char *name, const char *value, int overwrite))
 WRAPPER_PROTO(symlink, int, (const char *oldpath, const char *newpath))
-WRAPPER_PROTO(tempnam, char *, (const char *dir, const char *pfx))
 WRAPPER_PROTO(tmpnam, char *, (char *dir))
-WRAPPER_PROTO(truncate, int, (const char *path, off_t offset))
 WRAPPER_PROTO(unlink, int, (const char *path))
 WRAPPER_PROTO(unlinkat, int, (int dirfd, const char *pathname, int flags))
-WRAPPER_PROTO(utime, int, (const char *filename, const struct utimbuf *buf))
-WRAPPER_PROTO(utimes, int, (const char *filename, const struct timeval tv[2]))
+WRAPPER_PROTO(unsetenv, int, (const char *name))
 //WRAPPER_PROTO(, int, ())
 
 WRAPPER_PROTO(__fxstatat, int, (int ver, int drifd, const char *pathname, struct stat *buf, int flags))
@@ -85,50 +77,59 @@ WRAPPER_PROTO(__lxstat64, int, (int ver, const char *filename, struct stat64 *bu
 WRAPPER_PROTO(__open, int, (const char *pathname, int flags, ...))
 WRAPPER_PROTO(__open64, int, (const char *pathname, int flags, ...))
 WRAPPER_PROTO(__opendir2, DIR *, (const char *name, int flags))
-WRAPPER_PROTO(__xmknod, int, (int ver, const char *path, mode_t mode, dev_t *dev))
 WRAPPER_PROTO(__xstat, int, (int ver, const char *filename, struct stat *buf))
 WRAPPER_PROTO(__xstat64, int, (int ver, const char *filename, struct stat64 *buf))
 WRAPPER_PROTO(_xftw, int, (int mode, const char *dir, int(*fn)(const char *file, const struct stat *sb, int flag), int nopenfd))
 WRAPPER_PROTO(_xftw64, int, (int mode, const char *dir, int(*fn)(const char *file, const struct stat64 *sb, int flag), int nopenfd))
 WRAPPER_PROTO(canonicalize_file_name, char *, (const char *name))
 WRAPPER_PROTO(dlmopen, void *, (Lmid_t nsid, const char *filename, int flag))
-WRAPPER_PROTO(eaccess, int, (const char *pathname, int mode))
-WRAPPER_PROTO(euidaccess, int, (const char *pathname, int mode))
 WRAPPER_PROTO(fts_open, FTS *, (char * const *path_argv, int options,
 		int(*compar)(const FTSENT **, const FTSENT **)))
+WRAPPER_PROTO(fstatat, int, (int dirfd, const char *pathname, struct stat *buf, int flags))
 WRAPPER_PROTO(ftw, int, (const char *dir, int(*fn)(const char *file, const struct stat *sb, int flag), int nopenfd))
 WRAPPER_PROTO(ftw64, int, (const char *dir, int(*fn)(const char *file, const struct stat64 *sb, int flag), int nopenfd))
 WRAPPER_PROTO(get_current_dir_name, char *, (void))
-WRAPPER_PROTO(getxattr, ssize_t, (const char *path, const char *name, void *value, size_t size))
 WRAPPER_PROTO(glob64, int, (const char *pattern, int flags, int(*errfunc) (const char *, int),
 		glob64_t *pglob))
-WRAPPER_PROTO(glob_pattern_p, int, (const char *pattern, int quote))
-WRAPPER_PROTO(lchmod, int, (const char *path, mode_t mode))
 WRAPPER_PROTO(lckpwdf, int, (void))
-WRAPPER_PROTO(lgetxattr, ssize_t, (const char *path, const char *name, void *value, size_t size))
-WRAPPER_PROTO(listxattr, ssize_t, (const char *path, char *list, size_t size))
-WRAPPER_PROTO(llistxattr, ssize_t, (const char *path, char *list, size_t size))
-WRAPPER_PROTO(lremovexattr, int, (const char *path, const char *name))
-WRAPPER_PROTO(lsetxattr, int, (const char *path, const char *name, const void *value,
-		size_t size, int flags))
+WRAPPER_PROTO(lstat, int, (const char *file_name, struct stat *buf))
 WRAPPER_PROTO(lstat64, int, (const char *file_name, struct stat64 *buf))
-WRAPPER_PROTO(lutimes, int, (const char *filename, const struct timeval tv[2]))
 WRAPPER_PROTO(mkdtemp, char *, (char *template))
 WRAPPER_PROTO(nftw, int, (const char *dir, int(*fn)(const char *file, const struct stat *sb,
 			int flag, struct FTW *s), int nopenfd, int flags))
 WRAPPER_PROTO(nftw64, int, (const char *dir, int(*fn)(const char *file, const struct stat64 *sb,
 			int flag, struct FTW *s), int nopenfd, int flags))
-WRAPPER_PROTO(removexattr, int, (const char *path, const char *name))
-WRAPPER_PROTO(revoke, int, (const char *file))
+WRAPPER_PROTO(readdir64, struct dirent64 *, (DIR *dir))
 WRAPPER_PROTO(scandir, int, (const char *dir, struct dirent ***namelist, SCANDIR_TYPE_ARG3,
 		int(*compar)(const void *, const void *)))
 WRAPPER_PROTO(scandir64, int, (const char *dir, struct dirent64 ***namelist,
 		int(*filter)(const struct dirent64 *),
 		int(*compar)(const void *, const void *)))
-WRAPPER_PROTO(setxattr, int, (const char *path, const char *name, const void *value, size_t size, int flags))
+WRAPPER_PROTO(stat, int, (const char *file_name, struct stat *buf))
 WRAPPER_PROTO(stat64, int, (const char *file_name, struct stat64 *buf))
-WRAPPER_PROTO(truncate64, int, (const char *path, off64_t length))
 WRAPPER_PROTO(ulckpwdf, int, (void))
 
+/*
+ * glibc 2.33 turned stat(), lstat() and fstatat() into real functions and
+ * stopped declaring _STAT_VER; binaries built since call them directly
+ * instead of __xstat() and friends, so they are wrapped too.
+ */
+#if !defined(HAVE___XSTAT) || !defined(_STAT_VER)
+#define FAKECHROOT_PLAIN_STAT 1
+#define next_stat(path, buf) NEXTCALL(stat)((path), (buf))
+#define next_lstat(path, buf) NEXTCALL(lstat)((path), (buf))
+#else
+#define next_stat(path, buf) NEXTCALL(__xstat)(_STAT_VER, (path), (buf))
+#define next_lstat(path, buf) NEXTCALL(__lxstat)(_STAT_VER, (path), (buf))
+#endif
+
+/*
+ * Calls on host paths, which must not be translated again, go straight to
+ * the next definition instead of through our own exported wrappers.
+ */
+#define next_open(path, flags, mode) NEXTCALL(open)((path), (flags), (mode))
+#define next_readlink(path, buf, size) NEXTCALL(readlink)((path), (buf), (size))
+#define next_getcwd(buf, size) NEXTCALL(getcwd)((buf), (size))
+
 #endif /* __FAKECHROOT_PROTO_H__ */
 
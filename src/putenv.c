@@ -20,22 +20,24 @@
  */
 
 /*
- * acct() call wrapper
+ * putenv() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-/* #include <unistd.h> */
-int acct(const char *filename)
+#ifdef HAVE_PUTENV
+/* #include <stdlib.h> */
+int putenv(char *string)
 {
-	 
+	int ret = NEXTCALL(putenv)(string);
 
-	expand_chroot_path(filename);
+	if (ret == 0 && fchr_config_var(string))
+		fchr_config_refresh();
 
-	return NEXTCALL(acct)(filename);
+	return ret;
 }
 
-DECLARE_WRAPPER(acct);
-
+DECLARE_WRAPPER_FLAGS(putenv, FCHR_WRAPPER_KEEP);
+#endif
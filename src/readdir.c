@@ -20,25 +20,23 @@
  */
 
 /*
- * __xmknod() call wrapper
+ * readdir() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE___XMKNOD
-/* #include <sys/stat.h> */
-/* #include <unistd.h> */
-int __xmknod(int ver, const char *path, mode_t mode, dev_t *dev)
+#ifdef HAVE_READDIR
+/* #include <dirent.h> */
+struct dirent *readdir(DIR *dir)
 {
+	/* only merged overlay directories need a look */
+	if (__atomic_load_n(&fchr_overlay_dirs, __ATOMIC_RELAXED) == 0)
+		return NEXTCALL(readdir)(dir);
 
-	track_mknod(path, mode, *dev);
-	expand_chroot_path(path);
-
-	return NEXTCALL(__xmknod)(ver, path, mode, dev);
+	return fchr_overlay_readdir(dir);
 }
-DECLARE_WRAPPER(__xmknod)
+DECLARE_WRAPPER(readdir)
 
 #endif
-
@@ -20,24 +20,23 @@
  */
 
 /*
- * getxattr() call wrapper
+ * readdir64() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE_GETXATTR
-/* #include <sys/xattr.h> */
-ssize_t getxattr(const char *path, const char *name, void *value, size_t size)
+#ifdef HAVE_READDIR64
+/* #include <dirent.h> */
+struct dirent64 *readdir64(DIR *dir)
 {
-	 
+	/* only merged overlay directories need a look */
+	if (__atomic_load_n(&fchr_overlay_dirs, __ATOMIC_RELAXED) == 0)
+		return NEXTCALL(readdir64)(dir);
 
-	expand_chroot_path(path);
-
-	return NEXTCALL(getxattr)(path, name, value, size);
+	return fchr_overlay_readdir64(dir);
 }
-DECLARE_WRAPPER(getxattr)
+DECLARE_WRAPPER(readdir64)
 
 #endif
-
@@ -32,7 +32,6 @@ READLINK_TYPE_RETURN readlink(const char *path, char *buf, READLINK_TYPE_ARG3)
 {
 	int status;
 	char tmp[FAKECHROOT_MAXPATH], *tmpptr;
-	char fakechroot_ptr;
 
 	expand_chroot_path(path);
 
@@ -40,24 +39,15 @@ READLINK_TYPE_RETURN readlink(const char *path, char *buf, READLINK_TYPE_ARG3)
 		return status;
 
 	tmp[status] = '\0';
-
-	if (fakechroot_path != NULL) {
-		fakechroot_ptr = strstr(tmp, fakechroot_path);
-		if (fakechroot_ptr != tmp)
-			tmpptr = tmp;
-		else {
-			tmpptr = tmp + strlen(fakechroot_path);
-            status -= strlen(fakechroot_path);
-        }
-
-        if (strlen(tmpptr) > bufsiz) {
-            errno = EFAULT;
-            return -1;
-        }
-		strncpy(buf, tmpptr, status);
-	} else {
-		strncpy(buf, tmp, status);
-    }
+	tmpptr = tmp;
+	narrow_chroot_path(tmpptr);
+	status = strlen(tmpptr);
+
+	if (status > bufsiz) {
+		errno = EFAULT;
+		return -1;
+	}
+	memcpy(buf, tmpptr, status);
 
 	return status;
 }
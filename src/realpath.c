@@ -30,13 +30,32 @@
 /* #include <stdlib.h> */
 char *realpath(const char *name, char *resolved)
 {
-	char *ptr;
-	 
+	char buf[FAKECHROOT_PATHBUF], *ptr;
+	size_t len;
 
-	if ((ptr = NEXTCALL(realpath)(name, resolved)) != NULL)
-		narrow_chroot_path(ptr);
+	if (fakechroot_path == NULL || name == NULL || fchr_nested)
+		return NEXTCALL(realpath)(name, resolved);
 
-	return ptr;
+	if ((ptr = fchr_resolve(name, buf, FCHR_RESOLVE_EXISTING)) == NULL) {
+		if (errno != EXDEV)
+			return NULL;
+		/* working directory outside the fake root */
+		if ((ptr = fchr_direct(NEXTCALL(realpath)(name, resolved))) != NULL)
+			narrow_chroot_path_modify(ptr);
+		return ptr;
+	}
+
+	if (resolved == NULL)
+		return strdup(ptr);
+
+	len = strlen(ptr);
+	if (len >= FAKECHROOT_MAXPATH) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	memcpy(resolved, ptr, len + 1);
+
+	return resolved;
 }
 
 DECLARE_WRAPPER(realpath);
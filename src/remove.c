@@ -30,11 +30,17 @@
 /* #include <stdio.h> */
 int remove(const char *pathname)
 {
-	 
+	int ret;
+
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_remove(pathname, -1);
 
 	expand_chroot_path(pathname);
 
-	return NEXTCALL(remove)(pathname);
+	if ((ret = NEXTCALL(remove)(pathname)) == 0)
+		fchr_dcache_invalidate();
+
+	return ret;
 }
 
 DECLARE_WRAPPER(remove);
@@ -30,14 +30,18 @@
 /* #include <stdio.h> */
 int rename(const char *oldpath, const char *newpath)
 {
-	char tmp[FAKECHROOT_MAXPATH];
-	 
+	int ret;
+
+	if (fchr_overlay(fchr_conf()))
+		return fchr_negcache_made(fchr_overlay_rename(oldpath, newpath));
 
 	expand_chroot_path(oldpath);
-	strcpy(tmp, oldpath); oldpath=tmp;
 	expand_chroot_path(newpath);
 
-	return NEXTCALL(rename)(oldpath, newpath);
+	if ((ret = NEXTCALL(rename)(oldpath, newpath)) == 0)
+		fchr_dcache_invalidate();
+
+	return fchr_negcache_made(ret);
 }
 
 DECLARE_WRAPPER(rename);
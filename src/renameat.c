@@ -28,13 +28,19 @@
 #ifdef HAVE_RENAMEAT
 int renameat(int olddirfd, const char *oldpath, int newdirfd, const char *newpath)
 {
-	char tmp[FAKECHROOT_MAXPATH];
-	expand_chroot_path(oldpath);
-	strcpy(tmp, oldpath);
-    oldpath=tmp;
-	expand_chroot_path(newpath);
+	int ret;
 
-	return NEXTCALL(renameat)(olddirfd, oldpath, newdirfd, newpath);
+	if (fchr_overlay(fchr_conf()) && fchr_at_cwd(olddirfd, oldpath) &&
+			fchr_at_cwd(newdirfd, newpath))
+		return fchr_negcache_made(fchr_overlay_rename(oldpath, newpath));
+
+	expand_chroot_path_at(olddirfd, oldpath);
+	expand_chroot_path_at(newdirfd, newpath);
+
+	if ((ret = NEXTCALL(renameat)(olddirfd, oldpath, newdirfd, newpath)) == 0)
+		fchr_dcache_invalidate();
+
+	return fchr_negcache_made(ret);
 }
 DECLARE_WRAPPER(renameat);
 #endif
@@ -20,24 +20,24 @@
  */
 
 /*
- * euidaccess() call wrapper
+ * rewinddir() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE_EUIDACCESS
-/* #include <unistd.h> */
-int euidaccess(const char *pathname, int mode)
+#ifdef HAVE_REWINDDIR
+/* #include <dirent.h> */
+void rewinddir(DIR *dir)
 {
-	 
+	if (__atomic_load_n(&fchr_overlay_dirs, __ATOMIC_RELAXED) == 0) {
+		NEXTCALL(rewinddir)(dir);
+		return;
+	}
 
-	expand_chroot_path(pathname);
-
-	return NEXTCALL(euidaccess)(pathname, mode);
+	fchr_overlay_rewinddir(dir);
 }
-DECLARE_WRAPPER(euidaccess)
+DECLARE_WRAPPER(rewinddir)
 
 #endif
-
@@ -30,11 +30,18 @@
 /* #include <unistd.h> */
 int rmdir(const char *pathname)
 {
-	 
+	int ret;
+
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_remove(pathname, 1);
 
 	expand_chroot_path(pathname);
 
-	return NEXTCALL(rmdir)(pathname);
+	if ((ret = RAWCALL(fchr_raw_unlinkat(AT_FDCWD, pathname, AT_REMOVEDIR),
+					NEXTCALL(rmdir)(pathname))) == 0)
+		fchr_dcache_invalidate();
+
+	return ret;
 }
 
 DECLARE_WRAPPER(rmdir);
@@ -32,10 +32,21 @@
 int scandir(const char *dir, struct dirent ***namelist, SCANDIR_TYPE_ARG3,
 		int(*compar)(const void *, const void *))
 {
-	 
+	int n;
+
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_scandir(dir, (void ***)namelist,
+				(int (*)(const void *))filter,
+				(int (*)(const void *, const void *))compar, 0);
 
 	expand_chroot_path(dir);
 
+	if ((fchr_opts & OPT_INDEX) &&
+			(n = fchr_index_scandir(dir, (void ***)namelist,
+				(int (*)(const void *))filter,
+				(int (*)(const void *, const void *))compar, 0)) != FCHR_FALLBACK)
+		return n;
+
 	return NEXTCALL(scandir)(dir, namelist, filter, compar);
 }
 DECLARE_WRAPPER(scandir)
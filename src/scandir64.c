@@ -33,10 +33,21 @@ int scandir64 (const char *dir, struct dirent64 ***namelist,
 		int(*filter)(const struct dirent64 *),
 		int(*compar)(const void *, const void *))
 {
-	 
+	int n;
+
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_scandir(dir, (void ***)namelist,
+				(int (*)(const void *))filter,
+				(int (*)(const void *, const void *))compar, 1);
 
 	expand_chroot_path(dir);
 
+	if ((fchr_opts & OPT_INDEX) &&
+			(n = fchr_index_scandir(dir, (void ***)namelist,
+				(int (*)(const void *))filter,
+				(int (*)(const void *, const void *))compar, 1)) != FCHR_FALLBACK)
+		return n;
+
 	return NEXTCALL(scandir64)(dir, namelist, filter, compar);
 }
 DECLARE_WRAPPER(scandir64)
@@ -20,22 +20,24 @@
  */
 
 /*
- * chdir() call wrapper
+ * setenv() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-/* #include <unistd.h> */
-int chdir(const char *path)
+#ifdef HAVE_SETENV
+/* #include <stdlib.h> */
+int setenv(const char *name, const char *value, int overwrite)
 {
-	 
+	int ret = NEXTCALL(setenv)(name, value, overwrite);
 
-	expand_chroot_path(path);
+	if (ret == 0 && fchr_config_var(name))
+		fchr_config_refresh();
 
-	return NEXTCALL(chdir)(path);
+	return ret;
 }
 
-DECLARE_WRAPPER(chdir);
-
+DECLARE_WRAPPER_FLAGS(setenv, FCHR_WRAPPER_KEEP);
+#endif
@@ -20,24 +20,31 @@
  */
 
 /*
- * glob_pattern_p() call wrapper
+ * stat() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE_GLOB_PATTERN_P
-/* #include <glob.h> */
-int glob_pattern_p(const char *pattern, int quote)
+#if defined(HAVE_STAT) && defined(FAKECHROOT_PLAIN_STAT)
+/* #include <sys/stat.h> */
+int stat(const char *file_name, struct stat *buf)
 {
-	 
+	const char *guest = file_name;
 
-	expand_chroot_path(pattern);
+	if (fchr_negcache_hit(file_name, 0))
+		return -1;
 
-	return NEXTCALL(glob_pattern_p)(pattern, quote);
+	lookup_in_root(file_name, 0,
+			NEXTCALL(fstatat)(fakechroot_fd, "", buf, AT_EMPTY_PATH));
+	resolve_chroot_path(file_name, 0);
+
+	return fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_STAT, file_name, 0, buf,
+				RAWCALL(fchr_raw_fstatat(AT_FDCWD, file_name, buf, 0),
+					NEXTCALL(stat)(file_name, buf))));
 }
-DECLARE_WRAPPER(glob_pattern_p)
+DECLARE_WRAPPER(stat)
 
 #endif
-
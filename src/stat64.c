@@ -28,16 +28,23 @@
 #include "proto.h"
 
 #ifdef HAVE_STAT64
-#if !defined(HAVE___XSTAT64)
+#if !defined(HAVE___XSTAT64) || defined(FAKECHROOT_PLAIN_STAT)
 /* #include <sys/stat.h> */
 /* #include <unistd.h> */
 int stat64 (const char *file_name, struct stat64 *buf)
 {
-	 
+	const char *guest = file_name;
 
-	expand_chroot_path(file_name);
+	if (fchr_negcache_hit(file_name, 0))
+		return -1;
 
-	return NEXTCALL(stat64)(file_name, buf);
+	lookup_in_root(file_name, 0,
+			fstatat64(fakechroot_fd, "", buf, AT_EMPTY_PATH));
+	resolve_chroot_path(file_name, 0);
+
+	return fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_STAT64, file_name, 0, buf,
+				NEXTCALL(stat64)(file_name, buf)));
 }
 DECLARE_WRAPPER(stat64)
 
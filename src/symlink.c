@@ -35,9 +35,9 @@ int symlink(const char *oldpath, const char *newpath)
 	/*expand_chroot_path(oldpath);*/
 	strcpy(tmp, oldpath);
 	oldpath=tmp;
-	expand_chroot_path(newpath);
+	upper_chroot_path(newpath, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
 
-	return NEXTCALL(symlink)(oldpath, newpath);
+	return fchr_negcache_made(NEXTCALL(symlink)(oldpath, newpath));
 }
 
 DECLARE_WRAPPER(symlink);
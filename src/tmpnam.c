@@ -30,14 +30,13 @@
 /* #include <stdio.h> */
 char *tmpnam(char *s)
 {
-	char *ptr;
+	static char buf[FAKECHROOT_PATHBUF];
 
 	if (s != NULL)
 		return NEXTCALL(tmpnam)(s);
 
-	ptr = NEXTCALL(tmpnam)(NULL);
-	expand_chroot_path_malloc(ptr);
-	return ptr;
+	/* tmpnam(NULL) hands out a static buffer anyway */
+	return fakechroot_expand(NEXTCALL(tmpnam)(NULL), buf);
 }
 
 DECLARE_WRAPPER(tmpnam);
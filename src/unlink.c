@@ -30,11 +30,18 @@
 /* #include <unistd.h> */
 int unlink(const char *pathname)
 {
-	 
+	int ret;
+
+	if (fchr_overlay(fchr_conf()))
+		return fchr_overlay_remove(pathname, 0);
 
 	expand_chroot_path(pathname);
 
-	return NEXTCALL(unlink)(pathname);
+	if ((ret = RAWCALL(fchr_raw_unlinkat(AT_FDCWD, pathname, 0),
+					NEXTCALL(unlink)(pathname))) == 0)
+		fchr_dcache_invalidate();
+
+	return ret;
 }
 
 DECLARE_WRAPPER(unlink);
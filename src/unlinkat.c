@@ -28,8 +28,16 @@
 #ifdef HAVE_UNLINKAT
 int unlinkat(int dirfd, const char *pathname, int flags)
 {
-	expand_chroot_path(pathname);
-	return NEXTCALL(unlinkat)(dirfd, pathname, flags);
+	int ret;
+
+	if (fchr_overlay(fchr_conf()) && fchr_at_cwd(dirfd, pathname))
+		return fchr_overlay_remove(pathname, (flags & AT_REMOVEDIR) ? 1 : 0);
+
+	expand_chroot_path_at(dirfd, pathname);
+	if ((ret = RAWCALL(fchr_raw_unlinkat(dirfd, pathname, flags),
+					NEXTCALL(unlinkat)(dirfd, pathname, flags))) == 0)
+		fchr_dcache_invalidate();
+	return ret;
 }
 DECLARE_WRAPPER(unlinkat);
 #endif
@@ -20,26 +20,24 @@
  */
 
 /*
- * creat64() call wrapper
+ * unsetenv() call wrapper
  */
 
 #include "common.h"
 #include "wrapper.h"
 #include "proto.h"
 
-#ifdef HAVE_CREAT64
-/* #include <sys/types.h> */
-/* #include <sys/stat.h> */
-/* #include <fcntl.h> */
-int creat64 (const char *pathname, mode_t mode)
+#ifdef HAVE_UNSETENV
+/* #include <stdlib.h> */
+int unsetenv(const char *name)
 {
-	 
+	int ret = NEXTCALL(unsetenv)(name);
 
-	expand_chroot_path(pathname);
+	if (ret == 0 && fchr_config_var(name))
+		fchr_config_refresh();
 
-	return NEXTCALL(creat64)(pathname, mode);
+	return ret;
 }
 
-DECLARE_WRAPPER(creat64);
-
+DECLARE_WRAPPER_FLAGS(unsetenv, FCHR_WRAPPER_KEEP);
 #endif
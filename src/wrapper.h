@@ -24,48 +24,134 @@
 
 typedef void (*fchr_wrapperfn_t)(void);
 
+/*
+ * Dispatch through trampolines, where we know how to write them.  The
+ * symbol a wrapper exports is then a single indirect jump through the
+ * dispatch pointer of its fchr_wrappers entry, and the C function behind
+ * it is renamed to fchr_impl_<name>.  The pointer normally leads to that
+ * function; in a process without a fake root it is pointed straight at
+ * the next definition, see fchr_dispatch_update().
+ *
+ * Either way the wrapped functions are the library's interface and stay
+ * exported when it is built with -fvisibility=hidden; the trampolines,
+ * being assembler symbols, are not affected by it.
+ */
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__ELF__) && \
+	!defined(FAKECHROOT_NO_DISPATCH)
+#define FAKECHROOT_DISPATCH 1
+#endif
+
+#ifdef FAKECHROOT_DISPATCH
+#define WRAPPER_PROTO(__f, __r, __a) \
+	extern __r __f __a __asm__("fchr_impl_" #__f) \
+		__attribute__((visibility("hidden"))); \
+	extern struct fchr_wrapper WSEC fchr_ ## __f ## _wrapper_decl; \
+	typedef __r(*fchr_##__f##_fn_t)__a;
+#else
 #define WRAPPER_PROTO(__f, __r, __a) \
-	extern __r __f __a; \
+	extern __r __f __a __attribute__((visibility("default"))); \
 	extern struct fchr_wrapper WSEC fchr_ ## __f ## _wrapper_decl; \
 	typedef __r(*fchr_##__f##_fn_t)__a;
+#endif
 
 struct fchr_wrapper {
+	fchr_wrapperfn_t dispatch;	/* first: the trampolines jump through it */
 	fchr_wrapperfn_t func;
 	fchr_wrapperfn_t nextfunc;
 	const char *name;
+	unsigned int flags;
 };
 
-#define WSEC __attribute__((section("fchr_wrappers")))
+/* the wrapper has work to do even without a fake root */
+#define FCHR_WRAPPER_KEEP 0x1
 
-#define DECLARE_WRAPPER(__f)                                         \
-	struct fchr_wrapper WSEC fchr_ ## __f ## _wrapper_decl = {       \
+/*
+ * The explicit alignment keeps the compiler from padding the entries out
+ * to its preferred alignment for data, so that the section is an array.
+ * The trampolines refer to the entries from assembler, by name, which
+ * link time optimization cannot see: "used", on the definitions, keeps it
+ * from localizing them.
+ */
+#define WSEC __attribute__((section("fchr_wrappers"), aligned(sizeof(void *)), \
+			visibility("hidden")))
+
+#if defined(FAKECHROOT_DISPATCH) && defined(__x86_64__)
+#ifdef __CET__
+#define FCHR_TRAMPOLINE_ENTRY "\tendbr64\n"
+#else
+#define FCHR_TRAMPOLINE_ENTRY ""
+#endif
+#define FCHR_TRAMPOLINE_JUMP(__f) \
+	"\tjmp *fchr_" #__f "_wrapper_decl(%rip)\n"
+#elif defined(FAKECHROOT_DISPATCH) && defined(__aarch64__)
+#ifdef __ARM_FEATURE_BTI_DEFAULT
+#define FCHR_TRAMPOLINE_ENTRY "\tbti c\n"
+#else
+#define FCHR_TRAMPOLINE_ENTRY ""
+#endif
+#define FCHR_TRAMPOLINE_JUMP(__f) \
+	"\tadrp x16, fchr_" #__f "_wrapper_decl\n" \
+	"\tldr x16, [x16, #:lo12:fchr_" #__f "_wrapper_decl]\n" \
+	"\tbr x16\n"
+#endif
+
+#ifdef FAKECHROOT_DISPATCH
+#define FCHR_TRAMPOLINE(__f) \
+	__asm__(".pushsection .text\n" \
+		"\t.globl " #__f "\n" \
+		"\t.type " #__f ", %function\n" \
+		"\t.p2align 4\n" \
+		#__f ":\n" \
+		FCHR_TRAMPOLINE_ENTRY \
+		FCHR_TRAMPOLINE_JUMP(__f) \
+		"\t.size " #__f ", .-" #__f "\n" \
+		".popsection\n");
+#else
+#define FCHR_TRAMPOLINE(__f)
+#endif
+
+#define DECLARE_WRAPPER_FLAGS(__f, __flags)                          \
+	struct fchr_wrapper WSEC __attribute__((used))                   \
+		fchr_ ## __f ## _wrapper_decl = {                            \
+		.dispatch = (fchr_wrapperfn_t)__f,                           \
 		.func = (fchr_wrapperfn_t)__f,                               \
 		.nextfunc = NULL,                                            \
-		.name = #__f                                                 \
-	};                                                               
+		.name = #__f,                                                \
+		.flags = (__flags)                                           \
+	};                                                               \
+	FCHR_TRAMPOLINE(__f)
+
+#define DECLARE_WRAPPER(__f) DECLARE_WRAPPER_FLAGS(__f, 0)
 
 #define WRAPPER_PROLOGUE()
 
-static inline fchr_wrapperfn_t loadfunc(struct fchr_wrapper *w)
+fchr_wrapperfn_t fchr_loadfunc(struct fchr_wrapper *w) __attribute__((cold));
+
+/*
+ * The next definition of a wrapped function.  It is looked up on first
+ * use, unless fakechroot_init() bound them all already (FAKECHROOT_OPTS=N);
+ * the pointer is published atomically, so threads racing on the first call
+ * need no lock.
+ */
+static inline fchr_wrapperfn_t fchr_nextfunc(struct fchr_wrapper *w)
 {
-	w->nextfunc = dlsym(RTLD_NEXT, w->name);
-	if (!w->nextfunc) {
-		fprintf(stderr, "unresolved symbol %s\n", w->name);
-		exit(EXIT_FAILURE);
-	}
-	dprintf("Lazily loaded %s function\n", w->name);
-
-	return w->nextfunc;
+	fchr_wrapperfn_t f = __atomic_load_n(&w->nextfunc, __ATOMIC_ACQUIRE);
+
+	return f ? f : fchr_loadfunc(w);
 }
 
 #define NEXTCALL(__f)                                                \
-	( \
-	  (fchr_##__f##_fn_t)( \
-		  fchr_##__f##_wrapper_decl.nextfunc ? \
-		  fchr_##__f##_wrapper_decl.nextfunc : \
-		  loadfunc(&fchr_##__f##_wrapper_decl) \
-	  ) \
-	) 
+	((fchr_##__f##_fn_t)fchr_nextfunc(&fchr_##__f##_wrapper_decl))
+
+/*
+ * The call raw, a raw system call of lib-syscall.c, with FAKECHROOT_OPTS=R,
+ * otherwise next, the call of the next definition it stands for.
+ */
+#ifdef FAKECHROOT_RAW_SYSCALL
+#define RAWCALL(raw, next) ((fchr_opts & OPT_RAW_SYSCALL) ? (raw) : (next))
+#else
+#define RAWCALL(raw, next) (next)
+#endif
 
 /* linker should automatically generate these for fchr_wrappers section */
 extern struct fchr_wrapper __start_fchr_wrappers;
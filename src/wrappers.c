@@ -0,0 +1,365 @@
+/* Generated from wrappers.tab by mkwrappers.awk, do not edit. */
+
+#include "common.h"
+#include "wrapper.h"
+#include "proto.h"
+
+int acct(const char *filename)
+{
+	expand_chroot_path(filename);
+
+	return NEXTCALL(acct)(filename);
+}
+DECLARE_WRAPPER(acct);
+
+int chdir(const char *path)
+{
+	expand_chroot_path(path);
+
+	return NEXTCALL(chdir)(path);
+}
+DECLARE_WRAPPER(chdir);
+
+int chmod(const char *path, mode_t mode)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY);
+
+	return RAWCALL(fchr_raw_fchmodat(AT_FDCWD, path, mode),
+			NEXTCALL(chmod)(path, mode));
+}
+DECLARE_WRAPPER(chmod);
+
+#ifdef HAVE_LCHMOD
+int lchmod(const char *path, mode_t mode)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+
+	return NEXTCALL(lchmod)(path, mode);
+}
+DECLARE_WRAPPER(lchmod);
+#endif
+
+#ifdef HAVE_FCHMODAT
+int fchmodat(int dirfd, const char *path, mode_t mode, int flag)
+{
+	upper_chroot_path_at(dirfd, path, FCHR_UPPER_COPY | fchr_at_nofollow(flag));
+
+	return NEXTCALL(fchmodat)(dirfd, path, mode, flag);
+}
+DECLARE_WRAPPER(fchmodat);
+#endif
+
+int chown(const char *path, uid_t owner, gid_t group)
+{
+	track_chown(path, owner, group);
+	upper_chroot_path(path, FCHR_UPPER_COPY);
+
+	return RAWCALL(fchr_raw_fchownat(AT_FDCWD, path, owner, group, 0),
+			NEXTCALL(chown)(path, owner, group));
+}
+DECLARE_WRAPPER(chown);
+
+int lchown(const char *path, uid_t owner, gid_t group)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+
+	return RAWCALL(fchr_raw_fchownat(AT_FDCWD, path, owner, group, AT_SYMLINK_NOFOLLOW),
+			NEXTCALL(lchown)(path, owner, group));
+}
+DECLARE_WRAPPER(lchown);
+
+#ifdef HAVE_FCHOWNAT
+int fchownat(int dirfd, const char *path, uid_t owner, gid_t group, int flag)
+{
+	track_chown(path, owner, group);
+	upper_chroot_path_at(dirfd, path, FCHR_UPPER_COPY | fchr_at_nofollow(flag));
+
+	return RAWCALL(fchr_raw_fchownat(dirfd, path, owner, group, flag),
+			NEXTCALL(fchownat)(dirfd, path, owner, group, flag));
+}
+DECLARE_WRAPPER(fchownat);
+#endif
+
+int mkdir(const char *pathname, mode_t mode)
+{
+	upper_chroot_path(pathname, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return fchr_negcache_made(RAWCALL(fchr_raw_mkdirat(AT_FDCWD, pathname, mode),
+			NEXTCALL(mkdir)(pathname, mode)));
+}
+DECLARE_WRAPPER(mkdir);
+
+#ifdef HAVE_MKDIRAT
+int mkdirat(int dirfd, const char *pathname, mode_t mode)
+{
+	upper_chroot_path_at(dirfd, pathname, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return fchr_negcache_made(RAWCALL(fchr_raw_mkdirat(dirfd, pathname, mode),
+			NEXTCALL(mkdirat)(dirfd, pathname, mode)));
+}
+DECLARE_WRAPPER(mkdirat);
+#endif
+
+int mkfifo(const char *pathname, mode_t mode)
+{
+	upper_chroot_path(pathname, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return fchr_negcache_made(NEXTCALL(mkfifo)(pathname, mode));
+}
+DECLARE_WRAPPER(mkfifo);
+
+#ifdef HAVE___XMKNOD
+int __xmknod(int ver, const char *path, mode_t mode, dev_t *dev)
+{
+	track_mknod(path, mode, *dev);
+	upper_chroot_path(path, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return fchr_negcache_made(NEXTCALL(__xmknod)(ver, path, mode, dev));
+}
+DECLARE_WRAPPER(__xmknod);
+#endif
+
+int creat(const char *pathname, mode_t mode)
+{
+	upper_chroot_path(pathname, FCHR_UPPER_NEW | FCHR_UPPER_COPY | FCHR_UPPER_TRUNC);
+
+	return fchr_negcache_made(NEXTCALL(creat)(pathname, mode));
+}
+DECLARE_WRAPPER(creat);
+
+#ifdef HAVE_CREAT64
+int creat64(const char *pathname, mode_t mode)
+{
+	upper_chroot_path(pathname, FCHR_UPPER_NEW | FCHR_UPPER_COPY | FCHR_UPPER_TRUNC);
+
+	return fchr_negcache_made(NEXTCALL(creat64)(pathname, mode));
+}
+DECLARE_WRAPPER(creat64);
+#endif
+
+int link(const char *oldpath, const char *newpath)
+{
+	upper_chroot_path(oldpath, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+	upper_chroot_path(newpath, FCHR_UPPER_NEW | FCHR_UPPER_EXCL);
+
+	return fchr_negcache_made(NEXTCALL(link)(oldpath, newpath));
+}
+DECLARE_WRAPPER(link);
+
+int truncate(const char *path, off_t length)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY);
+
+	return NEXTCALL(truncate)(path, length);
+}
+DECLARE_WRAPPER(truncate);
+
+#ifdef HAVE_TRUNCATE64
+int truncate64(const char *path, off64_t length)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY);
+
+	return NEXTCALL(truncate64)(path, length);
+}
+DECLARE_WRAPPER(truncate64);
+#endif
+
+int utime(const char *filename, const struct utimbuf *buf)
+{
+	upper_chroot_path(filename, FCHR_UPPER_COPY);
+
+	return NEXTCALL(utime)(filename, buf);
+}
+DECLARE_WRAPPER(utime);
+
+int utimes(const char *filename, const struct timeval tv[2])
+{
+	upper_chroot_path(filename, FCHR_UPPER_COPY);
+
+	return NEXTCALL(utimes)(filename, tv);
+}
+DECLARE_WRAPPER(utimes);
+
+#ifdef HAVE_LUTIMES
+int lutimes(const char *filename, const struct timeval tv[2])
+{
+	upper_chroot_path(filename, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+
+	return NEXTCALL(lutimes)(filename, tv);
+}
+DECLARE_WRAPPER(lutimes);
+#endif
+
+#ifdef HAVE_GETXATTR
+ssize_t getxattr(const char *path, const char *name, void *value, size_t size)
+{
+	expand_chroot_path(path);
+
+	return NEXTCALL(getxattr)(path, name, value, size);
+}
+DECLARE_WRAPPER(getxattr);
+#endif
+
+#ifdef HAVE_LGETXATTR
+ssize_t lgetxattr(const char *path, const char *name, void *value, size_t size)
+{
+	expand_chroot_path(path);
+
+	return NEXTCALL(lgetxattr)(path, name, value, size);
+}
+DECLARE_WRAPPER(lgetxattr);
+#endif
+
+#ifdef HAVE_LISTXATTR
+ssize_t listxattr(const char *path, char *list, size_t size)
+{
+	expand_chroot_path(path);
+
+	return NEXTCALL(listxattr)(path, list, size);
+}
+DECLARE_WRAPPER(listxattr);
+#endif
+
+#ifdef HAVE_LLISTXATTR
+ssize_t llistxattr(const char *path, char *list, size_t size)
+{
+	expand_chroot_path(path);
+
+	return NEXTCALL(llistxattr)(path, list, size);
+}
+DECLARE_WRAPPER(llistxattr);
+#endif
+
+#ifdef HAVE_SETXATTR
+int setxattr(const char *path, const char *name, const void *value, size_t size, int flags)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY);
+
+	return NEXTCALL(setxattr)(path, name, value, size, flags);
+}
+DECLARE_WRAPPER(setxattr);
+#endif
+
+#ifdef HAVE_LSETXATTR
+int lsetxattr(const char *path, const char *name, const void *value, size_t size, int flags)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+
+	return NEXTCALL(lsetxattr)(path, name, value, size, flags);
+}
+DECLARE_WRAPPER(lsetxattr);
+#endif
+
+#ifdef HAVE_REMOVEXATTR
+int removexattr(const char *path, const char *name)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY);
+
+	return NEXTCALL(removexattr)(path, name);
+}
+DECLARE_WRAPPER(removexattr);
+#endif
+
+#ifdef HAVE_LREMOVEXATTR
+int lremovexattr(const char *path, const char *name)
+{
+	upper_chroot_path(path, FCHR_UPPER_COPY | FCHR_UPPER_NOFOLLOW);
+
+	return NEXTCALL(lremovexattr)(path, name);
+}
+DECLARE_WRAPPER(lremovexattr);
+#endif
+
+#ifdef HAVE_REVOKE
+int revoke(const char *file)
+{
+	expand_chroot_path(file);
+
+	return NEXTCALL(revoke)(file);
+}
+DECLARE_WRAPPER(revoke);
+#endif
+
+long pathconf(const char *path, int name)
+{
+	expand_chroot_path(path);
+
+	return NEXTCALL(pathconf)(path, name);
+}
+DECLARE_WRAPPER(pathconf);
+
+char *tempnam(const char *dir, const char *pfx)
+{
+	expand_chroot_path(dir);
+
+	return NEXTCALL(tempnam)(dir, pfx);
+}
+DECLARE_WRAPPER(tempnam);
+
+#ifdef HAVE_GLOB_PATTERN_P
+int glob_pattern_p(const char *pattern, int quote)
+{
+	expand_chroot_path(pattern);
+
+	return NEXTCALL(glob_pattern_p)(pattern, quote);
+}
+DECLARE_WRAPPER(glob_pattern_p);
+#endif
+
+char *getcwd(char *buf, size_t size)
+{
+	char *ret;
+
+	if ((ret = NEXTCALL(getcwd)(buf, size)) == NULL)
+		return NULL;
+	narrow_chroot_path_modify(ret);
+
+	return ret;
+}
+DECLARE_WRAPPER(getcwd);
+
+#ifdef HAVE_GETWD
+char *getwd(char *buf)
+{
+	char *ret;
+
+	if ((ret = NEXTCALL(getwd)(buf)) == NULL)
+		return NULL;
+	narrow_chroot_path(ret);
+
+	return ret;
+}
+DECLARE_WRAPPER(getwd);
+#endif
+
+#ifdef HAVE_EACCESS
+int eaccess(const char *pathname, int mode)
+{
+	const char *guest = pathname;
+
+	if (fchr_negcache_hit(pathname, 0))
+		return -1;
+	expand_chroot_path(pathname);
+
+	return fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_EACCESS, pathname, mode, NULL,
+				NEXTCALL(eaccess)(pathname, mode)));
+}
+DECLARE_WRAPPER(eaccess);
+#endif
+
+#ifdef HAVE_EUIDACCESS
+int euidaccess(const char *pathname, int mode)
+{
+	const char *guest = pathname;
+
+	if (fchr_negcache_hit(pathname, 0))
+		return -1;
+	expand_chroot_path(pathname);
+
+	return fchr_negcache_note(guest, 0,
+			fchr_statcache(FCHR_STATCACHE_EACCESS, pathname, mode, NULL,
+				NEXTCALL(euidaccess)(pathname, mode)));
+}
+DECLARE_WRAPPER(euidaccess);
+#endif
@@ -0,0 +1,43 @@
+/* Generated from wrappers.tab by mkwrappers.awk, do not edit. */
+
+#ifndef __FAKECHROOT_WRAPPERS_H__
+#define __FAKECHROOT_WRAPPERS_H__
+
+WRAPPER_PROTO(acct, int, (const char *filename))
+WRAPPER_PROTO(chdir, int, (const char *path))
+WRAPPER_PROTO(chmod, int, (const char *path, mode_t mode))
+WRAPPER_PROTO(lchmod, int, (const char *path, mode_t mode))
+WRAPPER_PROTO(fchmodat, int, (int dirfd, const char *path, mode_t mode, int flag))
+WRAPPER_PROTO(chown, int, (const char *path, uid_t owner, gid_t group))
+WRAPPER_PROTO(lchown, int, (const char *path, uid_t owner, gid_t group))
+WRAPPER_PROTO(fchownat, int, (int dirfd, const char *path, uid_t owner, gid_t group, int flag))
+WRAPPER_PROTO(mkdir, int, (const char *pathname, mode_t mode))
+WRAPPER_PROTO(mkdirat, int, (int dirfd, const char *pathname, mode_t mode))
+WRAPPER_PROTO(mkfifo, int, (const char *pathname, mode_t mode))
+WRAPPER_PROTO(__xmknod, int, (int ver, const char *path, mode_t mode, dev_t *dev))
+WRAPPER_PROTO(creat, int, (const char *pathname, mode_t mode))
+WRAPPER_PROTO(creat64, int, (const char *pathname, mode_t mode))
+WRAPPER_PROTO(link, int, (const char *oldpath, const char *newpath))
+WRAPPER_PROTO(truncate, int, (const char *path, off_t length))
+WRAPPER_PROTO(truncate64, int, (const char *path, off64_t length))
+WRAPPER_PROTO(utime, int, (const char *filename, const struct utimbuf *buf))
+WRAPPER_PROTO(utimes, int, (const char *filename, const struct timeval tv[2]))
+WRAPPER_PROTO(lutimes, int, (const char *filename, const struct timeval tv[2]))
+WRAPPER_PROTO(getxattr, ssize_t, (const char *path, const char *name, void *value, size_t size))
+WRAPPER_PROTO(lgetxattr, ssize_t, (const char *path, const char *name, void *value, size_t size))
+WRAPPER_PROTO(listxattr, ssize_t, (const char *path, char *list, size_t size))
+WRAPPER_PROTO(llistxattr, ssize_t, (const char *path, char *list, size_t size))
+WRAPPER_PROTO(setxattr, int, (const char *path, const char *name, const void *value, size_t size, int flags))
+WRAPPER_PROTO(lsetxattr, int, (const char *path, const char *name, const void *value, size_t size, int flags))
+WRAPPER_PROTO(removexattr, int, (const char *path, const char *name))
+WRAPPER_PROTO(lremovexattr, int, (const char *path, const char *name))
+WRAPPER_PROTO(revoke, int, (const char *file))
+WRAPPER_PROTO(pathconf, long, (const char *path, int name))
+WRAPPER_PROTO(tempnam, char *, (const char *dir, const char *pfx))
+WRAPPER_PROTO(glob_pattern_p, int, (const char *pattern, int quote))
+WRAPPER_PROTO(getcwd, char *, (char *buf, size_t size))
+WRAPPER_PROTO(getwd, char *, (char *buf))
+WRAPPER_PROTO(eaccess, int, (const char *pathname, int mode))
+WRAPPER_PROTO(euidaccess, int, (const char *pathname, int mode))
+
+#endif